@@ -83,6 +83,9 @@ sigma_phot (x_ptr, freq)
 
 struct lines *a21_line_ptr;
 double a21_a;
+#ifdef _OPENMP
+#pragma omp threadprivate(a21_line_ptr, a21_a)
+#endif
 
 /**********************************************************/
 /**
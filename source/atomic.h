@@ -55,18 +55,30 @@
 int nelements;                  /* The actual number of ions read from the data file */
 #define NIONS		500     /* Maximum number of ions to consider */
 int nions;                      /*The actual number of ions read from the datafile */
-#define NLEVELS 	12000   /* Maximum number of levels for all elements and ions */
 int nlevels;                    /*These are the actual number of levels which were read in */
+int nlevels_max;                /* The number of levels for which space is allocated */
 #define NLTE_LEVELS	12000   /* Maximum number of levels to treat explicitly */
 int nlte_levels;                /* Actual number of levels to treat explicityly */
 #define NLEVELS_MACRO   200     /* Maximum number of macro atom levels. (SS, June 04) */
 int nlevels_macro;              /* Actual number of macro atom levels. (SS, June 04) */
-#define NLINES 		200000  /* Maximum number of lines to be read */
+char atomic_masterfile[132];    /* The masterfile from which the atomic data in memory were read */
+#define NLINES 		10000000        /* Maximum number of lines.  This no longer sets the size of any array, but
+                                   photoionization is indicated by nres > NLINES */
 int nlines;                     /* Actual number of lines that were read in */
+int nlines_max;                 /* The number of lines for which space is allocated */
 int nlines_macro;               /* Actual number of Macro Atom lines that were read in.  New version of get_atomic
                                    data assumes that macro lines are read in before non-macro lines */
 #define N_INNER     10          /*Maximum number of inner shell ionization cross sections per ion */
 int n_inner_tot;                /*The actual number of inner shell ionization cross sections in total */
+int n_inner_max;                /* The number of inner shell cross sections for which space is allocated */
+
+/* The arrays of atomic data are allocated with the numbers of entries of each kind which are
+   found in the data files (see count_atomic_data), and the frequencies and x-sections of the
+   photoionization cross sections are allocated from one block of memory, atomic_arena */
+
+char *atomic_arena;
+long atomic_arena_size;         /* The size of atomic_arena in bytes */
+long atomic_arena_used;         /* The number of bytes which have been allocated from it */
 
 
 #define NBBJUMPS         100    /* Maximum number of Macro Atom bound-bound jumps from any one configuration (SS) */
@@ -207,6 +219,8 @@ typedef struct configurations
   int bbu_indx_first;           /* index to first MC estimator for bb jumps from this configuration (SS) */
   int bfu_indx_first;           /* index to first MC estimator for bf jumps from this configuration (SS) */
   int bfd_indx_first;           /* index to first rate for downward bf jumps from this configuration (SS) */
+  int jump_indx_first;          /* index to first jump probability (of all types) from this configuration */
+  int emiss_indx_first;         /* index to first emission probability from this configuration */
 
 }
 config_dummy, *ConfigPtr;
@@ -250,17 +264,21 @@ typedef struct lines
 line_dummy, *LinePtr;
 
 
-LinePtr line, lin_ptr[NLINES];  /* line[] is the actual structure array that contains all the data, *lin_ptr
+LinePtr line, *lin_ptr;         /* line[] is the actual structure array that contains all the data, *lin_ptr
                                    is an array which contains a frequency ordered set of ptrs to line */
                                 /* fast_line (added by SS August 05) is going to be a hypothetical
                                    rapid transition used in the macro atoms to stabilise level populations */
+double *lin_freq;               /* The frequencies of the lines in the same order as lin_ptr, so that a range
+                                   of lines can be searched without following the pointers */
+int *lin_nion;                  /* The ions of the lines in the same order as lin_ptr */
 struct lines fast_line;
 
 int nline_min, nline_max, nline_delt;   /* Used to select a range of lines in a frequency band from the lin_ptr array 
                                            in situations where the frequency range of interest is limited, including for defining which
                                            lines come into play for resonant scattering along a line of sight, and in
                                            calculating band_limit luminosities.  The limits are established by the
-                                           routine limit_lines.
+                                           routine limit_lines.  The photon transport keeps its own range in its
+                                           transport context (see line_range).
                                          */
 
 
@@ -269,6 +287,7 @@ int nline_min, nline_max, nline_delt;   /* Used to select a range of lines in a
 
 #define N_COLL_STREN_PTS	20      //The maximum number of parameters in the interpolations
 int n_coll_stren;
+int n_coll_stren_max;           /* The number of collision strengths for which space is allocated */
 
 typedef struct coll_stren
 {
@@ -285,7 +304,7 @@ typedef struct coll_stren
   double scups[N_COLL_STREN_PTS];       //The sclaed coll sttengths in ythe fit.
 } Coll_stren, *Coll_strenptr;
 
-Coll_stren coll_stren[NLINES];  //Set up the structure - we could in principle have as many of these as we have lines
+Coll_stren *coll_stren;         //Set up the structure - we could in principle have as many of these as we have lines
 
 /*structure containing photoionization data */
 
@@ -321,10 +340,10 @@ int nxphot;                     /*The actual number of ions for which there are
 double phot_freq_min;           /*The lowest frequency for which photoionization can occur */
 double inner_freq_min;          /*The lowest frequency for which inner shel ionization can take place */
 
-#define NCROSS 1500
-#define NTOP_PHOT 400           /* Maximum number of photoionisation processes. (SS) */
+#define NCROSS 1500             /* Maximum number of points in one photoionization x-section */
 int ntop_phot;                  /* The actual number of TopBase photoionzation x-sections */
 int nphot_total;                /* total number of photoionzation x-sections = nxphot + ntop_phot */
+int nphot_max;                  /* The number of photoionization x-sections for which space is allocated */
 
 typedef struct topbase_phot
 {                               /* If the old topbase treatment is to be replaced by Macro Atoms perhaps this
@@ -335,10 +354,6 @@ typedef struct topbase_phot
   int z, istate;
   int np;                       /*the number of points in the corr section fit */
   int n, l;                     /*Shell and subshell, used for inner shell */
-  int nlast;                    /* nlast is an index into the arrays freq and x.  It allows 
-                                   a quick check to see whether one needs to do a search
-                                   for the correct array elements, or whether this process
-                                   can be short circuited */
   int n_elec_yield;             /*Index to the electron yield array - only used for inner shell ionizations */
   int n_fluor_yield;            /*Inder to the fluorescent photon yield array - only used for inner shell ionizations */
   int macro_info;               /* Identifies whether line is to be treated using a Macro Atom approach.
@@ -353,14 +368,14 @@ typedef struct topbase_phot
                                    configuration (nlev) and then up_index. (SS) */
   int up_index;
   int use;                      /* It we are to use this cross section. This allows unused VFKY cross sections to sit in the array. */
-  double freq[NCROSS], x[NCROSS];
-  double f, sigma;              /*last freq, last x-section */
+  double *freq, *x;             /* The np frequencies and x-sections, which are allocated from atomic_arena.  The last
+                                   frequency and x-section used in the transport are kept in the transport context */
 } Topbase_phot, *TopPhotPtr;
 
-Topbase_phot phot_top[NLEVELS];
-TopPhotPtr phot_top_ptr[NLEVELS];       /* Pointers to phot_top in threshold frequency order - this */
-Topbase_phot inner_cross[N_INNER * NIONS];
-TopPhotPtr inner_cross_ptr[N_INNER * NIONS];
+Topbase_phot *phot_top;
+TopPhotPtr *phot_top_ptr;       /* Pointers to phot_top in threshold frequency order - this */
+Topbase_phot *inner_cross;
+TopPhotPtr *inner_cross_ptr;
 
 
 
@@ -555,3 +570,7 @@ Gaunt_total gaunt_total[MAX_GAUNT_N_GSQRD];     //Set up the structure
 /* a variable which controls whether to save a summary of atomic data
    this is defined in atomic.h, rather than the modes structure */
 int write_atomicdata;
+
+/* If set, get_atomic_data always reads the data files named in the masterfile, and not
+   a binary image of them made with py_atomic_image */
+int ignore_atomic_image;
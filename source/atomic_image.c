@@ -0,0 +1,545 @@
+
+/***********************************************************/
+/** @file  atomic_image.c
+ * @date   October, 2026
+ *
+ * @brief  Routines to write the atomic data to a binary image, and
+ * to read them back from it
+ *
+ * ### Notes ###
+ *
+ * Reading the atomic data from the ascii files named in a masterfile
+ * takes a significant time for the larger data sets, and is repeated
+ * by every process of a parallel run.  py_atomic_image reads the data
+ * in the usual way and then writes everything that get_atomic_data
+ * produces, including the frequency ordered indexes, to the file
+ * masterfile.image.  When get_atomic_data finds such a file, and it is
+ * newer than the masterfile and all of the data files named in it, the
+ * file is mapped into memory and the data are copied from it.
+ *
+ * Like a windsave file, an image begins with a header and a table which
+ * gives the name, position and size of each section of the file.  Only
+ * the entries of the large arrays which are in use are written.  The
+ * pointers in the frequency ordered indexes are written as positions
+ * in the arrays they point into.  The points of the photoionization
+ * x-sections are written as one section, a copy of atomic_arena, and
+ * the pointers to them are moved to the new arena when they are read.
+ *
+ ***********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "atomic.h"
+#include "log.h"
+
+
+#define ATOMIC_IMAGE_MAGIC      "python_atomic"
+#define ATOMIC_IMAGE_FORMAT     2
+#define NATOMIC_IMAGE_SECTIONS  32
+#define NATOMIC_IMAGE_FILES     100
+#define ATOMIC_IMAGE_NAME       256     /* The length of the file names recorded in the header */
+#define ATOMIC_IMAGE_ALIGN      8       /* Each section begins at a multiple of this number of bytes */
+
+/* The header at the beginning of an image.  The files are those which were read to
+   make it, so that an image which is out of date can be recognised */
+
+typedef struct atomic_image_header
+{
+  char magic[16];
+  int format;                   /* ATOMIC_IMAGE_FORMAT when the file was written */
+  int nsections;                /* The number of sections in the table which follows the header */
+  int nfiles;
+  char files[NATOMIC_IMAGE_FILES][ATOMIC_IMAGE_NAME];   /* The masterfile followed by the data files */
+  int nelements, nions, nlevels, nlte_levels, nlevels_macro, nlines, nlines_macro;
+  int n_inner_tot, nauger, n_coll_stren, nxphot, ntop_phot, nphot_total, nxcol;
+  int ndrecomb, n_total_rr, n_bad_gs_rr, n_dere_di_rate, gaunt_n_gsqrd;
+  double rho2nh, phot_freq_min, inner_freq_min;
+  long arena_used;              /* The part of atomic_arena which was in use */
+  char *arena_base;             /* The address of atomic_arena in the program which wrote the image */
+} atomic_image_header_dummy;
+
+typedef struct atomic_image_section
+{
+  char name[32];
+  long offset;                  /* The position of the section in bytes from the beginning of the file */
+  long size;                    /* The size of one entry */
+  long nentries;                /* The number of entries */
+} atomic_image_section_dummy;
+
+atomic_image_header_dummy atomic_image_header;
+atomic_image_section_dummy atomic_image_table[NATOMIC_IMAGE_SECTIONS];
+
+/* The arrays which are written to an image, and the number of entries of each which are
+   in use.  The table is filled by atomic_image_arrays once the numbers are known */
+
+typedef struct atomic_image_array
+{
+  char *name;
+  void *ptr;
+  long size;
+  long nentries;
+} atomic_image_array_dummy;
+
+#define IMAGE_ARRAY(a, n) {#a, (void *) (a), sizeof ((a)[0]), n}
+
+/* The frequency ordered indexes, which are arrays of pointers into the arrays above */
+
+typedef struct atomic_image_index
+{
+  char *name;
+  void **ptr;
+  char *base;
+  long size;
+  long nentries;
+} atomic_image_index_dummy;
+
+#define IMAGE_INDEX(p, a, n) {#p, (void **) (p), (char *) (a), sizeof ((a)[0]), n}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Fill the tables of the arrays and indexes which are written to an image
+ *
+ * @param [out] atomic_image_array_dummy *  arrays   The table of arrays
+ * @param [out] atomic_image_index_dummy *  indexes   The table of indexes
+ * @param [out] int *  nindexes   The number of indexes
+ * @return     The number of arrays
+ *
+ * @details
+ * The numbers of entries are those of the atomic data in memory, so when
+ * an image is read they must have been set from the header first.
+ *
+ * ### Notes ###
+ * The structures ele, ion, config and line are allocated, and so the
+ * tables cannot be initialised statically.
+ *
+ **********************************************************/
+
+int
+atomic_image_arrays (arrays, indexes, nindexes)
+     atomic_image_array_dummy *arrays;
+     atomic_image_index_dummy *indexes;
+     int *nindexes;
+{
+  atomic_image_array_dummy a[] = {
+    IMAGE_ARRAY (ele, nelements), IMAGE_ARRAY (ion, nions), IMAGE_ARRAY (config, nlevels),
+    IMAGE_ARRAY (line, nlines), IMAGE_ARRAY (coll_stren, n_coll_stren),
+    IMAGE_ARRAY (phot_top, ntop_phot + nxphot), IMAGE_ARRAY (inner_cross, n_inner_tot),
+    IMAGE_ARRAY (augerion, nauger), IMAGE_ARRAY (inner_elec_yield, N_INNER * NIONS),
+    IMAGE_ARRAY (inner_fluor_yield, N_INNER * NIONS), IMAGE_ARRAY (ground_frac, NIONS),
+    IMAGE_ARRAY (xcol, nxcol), IMAGE_ARRAY (drecomb, ndrecomb), IMAGE_ARRAY (total_rr, n_total_rr),
+    IMAGE_ARRAY (bad_gs_rr, n_bad_gs_rr), IMAGE_ARRAY (dere_di_rate, n_dere_di_rate),
+    IMAGE_ARRAY (gaunt_total, gaunt_n_gsqrd), IMAGE_ARRAY (atomic_arena, atomic_arena_used)
+  };
+  atomic_image_index_dummy x[] = {
+    IMAGE_INDEX (lin_ptr, line, nlines), IMAGE_INDEX (phot_top_ptr, phot_top, ntop_phot + nxphot),
+    IMAGE_INDEX (inner_cross_ptr, inner_cross, n_inner_tot), IMAGE_INDEX (xcol_ptr, xcol, nxcol)
+  };
+
+  memcpy (arrays, a, sizeof (a));
+  memcpy (indexes, x, sizeof (x));
+  *nindexes = sizeof (x) / sizeof (atomic_image_index_dummy);
+
+  return (sizeof (a) / sizeof (atomic_image_array_dummy));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Write the atomic data in memory to a binary image
+ *
+ * @param [in] char *  masterfile   The masterfile from which the data were read
+ * @param [in] char *  imagefile   The name of the image
+ * @return     The number of sections which were written
+ *
+ * @details
+ * The names of the masterfile and of the data files it lists are
+ * recorded in the header, followed by the numbers of entries of
+ * each kind, and then each array and index is written as a section.
+ *
+ * ### Notes ###
+ * get_atomic_data must have been called for masterfile first.
+ *
+ **********************************************************/
+
+int
+atomic_image_write (masterfile, imagefile)
+     char *masterfile, *imagefile;
+{
+  FILE *fptr, *mptr;
+  char aline[ATOMIC_IMAGE_NAME], file[ATOMIC_IMAGE_NAME];
+  atomic_image_array_dummy arrays[NATOMIC_IMAGE_SECTIONS], *a;
+  atomic_image_index_dummy indexes[NATOMIC_IMAGE_SECTIONS], *x;
+  atomic_image_header_dummy *h;
+  int narrays, nindexes;
+  long n, *pos;
+  long atomic_image_start_section ();
+
+  if ((mptr = fopen (masterfile, "r")) == NULL)
+  {
+    Error ("atomic_image_write: Could not open masterfile %s\n", masterfile);
+    exit (0);
+  }
+
+  h = &atomic_image_header;
+  memset (h, 0, sizeof (atomic_image_header));
+  memset (atomic_image_table, 0, sizeof (atomic_image_table));
+
+  strcpy (h->magic, ATOMIC_IMAGE_MAGIC);
+  h->format = ATOMIC_IMAGE_FORMAT;
+  strncpy (h->files[h->nfiles++], masterfile, ATOMIC_IMAGE_NAME - 1);
+
+  while (fgets (aline, ATOMIC_IMAGE_NAME, mptr) != NULL)
+  {
+    if (sscanf (aline, "%s", file) == 1 && file[0] != '#')
+    {
+      if (h->nfiles == NATOMIC_IMAGE_FILES)
+      {
+        Error ("atomic_image_write: Too many data files (%d) in %s\n", NATOMIC_IMAGE_FILES, masterfile);
+        exit (0);
+      }
+      strcpy (h->files[h->nfiles++], file);
+    }
+  }
+  fclose (mptr);
+
+  h->nelements = nelements;
+  h->nions = nions;
+  h->nlevels = nlevels;
+  h->nlte_levels = nlte_levels;
+  h->nlevels_macro = nlevels_macro;
+  h->nlines = nlines;
+  h->nlines_macro = nlines_macro;
+  h->n_inner_tot = n_inner_tot;
+  h->nauger = nauger;
+  h->n_coll_stren = n_coll_stren;
+  h->nxphot = nxphot;
+  h->ntop_phot = ntop_phot;
+  h->nphot_total = nphot_total;
+  h->nxcol = nxcol;
+  h->ndrecomb = ndrecomb;
+  h->n_total_rr = n_total_rr;
+  h->n_bad_gs_rr = n_bad_gs_rr;
+  h->n_dere_di_rate = n_dere_di_rate;
+  h->gaunt_n_gsqrd = gaunt_n_gsqrd;
+  h->rho2nh = rho2nh;
+  h->phot_freq_min = phot_freq_min;
+  h->inner_freq_min = inner_freq_min;
+  h->arena_used = atomic_arena_used;
+  h->arena_base = atomic_arena;
+
+  if ((fptr = fopen (imagefile, "w")) == NULL)
+  {
+    Error ("atomic_image_write: Unable to open %s\n", imagefile);
+    exit (0);
+  }
+
+  /* Leave space for the header and the table, which are written when the positions of
+     all of the sections are known */
+
+  fwrite (h, sizeof (atomic_image_header), 1, fptr);
+  fwrite (atomic_image_table, sizeof (atomic_image_table), 1, fptr);
+
+  narrays = atomic_image_arrays (arrays, indexes, &nindexes);
+
+  for (a = arrays; a < arrays + narrays; a++)
+  {
+    atomic_image_start_section (fptr, a->name, a->size, a->nentries);
+    fwrite (a->ptr, a->size, a->nentries, fptr);
+  }
+
+  /* The indexes are written as the positions of the entries they point to */
+
+  for (x = indexes; x < indexes + nindexes; x++)
+  {
+    atomic_image_start_section (fptr, x->name, sizeof (long), x->nentries);
+    if ((pos = (long *) calloc (sizeof (long), x->nentries + 1)) == NULL)
+    {
+      Error ("atomic_image_write: Could not allocate memory for %s\n", x->name);
+      exit (0);
+    }
+    for (n = 0; n < x->nentries; n++)
+    {
+      pos[n] = ((char *) x->ptr[n] - x->base) / x->size;
+    }
+    fwrite (pos, sizeof (long), x->nentries, fptr);
+    free (pos);
+  }
+
+  fseek (fptr, 0, SEEK_SET);
+  fwrite (h, sizeof (atomic_image_header), 1, fptr);
+  fwrite (atomic_image_table, sizeof (atomic_image_table), 1, fptr);
+
+  fclose (fptr);
+
+  Log ("atomic_image_write: Wrote %d sections of the atomic data from %s to %s\n", h->nsections, masterfile, imagefile);
+
+  return (h->nsections);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Add a section to the table of an image which is being written
+ *
+ * @param [in] FILE *  fptr   The image
+ * @param [in] char *  name   The name of the section
+ * @param [in] long  size   The size of one entry
+ * @param [in] long  nentries   The number of entries
+ * @return     The position in the file at which the section begins
+ *
+ * @details
+ * The file is padded so that the section begins at a multiple of
+ * ATOMIC_IMAGE_ALIGN bytes.  The caller then writes the section itself.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+long
+atomic_image_start_section (fptr, name, size, nentries)
+     FILE *fptr;
+     char *name;
+     long size, nentries;
+{
+  long offset;
+  atomic_image_section_dummy *sec;
+
+  if (atomic_image_header.nsections == NATOMIC_IMAGE_SECTIONS)
+  {
+    Error ("atomic_image_start_section: Too many sections (%d) in the image\n", NATOMIC_IMAGE_SECTIONS);
+    exit (0);
+  }
+
+  offset = ftell (fptr);
+  while (offset % ATOMIC_IMAGE_ALIGN)
+  {
+    fputc (0, fptr);
+    offset++;
+  }
+
+  sec = &atomic_image_table[atomic_image_header.nsections++];
+  strncpy (sec->name, name, sizeof (sec->name) - 1);
+  sec->offset = offset;
+  sec->size = size;
+  sec->nentries = nentries;
+
+  return (offset);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Read the atomic data from a binary image of a masterfile, if
+ * there is one which is up to date
+ *
+ * @param [in] char *  masterfile   The masterfile
+ * @return     0 if the data were read from the image, -1 if they must be read
+ * from the data files
+ *
+ * @details
+ * The image is the file masterfile.image.  It is used only if it was written
+ * in the current format by a program with the same layout of the structures,
+ * and is newer than the masterfile and all of the data files it lists.  The
+ * file is mapped into memory, the structures are allocated with the numbers
+ * of entries in the image, and each section is copied to where it belongs.
+ * Finally the indexes are turned back into pointers, and the pointers to
+ * the points of the x-sections are moved to the new atomic_arena.
+ *
+ * ### Notes ###
+ * If the image cannot be used after the structures have been allocated,
+ * get_atomic_data allocates them again before the data files are read.
+ *
+ * The data are copied rather than used in place, so that the
+ * structures can be freed and the data read again as before.
+ *
+ **********************************************************/
+
+int
+atomic_image_read (masterfile)
+     char *masterfile;
+{
+  char imagefile[ATOMIC_IMAGE_NAME + 8];
+  int fd;
+  struct stat st, fst;
+  char *base;
+  atomic_image_header_dummy *h;
+  atomic_image_section_dummy *table, *sec[NATOMIC_IMAGE_SECTIONS];
+  atomic_image_array_dummy arrays[NATOMIC_IMAGE_SECTIONS];
+  atomic_image_index_dummy indexes[NATOMIC_IMAGE_SECTIONS];
+  int narrays, nindexes;
+  int i, m;
+  long n, *pos;
+  int init_atomic_data ();
+
+  if (ignore_atomic_image || strlen (masterfile) >= ATOMIC_IMAGE_NAME)
+  {
+    return (-1);
+  }
+
+  sprintf (imagefile, "%s.image", masterfile);
+
+  if ((fd = open (imagefile, O_RDONLY)) < 0)
+  {
+    return (-1);
+  }
+
+  if (fstat (fd, &st) != 0 || st.st_size < (off_t) (sizeof (atomic_image_header_dummy) + sizeof (atomic_image_table)))
+  {
+    close (fd);
+    return (-1);
+  }
+
+  base = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+
+  if (base == MAP_FAILED)
+  {
+    return (-1);
+  }
+
+  h = (atomic_image_header_dummy *) base;
+  table = (atomic_image_section_dummy *) (base + sizeof (atomic_image_header_dummy));
+
+  if (strncmp (h->magic, ATOMIC_IMAGE_MAGIC, sizeof (h->magic)) != 0 || h->format != ATOMIC_IMAGE_FORMAT
+      || h->nfiles < 1 || strcmp (h->files[0], masterfile) != 0)
+  {
+    Log ("atomic_image_read: %s is not an image of %s which can be read\n", imagefile, masterfile);
+    munmap (base, st.st_size);
+    return (-1);
+  }
+
+  for (i = 0; i < h->nfiles; i++)
+  {
+    if (stat (h->files[i], &fst) != 0 || fst.st_mtime > st.st_mtime)
+    {
+      Log ("atomic_image_read: %s is out of date with respect to %s, so the data files will be read\n", imagefile, h->files[i]);
+      munmap (base, st.st_size);
+      return (-1);
+    }
+  }
+
+  /* Allocate the structures with exactly the space that is needed */
+
+  nlines_max = h->nlines + 1;
+  nlevels_max = h->nlevels + 1;
+  n_coll_stren_max = h->n_coll_stren + 1;
+  nphot_max = h->ntop_phot + h->nxphot + 1;
+  n_inner_max = h->n_inner_tot + 1;
+  atomic_arena_size = h->arena_used + sizeof (double);
+
+  init_atomic_data ();
+
+  /* Set the numbers of entries, and so the sizes of the sections which are expected */
+
+  nelements = h->nelements;
+  nions = h->nions;
+  nlevels = h->nlevels;
+  nlte_levels = h->nlte_levels;
+  nlevels_macro = h->nlevels_macro;
+  nlines = h->nlines;
+  nlines_macro = h->nlines_macro;
+  n_inner_tot = h->n_inner_tot;
+  nauger = h->nauger;
+  n_coll_stren = h->n_coll_stren;
+  nxphot = h->nxphot;
+  ntop_phot = h->ntop_phot;
+  nphot_total = h->nphot_total;
+  nxcol = h->nxcol;
+  ndrecomb = h->ndrecomb;
+  n_total_rr = h->n_total_rr;
+  n_bad_gs_rr = h->n_bad_gs_rr;
+  n_dere_di_rate = h->n_dere_di_rate;
+  gaunt_n_gsqrd = h->gaunt_n_gsqrd;
+  atomic_arena_used = h->arena_used;
+  narrays = atomic_image_arrays (arrays, indexes, &nindexes);
+
+  /* Find all of the sections before anything is copied, so that if the image cannot be
+     used the data files can still be read */
+
+  for (m = 0; m < narrays + nindexes; m++)
+  {
+    sec[m] = NULL;
+    for (i = 0; i < h->nsections; i++)
+    {
+      if (m < narrays ? strcmp (table[i].name, arrays[m].name) == 0 : strcmp (table[i].name, indexes[m - narrays].name) == 0)
+      {
+        sec[m] = &table[i];
+      }
+    }
+
+    if (sec[m] == NULL
+        || sec[m]->size != (m < narrays ? arrays[m].size : (long) sizeof (long))
+        || sec[m]->nentries != (m < narrays ? arrays[m].nentries : indexes[m - narrays].nentries)
+        || sec[m]->offset + sec[m]->size * sec[m]->nentries > st.st_size)
+    {
+      Log ("atomic_image_read: %s was written by a program with a different layout of the structures\n", imagefile);
+      nelements = nions = nlevels = nlte_levels = nlevels_macro = nlines = nlines_macro = 0;
+      n_inner_tot = nauger = n_coll_stren = nxphot = ntop_phot = nphot_total = nxcol = 0;
+      ndrecomb = n_total_rr = n_bad_gs_rr = n_dere_di_rate = gaunt_n_gsqrd = 0;
+      munmap (base, st.st_size);
+      return (-1);
+    }
+  }
+
+  for (m = 0; m < narrays; m++)
+  {
+    memcpy (arrays[m].ptr, base + sec[m]->offset, arrays[m].size * arrays[m].nentries);
+  }
+
+  for (m = 0; m < nindexes; m++)
+  {
+    pos = (long *) (base + sec[narrays + m]->offset);
+    for (n = 0; n < indexes[m].nentries; n++)
+    {
+      indexes[m].ptr[n] = indexes[m].base + pos[n] * indexes[m].size;
+    }
+  }
+
+  for (n = 0; n < ntop_phot + nxphot; n++)
+  {
+    if (phot_top[n].freq != NULL)
+    {
+      phot_top[n].freq = (double *) (atomic_arena + ((char *) phot_top[n].freq - h->arena_base));
+      phot_top[n].x = (double *) (atomic_arena + ((char *) phot_top[n].x - h->arena_base));
+    }
+  }
+
+  for (n = 0; n < n_inner_tot; n++)
+  {
+    if (inner_cross[n].freq != NULL)
+    {
+      inner_cross[n].freq = (double *) (atomic_arena + ((char *) inner_cross[n].freq - h->arena_base));
+      inner_cross[n].x = (double *) (atomic_arena + ((char *) inner_cross[n].x - h->arena_base));
+    }
+  }
+
+  rho2nh = h->rho2nh;
+  phot_freq_min = h->phot_freq_min;
+  inner_freq_min = h->inner_freq_min;
+
+  /* The line frequencies and ions in the order of lin_ptr are not in the image */
+
+  for (n = 0; n < nlines; n++)
+  {
+    lin_freq[n] = lin_ptr[n]->freq;
+    lin_nion[n] = lin_ptr[n]->nion;
+  }
+
+  Log ("atomic_image_read: Read the atomic data from %s\n", imagefile);
+
+  munmap (base, st.st_size);
+
+  return (0);
+}
@@ -17,6 +17,9 @@
 #include "python.h"
 
 PlasmaPtr xplasma;              /// Pointer to current plasma cell
+#ifdef _OPENMP
+#pragma omp threadprivate(xplasma)
+#endif
 
 /**********************************************************/
 /** 
@@ -257,6 +260,9 @@ klein_nishina (nu)
 double sigma_rand;              //The randomised cross section that our photon will see
 double sigma_max;               //The cross section for the maxmimum energy loss
 double x1;                      //The ratio of photon eneergy to electron energy
+#ifdef _OPENMP
+#pragma omp threadprivate(sigma_rand, sigma_max, x1)
+#endif
 
 /**********************************************************/
 /** 
@@ -73,6 +73,7 @@
  * @brief      cylin_ds_in_cell calculates the distance to the far
  * boundary of the cell in which the photon bundle resides.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] int  ndom   The number of the domain of interest
  * @param [in] PhotPtr  p   Photon pointer
  * @return     Distance to the far boundary of the cell in which the photon
@@ -93,7 +94,8 @@
  **********************************************************/
 
 double
-cylvar_ds_in_cell (ndom, p)
+cylvar_ds_in_cell (ctx, ndom, p)
+     CtxPtr ctx;
      int ndom;
      PhotPtr p;
 
@@ -109,7 +111,7 @@ cylvar_ds_in_cell (ndom, p)
   // XXX  Next lines are just a check and one can probbly delette
   // them but one shcoul check.  For now have just tried to get this working
   //
-  if ((p->grid = n = where_in_grid (ndom, p->x)) < 0)
+  if ((p->grid = n = where_in_grid (ctx, ndom, p->x)) < 0)
   {
     Error ("cylvar_ds_in_cell: Photon not in grid when routine entered\n");
     return (n);                 /* Photon was not in wind */
@@ -669,6 +671,9 @@ cylvar_volumes (ndom, w)
 
 int cylvar_n_approx;
 int ierr_cylvar_where_in_grid = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(cylvar_n_approx, ierr_cylvar_where_in_grid)
+#endif
 
 
 /**********************************************************/
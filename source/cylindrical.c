@@ -28,6 +28,7 @@
  * boundary of the cell in which the photon bundle when dealing
  * with a cylindrical domain
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] ndom   The number of the domain of interest
  * @param [in] p   Photon pointer
  * @return     distance to the far boundary of the cell
@@ -52,7 +53,8 @@
  **********************************************************/
 
 double
-cylind_ds_in_cell (ndom, p)
+cylind_ds_in_cell (ctx, ndom, p)
+     CtxPtr ctx;
      int ndom;
      PhotPtr p;
 
@@ -71,7 +73,7 @@ cylind_ds_in_cell (ndom, p)
    */
 
 
-  if ((p->grid = n = where_in_grid (ndom, p->x)) < 0)
+  if ((p->grid = n = where_in_grid (ctx, ndom, p->x)) < 0)
   {
     if (modes.save_photons)
     {
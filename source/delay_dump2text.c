@@ -0,0 +1,121 @@
+
+/***********************************************************/
+/** @file  delay_dump2text.c
+ * @date   October, 2026
+ *
+ * @brief  A standalone routine which converts a binary delay dump
+ * file into the text format used by the analysis scripts
+ *
+ * This routine is run from the command line, as follows
+ *
+ * delay_dump2text  root.delay_dump  [outputfile]
+ *
+ * If the output file is not given the text is written to 
+ * root.delay_dump.txt.
+ *
+ * ### Notes ###
+ *
+ * The format of the binary file is defined by delay_dump_header
+ * and delay_dump_record in python.h, and it is written by the
+ * routines in reverb.c
+ *
+ ***********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "atomic.h"
+#include "python.h"
+
+
+
+/**********************************************************/
+/**
+ * @brief      delay_dump2text writes the photons in a binary delay
+ * dump file as text.  This is the main routine.
+ *
+ * @param [in] int  argc   The number of argments in the command line
+ * @param [in] char *  argv[]   The command line
+ * @return     0 on success, 1 if the file could not be converted
+ *
+ * @details
+ * The header and the columns are those of the text files which
+ * were written by python before the delay dump became binary.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+int
+main (argc, argv)
+     int argc;
+     char *argv[];
+{
+  FILE *fin, *fout;
+  char outfile[LINELENGTH + 8];
+  delay_dump_header_dummy header;
+  delay_dump_record_dummy rec;
+  long n;
+
+  if (argc < 2 || argc > 3)
+  {
+    printf ("Usage: delay_dump2text root.delay_dump [outputfile]\n");
+    exit (0);
+  }
+
+  if (argc == 3)
+    snprintf (outfile, sizeof (outfile), "%s", argv[2]);
+  else
+    sprintf (outfile, "%.*s.txt", LINELENGTH - 1, argv[1]);
+
+  if ((fin = fopen (argv[1], "r")) == NULL)
+  {
+    printf ("delay_dump2text: Could not open %s\n", argv[1]);
+    return (1);
+  }
+
+  if (fread (&header, sizeof (header), 1, fin) != 1 || strncmp (header.magic, DELAY_DUMP_MAGIC, 8) != 0)
+  {
+    printf ("delay_dump2text: %s is not a delay dump file\n", argv[1]);
+    return (1);
+  }
+
+  if (header.format != DELAY_DUMP_FORMAT || header.record_size != sizeof (rec))
+  {
+    printf ("delay_dump2text: %s has format %d and records of %d bytes, but this program reads format %d with records of %d bytes\n",
+            argv[1], header.format, header.record_size, DELAY_DUMP_FORMAT, (int) sizeof (rec));
+    return (1);
+  }
+
+  if ((fout = fopen (outfile, "w")) == NULL)
+  {
+    printf ("delay_dump2text: Could not open %s\n", outfile);
+    return (1);
+  }
+
+  fprintf (fout, "# Python Version %s\n", header.version);
+  fprintf (fout, "# Date	%s\n#  \n", header.date);
+  fprintf (fout, "# \n#    Freq.     Lambda     Weight      Last X      Last Y      Last Z Scat. RScat      Delay Spec. Orig.  Res.\n");
+
+  for (n = 0; n < header.nrecords; n++)
+  {
+    if (fread (&rec, sizeof (rec), 1, fin) != 1)
+    {
+      printf ("delay_dump2text: %s ends after %ld of %ld photons\n", argv[1], n, header.nrecords);
+      break;
+    }
+    fprintf (fout,
+             "%10.5g %12.7g %10.5g %+10.5g %+10.5g %+10.5g %3d     %3d     %10.5g %5d %5d %5d\n",
+             rec.freq, C * 1e8 / rec.freq, rec.w, rec.x[0], rec.x[1], rec.x[2], rec.nscat, rec.nrscat, rec.delay, rec.spec, rec.origin,
+             rec.nres);
+  }
+
+  fclose (fin);
+  fclose (fout);
+
+  printf ("Wrote %ld photons from %s to %s\n", n, argv[1], outfile);
+
+  return (0);
+}
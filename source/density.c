@@ -12,6 +12,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "atomic.h"
@@ -67,8 +68,16 @@ in the plasma structure*/
 
     for (nn = 0; nn < nelem; nn++)
     {
-      nplasma = wmain[nnn[nn]].nplasma;
-      dd += plasmamain[nplasma].density[nion] * frac[nn];
+      if (windhot != NULL && plasmahot != NULL)
+      {                         /* Use the compact copies of the structures when they have been made */
+        nplasma = windhot[nnn[nn]].nplasma;
+        dd += plasmahot[nplasma].density[nion] * frac[nn];
+      }
+      else
+      {
+        nplasma = wmain[nnn[nn]].nplasma;
+        dd += plasmamain[nplasma].density[nion] * frac[nn];
+      }
     }
   }
   else
@@ -79,3 +88,87 @@ in the plasma structure*/
 
   return (dd);
 }
+
+
+
+/**********************************************************/
+/** 
+ * @brief      Find the ions whose lines can be in resonance in each cell
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * calculate_ds ignores a line if the density of its ion, as interpolated by 
+ * get_ion_density, is less than LDEN_MIN.  The interpolation is between the
+ * centres of a cell and its neighbours, so the interpolated density 
+ * cannot exceed the largest density of the ion in these cells.  For each
+ * plasma cell, ion_populated[nplasma * nions + nion] is set TRUE if the
+ * density of the ion exceeds LDEN_MIN in one of the wind cells which
+ * use the plasma cell or their neighbours, and FALSE otherwise.  calculate_ds
+ * skips the lines of the ions which are FALSE without interpolating their 
+ * densities.
+ *
+ * ### Notes ###
+ * The flags must be found again whenever the densities change, and so
+ * trans_phot calls this routine before each flight of photons.
+ *
+ * In cylvar coordinates the rows of cells are offset in z from one column
+ * to the next, so coord_fraction can interpolate between cells which are
+ * more than one row away.  All of the ions are therefore flagged TRUE for
+ * the cells of cylvar domains, and none of their lines are skipped.
+ *
+ **********************************************************/
+
+int
+ion_populated_make ()
+{
+  int n, nn, nion, ndom;
+  int i, j, ii, jj;
+  char *flags;
+  double *density;
+
+  if ((ion_populated = realloc (ion_populated, (NPLASMA + 1) * nions + 1)) == NULL)
+  {
+    Error ("ion_populated_make: Could not allocate memory for %d cells and %d ions\n", NPLASMA + 1, nions);
+    exit (0);
+  }
+  memset (ion_populated, FALSE, (NPLASMA + 1) * nions + 1);
+
+  for (n = 0; n < NDIM2; n++)
+  {
+    ndom = wmain[n].ndom;
+    flags = &ion_populated[wmain[n].nplasma * nions];
+    i = (n - zdom[ndom].nstart) / zdom[ndom].mdim;
+    j = (n - zdom[ndom].nstart) % zdom[ndom].mdim;
+
+    if (zdom[ndom].coord_type == CYLVAR)
+    {
+      memset (flags, TRUE, nions);
+      continue;
+    }
+
+    for (ii = i - 1; ii <= i + 1; ii++)
+    {
+      for (jj = j - 1; jj <= j + 1; jj++)
+      {
+        if (ii < 0 || ii >= zdom[ndom].ndim || jj < 0 || jj >= zdom[ndom].mdim)
+        {
+          continue;
+        }
+
+        nn = zdom[ndom].nstart + ii * zdom[ndom].mdim + jj;
+        density = plasmamain[wmain[nn].nplasma].density;
+
+        for (nion = 0; nion < nions; nion++)
+        {
+          if (density[nion] > LDEN_MIN)
+          {
+            flags[nion] = TRUE;
+          }
+        }
+      }
+    }
+  }
+
+  return (0);
+}
@@ -87,6 +87,7 @@
  * * the fractional distance a photons may travel
  * * the lowest ion allowed to contribute to photabosrption
  * * whether photoabsorption is considered in the final spectrum
+ * * whether the continuum opacity is tabulated for the final spectrum
  *
  * ### Notes ###
  * @bug It is not obvious that much recent thought has been
@@ -104,6 +105,10 @@
  * Keeping photoionizaion during final spectrum allows one to
  * check the contribution of photoabsorption.
  *
+ * Tabulating the continuum opacity makes the final spectrum faster
+ * when photoabsorption is kept, at the cost of smearing each edge over
+ * one step of the frequency grid (see kappa_cont_tab_make).
+ *
  **********************************************************/
 
 int
@@ -125,6 +130,7 @@ get_standard_care_factors ()
       rddoub ("@Diag.fractional_distance_photon_may_travel", &SMAX_FRAC);
       rddoub ("@Diag.lowest_ion_density_for_photoabs", &DENSITY_PHOT_MIN);
       rdint ("@Diag.keep_photoabs_in_final_spectra(1=yes)", &modes.keep_photoabs);
+      rdint ("@Diag.tabulate_continuum_opacity_in_final_spectra(1=yes)", &modes.kappa_table);
     }
   }
   return (0);
@@ -377,6 +383,9 @@ save_photons (p, comment)
      PhotPtr p;
      char comment[];
 {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
   save_photon_number += 1;
 //OLD  if (save_photon_number > 1000000)
 //OLD    return (0);
@@ -313,6 +313,9 @@ zdisk (r)
 int ds_to_disk_init = 0;
 struct photon ds_to_disk_photon;
 struct plane diskplane, disktop, diskbottom;
+#ifdef _OPENMP
+#pragma omp threadprivate(ds_to_disk_init, ds_to_disk_photon, diskplane, disktop, diskbottom)
+#endif
 
 
 /**********************************************************/
@@ -206,14 +206,17 @@ total_emission (one, f1, f2)
  *
  * @details
  *
- * The routine first generates a random number which is used to determine
- * in which wind cell  should be generated, and then  determines the
- * type of photon to generate.  Once this is doen the routine cycles thourhg
- * the PlasmaCells generatating all of the photons for each cell at once.
+ * The routine first decides how many photons should be generated
+ * in each wind cell, and how many of those should be ff, fb and line
+ * photons.  Once this is done the routine cycles through
+ * the PlasmaCells generating all of the photons for each cell at once.
  *
  *
  * ### Notes ###
- * This logic was adopted for speed related reasons.
+ * This logic was adopted for speed related reasons.  The numbers of photons
+ * in each cell, and of each type, are drawn from multinomial distributions
+ * (see random_multinomial) so the cost does not depend on the product of
+ * the number of photons and the number of cells.
  *
  * If photo_gen_wind tries to create more photons than exist in the photon structure the
  * program will stop (rather than continue incorrectly or start blasting away memory.)
@@ -229,20 +232,24 @@ photo_gen_wind (p, weight, freqmin, freqmax, photstart, nphot)
      double freqmin, freqmax;
      int photstart, nphot;
 {
-  int n, nn, np;
+  int n, np;
   int photstop;
-  double xlum, xlumsum, lum;
   double v[3];
   int icell, icell_old;
-  int nplasma;
   int nnscat;
   int ndom;
-  int ptype[NPLASMA][3];        //Store for the types of photons we want, ff first, fb next, line third
+  double *xlum, xtype[3];
+  unsigned int *ncell;
+  unsigned int (*ptype)[3];     //Store for the types of photons we want, ff first, fb next, line third
 
-  for (n = 0; n < NPLASMA; n++)
+  xlum = calloc (sizeof (double), NPLASMA);
+  ncell = calloc (sizeof (unsigned int), NPLASMA);
+  ptype = calloc (sizeof (*ptype), NPLASMA);
+
+  if (xlum == NULL || ncell == NULL || ptype == NULL)
   {
-    for (nn = 0; nn < 3; nn++)
-      ptype[n][nn] = 0;
+    Error ("photo_gen_wind: Could not allocate memory for %d cells\n", NPLASMA);
+    exit (0);
   }
 
   /* Limit the lines to consider */
@@ -252,61 +259,46 @@ photo_gen_wind (p, weight, freqmin, freqmax, photstart, nphot)
   photstop = photstart + nphot;
   Log_silent ("photo_gen_wind creates nphot %5d photons from %5d to %5d \n", nphot, photstart, photstop);
 
-  for (n = photstart; n < photstop; n++)
-  {
-    /* locate the wind_cell in which the photon bundle originates.
-       Note: In photo_gen, both geo.f_wind and geo.lum_wind will have been determined.
-       geo.f_wind refers to the specific flux between freqmin and freqmax.  Note that
-       we make sure that xlum is not == 0 or to geo.f_wind. */
-
-    xlum = random_number (0.0, 1.0) * geo.f_wind;
+  /* Decide how many photon bundles originate in each cell.  lum_tot is the band limited
+     luminosity of the cell; in photo_gen these will have been summed to give geo.f_wind. */
 
-
-    xlumsum = 0;
-    icell = 0;
-    while (xlumsum < xlum)
+  for (n = 0; n < NPLASMA; n++)
+  {
+    if (wmain[plasmamain[n].nwind].vol > 0.0)
     {
-
-
-      if (wmain[icell].vol > 0.0)
-      {
-        nplasma = wmain[icell].nplasma;
-        /*increment the xlumsum by the lum_tot (the band limited luminosity in this cell */
-        xlumsum += plasmamain[nplasma].lum_tot;
-      }
-      icell++;
+      xlum[n] = plasmamain[n].lum_tot;
     }
-    icell--;
+  }
 
-    /* At this point we know the cell in which the photon will be generated */
+  if (random_multinomial (NPLASMA, nphot, xlum, ncell))
+  {
+    Error ("photo_gen_wind: There is no wind luminosity between %g and %g\n", freqmin, freqmax);
+    exit (0);
+  }
 
-    nplasma = wmain[icell].nplasma;
-    ndom = wmain[icell].ndom;
-    plasmamain[nplasma].nrad += 1;      /* Increment the counter for the number of photons generatd in the cell */
+  /* Now determine the types of the photons in each cell, and store in ptype the total number of
+   * each photon type to be made in each cell */
 
+  for (n = 0; n < NPLASMA; n++)
+  {
+    if (ncell[n] == 0)
+      continue;
 
+    plasmamain[n].nrad += ncell[n];     /* Increment the counter for the number of photons generatd in the cell */
 
-    /*Determine the type of photon this photon will be and increment ptype, which stores the total number of
-     * each photon type to be made in each cell */
+    xtype[0] = plasmamain[n].lum_ff;    /* ff photons */
+    xtype[1] = plasmamain[n].lum_rr;    /* fb photons */
+    xtype[2] = plasmamain[n].lum_tot - xtype[0] - xtype[1];     /* line photons */
+    if (xtype[2] < 0.0)
+      xtype[2] = 0.0;
 
-    lum = plasmamain[nplasma].lum_tot;
-    xlum = lum * random_number (0.0, 1.0);
-    xlumsum = 0;
+    random_multinomial (3, ncell[n], xtype, ptype[n]);
+  }
 
+  for (n = photstart; n < photstop; n++)
+  {
     p[n].nres = -1;
     p[n].nnscat = 1;
-    if ((xlumsum += plasmamain[nplasma].lum_ff) > xlum)
-    {
-      ptype[nplasma][0]++;      /* a ff photon  */
-    }
-    else if ((xlumsum += plasmamain[nplasma].lum_rr) > xlum)
-    {
-      ptype[nplasma][1]++;      /* a fb photon */
-    }
-    else
-    {
-      ptype[nplasma][2]++;      /* a line photon */
-    }
   }
 
 
@@ -333,7 +325,7 @@ photo_gen_wind (p, weight, freqmin, freqmax, photstart, nphot)
         if (p[np].freq <= 0.0)
         {
           Error_silent
-            ("photo_gen_wind: On return from one_ff: icell %d vol %g t_e %g\n", icell, wmain[icell].vol, plasmamain[nplasma].t_e);
+            ("photo_gen_wind: On return from one_ff: icell %d vol %g t_e %g\n", icell, wmain[icell].vol, plasmamain[n].t_e);
           p[np].freq = 0.0;
         }
       }
@@ -420,6 +412,9 @@ was a resonant scatter but we want isotropic scattering anyway.  */
 
   }
 
+  free (xlum);
+  free (ncell);
+  free (ptype);
 
   return (nphot);               /* Return the number of photons generated */
 }
@@ -661,6 +656,9 @@ double ff_x[ARRAY_PDF], ff_y[ARRAY_PDF];
 
 /// Old values
 double one_ff_f1, one_ff_f2, one_ff_te;
+#ifdef _OPENMP
+#pragma omp threadprivate(ff_x, ff_y, one_ff_f1, one_ff_f2, one_ff_te)
+#endif
 
 
 /**********************************************************/
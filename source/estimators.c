@@ -25,6 +25,9 @@
 struct topbase_phot *cont_ext_ptr2;     //continuum pointer passed externally
 double temp_ext2;               //temperature passed externally
 double temp_ext_rad;            //radiation temperature passed externally 
+#ifdef _OPENMP
+#pragma omp threadprivate(cont_ext_ptr2, temp_ext2, temp_ext_rad)
+#endif
 
 #define ALPHA_SP_CONSTANT 5.79618e-36   //
 
@@ -32,6 +35,7 @@ double temp_ext_rad;            //radiation temperature passed externally
 /**
  * @brief increment the matom bound-free estimators
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] WindPtr  one pointer to cell
  * @param [in] PhotPtr  p the packet
  * @param [in] double  ds the path length
@@ -54,7 +58,8 @@ double temp_ext_rad;            //radiation temperature passed externally
  **********************************************************/
 
 int
-bf_estimators_increment (one, p, ds)
+bf_estimators_increment (ctx, one, p, ds)
+     CtxPtr ctx;
      WindPtr one;
      PhotPtr p;
      double ds;
@@ -201,7 +206,7 @@ bf_estimators_increment (one, p, ds)
            recombination is included here. (SS, Apr 04) */
         if (density > DENSITY_PHOT_MIN)
         {
-          x = sigma_phot (&phot_top[n], freq_av);       //this is the cross section
+          x = sigma_phot (ctx, &phot_top[n], freq_av);      //this is the cross section
           weight_of_packet = p->w;
           y = weight_of_packet * x * ds;
 
@@ -1014,18 +1019,22 @@ get_gamma (cont_ptr, xplasma)
   double qromb ();
   double gamma_integrand ();
 
-  temp_ext2 = xplasma->t_r;     //external temperature
-  cont_ext_ptr2 = cont_ptr;     //external cont pointer
-  fthresh = cont_ptr->freq[0];  //first frequency in list
-  flast = cont_ptr->freq[cont_ptr->np - 1];     //last frequency in list
-  if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
-  {
-    //flast is currently very far into the exponential tail: so reduce flast to limit value of h nu / k T.
-    flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
-  }
+  /* Use the tabulated integrals if possible, and otherwise integrate directly */
 
+  if ((gamma_value = matom_rate_sum (cont_ptr, FALSE, 0.0, xplasma->t_r)) < 0.0)
+  {
+    temp_ext2 = xplasma->t_r;   //external temperature
+    cont_ext_ptr2 = cont_ptr;   //external cont pointer
+    fthresh = cont_ptr->freq[0];        //first frequency in list
+    flast = cont_ptr->freq[cont_ptr->np - 1];   //last frequency in list
+    if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
+    {
+      //flast is currently very far into the exponential tail: so reduce flast to limit value of h nu / k T.
+      flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
+    }
 
-  gamma_value = qromb (gamma_integrand, fthresh, flast, 1e-4);
+    gamma_value = qromb (gamma_integrand, fthresh, flast, 1e-4);
+  }
 
   gamma_value *= 8 * PI / C / C * xplasma->w;
 
@@ -1062,7 +1071,7 @@ gamma_integrand (freq)
   if (freq < fthresh)
     return (0.0);               // No photoionization at frequencies lower than the threshold freq occur
 
-  x = sigma_phot (cont_ext_ptr2, freq); //this is the cross-section
+  x = sigma_phot (NULL, cont_ext_ptr2, freq); //this is the cross-section
   integrand = x * freq * freq / (exp (H_OVER_K * freq / tt) - 1);
 
   return (integrand);
@@ -1093,18 +1102,22 @@ get_gamma_e (cont_ptr, xplasma)
   double qromb ();
   double gamma_e_integrand ();
 
-  temp_ext2 = xplasma->t_r;     //external temperature
-  cont_ext_ptr2 = cont_ptr;     //external cont pointer
-  fthresh = cont_ptr->freq[0];  //first frequency in list
-  flast = cont_ptr->freq[cont_ptr->np - 1];     //last frequency in list
-  if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
-  {
-    //flast is currently very far into the exponential tail: so reduce flast to limit value of h nu / k T.
-    flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
-  }
+  /* Use the tabulated integrals if possible, and otherwise integrate directly */
 
+  if ((gamma_e_value = matom_rate_sum (cont_ptr, TRUE, 0.0, xplasma->t_r)) < 0.0)
+  {
+    temp_ext2 = xplasma->t_r;   //external temperature
+    cont_ext_ptr2 = cont_ptr;   //external cont pointer
+    fthresh = cont_ptr->freq[0];        //first frequency in list
+    flast = cont_ptr->freq[cont_ptr->np - 1];   //last frequency in list
+    if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
+    {
+      //flast is currently very far into the exponential tail: so reduce flast to limit value of h nu / k T.
+      flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
+    }
 
-  gamma_e_value = qromb (gamma_e_integrand, fthresh, flast, 1e-4);
+    gamma_e_value = qromb (gamma_e_integrand, fthresh, flast, 1e-4);
+  }
 
   gamma_e_value *= 8 * PI / C / C * xplasma->w;
 
@@ -1140,7 +1153,7 @@ gamma_e_integrand (freq)
   if (freq < fthresh)
     return (0.0);               // No photoionization at frequencies lower than the threshold freq occur
 
-  x = sigma_phot (cont_ext_ptr2, freq); //this is the cross-section
+  x = sigma_phot (NULL, cont_ext_ptr2, freq); //this is the cross-section
   integrand = x * freq * freq * freq / (exp (H_OVER_K * freq / tt) - 1) / fthresh;
 
   return (integrand);
@@ -1172,20 +1185,24 @@ get_alpha_st (cont_ptr, xplasma)
   double qromb ();
   double alpha_st_integrand ();
 
-  temp_ext2 = xplasma->t_e;     //external for use in integrand
-  temp_ext_rad = xplasma->t_r;
-  cont_ext_ptr2 = cont_ptr;     //"
-  fthresh = cont_ptr->freq[0];  //first frequency in list
-  flast = cont_ptr->freq[cont_ptr->np - 1];     //last frequency in list
+  /* Use the tabulated integrals if possible, and otherwise integrate directly */
 
-  if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
+  if ((alpha_st_value = matom_rate_sum (cont_ptr, FALSE, xplasma->t_e, xplasma->t_r)) < 0.0)
   {
-    //flast is currently very far into the exponential tail: so reduce flast to limit value of h nu / k T.
-    flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
-  }
+    temp_ext2 = xplasma->t_e;   //external for use in integrand
+    temp_ext_rad = xplasma->t_r;        //"
+    cont_ext_ptr2 = cont_ptr;   //"
+    fthresh = cont_ptr->freq[0];        //first frequency in list
+    flast = cont_ptr->freq[cont_ptr->np - 1];   //last frequency in list
 
+    if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
+    {
+      //flast is currently very far into the exponential tail: so reduce flast to limit value of h nu / k T.
+      flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
+    }
 
-  alpha_st_value = qromb (alpha_st_integrand, fthresh, flast, 1e-4);
+    alpha_st_value = qromb (alpha_st_integrand, fthresh, flast, 1e-4);
+  }
 
 
   /* The lines above evaluate the integral in alpha_sp. Now we just want to multiply 
@@ -1235,7 +1252,7 @@ alpha_st_integrand (freq)
   if (freq < fthresh)
     return (0.0);               // No recombination at frequencies lower than the threshold freq occur
 
-  x = sigma_phot (cont_ext_ptr2, freq); //this is the cross-section
+  x = sigma_phot (NULL, cont_ext_ptr2, freq); //this is the cross-section
   integrand = x * freq * freq * exp (H_OVER_K * (fthresh - freq) / tt) / (exp (H_OVER_K * freq / ttrr) - 1);
 
   return (integrand);
@@ -1268,20 +1285,24 @@ get_alpha_st_e (cont_ptr, xplasma)
   double qromb ();
   double alpha_st_e_integrand ();
 
-  temp_ext2 = xplasma->t_e;     //external for use in integrand
-  temp_ext_rad = xplasma->t_r;  //"
-  cont_ext_ptr2 = cont_ptr;     //"
-  fthresh = cont_ptr->freq[0];  //first frequency in list
-  flast = cont_ptr->freq[cont_ptr->np - 1];     //last frequency in list
+  /* Use the tabulated integrals if possible, and otherwise integrate directly */
 
-  if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
+  if ((alpha_st_e_value = matom_rate_sum (cont_ptr, TRUE, xplasma->t_e, xplasma->t_r)) < 0.0)
   {
-    //flast is currently very far into the exponential tail: so reduce flast to limit value of h nu / k T.
-    flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
-  }
+    temp_ext2 = xplasma->t_e;   //external for use in integrand
+    temp_ext_rad = xplasma->t_r;        //"
+    cont_ext_ptr2 = cont_ptr;   //"
+    fthresh = cont_ptr->freq[0];        //first frequency in list
+    flast = cont_ptr->freq[cont_ptr->np - 1];   //last frequency in list
 
+    if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
+    {
+      //flast is currently very far into the exponential tail: so reduce flast to limit value of h nu / k T.
+      flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
+    }
 
-  alpha_st_e_value = qromb (alpha_st_e_integrand, fthresh, flast, 1e-4);
+    alpha_st_e_value = qromb (alpha_st_e_integrand, fthresh, flast, 1e-4);
+  }
 
   /* The lines above evaluate the integral in alpha_sp. Now we just want to multiply 
      through by the appropriate constant. */
@@ -1331,8 +1352,285 @@ alpha_st_e_integrand (freq)
   if (freq < fthresh)
     return (0.0);               // No recombination at frequencies lower than the threshold freq occur
 
-  x = sigma_phot (cont_ext_ptr2, freq); //this is the cross-section
+  x = sigma_phot (NULL, cont_ext_ptr2, freq); //this is the cross-section
   integrand = x * freq * freq * exp (H_OVER_K * (fthresh - freq) / tt) / (exp (H_OVER_K * freq / ttrr) - 1) * freq / fthresh;
 
   return (integrand);
 }
+
+
+
+/* The tables of the rate integrals for each continuum, indexed by the position of the continuum in phot_top */
+double **matom_rate_tab = NULL;
+int matom_rate_ntab = 0;
+
+
+
+/**********************************************************/
+/**
+ * @brief find the table of rate integrals for a continuum, making it if necessary
+ *
+ * @param [in] struct topbase_phot *  cont_ptr   the continuum
+ * @return a pointer to the table, or NULL if the continuum cannot be tabulated
+ *
+ * @details
+ * For each continuum two integrals over the photoionization x-section
+ * are tabulated on a grid of MATOM_RATE_NTEMP temperatures spaced evenly
+ * in log T between MATOM_RATE_TMIN and MATOM_RATE_TMAX,
+ *
+ * G(T) = int x nu^2 exp (-h (nu - nu_t) / kT) dnu
+ *
+ * H(T) = int x nu^3 / nu_t exp (-h (nu - nu_t) / kT) dnu
+ *
+ * from the threshold nu_t to the last frequency of the x-section,
+ * or to where h (nu - nu_t) / kT reaches ALPHA_MATOM_NUMAX_LIMIT.
+ * The first MATOM_RATE_NTEMP elements of the table hold G and the
+ * rest hold H.
+ *
+ * ### Notes ###
+ * The tables are made the first time each continuum is needed, so
+ * only the continua of macro atoms are ever tabulated.  qromb is
+ * not reentrant, and so only one thread at a time makes a table.
+ *
+ **********************************************************/
+
+double *
+matom_rate_table (cont_ptr)
+     struct topbase_phot *cont_ptr;
+{
+  int n, i;
+  double *tab;
+  double lt, fthresh, flast;
+  double qromb ();
+  double matom_rate_integrand (), matom_rate_e_integrand ();
+
+  n = cont_ptr - phot_top;
+  if (phot_top == NULL || n < 0 || n >= nphot_max || cont_ptr->np < 2)
+    return (NULL);
+
+#ifdef _OPENMP
+#pragma omp critical (matom_rate)
+#endif
+  {
+    /* The atomic data may have been read again since the tables were made */
+    if (matom_rate_ntab != nphot_max)
+    {
+      if (matom_rate_tab != NULL)
+      {
+        for (i = 0; i < matom_rate_ntab; i++)
+          free (matom_rate_tab[i]);
+        free (matom_rate_tab);
+      }
+
+      if ((matom_rate_tab = (double **) calloc (sizeof (double *), nphot_max)) == NULL)
+      {
+        Error ("matom_rate_table: Could not allocate memory for the tables of %d continua\n", nphot_max);
+        exit (0);
+      }
+      matom_rate_ntab = nphot_max;
+    }
+
+    if (matom_rate_tab[n] == NULL)
+    {
+      if ((tab = (double *) calloc (sizeof (double), 2 * MATOM_RATE_NTEMP)) == NULL)
+      {
+        Error ("matom_rate_table: Could not allocate memory for the table of continuum %d\n", n);
+        exit (0);
+      }
+
+      cont_ext_ptr2 = cont_ptr;
+      fthresh = cont_ptr->freq[0];
+      for (i = 0; i < MATOM_RATE_NTEMP; i++)
+      {
+        lt = log10 (MATOM_RATE_TMIN) + i * (log10 (MATOM_RATE_TMAX) - log10 (MATOM_RATE_TMIN)) / (MATOM_RATE_NTEMP - 1);
+        temp_ext2 = pow (10., lt);
+
+        flast = cont_ptr->freq[cont_ptr->np - 1];
+        if ((H_OVER_K * (flast - fthresh) / temp_ext2) > ALPHA_MATOM_NUMAX_LIMIT)
+          flast = fthresh + temp_ext2 * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
+
+        tab[i] = qromb (matom_rate_integrand, fthresh, flast, 1e-4);
+        tab[i + MATOM_RATE_NTEMP] = qromb (matom_rate_e_integrand, fthresh, flast, 1e-4);
+      }
+
+      matom_rate_tab[n] = tab;
+    }
+
+    tab = matom_rate_tab[n];
+  }
+
+  return (tab);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief the integrand for G(T) in the tables of rate integrals
+ *
+ * @param [in] double freq
+ * @return integrand
+ *
+ * @details
+ * The continuum and temperature are passed externally in
+ * cont_ext_ptr2 and temp_ext2.
+ *
+ **********************************************************/
+
+double
+matom_rate_integrand (freq)
+     double freq;
+{
+  double fthresh;
+  double x;
+
+  fthresh = cont_ext_ptr2->freq[0];
+
+  if (freq < fthresh)
+    return (0.0);
+
+  x = sigma_phot (NULL, cont_ext_ptr2, freq);
+
+  return (x * freq * freq * exp (H_OVER_K * (fthresh - freq) / temp_ext2));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief the integrand for H(T) in the tables of rate integrals
+ *
+ * @param [in] double freq
+ * @return integrand
+ *
+ * @details
+ * This is the integrand of matom_rate_integrand weighted by
+ * nu / nu_t, as for the energy-weighted estimators.
+ *
+ **********************************************************/
+
+double
+matom_rate_e_integrand (freq)
+     double freq;
+{
+  return (matom_rate_integrand (freq) * freq / cont_ext_ptr2->freq[0]);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief interpolate in the table of a rate integral
+ *
+ * @param [in] double *  tab   the MATOM_RATE_NTEMP values of G or H for a continuum
+ * @param [in] double  t   the temperature
+ * @return the integral at t
+ *
+ * @details
+ * The interpolation is in log T and log G, unless either of the
+ * bracketing values is zero, when it is linear.  The temperature
+ * must lie between MATOM_RATE_TMIN and MATOM_RATE_TMAX.
+ *
+ **********************************************************/
+
+double
+matom_rate_interp (tab, t)
+     double *tab;
+     double t;
+{
+  int i;
+  double dlt, f;
+
+  dlt = (log10 (MATOM_RATE_TMAX) - log10 (MATOM_RATE_TMIN)) / (MATOM_RATE_NTEMP - 1);
+  f = (log10 (t) - log10 (MATOM_RATE_TMIN)) / dlt;
+
+  i = (int) f;
+  if (i < 0)
+    i = 0;
+  if (i > MATOM_RATE_NTEMP - 2)
+    i = MATOM_RATE_NTEMP - 2;
+  f -= i;
+
+  if (tab[i] > 0.0 && tab[i + 1] > 0.0)
+    return (tab[i] * pow (tab[i + 1] / tab[i], f));
+
+  return ((1. - f) * tab[i] + f * tab[i + 1]);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief calculate the integral in the gamma and alpha_st estimators from the tables
+ *
+ * @param [in] struct topbase_phot *  cont_ptr   the continuum
+ * @param [in] int  energy_weighted   TRUE for the energy-weighted estimators
+ * @param [in] double  t_e   the electron temperature, or 0 for gamma
+ * @param [in] double  t_r   the radiation temperature
+ * @return the integral, or -1 if it could not be found from the tables
+ *
+ * @details
+ * The integrals for a diluted black body are expanded with
+ *
+ * 1 / (exp (h nu / k T_r) - 1) = sum_k exp (-k h nu / k T_r)
+ *
+ * so that the integral for gamma is
+ *
+ * sum_k exp (-k h nu_t / k T_r) G(T_r / k)
+ *
+ * and the integral for alpha_st is the same with G(T_k), where
+ * 1 / T_k = 1 / T_e + k / T_r.  The energy-weighted forms use H in
+ * place of G.  Since G and H grow with temperature, the remainder of
+ * the series after term k is no more than the term times
+ * exp (-x_t) / (1 - exp (-x_t)), with x_t = h nu_t / k T_r, and the sum
+ * stops when this is less than MATOM_RATE_ACCURACY of the sum.
+ *
+ * ### Notes ###
+ * -1 is returned, and the caller integrates directly, if any of
+ * the temperatures needed is outside the tables, or if the series
+ * has not converged after MATOM_RATE_NTERMS terms.
+ *
+ **********************************************************/
+
+double
+matom_rate_sum (cont_ptr, energy_weighted, t_e, t_r)
+     struct topbase_phot *cont_ptr;
+     int energy_weighted;
+     double t_e, t_r;
+{
+  int k;
+  double *tab;
+  double xt, ratio, tk, term, sum;
+
+  if (t_r <= 0.0)
+    return (0.0);
+
+  if ((tab = matom_rate_table (cont_ptr)) == NULL)
+    return (-1.0);
+
+  if (energy_weighted)
+    tab += MATOM_RATE_NTEMP;
+
+  xt = H_OVER_K * cont_ptr->freq[0] / t_r;
+  ratio = exp (-xt) / (1. - exp (-xt));
+
+  sum = 0.0;
+  for (k = 1; k <= MATOM_RATE_NTERMS; k++)
+  {
+    if (t_e > 0.0)
+      tk = 1. / (1. / t_e + k / t_r);
+    else
+      tk = t_r / k;
+
+    if (tk < MATOM_RATE_TMIN || tk > MATOM_RATE_TMAX)
+      return (-1.0);
+
+    term = exp (-k * xt) * matom_rate_interp (tab, tk);
+    sum += term;
+
+    if (term * ratio <= MATOM_RATE_ACCURACY * sum)
+      return (sum);
+  }
+
+  return (-1.0);
+}
@@ -86,6 +86,7 @@
  * @brief      A supervisory routine called to 
  * 	builds detailed spectra in the normal (extract) mode.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in, out] WindPtr  w   The entire wind
  * @param [in, out] PhotPtr  p   The photon to extract
  * @param [in, out] int  itype   An integer representing the type of photon 
@@ -146,12 +147,13 @@
  **********************************************************/
 
 int
-extract (w, p, itype)
+extract (ctx, w, p, itype)
+     CtxPtr ctx;
      WindPtr w;
      PhotPtr p;
      int itype;
 {
-  int n, mscat, mtopbot;
+  int n, m, mscat, mtopbot;
   struct photon pp;
   double v[3];
   double length ();
@@ -159,6 +161,7 @@ extract (w, p, itype)
   int yep;
   double xdiff[3];
   int ndom;
+  int accept[MSPEC + NSPEC];
 
 
   /* The next line selects the middle inclination angle for recording the absorbed energy */
@@ -197,7 +200,27 @@ extract (w, p, itype)
         yep = 0;
     }
 
-    if (yep)                    //Then we want to extract this photon
+    accept[n] = yep;
+  }
+
+/* The velocity used to doppler shift the photon depends only on its position, and so 
+ * is the same for all of the directions in which it is extracted
+ */
+
+  v[0] = v[1] = v[2] = 0.0;
+  if (itype == PTYPE_DISK)
+  {
+    vdisk (p->x, v);
+  }
+  else if (itype == PTYPE_WIND)
+  {
+    ndom = wmain[p->grid].ndom;
+    vwind_xyz (ndom, p, v);     /*  Get the velocity at the position of the photon */
+  }
+
+  for (n = MSPEC; n < nspectra; n++)
+  {
+    if (accept[n])              //Then we want to extract this photon
     {
 
 
@@ -218,15 +241,12 @@ one is odd. We do frequency here but weighting is carried out in  extract */
 
       if (itype == PTYPE_DISK)
       {
-        vdisk (pp.x, v);
         doppler (p, &pp, v, -1);
 
       }
       if (itype == PTYPE_WIND)
       {                         /* If the photon was scattered in the wind, 
                                    the frequency also must be shifted */
-        ndom = wmain[p->grid].ndom;
-        vwind_xyz (ndom, &pp, v);       /*  Get the velocity at the position of pp */
         doppler (p, &pp, v, pp.nres);   /*  Doppler shift the photon -- test! */
 
 /*  Doppler shift the photon (as nonresonant scatter) to new direction */
@@ -235,20 +255,28 @@ one is odd. We do frequency here but weighting is carried out in  extract */
 
       if (modes.save_extract_photons && 1545.0 < 2.997925e18 / pp.freq && 2.997925e18 / pp.freq < 1565.0)
       {
-        save_extract_photons (n, p, &pp, v);
+        for (m = n; m < nspectra; m++)
+        {
+          if (m == n || (accept[m] && xxspec[m].ndirection == xxspec[n].ndirection))
+          {
+            save_extract_photons (m, p, &pp, v);
+          }
+        }
       }
 
 /* 68b - 0902 - ksl - turn phot_history on for the middle spectrum.  Note that we have to wait
  * to actually initialize phot_hist because the photon bundle is reweighted in extract_one */
 
-      if (phot_history_spectrum == n)
+      if (phot_history_spectrum == n || (phot_history_spectrum > n && phot_history_spectrum < nspectra
+                                         && accept[phot_history_spectrum]
+                                         && xxspec[phot_history_spectrum].ndirection == xxspec[n].ndirection))
       {
         phot_hist_on = 1;       // Start recording the history of the photon
       }
 
-      /* Now extract the photon */
+      /* Now extract the photon, into this spectrum and any later ones in the same direction */
 
-      extract_one (w, &pp, itype, n);
+      extract_one (ctx, w, &pp, itype, n, accept);
 
       /* Make sure phot_hist is on, for just one extraction */
 
@@ -268,10 +296,12 @@ one is odd. We do frequency here but weighting is carried out in  extract */
 /** 
  * @brief      (w,pp,itype,nspec)
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] WindPtr  w   The entire wind
  * @param [in] PhotPtr  pp  The photon to be extracted
  * @param [in] int  itype   The type of photon (star, disk, wind, etc)
  * @param [in] int  nspec   the spectrum which will be incremented
+ * @param [in, out] int  accept[]   TRUE for the spectra into which the photon is to be extracted
  * @return     The photon status after translation
  *
  * @details
@@ -279,6 +309,16 @@ one is odd. We do frequency here but weighting is carried out in  extract */
  * basic point is to calculate the optical depth through the plasma in a certain
  * direction, and to increment the appropriate spectrum.  
  *
+ * Several spectra can be extracted in the same direction, for example when they 
+ * select photons with different numbers of scatters.  The optical depth is the same
+ * for all of them, so the photon is traced once, and every later spectrum with 
+ * the same direction (see spectrum_init) which accepts the photon is incremented
+ * as well.  accept is set FALSE for these so that extract does not trace the 
+ * photon again.
+ *
+ * The photon is not followed once the optical depth exceeds TAU_MAX, since it 
+ * can then make no significant contribution to the spectrum.
+ *
  * Unlike trans_phot, this routine also checks to see if 
  * whether the photon hits the secondary star, if one exists.
  *
@@ -298,13 +338,16 @@ one is odd. We do frequency here but weighting is carried out in  extract */
  **********************************************************/
 
 int
-extract_one (w, pp, itype, nspec)
+extract_one (ctx, w, pp, itype, nspec, accept)
+     CtxPtr ctx;
      WindPtr w;
      PhotPtr pp;
      int itype, nspec;
+     int accept[];
 
 {
   int istat, nres;
+  int m;
   struct photon pstart;
   double weight_min;
   int icell;
@@ -370,7 +413,7 @@ needs to reweight
 /* But in any event we have to reposition wind photons so that they don't go through
 the same resonance again */
 
-    reposition (pp);            // Only reposition the photon if it was a wind photon
+    reposition (ctx, pp);       // Only reposition the photon if it was a wind photon
   }
 
   if (tau > TAU_MAX)
@@ -392,7 +435,7 @@ the same resonance again */
 
   while (istat == P_INWIND)
   {
-    istat = translate (w, pp, 20., &tau, &nres);
+    istat = translate (ctx, w, pp, 20., &tau, &nres);
     icell++;
 
     istat = walls (pp, &pstart, normal);
@@ -420,69 +463,101 @@ the same resonance again */
     {                           /* Cause the photon to scatter and reinitilize */
       break;
     }
+    if (tau > TAU_MAX)
+    {                           /* The photon is effectively absorbed, so there is no need to follow it further */
+      istat = P_ABSORB;
+      break;
+    }
   }
 
-  if (istat == P_ESCAPE)
+  for (m = nspec; m < nspectra; m++)
   {
-
-    if (!(0 <= tau && tau < 1.e4))
-      Error_silent ("Warning: extract_one: ignoring very high tau  %8.2e at %g\n", tau, pp->freq);
-    else
+    if (m > nspec)
     {
-      k = (pp->freq - xxspec[nspec].freqmin) / xxspec[nspec].dfreq;
-
-      /* Force the frequency to be in range of that recorded in the spectrum */
-
-      if (k < 0)
-        k = 0;
-      else if (k > NWAVE - 1)
-        k = NWAVE - 1;
-
-
-      lfreqmin = log10 (xxspec[nspec].freqmin);
-      lfreqmax = log10 (xxspec[nspec].freqmax);
-      ldfreq = (lfreqmax - lfreqmin) / NWAVE;
-
-      /* find out where we are in log space */
-      k1 = (log10 (pp->freq) - log10 (xxspec[nspec].freqmin)) / ldfreq;
-      if (k1 < 0)
+      if (!accept[m] || xxspec[m].ndirection != xxspec[nspec].ndirection)
       {
-        k1 = 0;
+        continue;
       }
-      if (k1 > NWAVE - 1)
+      accept[m] = FALSE;        /* So extract does not trace the photon again for this spectrum */
+    }
+
+    if (istat == P_ESCAPE)
+    {
+
+      if (!(0 <= tau && tau < 1.e4))
+        Error_silent ("Warning: extract_one: ignoring very high tau  %8.2e at %g\n", tau, pp->freq);
+      else
       {
-        k1 = NWAVE - 1;
-      }
+        k = (pp->freq - xxspec[m].freqmin) / xxspec[m].dfreq;
 
-      /* Increment the spectrum.  Note that the photon weight has not been diminished
-       * by its passage through th wind, even though it may have encounterd a number
-       * of resonance, and so the weight must be reduced by tau
-       */
+        /* Force the frequency to be in range of that recorded in the spectrum */
 
-      xxspec[nspec].f[k] += pp->w * exp (-(tau));       //OK increment the spectrum in question
-      xxspec[nspec].lf[k1] += pp->w * exp (-(tau));     //And increment the log spectrum
+        if (k < 0)
+          k = 0;
+        else if (k > NWAVE - 1)
+          k = NWAVE - 1;
 
 
-      /* If this photon was a wind photon, then also increment the "reflected" spectrum */
-      if (pp->origin == PTYPE_WIND || pp->origin == PTYPE_WIND_MATOM || pp->nscat > 0)
-      {
+        lfreqmin = log10 (xxspec[m].freqmin);
+        lfreqmax = log10 (xxspec[m].freqmax);
+        ldfreq = (lfreqmax - lfreqmin) / NWAVE;
 
-        xxspec[nspec].f_wind[k] += pp->w * exp (-(tau));        //OK increment the spectrum in question
-        xxspec[nspec].lf_wind[k1] += pp->w * exp (-(tau));      //OK increment the spectrum in question
+        /* find out where we are in log space */
+        k1 = (log10 (pp->freq) - log10 (xxspec[m].freqmin)) / ldfreq;
+        if (k1 < 0)
+        {
+          k1 = 0;
+        }
+        if (k1 > NWAVE - 1)
+        {
+          k1 = NWAVE - 1;
+        }
 
-      }
+        /* Increment the spectrum.  Note that the photon weight has not been diminished
+         * by its passage through th wind, even though it may have encounterd a number
+         * of resonance, and so the weight must be reduced by tau.  The spectra are 
+         * shared by all threads, so the increments are atomic when there are several.
+         */
+
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+        xxspec[m].f[k] += pp->w * exp (-(tau)); //OK increment the spectrum in question
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+        xxspec[m].lf[k1] += pp->w * exp (-(tau));       //And increment the log spectrum
+
+
+        /* If this photon was a wind photon, then also increment the "reflected" spectrum */
+        if (pp->origin == PTYPE_WIND || pp->origin == PTYPE_WIND_MATOM || pp->nscat > 0)
+        {
+
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+          xxspec[m].f_wind[k] += pp->w * exp (-(tau));  //OK increment the spectrum in question
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+          xxspec[m].lf_wind[k1] += pp->w * exp (-(tau));        //OK increment the spectrum in question
 
+        }
 
-      /* Records the total distance travelled by extracted photon if in reverberation mode */
-      if (geo.reverb != REV_NONE)
-      {
-        if (pstart.nscat > 0 || pstart.origin > 9 || (pstart.nres > -1 && pstart.nres < nlines))
-        {                       //If this photon has scattered, been reprocessed, or originated in the wind it's important
-          pstart.w = pp->w * exp (-(tau));      //Adjust weight to weight reduced by extraction
-          stuff_v (xxspec[nspec].lmn, pstart.lmn);
-          delay_dump_single (&pstart, nspec);   //Dump photon now weight has been modified by extraction
+
+        /* Records the total distance travelled by extracted photon if in reverberation mode */
+        if (geo.reverb != REV_NONE)
+        {
+          if (pstart.nscat > 0 || pstart.origin > 9 || (pstart.nres > -1 && pstart.nres < nlines))
+          {                     //If this photon has scattered, been reprocessed, or originated in the wind it's important
+            pstart.w = pp->w * exp (-(tau));    //Adjust weight to weight reduced by extraction
+            stuff_v (xxspec[m].lmn, pstart.lmn);
+#ifdef _OPENMP
+#pragma omp critical (reverb)
+#endif
+            delay_dump_single (&pstart, m);     //Dump photon now weight has been modified by extraction
+          }
         }
-      }
 
 
 
@@ -490,24 +565,30 @@ the same resonance again */
  * The reason this is here is that we only summarizes the history if the photon actually got to the observer
  */
 
-      if (phot_hist_on)
-      {
-        phot_history_summarize ();
-        phot_hist_on = 0;
-      }
+        if (phot_hist_on)
+        {
+          phot_history_summarize ();
+          phot_hist_on = 0;
+        }
 
 
-    }
+      }
 
-  }
+    }
 
 
-  if (istat > -1 && istat < 9)
-    xxspec[nspec].nphot[istat]++;
-  else
-    Error
-      ("Extract: Abnormal photon %d %8.2e %8.2e %8.2e %8.2e %8.2e %8.2e\n",
-       istat, pp->x[0], pp->x[1], pp->x[2], pp->lmn[0], pp->lmn[1], pp->lmn[2]);
+    if (istat > -1 && istat < 9)
+    {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      xxspec[m].nphot[istat]++;
+    }
+    else
+      Error
+        ("Extract: Abnormal photon %d %8.2e %8.2e %8.2e %8.2e %8.2e %8.2e\n",
+         istat, pp->x[0], pp->x[1], pp->x[2], pp->lmn[0], pp->lmn[1], pp->lmn[2]);
+  }
 
   return (istat);
 }
@@ -205,6 +205,9 @@
  * frequency ascending order.   This is actually done by a small subroutine index_lines
  * which in turn calls a Numerical Recipes routine.
  *
+ * If the data from masterfile are already in memory, the routine returns
+ * without reading them again.
+ *
  * ### Notes ###
  *
  * get_atomic data is intended to be stand-alone, that is one should be able to use it for routines
@@ -253,6 +256,7 @@ get_atomic_data (masterfile)
   char choice;
   int lineno;                   /* the line number in the file beginning with 1 */
   int index_collisions (), index_lines (), index_phot_top (), index_inner_cross (), index_phot_verner (), check_xsections ();
+  int count_atomic_data (), init_atomic_data (), alloc_xsection (), atomic_image_read ();
   int nwords;
   int nlte, nmax;
   int mflag;                    //flag to identify reading data for macro atoms
@@ -291,1367 +295,1097 @@ get_atomic_data (masterfile)
 
   /* define which files to read as data files */
 
+  /* The atomic data are read again only if they come from a different masterfile.  This is
+     the case when, for example, a windsave file is read by a program which has already
+     read the atomic data used to create it */
 
-/* Allocate structures for storage of data */
-
-  if (ele != NULL)
-  {
-    free (ele);
-  }
-  ele = (ElemPtr) calloc (sizeof (ele_dummy), NELEMENTS);
-
-  if (ele == NULL)
-  {
-    Error ("There is a problem in allocating memory for the element structure\n");
-    exit (0);
-  }
-  else
+  if (ele != NULL && strcmp (masterfile, atomic_masterfile) == 0)
   {
-    Log_silent
-      ("Allocated %10d bytes for each of %6d elements of   elements totaling %10.0f Mb \n",
-       sizeof (ele_dummy), NELEMENTS, 1.e-6 * NELEMENTS * sizeof (ele_dummy));
+    Log_silent ("get_atomic_data: The atomic data from %s have already been read\n", masterfile);
+    return (0);
   }
 
 
-  if (ion != NULL)
-  {
-    free (ion);
-  }
-  ion = (IonPtr) calloc (sizeof (ion_dummy), NIONS);
+  /* If there is an up to date binary image of the data, made with py_atomic_image, read that instead */
 
-  if (ion == NULL)
-  {
-    Error ("There is a problem in allocating memory for the ion structure\n");
-    exit (0);
-  }
-  else
+  if (atomic_image_read (masterfile) == 0)
   {
-    Log_silent
-      ("Allocated %10d bytes for each of %6d elements of       ions totaling %10.1f Mb \n",
-       sizeof (ion_dummy), NIONS, 1.e-6 * NIONS * sizeof (ion_dummy));
+    strcpy (atomic_masterfile, masterfile);
+    return (0);
   }
 
+/* Allocate structures for storage of data, with the numbers of entries found in the data files, and
+   set them to their initial values */
 
+  count_atomic_data (masterfile);
+  init_atomic_data ();
 
-  if (config != NULL)
-  {
-    free (config);
-  }
-  config = (ConfigPtr) calloc (sizeof (config_dummy), NLEVELS);
-
-  if (config == NULL)
-  {
-    Error ("There is a problem in allocating memory for the config structure\n");
-    exit (0);
-  }
-  else
-  {
-    Log_silent
-      ("Allocated %10d bytes for each of %6d elements of     config totaling %10.1f Mb \n",
-       sizeof (config_dummy), NLEVELS, 1.e-6 * NLEVELS * sizeof (config_dummy));
-  }
+  n_elec_yield_tot = n_fluor_yield_tot = 0;     //Counters for electron and fluorescent photon yields
+  gstmin = 0.0;
+  gstmax = 1e99;
 
+  choice = 'x';                 /* Start by assuming you cannot determine what kind of line it is */
+  nelements = 0;
+  nions = nions_simple = nions_macro = 0;
+  nlevels = nlevels_simple = nlevels_macro = 0;
+  ntop_phot_simple = ntop_phot_macro = 0;
+  nlte_levels = 0;
+  nlines = nlines_simple = nlines_macro = 0;
+  lineno = 0;
+  nxphot = 0;
+  nxcol = 0;
+/*mflag is set initially to 1, in order to establish that
+macro-lines need to be read in before any "simple" lines.  This
+is so that we can assure that the first lines in the line array
+are macro-lines.   It is important to recognize that the lin_ptr
+structure does not have this property! */
+  mflag = 1;
 
 
+/* Completed all initialization */
 
-  if (line != NULL)
-  {
-    free (line);
-  }
-  line = (LinePtr) calloc (sizeof (line_dummy), NLINES);
+  /* OK now we can try to read in the data from the data files */
 
-  if (line == NULL)
+  if ((mptr = fopen (masterfile, "r")) == NULL)
   {
-    Error ("There is a problem in allocating memory for the line structure\n");
+    Error ("Get_atomic_data:  Could not open masterfile %s\n", masterfile);
     exit (0);
   }
   else
   {
-    Log_silent
-      ("Allocated %10d bytes for each of %6d elements of       line totaling %10.1f Mb \n",
-       sizeof (line_dummy), NLINES, 1.e-6 * NLINES * sizeof (line_dummy));
+    Log ("Get_atomicdata: Reading from masterfile %s\n", masterfile);
   }
 
+/* Open and read each line in the masterfile in turn */
 
+  while (fgets (aline, LINELENGTH, mptr) != NULL)
+  {
+    if (sscanf (aline, "%s", file) == 1 && file[0] != '#')
+    {
 
-  /* Initialize variables */
+      /* Open one of the files designated in the masterfile and begin to read it */
 
+      if ((fptr = fopen (file, "r")) == NULL)
+      {
+        Error ("Get_atomic_data:  Could not open %s\n", file);
+        exit (0);
+      }
+      else
+      {
+        Log_silent ("Get_atomic_data: Now reading data from %s\n", file);
+        lineno = 1;
+      }
 
+      /* Main loop for reading each data file line by line */
 
-  phot_freq_min = VERY_BIG;
-  inner_freq_min = VERY_BIG;
+      while (fgets (aline, LINELENGTH, fptr) != NULL)
+      {
+        lineno++;
 
-  for (n = 0; n < NELEMENTS; n++)
-  {
-    strcpy (ele[n].name, "none");
-    ele[n].z = (-1);
-    ele[n].abun = (-1);
-    ele[n].firstion = (-1);
-    ele[n].nions = (-1);
-  }
+        strcpy (word, "");      /*For reasons which are not clear, word needs to be reinitialized every time to
+                                   properly deal with blank lines */
 
-  for (n = 0; n < NIONS; n++)
-  {
-    ion[n].z = (-1);
-    ion[n].istate = (-1);
-    ion[n].ip = (-1);
-    ion[n].g = (-1);
-    ion[n].nmax = (-1);
-    ion[n].firstlevel = (-1);
-    ion[n].nlevels = (-1);
-    ion[n].first_nlte_level = (-1);
-    ion[n].first_levden = (-1);
-    ion[n].nlte = (-1);
-    ion[n].phot_info = (-1);
-    ion[n].macro_info = (-1);   //Initialise - don't know if using Macro Atoms or not: set to -1 (SS)
-    ion[n].ntop_first = 0;      // The fact that ntop_first and ntop  are initialized to 0 and not -1 is important
-    ion[n].ntop_ground = 0;     //NSH 0312 initialize the new pointer for GS cross sections
-    ion[n].ntop = 0;
-    ion[n].nxphot = (-1);
-    ion[n].lev_type = (-1);     // Initialise to indicate we don't know what types of configurations will be read
-    ion[n].drflag = 0;          //Initialise to indicate as far as we know, there are no dielectronic recombination parameters associated with this ion.
-    ion[n].total_rrflag = 0;    //Initialise to say this ion has no Badnell total recombination data
-    ion[n].nxtotalrr = -1;      //Initialise the pointer into the bad_t_rr structure.
-    ion[n].bad_gs_rr_t_flag = 0;        //Initialise to say this ion has no Badnell ground state recombination data
-    ion[n].bad_gs_rr_r_flag = 0;        //Initialise to say this ion has no Badnell ground state recombination data
-    ion[n].nxbadgsrr = -1;      //Initialise the pointer into the bad_gs_rr structure.
-    ion[n].dere_di_flag = 0;    //Initialise to say this ion has no Dere DI rate data
-    ion[n].nxderedi = -1;       //Initialise the pointer into the Dere DI rate structure
-    ion[n].n_inner = 0;         //Initialise the pointer to say we have no inner shell ionization cross sections
-    for (i = 0; i < N_INNER; i++)
-      ion[n].nxinner[i] = -1;   //Inintialise the inner shell pointer array
-  }
+        if (sscanf (aline, "%s", word) == 0 || strlen (word) == 0)
+          choice = 'c';         /*It's a a blank line, treated like a comment */
+        else if (strncmp (word, "!", 1) == 0)
+          choice = 'c';
+        else if (strncmp (word, "#", 1) == 0)
+          choice = 'c';         /* It's a comment */
+        else if (strncmp (word, "CSTREN", 6) == 0)      //collision strengths
+          choice = 'C';
+        else if (strncmp (word, "Element", 5) == 0)
+          choice = 'e';
+        else if (strncmp (word, "Ion", 3) == 0)
+          choice = 'i';
+        else if (strncmp (word, "LevTop", 6) == 0)
+          choice = 'N';
+        else if (strncmp (word, "LevMacro", 8) == 0)    // This indicated leves for a Macro Atom (SS)
+          choice = 'N';
+        else if (strncmp (word, "Level", 3) == 0)       // There are various records of this type
+          choice = 'n';
+        else if (strncmp (word, "Phot", 4) == 0)        // There are various records of this type
+          choice = 'w';         // Macro Atom Phots are a subset of these (SS)
+        else if (strncmp (word, "Line", 4) == 0)
+          choice = 'r';
+        else if (strncmp (word, "LinMacro", 8) == 0)    //This indicates lines for a Macro Atom (SS)
+          choice = 'r';
+        else if (strncmp (word, "Frac", 4) == 0)
+          choice = 'f';         /*ground state fractions */
+        else if (strncmp (word, "Xcol", 4) == 0)
+          choice = 'x';         /*It's a collision strength line */
+//            else if (strncmp (word, "InPhot", 6) == 0)
+//              choice = 'A';   /*It's an inner shell ionization for Auger effect */
+        else if (strncmp (word, "InnerVYS", 8) == 0)
+          choice = 'I';         /*Its a set of inner shell photoionization cross sections */
+        else if (strncmp (word, "DR_BADNL", 8) == 0)    /* It's a badnell type dielectronic recombination file */
+          choice = 'D';
+        else if (strncmp (word, "DR_SHULL", 8) == 0)    /*its a schull type dielectronic recombination */
+          choice = 'S';
+        else if (strncmp (word, "RR_BADNL", 8) == 0)    /*Its a badnell type line in the total RR file */
+          choice = 'T';
+        else if (strncmp (word, "DI_DERE", 7) == 0)     /*Its a data file giving direct ionization rates from Dere (2007) */
+          choice = 'd';
+        else if (strncmp (word, "RR_SHULL", 8) == 0)    /*Its a shull type line in the total RR file */
+          choice = 's';
+        else if (strncmp (word, "BAD_GS_RR", 9) == 0)   /*Its a badnell resolved ground state RR file */
+          choice = 'G';
+        else if (strncmp (word, "FF_GAUNT", 8) == 0)    /*Its a data file giving the temperature averaged gaunt factors from Sutherland (1998) */
+          choice = 'g';
+        else if (strncmp (word, "Kelecyield", 10) == 0) /*Electron yield from inner shell ionization fro Kaastra and Mewe */
+          choice = 'K';
+        else if (strncmp (word, "Kphotyield", 10) == 0) /*Floruescent photon yield from IS ionization from Kaastra and Mewe */
+          choice = 'F';
+        else if (strncmp (word, "*", 1) == 0);  /* It's a continuation so record type remains same */
 
-  nlevels = nxphot = nphot_total = ntop_phot = nauger = ndrecomb = n_inner_tot = 0;     //Added counter for DR//
-  n_elec_yield_tot = n_fluor_yield_tot = 0;     //Counters for electron and fluorescent photon yields
+        else
+          choice = 'z';         /* Who knows what it is */
 
-  /*This initializes the top_phot array - it is used for all ionization processes so some elements
-     are only used in some circumstances
-   */
 
-  for (n = 0; n < NLEVELS; n++)
-  {
-    phot_top[n].nlev = (-1);
-    phot_top[n].uplev = (-1);
-    phot_top[n].nion = (-1);    //the ion to which this cross section belongs
-    phot_top[n].n_elec_yield = -1;      //pointer to the electron yield array (for inner shell)
-    phot_top[n].n_fluor_yield = -1;     //pointer to the fluorescent photon yield (for inner shell)
-    phot_top[n].n = -1;         //pointer to shell (inner shell)
-    phot_top[n].l = -1;         //pointer to l subshell (inner shell only)
-    phot_top[n].z = (-1);       //atomic number
-    phot_top[n].np = (-1);      //number of points in the fit
-    phot_top[n].macro_info = (-1);      //Initialise - don't know if using Macro Atoms or not: set to -1 (SS)
-    for (j = 0; j < NCROSS; j++)        //initialise the crooss sectiond
-    {
-      phot_top[n].freq[j] = (-1);
-      phot_top[n].x[j] = (-1);
-    }
-    phot_top[n].f = (-1);       //last frequency
-    phot_top[n].sigma = 0.0;    //last cross section
-  }
+        switch (choice)
+        {
+/**
+ * @section Elements
+ *
+ * A typical element has the following format
+ *
+ *  Element    6    C    8.56
+ *
+ * where 6 here refers to z of the elemnt, C is the name, and 8.56 is the abundance relative to H at 12
+ *
+ * */
+        case 'e':
+          if (sscanf (aline, "%*s %d %s %le", &ele[nelements].z, ele[nelements].name, &ele[nelements].abun) != 3)
+          {
+            Error ("Get_atomic_data: file %s line %d: Element line incorrectly formatted\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+          ele[nelements].abun = pow (10., ele[nelements].abun - 12.0);  /* Immediate replace by number density relative to H */
+          nelements++;
+          if (nelements > NELEMENTS)
+          {
+            Error ("getatomic_data: file %s line %d: More elements than allowed. Increase NELEMENTS in atomic.h\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+          break;
 
 
-  for (n = 0; n < NIONS * N_INNER; n++) //Initialise atomic arrasy with dimension NIONS*NINNER
-  {
-    inner_cross[n].nlev = (-1);
-    inner_cross[n].uplev = (-1);
-    inner_cross[n].nion = inner_elec_yield[n].nion = inner_fluor_yield[n].nion = (-1);
-    inner_cross[n].n_elec_yield = -1;
-    inner_cross[n].n_fluor_yield = -1;
-    inner_cross[n].n = inner_elec_yield[n].n = inner_fluor_yield[n].n = (-1);
-    inner_cross[n].l = inner_elec_yield[n].l = inner_fluor_yield[n].l = (-1);
-    inner_cross[n].z = inner_elec_yield[n].z = inner_fluor_yield[n].z = (-1);
-    inner_elec_yield[n].I = inner_elec_yield[n].Ea = 0.0;
-    inner_fluor_yield[n].freq = inner_fluor_yield[n].yield = 0.0;
-    for (j = 0; j < 10; j++)
-      inner_elec_yield[n].prob[j] = 0.0;
-    inner_cross[n].np = (-1);
-    inner_cross[n].macro_info = (-1);   //Initialise - don't know if using Macro Atoms or not: set to -1 (SS)
-    for (j = 0; j < NCROSS; j++)
-    {
-      inner_cross[n].freq[j] = (-1);
-      inner_cross[n].x[j] = (-1);
-    }
-    inner_cross[n].f = (-1);
-    inner_cross[n].sigma = 0.0;
-  }
+/**
+ * @section Ions
+ *
+ * Ions are specified with the keyword Ion.  A typical entry for ions looks like
+ *
+ *  @verbatim
+ *  IonV    C   6   4   2   64.49400 1000   10     1s^22s(2S_{1/2})
+ *  @endverbatim
+ *
+ * where C is the elment name, 6 is the elemnt z, 4 is the ionization state (in conventional
+ * astrophysics notation, 2 is the mulitplicity  of the ground state, and 1000 and 10 refer
+ * to maximum number of allowed LTE and nLTE configurations.  The configuration is not actually
+ * required and is for information only.
+ *
+ * @detail
+ *
+ * Note that keyword parsing is done only on the first 3 letters, so Ion and IonV are equivlalent
+ *
+ * The routine still supports an earlier format which consists of the first 6 "words" in which case
+ * default values are assigned to for the maximum number of LTE/simple and nLTE/macro atom configurations.
+ *
+ * @bug Exactly what is meant by LTE here needs clarification.  Is there code here that should
+ * be removed because we do not need the "earlier" format?
+ *
+ */
 
+        case 'i':
 
+          if ((nwords = sscanf (aline, "%*s %*s %d %d %le %le %d %d", &z, &istate, &gg, &p, &nmax, &nlte)) == 6)
+          {
+          }
+//OLD          // It's a new style ion line specifying levels to treat in nlte
+//OLD             else if (nwords == 4)
+//OLD               {           //It's an old style ion line
+//OLD                 nlte = 0;
+//OLD         nmax = 10;
+//OLD       }
+          else
+          {
+            Error ("get_atomic_data: file %s line %d: Ion istate line incorrectly formatted\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+// Now check that an element line for this ion has already been read
+          n = 0;
+          while (ele[n].z != z && n < nelements)
+            n++;
+          if (n == nelements)
+          {
 
+            Debug ("get_atomic_data: file %s line %d has ion for unknown element with z %d\n", file, lineno, z);
+            break;
+          }
 
-  for (i = 0; i < NLEVELS; i++)
-  {
-    config[i].n_bbu_jump = 0;   // initialising the number of jumps from each level to 0. (SS)
-    config[i].n_bbd_jump = 0;
-    config[i].n_bfu_jump = 0;
-    config[i].n_bfd_jump = 0;
-  }
+// Now populate the ion structure
 
-  for (n = 0; n < NLINES; n++)
-  {
-    line[n].freq = -1;
-    line[n].f = 0;
-    line[n].nion = -1;
-    line[n].gl = line[n].gu = 0;
-    line[n].el = line[n].eu = 0.0;
-    line[n].macro_info = -1;
-    line[n].coll_index = -999;
-  }
+          if (nlte > 0)
+          {                     // Then we want to consider some of these levels as non-lte
+            ion[nions].first_levden = nlte_levels;      /* This is the index to into
+                                                           the levden aray */
+            ion[nions].n_lte_max = nlte;        //Reserve this many elements of levden
+            nlte_levels += nlte;
+            if (nlte_levels > NLTE_LEVELS)
+            {
+              Error ("get_atomic_data: nlte_levels (%d) > NLTE_LEVELS (%d)\n", nlte_levels, NLTE_LEVELS);
+              exit (0);
+            }
 
-/* The following lines initialise the dielectronic recombination structure */
-  for (n = 0; n < NIONS; n++)
-  {
-    drecomb[n].nion = -1;
-    drecomb[n].nparam = -1;     //the number of parameters - it varies from ion to ion
-    for (n1 = 0; n1 < MAX_DR_PARAMS; n1++)
-    {
-      drecomb[n].c[n1] = 0.0;
-      drecomb[n].e[n1] = 0.0;
-    }
-  }
+          }
+          ion[nions].z = z;
+          ion[nions].istate = istate;
+          ion[nions].g = gg;
+          ion[nions].ip = p * EV2ERGS;
+          ion[nions].nmax = nmax;
+/* Use the keyword IonM to classify the ion as a macro-ion (IonM) or not (simply Ion) */
+          if (strncmp (word, "IonM", 4) == 0)
+          {
+            ion[nions].macro_info = 1;
+            nions_macro++;
+          }
+          else
+          {
+            ion[nions].macro_info = 0;
+            nions_simple++;
+          }
+          nions++;
+          if (nions == NIONS)
+          {
+            Error
+              ("getatomic_data: file %s line %d: %d ions is more than %d allowed. Increase NIONS in atomic.h\n",
+               file, lineno, nions, NIONS);
+            exit (0);
+          }
+          break;
 
+/**
+ * @section levels Levels or Configurations
+ *
+ * This version of get_atomicdata can read various types of configuration inputs, some of which should gradually be
+ * exsized from the program.  Originally, the idea was that Levels would immediately follow an ion, and in that case
+ * all that was need to describe a level, was a level number, a multiplicity, and an energy for the level.  An example
+ * of this type of line follows:
+ *
+ *  @verbatim
+ *  Ion	He	2	1	1	24.587  6 2
+ *  Level 1 1 0.0
+ *  Level 2 3 19.819
+ *  @endverbatim
+ *
+ * It is a requirement that when an OLDSTYLE line is used, it must immediately follow the ion.
+ *
+ * The second type of LEVEL style was developed solely to allow the levels to be disjoint from
+ * the ions.  Disjoint in this case implies that the level must follow the ion, but it does not
+ * have to be immediately after the ion line.
+ *
+ * It was developed to allow one to use levels developed from the Kurucz
+ * line list, and the new Verner level file.
+ *
+ * A typical KURUCZSTYLE record would look like:
+ *
+ *  @verbatim
+ *  Comment-- Ion H  1
+ *  \# There are 17 unique levels for 1 1
+ *  Level   1   1   0    2   0.000000
+ *  Level   1   1   1    2  10.200121
+ *  Level   1   1   2    4  10.200166
+ *  Level   1   1   3    2  12.089051
+ *  @endverbatim
+ * where the colums are z, istate (in conventianal notation), a unique level no,
+ * the multiplicity of the level and the exitation energy of the level in eV
+ *
+ *
+ *
+ * The new Topbase style records (created by py_parse_levels) look like this:
+ *
+ *
+ *  @verbatim
+ *  ======================================================================================
+ *  #      i NZ NE iSLP iLV iCONF                 E(RYD)      TE(RYD)   gi     EQN    RL(NS)
+ *  # ======================================================================================
+ *  # ======================================================================================
+ *  LevTop  1  1  200  1 -13.605698   0.000000  2  1.0000 1.00e+21 () 1s
+ *  LevTop  1  1  200  2  -3.401425  10.204273  2  2.0000 1.00e+21 () 2s
+ *  LevTop  1  1  211  1  -3.401425  10.204273  6  2.0000 1.60e-09 () 2p
+ *  LevTop  1  1  220  1  -1.511743  12.093955 10  3.0000 1.55e-08 () 3d
+ *  LevTop  1  1  200  3  -1.511743  12.093955  2  3.0000 1.59e-07 () 3s
+ *  LevTop  1  1  211  2  -1.511743  12.093955  6  3.0000 5.28e-09 () 3p
+ *  LevTop  2  1  100  1 -24.310389   0.000000  1  0.7481 1.00e+21 1s2
+ *  LevTop  2  1  300  1  -4.766334  19.544041  3  1.6895 1.00e+21 1s 2s
+ *  LevTop  2  1  100  2  -3.941516  20.368818  1  1.8579 1.00e+21 1s 2s
+ *  @endverbatim
+ *
+ * The details are:
+ *
+ * | Col | Name    | Description
+ * | --- | ------- | -----------
+ * | 2   |  NZ     | the atomic number of the level
+ * | 3   |  NE     | the ionization state according to the usual astronomical convention.
+ * |     |         | Note that Topbase uses the number of electrons but this is fixed in my reformatting program.
+ * | 4   | iSLP    | A coded version of the angular momentum
+ * | 5   | iLV     | The level number (starts with 1)
+ * | 6   | E(Ryd)  | The energy in eV  relative to the continuum
+ * | 7   | TE(Ryd) | The energy in ev  realative to the ground state
+ * | 8   | gi      | The multiplicity
+ * | 9   | eqn     | The equivalent quantum number  (Not necessarily an integer)
+ * | 10  | rl	     | The radiative lifetime
+ * | 11  | config  | A string showing the configuration
+ *
+ *
+ * \subsection matoms Macro Atoms (SS)
+ *
+ * When the macro atom method is to be used the level data should look like:
+ * e.g.
+ *
+ *  @verbatim
+ *  #         z ion lvl ion_pot   ex_energy  g  rad_rate
+ *  LevMacro  1  1  1 -13.605698   0.000000  2  1.00e+21 () n=1
+ *  LevMacro  1  1  2  -3.401425  10.204273  8  1.60e-09 () n=2
+ *  LevMacro  1  1  3  -1.511743  12.093955 18  1.00e-08 () n=3
+ *  LevMacro  1  1  4  -0.850356  12.755342 32  1.00e-08 () n=4
+ *  LevMacro  1  2  1   0.000000  13.605698  1  1.00e+21 () cnt
+ *  @endverbatim
+ *
+ *
+ * The details are:
+ *
+ * | Col | Name      | Description
+ * |---- | --------- | ------------
+ * | 2   | z         | Atomic number
+ * | 3   | ion       | Ionisation state (usual astronomical convention: neutral=1)
+ * | 4   | lvl       | An index for the level: this index must be assigned consistently in all the macro input files
+ * |     |           | (i.e. also in photoionisation data). Each level index in a particular ion must be unique.
+ * | 5   | ion_pot   | Ionisation potential (electron volts)
+ * | 6   | ex_energy | Excitation energy (electron volts). A consistent definition of energy=0 must be used for all ions of the same element:
+ * |     |           | ground state energy for the neutral species = 0.
+ * | 7   | g         | Statistical weight
+ * | 8   | rad_rate  | Radiative lifetime
+ * | 9   |           | A string giving a name for the level (not used by code)
+ *
+ *
+ * */
 
-/* The following lines initialise the badnell total radiative recombination rate structure */
-  for (n = 0; n < NIONS; n++)
-  {
-    total_rr[n].nion = -1;
-    for (n1 = 0; n1 < T_RR_PARAMS; n1++)
-    {
-      total_rr[n].params[n1] = 0.0;
-    }
 
-  }
+        case 'N':
+/*
+    It's a non-lte level, i.e. one for which we are going to calculate populations, at least for some number of these.
+	For these, we have to set aside space in the levden array in the plasma structure.  This is used for topbase
+	photoionization and macro atoms
+*/
 
+/* ?? ksl This mix and match situation may be too much.  We are storing both macro level densities and so-called
+topbase level densities in some of the same arrays in python.  Leave for now, but it may be difficult to keep
+the program working in both cases, and certainly mixed cases  04apr ksl  */
 
-/* The following lines initialise the badnell total radiative recombination rate structure */
-  for (n = 0; n < NIONS; n++)
-  {
-    bad_gs_rr[n].nion = -1;
-    for (n1 = 0; n1 < BAD_GS_RR_PARAMS; n1++)
-    {
-      bad_gs_rr[n].temps[n1] = 0.0;
-      bad_gs_rr[n].rates[n1] = 0.0;
-    }
+/* 080810 -- ksl -- 62 -- I have changed the way levels are created so that one can only read one type
+ * of levels for each ion.  Note also that all of the confiruations for a single ion need to be read together.
+ * It will be possible to read other types of records but one should not mix levels of different ions (This
+ * last bit is not actually new.
+ */
 
-  }
-  gstmin = 0.0;
-  gstmax = 1e99;
+          if (strncmp (word, "LevTop", 6) == 0)
+          {                     //Its a TOPBASESTYLE level
+            sscanf (aline,
+                    "%*s %d %d %d %d %le %le %le %le %le %15c \n", &zz, &iistate, &islp, &ilv, &e, &exx, &ggg, &qqnum, &rl, configname);
+            istate = iistate;
+            z = zz;
+            gg = ggg;
+            exx *= EV2ERGS;     // Convert energy above ground to ergs
+            mflag = -1;         //record that this is a LevTop not LevMacro read
+            lev_type = 2;       // It's a topbase record
+          }
 
+          else if (strncmp (word, "LevMacro", 8) == 0)
+          {                     //It's a Macro Atom level (SS)
+            sscanf (aline, "%*s %d %d %d %le %le %le %le %15c \n", &zz, &iistate, &ilv, &e, &exx, &ggg, &rl, configname);
+            islp = -1;          //these indices are not going to be used so just leave
+            qqnum = -1;         //them at -1
+            mflag = 1;          //record Macro read
+            lev_type = 1;       // It's a Macro record
+            istate = iistate;
+            z = zz;
+            gg = ggg;
+            exx *= EV2ERGS;     // Convert energy to ergs
+          }
+          else
+          {
+            Error ("get_atomic_data: file %s line %d: Level line incorrectly formatted\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+// Now check that the ion for this level is already known.  If not break out
+          n = 0;
+          while ((ion[n].z != z || ion[n].istate != istate) && n < nions)
+            n++;
+          if (n == nions)
+          {
 
-/* The following lines initialise the dere direct ionization rate struture */
-  for (n = 0; n < NIONS; n++)
-  {
-    dere_di_rate[n].nion = -1;
-    dere_di_rate[n].xi = 0.0;
-    dere_di_rate[n].min_temp = 1e99;
-    for (n1 = 0; n1 < DERE_DI_PARAMS; n1++)
-    {
-      dere_di_rate[n].temps[n1] = 0.0;
-      dere_di_rate[n].rates[n1] = 0.0;
-    }
+            Debug ("get_atomic_data: file %s line %d has level for unknown ion \n", file, lineno);
+            break;
+          }
 
-  }
+          /* Check that for a non-lte (macro atom) that the configuration level is not greater than was allowed for in the
+           * ion line
+           */
 
+          if (lev_type == 1 && ilv > ion[n].n_lte_max)
+          {
+            Error ("get_atomic_data: macro level %d ge %d for z %d  istate %d\n", ilv, ion[n].n_lte_max, ion[n].z, ion[n].istate);
+            //exit(0);
+            break;
+          }
 
+/*  So now we know that this level can be associated with an ion
 
+Now either set the type of level that will be used for this ion or set it if
+a level type has not been established
+		   */
 
-/* The following lines initialise the Sutherland gaunt factors */
-  gaunt_n_gsqrd = 0;            //The number of sets of scaled temperatures we have data for
-  for (n = 0; n < MAX_GAUNT_N_GSQRD; n++)
-  {
-    gaunt_total[n].log_gsqrd = 0.0;
-    gaunt_total[n].gff = 0.0;
-    gaunt_total[n].s1 = 0.0;
-    gaunt_total[n].s2 = 0.0;
-    gaunt_total[n].s3 = 0.0;
-  }
+          if (ion[n].lev_type == (-1))
+          {
+            ion[n].lev_type = lev_type;
+          }
+          else if (ion[n].lev_type != lev_type)
+          {
+            break;
+          }
 
+/*
+ Now check 1) if it was a LevMacro that there isn't already a LevTop (if there was then
+ something has gone wrong in the input order).
+ 2) if it was a LevTop that there wasn't already a LevMacro.If there was then ignore the new LevTop data
+ for this ion. (SS)
+*/
 
-/* The following lines initialise the collision strengths */
-  n_coll_stren = 0;             //The number of data sets
-  for (n = 0; n < NLINES; n++)
-  {
-    coll_stren[n].n = -1;       //Internal index
-    coll_stren[n].lower = -1;   //The lower energy level - this is in Chianti notation and is currently unused
-    coll_stren[n].upper = -1;   //The upper energy level - this is in Chianti notation and is currently unused
-    coll_stren[n].energy = 0.0; //The energy of the transition
-    coll_stren[n].gf = 0.0;
-    coll_stren[n].hi_t_lim = 0.0;       //The high temerature limit
-    coll_stren[n].n_points = 0.0;       //The number of points in the splie fit
-    coll_stren[n].type = -1;    //The type of fit, this defines how one computes the scaled temperature and scaled coll strength
-    coll_stren[n].scaling_param = 0.0;  //The scaling parameter C used in the Burgess and Tully calculations
-    for (n1 = 0; n1 < N_COLL_STREN_PTS; n1++)
-    {
-      coll_stren[n].sct[n1] = 0.0;      //The scaled temperature points in the fit
-      coll_stren[n].scups[n1] = 0.0;
-    }
-  }
 
+// Next steps should never happen; we have added a more robust mechanism to prevent any kind of mix and match above
+          if (ion[n].macro_info == 1 && mflag == -1)
+          {                     //it is already flagged as macro atom - current read is for LevTop - don't use it (SS)
+            Error ("Get_atomic_data: file %s  Ignoring LevTop data for ion %d - already using Macro Atom data\n", file, n);
+            break;
+          }
+          if (ion[n].macro_info == 0 && mflag == 1)
+          {                     //It is already flagged as simple atom and this is  before MacroAtom data - so ignore.  ksl
+            Error ("Get_atomic_data: file %s  Trying to read MacroAtom data after LevTop data for ion %d. Not allowed\n", file, n);
+            break;
+          }
 
 
-  choice = 'x';                 /* Start by assuming you cannot determine what kind of line it is */
-  nelements = 0;
-  nions = nions_simple = nions_macro = 0;
-  nlevels = nlevels_simple = nlevels_macro = 0;
-  ntop_phot_simple = ntop_phot_macro = 0;
-  nlte_levels = 0;
-  nlines = nlines_simple = nlines_macro = 0;
-  lineno = 0;
-  nxphot = 0;
-  nxcol = 0;
-/*mflag is set initially to 1, in order to establish that
-macro-lines need to be read in before any "simple" lines.  This
-is so that we can assure that the first lines in the line array
-are macro-lines.   It is important to recognize that the lin_ptr
-structure does not have this property! */
-  mflag = 1;
+          // case where data will be used (SS)
+          if (mflag == 1)
+          {
+            config[nlevels].macro_info = 1;
 
+            /* Extra check added here to be sure that the level emissivities used in the
+               detailed spectrum calculation won't get messed up. The next loop should
+               never trigger and can probably be deleted but I just want to check it for now.
+               SS June 04. */
 
-/* Completed all initialization */
+            if (nlevels_macro != nlevels)
+            {
+              Error ("get_atomicdata: Simple level has appeared before macro level. Not allowed.\n");
+              exit (0);
+            }
+            nlevels_macro++;
 
-  /* OK now we can try to read in the data from the data files */
+            if (nlevels_macro > NLEVELS_MACRO)
+            {
+              Error ("get_atomicdata: Too many macro atom levels. Increase NLEVELS_MACRO. Abort. \n");
+              exit (0);
+            }
+          }
+          else
+          {
+            config[nlevels].macro_info = 0;
+            nlevels_simple++;
+          }
 
-  if ((mptr = fopen (masterfile, "r")) == NULL)
-  {
-    Error ("Get_atomic_data:  Could not open masterfile %s\n", masterfile);
-    exit (0);
-  }
-  else
-  {
-    Log ("Get_atomicdata: Reading from masterfile %s\n", masterfile);
-  }
+          config[nlevels].z = z;
+          config[nlevels].istate = istate;
+          config[nlevels].isp = islp;
+          config[nlevels].ilv = ilv;
+          config[nlevels].nion = n;     //Internal index to ion structure
+          config[nlevels].q_num = qqnum;
+          config[nlevels].g = gg;
+          config[nlevels].ex = exx;
+          config[nlevels].rad_rate = rl;
+          /* SS Aug 2005
+             Previously, the line above set the rad_rate to 0 and is was never used.
+             Now I'm setting it to the radiative lifetime of the level.
+             It will now be used in the macro atom calculation - if the lifetime is
+             set to be long (infinite) in the input data, the level is assumed to be
+             collisional supported by the ground state (i.e. has the LTE excitation
+             fraction relative to ground).
+           */
 
-/* Open and read each line in the masterfile in turn */
 
-  while (fgets (aline, LINELENGTH, mptr) != NULL)
-  {
-    if (sscanf (aline, "%s", file) == 1 && file[0] != '#')
-    {
+          if (ion[n].n_lte_max > 0)
+          {                     // Then this ion wants nlte levels
+            if (ion[n].first_nlte_level < 0)
+            {                   // Then this is the first one that has been found
+              ion[n].first_nlte_level = nlevels;
+              ion[n].nlte = 1;
+              config[nlevels].nden = ion[n].first_levden;
+            }
+            else if (ion[n].n_lte_max > ion[n].nlte)
+            {
+              config[nlevels].nden = ion[n].first_levden + ion[n].nlte;
+              ion[n].nlte++;
+            }
+            else
+            {
+              config[nlevels].nden = -1;
+            }
+          }
+          else
+          {
+            config[nlevels].nden = -1;
+          }
 
-      /* Open one of the files designated in the masterfile and begin to read it */
 
-      if ((fptr = fopen (file, "r")) == NULL)
-      {
-        Error ("Get_atomic_data:  Could not open %s\n", file);
-        exit (0);
-      }
-      else
-      {
-        Log_silent ("Get_atomic_data: Now reading data from %s\n", file);
-        lineno = 1;
-      }
+/* Now associate this config with the levden array where appropriate.  The -1 is because ion[].nlte
+is already incremented
 
-      /* Main loop for reading each data file line by line */
+*/
 
-      while (fgets (aline, LINELENGTH, fptr) != NULL)
-      {
-        lineno++;
+          if (ion[n].firstlevel < 0)
+          {
+            ion[n].firstlevel = nlevels;
+            ion[n].nlevels = 1;
+          }
+          else
+            ion[n].nlevels++;
 
-        strcpy (word, "");      /*For reasons which are not clear, word needs to be reinitialized every time to
-                                   properly deal with blank lines */
 
-        if (sscanf (aline, "%s", word) == 0 || strlen (word) == 0)
-          choice = 'c';         /*It's a a blank line, treated like a comment */
-        else if (strncmp (word, "!", 1) == 0)
-          choice = 'c';
-        else if (strncmp (word, "#", 1) == 0)
-          choice = 'c';         /* It's a comment */
-        else if (strncmp (word, "CSTREN", 6) == 0)      //collision strengths
-          choice = 'C';
-        else if (strncmp (word, "Element", 5) == 0)
-          choice = 'e';
-        else if (strncmp (word, "Ion", 3) == 0)
-          choice = 'i';
-        else if (strncmp (word, "LevTop", 6) == 0)
-          choice = 'N';
-        else if (strncmp (word, "LevMacro", 8) == 0)    // This indicated leves for a Macro Atom (SS)
-          choice = 'N';
-        else if (strncmp (word, "Level", 3) == 0)       // There are various records of this type
-          choice = 'n';
-        else if (strncmp (word, "Phot", 4) == 0)        // There are various records of this type
-          choice = 'w';         // Macro Atom Phots are a subset of these (SS)
-        else if (strncmp (word, "Line", 4) == 0)
-          choice = 'r';
-        else if (strncmp (word, "LinMacro", 8) == 0)    //This indicates lines for a Macro Atom (SS)
-          choice = 'r';
-        else if (strncmp (word, "Frac", 4) == 0)
-          choice = 'f';         /*ground state fractions */
-        else if (strncmp (word, "Xcol", 4) == 0)
-          choice = 'x';         /*It's a collision strength line */
-//            else if (strncmp (word, "InPhot", 6) == 0)
-//              choice = 'A';   /*It's an inner shell ionization for Auger effect */
-        else if (strncmp (word, "InnerVYS", 8) == 0)
-          choice = 'I';         /*Its a set of inner shell photoionization cross sections */
-        else if (strncmp (word, "DR_BADNL", 8) == 0)    /* It's a badnell type dielectronic recombination file */
-          choice = 'D';
-        else if (strncmp (word, "DR_SHULL", 8) == 0)    /*its a schull type dielectronic recombination */
-          choice = 'S';
-        else if (strncmp (word, "RR_BADNL", 8) == 0)    /*Its a badnell type line in the total RR file */
-          choice = 'T';
-        else if (strncmp (word, "DI_DERE", 7) == 0)     /*Its a data file giving direct ionization rates from Dere (2007) */
-          choice = 'd';
-        else if (strncmp (word, "RR_SHULL", 8) == 0)    /*Its a shull type line in the total RR file */
-          choice = 's';
-        else if (strncmp (word, "BAD_GS_RR", 9) == 0)   /*Its a badnell resolved ground state RR file */
-          choice = 'G';
-        else if (strncmp (word, "FF_GAUNT", 8) == 0)    /*Its a data file giving the temperature averaged gaunt factors from Sutherland (1998) */
-          choice = 'g';
-        else if (strncmp (word, "Kelecyield", 10) == 0) /*Electron yield from inner shell ionization fro Kaastra and Mewe */
-          choice = 'K';
-        else if (strncmp (word, "Kphotyield", 10) == 0) /*Floruescent photon yield from IS ionization from Kaastra and Mewe */
-          choice = 'F';
-        else if (strncmp (word, "*", 1) == 0);  /* It's a continuation so record type remains same */
-
-        else
-          choice = 'z';         /* Who knows what it is */
 
+          nlevels++;
 
-        switch (choice)
-        {
-/**
- * @section Elements
- *
- * A typical element has the following format
- *
- *  Element    6    C    8.56
- *
- * where 6 here refers to z of the elemnt, C is the name, and 8.56 is the abundance relative to H at 12
- *
- * */
-        case 'e':
-          if (sscanf (aline, "%*s %d %s %le", &ele[nelements].z, ele[nelements].name, &ele[nelements].abun) != 3)
-          {
-            Error ("Get_atomic_data: file %s line %d: Element line incorrectly formatted\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-          ele[nelements].abun = pow (10., ele[nelements].abun - 12.0);  /* Immediate replace by number density relative to H */
-          nelements++;
-          if (nelements > NELEMENTS)
+          if (nlevels > nlevels_max)
           {
-            Error ("getatomic_data: file %s line %d: More elements than allowed. Increase NELEMENTS in atomic.h\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
+            Error ("getatomic_data: file %s line %d: More energy levels than were counted (%d)\n", file, lineno, nlevels_max);
             exit (0);
           }
           break;
 
+        case 'n':              // Its an "LTE" level
 
-/**
- * @section Ions
- *
- * Ions are specified with the keyword Ion.  A typical entry for ions looks like
- *
- *  @verbatim
- *  IonV    C   6   4   2   64.49400 1000   10     1s^22s(2S_{1/2})
- *  @endverbatim
- *
- * where C is the elment name, 6 is the elemnt z, 4 is the ionization state (in conventional
- * astrophysics notation, 2 is the mulitplicity  of the ground state, and 1000 and 10 refer
- * to maximum number of allowed LTE and nLTE configurations.  The configuration is not actually
- * required and is for information only.
- *
- * @detail
- *
- * Note that keyword parsing is done only on the first 3 letters, so Ion and IonV are equivlalent
- *
- * The routine still supports an earlier format which consists of the first 6 "words" in which case
- * default values are assigned to for the maximum number of LTE/simple and nLTE/macro atom configurations.
- *
- * @bug Exactly what is meant by LTE here needs clarification.  Is there code here that should
- * be removed because we do not need the "earlier" format?
- *
- */
-
-        case 'i':
+          if (sscanf (aline, "%*s %d %d %d %le %le\n", &zz, &iistate, &qnum, &gg, &exx) == 5)   //IT's KURUCZSTYLE
+          {
+            istate = iistate;
+            z = zz;
+            exx *= EV2ERGS;
+            qqnum = ilv = qnum;
+            lev_type = 0;       // It's a Kurucz-style record
 
-          if ((nwords = sscanf (aline, "%*s %*s %d %d %le %le %d %d", &z, &istate, &gg, &p, &nmax, &nlte)) == 6)
+          }
+          else                  // Read an OLDSTYLE level description
+          if (sscanf (aline, "%*s  %d %le %le\n", &qnum, &gg, &exx) == 3)
           {
+            exx *= EV2ERGS;
+            qqnum = ilv = qnum;
+            lev_type = -2;      // It's an old style record, one which is only here for backward compatibility
           }
-//OLD          // It's a new style ion line specifying levels to treat in nlte
-//OLD             else if (nwords == 4)
-//OLD               {           //It's an old style ion line
-//OLD                 nlte = 0;
-//OLD         nmax = 10;
-//OLD       }
           else
           {
-            Error ("get_atomic_data: file %s line %d: Ion istate line incorrectly formatted\n", file, lineno);
+            Error ("get_atomic_data: file %s line %d: Level line incorrectly formatted\n", file, lineno);
             Error ("Get_atomic_data: %s\n", aline);
             exit (0);
           }
-// Now check that an element line for this ion has already been read
+/* Check whether the ion for this level is known.  If not, skip the level */
+
+// Next section is identical already to case N
           n = 0;
-          while (ele[n].z != z && n < nelements)
+          while ((ion[n].z != z || ion[n].istate != istate) && n < nions)
             n++;
-          if (n == nelements)
+          if (n == nions)
           {
 
-            Debug ("get_atomic_data: file %s line %d has ion for unknown element with z %d\n", file, lineno, z);
+            Debug ("get_atomic_data: file %s line %d has level for unknown ion \n", file, lineno);
             break;
+
           }
 
-// Now populate the ion structure
+          /* Now either set the type of level that will be used for this ion or set it if
+           * a level type has not been established
+           */
 
-          if (nlte > 0)
-          {                     // Then we want to consider some of these levels as non-lte
-            ion[nions].first_levden = nlte_levels;      /* This is the index to into
-                                                           the levden aray */
-            ion[nions].n_lte_max = nlte;        //Reserve this many elements of levden
-            nlte_levels += nlte;
-            if (nlte_levels > NLTE_LEVELS)
-            {
-              Error ("get_atomic_data: nlte_levels (%d) > NLTE_LEVELS (%d)\n", nlte_levels, NLTE_LEVELS);
-              exit (0);
-            }
+          if (ion[n].lev_type == (-1))
+          {
+            ion[n].lev_type = lev_type;
+          }
+          else if (ion[n].lev_type != lev_type)
+          {
 
+            break;
           }
-          ion[nions].z = z;
-          ion[nions].istate = istate;
-          ion[nions].g = gg;
-          ion[nions].ip = p * EV2ERGS;
-          ion[nions].nmax = nmax;
-/* Use the keyword IonM to classify the ion as a macro-ion (IonM) or not (simply Ion) */
-          if (strncmp (word, "IonM", 4) == 0)
+//  End section known to be idential to case N
+
+
+/* Check whether this is a macro-ion.  If it is a macro-ion, but the level appears to be described as a
+simple level (i.e without a keyword LeVMacro), then skip it, since a macro-ion has to have all the levels
+described as macro-levels. */
+          if (ion[n].macro_info == 1)
           {
-            ion[nions].macro_info = 1;
-            nions_macro++;
+            Error ("get_atomic_data: file %s line %d has simple level for ion[%d], which is a macro-ion\n", file, lineno, n);
+            break;
           }
-          else
+/* Check to prevent one from adding simple levels to an ionized that already has some nlte levels.  Note that
+   an ion may have simple levels, i.e. levels with no entries in the plasma structure levden array, but this
+   will only be the case if there are too many of this type of level.
+*/
+          if (ion[n].nlte > 0)
           {
-            ion[nions].macro_info = 0;
-            nions_simple++;
+            Error ("get_atomic_data:  file %s line %d has simple level for ion[%d], which has non_lte_levels\n", file, lineno, n);
+            break;
           }
-          nions++;
-          if (nions == NIONS)
+
+/*  Check whether we already have too many levels specified for this ion. If so, skip */
+          if (ion[n].nmax == ion[n].nlevels)
           {
-            Error
-              ("getatomic_data: file %s line %d: %d ions is more than %d allowed. Increase NIONS in atomic.h\n",
-               file, lineno, nions, NIONS);
+
+            Debug ("get_atomic_data: file %s line %d has level exceeding the number allowed for ion[%d]\n", file, lineno, n);
+
+            break;
+          }
+//  So now we know that this level can be associated with an ion
+
+          config[nlevels].z = z;
+          config[nlevels].istate = istate;
+          config[nlevels].isp = islp;
+          config[nlevels].ilv = ilv;
+          config[nlevels].nion = n;     //Internal index to ion structure
+          config[nlevels].q_num = qqnum;
+          config[nlevels].g = gg;
+          config[nlevels].ex = exx;
+          if (ion[n].firstlevel < 0)
+          {
+            ion[n].firstlevel = nlevels;
+            ion[n].nlevels = 1;
+          }
+          else
+            ion[n].nlevels++;
+
+
+/* Now declare that this level has no corresponding element in the levden array which is part
+   of the plasma stucture.  To do this set config[].ndent to -1
+*/
+
+          config[nlevels].nden = -1;
+
+          config[nlevels].rad_rate = 0.0;       // ?? Set emission oscillator strength for the level to zero
+
+          nlevels_simple++;
+          nlevels++;
+          if (nlevels > nlevels_max)
+          {
+            Error ("getatomic_data: file %s line %d: More energy levels than were counted (%d)\n", file, lineno, nlevels_max);
             exit (0);
           }
           break;
 
+
+
 /**
- * @section levels Levels or Configurations
+ * @section  Photoionization
  *
- * This version of get_atomicdata can read various types of configuration inputs, some of which should gradually be
- * exsized from the program.  Originally, the idea was that Levels would immediately follow an ion, and in that case
- * all that was need to describe a level, was a level number, a multiplicity, and an energy for the level.  An example
- * of this type of line follows:
+ * Until at least Oct 2001, Python used photoionization crossections from Verner, Ferland, Korista, and Yakolev (DFKY)
+ * The routine sigma_phot(xptr, freq) calculates the crossection based on this.
  *
- *  @verbatim
- *  Ion	He	2	1	1	24.587  6 2
- *  Level 1 1 0.0
- *  Level 2 3 19.819
- *  @endverbatim
  *
- * It is a requirement that when an OLDSTYLE line is used, it must immediately follow the ion.
+ * The original topbase records look like this
  *
- * The second type of LEVEL style was developed solely to allow the levels to be disjoint from
- * the ions.  Disjoint in this case implies that the level must follow the ion, but it does not
- * have to be immediately after the ion line.
+ * @verbatim
+ *  ================================================
+ *        I  NZ  NE  ISLP  ILV        E(RYD)      NP
+ *  ================================================
+ *        1   2   1   200    1  -4.00000E+00     101
+ *   3.960000E+00 1.619E+00
+ *   4.000000E+00 1.576E+00
+ *   4.101260E+00 1.474E+00
+ *   4.205084E+00 1.379E+00
+ *   4.311536E+00 1.289E+00
+ *   4.420684E+00 1.206E+00
+ * @endverbatim
  *
- * It was developed to allow one to use levels developed from the Kurucz
- * line list, and the new Verner level file.
+ * They are converted to something that is more compatible with Topbase
+ * by py_top_phot
  *
- * A typical KURUCZSTYLE record would look like:
- *
- *  @verbatim
- *  Comment-- Ion H  1
- *  \# There are 17 unique levels for 1 1
- *  Level   1   1   0    2   0.000000
- *  Level   1   1   1    2  10.200121
- *  Level   1   1   2    4  10.200166
- *  Level   1   1   3    2  12.089051
- *  @endverbatim
- * where the colums are z, istate (in conventianal notation), a unique level no,
- * the multiplicity of the level and the exitation energy of the level in eV
- *
- *
- *
- * The new Topbase style records (created by py_parse_levels) look like this:
- *
- *
- *  @verbatim
- *  ======================================================================================
- *  #      i NZ NE iSLP iLV iCONF                 E(RYD)      TE(RYD)   gi     EQN    RL(NS)
- *  # ======================================================================================
- *  # ======================================================================================
- *  LevTop  1  1  200  1 -13.605698   0.000000  2  1.0000 1.00e+21 () 1s
- *  LevTop  1  1  200  2  -3.401425  10.204273  2  2.0000 1.00e+21 () 2s
- *  LevTop  1  1  211  1  -3.401425  10.204273  6  2.0000 1.60e-09 () 2p
- *  LevTop  1  1  220  1  -1.511743  12.093955 10  3.0000 1.55e-08 () 3d
- *  LevTop  1  1  200  3  -1.511743  12.093955  2  3.0000 1.59e-07 () 3s
- *  LevTop  1  1  211  2  -1.511743  12.093955  6  3.0000 5.28e-09 () 3p
- *  LevTop  2  1  100  1 -24.310389   0.000000  1  0.7481 1.00e+21 1s2
- *  LevTop  2  1  300  1  -4.766334  19.544041  3  1.6895 1.00e+21 1s 2s
- *  LevTop  2  1  100  2  -3.941516  20.368818  1  1.8579 1.00e+21 1s 2s
- *  @endverbatim
- *
- * The details are:
- *
- * | Col | Name    | Description
- * | --- | ------- | -----------
- * | 2   |  NZ     | the atomic number of the level
- * | 3   |  NE     | the ionization state according to the usual astronomical convention.
- * |     |         | Note that Topbase uses the number of electrons but this is fixed in my reformatting program.
- * | 4   | iSLP    | A coded version of the angular momentum
- * | 5   | iLV     | The level number (starts with 1)
- * | 6   | E(Ryd)  | The energy in eV  relative to the continuum
- * | 7   | TE(Ryd) | The energy in ev  realative to the ground state
- * | 8   | gi      | The multiplicity
- * | 9   | eqn     | The equivalent quantum number  (Not necessarily an integer)
- * | 10  | rl	     | The radiative lifetime
- * | 11  | config  | A string showing the configuration
- *
- *
- * \subsection matoms Macro Atoms (SS)
+ * The new topbase style records look like this.
  *
- * When the macro atom method is to be used the level data should look like:
- * e.g.
+ * @verbatim
+ * PhotTopS  2  1 200    1    54.422791 101
+ * PhotTop    54.422791 1.576e-18
+ * PhotTop    66.508772 9.197e-19
+ * PhotTop    78.594753 5.817e-19
+ * PhotTop    90.680734 3.906e-19
+ * PhotTop   102.766715 2.746e-19
+ * PhotTop   114.852696 2.001e-19
+ * PhotTop   126.938677 1.502e-19
+ * PhotTop   139.024658 1.155e-19
+ * PhotTop   151.110639 9.057e-20
+ * @endverbatim
  *
- *  @verbatim
- *  #         z ion lvl ion_pot   ex_energy  g  rad_rate
- *  LevMacro  1  1  1 -13.605698   0.000000  2  1.00e+21 () n=1
- *  LevMacro  1  1  2  -3.401425  10.204273  8  1.60e-09 () n=2
- *  LevMacro  1  1  3  -1.511743  12.093955 18  1.00e-08 () n=3
- *  LevMacro  1  1  4  -0.850356  12.755342 32  1.00e-08 () n=4
- *  LevMacro  1  2  1   0.000000  13.605698  1  1.00e+21 () cnt
- *  @endverbatim
+ * The main changes from the original records are that energy levels
+ * have been converted to eV, cross sections to cm**2, and the electron
+ * number has been converted to conventional astronomical notiation
+ * for the ionstate.
  *
+ * ### Macro atoms (SS)
  *
- * The details are:
+ * For the Macro Atom method the input photoionisation data should look like
+ * (one entry for every photoionisation process):
  *
- * | Col | Name      | Description
- * |---- | --------- | ------------
- * | 2   | z         | Atomic number
- * | 3   | ion       | Ionisation state (usual astronomical convention: neutral=1)
- * | 4   | lvl       | An index for the level: this index must be assigned consistently in all the macro input files
- * |     |           | (i.e. also in photoionisation data). Each level index in a particular ion must be unique.
- * | 5   | ion_pot   | Ionisation potential (electron volts)
- * | 6   | ex_energy | Excitation energy (electron volts). A consistent definition of energy=0 must be used for all ions of the same element:
- * |     |           | ground state energy for the neutral species = 0.
- * | 7   | g         | Statistical weight
- * | 8   | rad_rate  | Radiative lifetime
- * | 9   |           | A string giving a name for the level (not used by code)
+ * @verbatim
+ * z  ion ll ul   threshold  npts
+ * PhotMacS  1  1  1  1    13.605698  50
+ * PhotMac    13.605698 6.304e-18
+ * PhotMac    16.627193 3.679e-18
+ * PhotMac    19.648688 2.327e-18
+ * PhotMac    22.670183 1.563e-18
+ * PhotMac    25.691679 1.098e-18
+ * PhotMac    28.713174 8.004e-19
+ * PhotMac    31.734669 6.006e-19
+ * PhotMac    34.756165 4.618e-19
+ * @endverbatim
  *
+ * Details for the first row of each entry:
+ * | Col | Name  | Description
+ * | --- | ----- | -----------
+ * | 2   | z     | Atomic number
+ * | 3   | ion   | Ionisation stage (astronomical convention): LOWER ION (i.e. the one that GETS IONISED)
+ * |     |       | it is always assumed that the upper stage is this+1!
+ * | 4   | ll    | index for the level in the LOWER ION (must match the index given to the level in input level data)
+ * | 5   | ul    | index for the level in the UPPER ION (must match the index given to the level in the input level data)
+ * | 6   | thresh| threshold energy of edge (in eV)
+ * | 7   | npts  | number of data points in the following table
  *
- * */
+ * * Then follows the table of energy and cross-section values (same as TopBase above)
+ * * 04dec	ksl	Modified this section so that "unknown" level information is skipped so that
+ *   		one need modify only the higher level elements_ions file
+ */
 
+        case 'w':
+          if (strncmp (word, "PhotMacS", 8) == 0)
+          {
+            // It's a Macro atom entry - similar format to TOPBASE - see below (SS)
+            sscanf (aline, "%*s %d %d %d %d %le %d\n", &z, &istate, &levl, &levu, &exx, &np);
+            islp = -1;
+            ilv = -1;
 
-        case 'N':
-/*
-    It's a non-lte level, i.e. one for which we are going to calculate populations, at least for some number of these.
-	For these, we have to set aside space in the levden array in the plasma structure.  This is used for topbase
-	photoionization and macro atoms
-*/
+            for (n = 0; n < np; n++)
+            {
+              //Read the photo. records but do nothing with them until verifyina a valid level
+              if (fgets (aline, LINELENGTH, fptr) == NULL)
+              {
+                Error ("Get_atomic_data: Problem reading topbase photoionization record\n");
+                Error ("Get_atomic_data: %s\n", aline);
+                exit (0);
+              }
+              sscanf (aline, "%*s %le %le", &xe[n], &xx[n]);
+              lineno++;
+            }
 
-/* ?? ksl This mix and match situation may be too much.  We are storing both macro level densities and so-called
-topbase level densities in some of the same arrays in python.  Leave for now, but it may be difficult to keep
-the program working in both cases, and certainly mixed cases  04apr ksl  */
+            // Locate upper state
+            n = 0;
+            while ((config[n].z != z || config[n].istate != (istate + 1)        //note that the upper config will (SS)
+                    || config[n].ilv != levu) && n < nlevels)   //be the next ion up (istate +1) (SS)
+              n++;
+            if (n == nlevels)
+            {
+              Error_silent ("get_atomic_data: No configuration found to match upper state for phot. line %d\n", lineno);
+              break;            //Need to match the configuration for macro atoms - break if not found.
+            }
 
-/* 080810 -- ksl -- 62 -- I have changed the way levels are created so that one can only read one type
- * of levels for each ion.  Note also that all of the confiruations for a single ion need to be read together.
- * It will be possible to read other types of records but one should not mix levels of different ions (This
- * last bit is not actually new.
- */
 
-          if (strncmp (word, "LevTop", 6) == 0)
-          {                     //Its a TOPBASESTYLE level
-            sscanf (aline,
-                    "%*s %d %d %d %d %le %le %le %le %le %15c \n", &zz, &iistate, &islp, &ilv, &e, &exx, &ggg, &qqnum, &rl, configname);
-            istate = iistate;
-            z = zz;
-            gg = ggg;
-            exx *= EV2ERGS;     // Convert energy above ground to ergs
-            mflag = -1;         //record that this is a LevTop not LevMacro read
-            lev_type = 2;       // It's a topbase record
-          }
+            // Locate lower state
+            m = 0;
+            while ((config[m].z != z || config[m].istate != istate      //Now searching for the lower
+                    || config[m].ilv != levl) && m < nlevels)   //configuration (SS)
+              m++;
+            if (m == nlevels)
+            {
+              Error_silent ("get_atomic_data: No configuration found to match lower state for phot. line %d\n", lineno);
+              break;            //Need to match the configuration for macro atoms - break if not found.
+            }
 
-          else if (strncmp (word, "LevMacro", 8) == 0)
-          {                     //It's a Macro Atom level (SS)
-            sscanf (aline, "%*s %d %d %d %le %le %le %le %15c \n", &zz, &iistate, &ilv, &e, &exx, &ggg, &rl, configname);
-            islp = -1;          //these indices are not going to be used so just leave
-            qqnum = -1;         //them at -1
-            mflag = 1;          //record Macro read
-            lev_type = 1;       // It's a Macro record
-            istate = iistate;
-            z = zz;
-            gg = ggg;
-            exx *= EV2ERGS;     // Convert energy to ergs
-          }
-          else
-          {
-            Error ("get_atomic_data: file %s line %d: Level line incorrectly formatted\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-// Now check that the ion for this level is already known.  If not break out
-          n = 0;
-          while ((ion[n].z != z || ion[n].istate != istate) && n < nions)
-            n++;
-          if (n == nions)
-          {
+            // Populate upper state info
+            phot_top[ntop_phot].uplev = n;      //store the level in the upper ion (SS)
+            config[n].bfd_jump[config[n].n_bfd_jump] = ntop_phot;       //record the line index as a downward bf Macro Atom jump (SS)
+            phot_top[ntop_phot].down_index = config[n].n_bfd_jump;      //record jump index in the photoionization structure
+            config[n].n_bfd_jump += 1;  //note that there is one more downwards bf jump available (SS)
+            if (config[n].n_bfd_jump > NBFJUMPS)
+            {
+              Error ("get_atomic_data: Too many downward b-f jump for ion %d\n", config[n].istate);
+              exit (0);
+            }
 
-            Debug ("get_atomic_data: file %s line %d has level for unknown ion \n", file, lineno);
-            break;
-          }
 
-          /* Check that for a non-lte (macro atom) that the configuration level is not greater than was allowed for in the
-           * ion line
-           */
+            // Populate lower state info
+            phot_top[ntop_phot].nlev = m;       //store lower configuration then find upper configuration(SS)
+            config[m].bfu_jump[config[m].n_bfu_jump] = ntop_phot;       //record the line index as an upward bf Macro Atom jump (SS)
+            phot_top[ntop_phot].up_index = config[m].n_bfu_jump;        //record the jump index in the photoionization structure
+            config[m].n_bfu_jump += 1;  //note that there is one more upwards bf jump available (SS)
+            if (config[m].n_bfu_jump > NBFJUMPS)
+            {
+              Error ("get_atomic_data: Too many upward b-f jump for ion %d\n", config[m].istate);
+              exit (0);
+            }
 
-          if (lev_type == 1 && ilv > ion[n].n_lte_max)
-          {
-            Error ("get_atomic_data: macro level %d ge %d for z %d  istate %d\n", ilv, ion[n].n_lte_max, ion[n].z, ion[n].istate);
-            //exit(0);
-            break;
-          }
 
-/*  So now we know that this level can be associated with an ion
+            phot_top[ntop_phot].nion = config[m].nion;
+            phot_top[ntop_phot].z = z;
+            phot_top[ntop_phot].istate = istate;
+            phot_top[ntop_phot].np = np;
+            phot_top[ntop_phot].macro_info = 1;
 
-Now either set the type of level that will be used for this ion or set it if
-a level type has not been established
-		   */
+            if (ion[config[m].nion].phot_info == -1)
+            {
+              ion[config[m].nion].phot_info = 1;        /* Mark this ion as using TOPBASE photo */
+              ion[config[m].nion].ntop_first = ntop_phot;
+            }
 
-          if (ion[n].lev_type == (-1))
-          {
-            ion[n].lev_type = lev_type;
-          }
-          else if (ion[n].lev_type != lev_type)
-          {
-            break;
-          }
-
-/*
- Now check 1) if it was a LevMacro that there isn't already a LevTop (if there was then
- something has gone wrong in the input order).
- 2) if it was a LevTop that there wasn't already a LevMacro.If there was then ignore the new LevTop data
- for this ion. (SS)
-*/
-
-
-// Next steps should never happen; we have added a more robust mechanism to prevent any kind of mix and match above
-          if (ion[n].macro_info == 1 && mflag == -1)
-          {                     //it is already flagged as macro atom - current read is for LevTop - don't use it (SS)
-            Error ("Get_atomic_data: file %s  Ignoring LevTop data for ion %d - already using Macro Atom data\n", file, n);
-            break;
-          }
-          if (ion[n].macro_info == 0 && mflag == 1)
-          {                     //It is already flagged as simple atom and this is  before MacroAtom data - so ignore.  ksl
-            Error ("Get_atomic_data: file %s  Trying to read MacroAtom data after LevTop data for ion %d. Not allowed\n", file, n);
-            break;
-          }
-
-
-          // case where data will be used (SS)
-          if (mflag == 1)
-          {
-            config[nlevels].macro_info = 1;
-
-            /* Extra check added here to be sure that the level emissivities used in the
-               detailed spectrum calculation won't get messed up. The next loop should
-               never trigger and can probably be deleted but I just want to check it for now.
-               SS June 04. */
-
-            if (nlevels_macro != nlevels)
+            /* next line sees if the topbase level just read in is the ground state -
+               if it is, the ion structure element ntop_ground is set to that topbase level number
+               note that m is the lower level here */
+            if (m == config[ion[config[n].nion].first_nlte_level].ilv)
             {
-              Error ("get_atomicdata: Simple level has appeared before macro level. Not allowed.\n");
-              exit (0);
+              ion[config[n].nion].ntop_ground = ntop_phot;
             }
-            nlevels_macro++;
 
-            if (nlevels_macro > NLEVELS_MACRO)
+            ion[config[m].nion].ntop++;
+
+            // Finish up this section by storing the photionization data properly
+
+            alloc_xsection (&phot_top[ntop_phot], np);
+            for (n = 0; n < np; n++)
             {
-              Error ("get_atomicdata: Too many macro atom levels. Increase NLEVELS_MACRO. Abort. \n");
-              exit (0);
+              phot_top[ntop_phot].freq[n] = xe[n] * EV2ERGS / H;        // convert from eV to freqency
+              phot_top[ntop_phot].x[n] = xx[n]; // leave cross sections in  CGS
             }
-          }
-          else
-          {
-            config[nlevels].macro_info = 0;
-            nlevels_simple++;
-          }
+            if (phot_freq_min > phot_top[ntop_phot].freq[0])
+              phot_freq_min = phot_top[ntop_phot].freq[0];
 
-          config[nlevels].z = z;
-          config[nlevels].istate = istate;
-          config[nlevels].isp = islp;
-          config[nlevels].ilv = ilv;
-          config[nlevels].nion = n;     //Internal index to ion structure
-          config[nlevels].q_num = qqnum;
-          config[nlevels].g = gg;
-          config[nlevels].ex = exx;
-          config[nlevels].rad_rate = rl;
-          /* SS Aug 2005
-             Previously, the line above set the rad_rate to 0 and is was never used.
-             Now I'm setting it to the radiative lifetime of the level.
-             It will now be used in the macro atom calculation - if the lifetime is
-             set to be long (infinite) in the input data, the level is assumed to be
-             collisional supported by the ground state (i.e. has the LTE excitation
-             fraction relative to ground).
-           */
 
+            ntop_phot_macro++;
+            ntop_phot++;
+            nphot_total++;
 
-          if (ion[n].n_lte_max > 0)
-          {                     // Then this ion wants nlte levels
-            if (ion[n].first_nlte_level < 0)
-            {                   // Then this is the first one that has been found
-              ion[n].first_nlte_level = nlevels;
-              ion[n].nlte = 1;
-              config[nlevels].nden = ion[n].first_levden;
-            }
-            else if (ion[n].n_lte_max > ion[n].nlte)
-            {
-              config[nlevels].nden = ion[n].first_levden + ion[n].nlte;
-              ion[n].nlte++;
-            }
-            else
+            if (nphot_total > nphot_max)
             {
-              config[nlevels].nden = -1;
+              Error ("get_atomicdata: More macro photoionization cross sections than were counted (%d)\n", nphot_max);
+              exit (0);
             }
+            break;
           }
-          else
-          {
-            config[nlevels].nden = -1;
-          }
-
 
-/* Now associate this config with the levden array where appropriate.  The -1 is because ion[].nlte
-is already incremented
 
-*/
 
-          if (ion[n].firstlevel < 0)
+          else if (strncmp (word, "PhotTopS", 8) == 0)
           {
-            ion[n].firstlevel = nlevels;
-            ion[n].nlevels = 1;
-          }
-          else
-            ion[n].nlevels++;
+            // It's a TOPBASE style photoionization record, beginning with the summary record
+            sscanf (aline, "%*s %d %d %d %d %le %d\n", &z, &istate, &islp, &ilv, &exx, &np);
+            for (n = 0; n < np; n++)
+            {                   //Read the topbase photoionization records
+              if (fgets (aline, LINELENGTH, fptr) == NULL)
+              {
+                Error ("Get_atomic_data: Problem reading topbase photoionization record\n");
+                Error ("Get_atomic_data: %s\n", aline);
+                exit (0);
+              }
+              sscanf (aline, "%*s %le %le", &xe[n], &xx[n]);
+              lineno++;
 
+            }
 
+            n = 0;
 
-          nlevels++;
 
-          if (nlevels > NLEVELS)
-          {
-            Error ("getatomic_data: file %s line %d: More energy levels than allowed. Increase NLEVELS in atomic.h\n", file, lineno);
-            exit (0);
-          }
-          break;
+            /* additional check to assure that records were
+             * only matched with levels whose density was being tracked in levden.  This
+             * is now necesary since a change was made to use topbase levels for calculating
+             * partition functions
+             */
 
-        case 'n':              // Its an "LTE" level
+            while ((config[n].nden == -1
+                    || config[n].z != z || config[n].istate != istate || config[n].isp != islp || config[n].ilv != ilv) && n < nlevels)
+              n++;
+            if (n == nlevels)
+            {
 
-          if (sscanf (aline, "%*s %d %d %d %le %le\n", &zz, &iistate, &qnum, &gg, &exx) == 5)   //IT's KURUCZSTYLE
-          {
-            istate = iistate;
-            z = zz;
-            exx *= EV2ERGS;
-            qqnum = ilv = qnum;
-            lev_type = 0;       // It's a Kurucz-style record
+              Debug ("No level found to match PhotTop data in file %s on line %d. Data ignored.\n", file, lineno);
+              break;            // There was no pre-existing ion
+            }
+            if (ion[config[n].nion].macro_info == 0)    //this is not a macro atom level (SS)
+            {
+              phot_top[ntop_phot].nlev = n;     // level associated with this crossection.
+              phot_top[ntop_phot].nion = config[n].nion;
+              phot_top[ntop_phot].z = z;
+              phot_top[ntop_phot].istate = istate;
+              phot_top[ntop_phot].np = np;
+              phot_top[ntop_phot].macro_info = 0;
 
-          }
-          else                  // Read an OLDSTYLE level description
-          if (sscanf (aline, "%*s  %d %le %le\n", &qnum, &gg, &exx) == 3)
-          {
-            exx *= EV2ERGS;
-            qqnum = ilv = qnum;
-            lev_type = -2;      // It's an old style record, one which is only here for backward compatibility
-          }
-          else
-          {
-            Error ("get_atomic_data: file %s line %d: Level line incorrectly formatted\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-/* Check whether the ion for this level is known.  If not, skip the level */
+              /* next line sees if the topbase level just read in is the ground state -
+                 if it is, the ion structure element ntop_ground is set to that topbase level number */
+              if (islp == config[ion[config[n].nion].first_nlte_level].isp && ilv == config[ion[config[n].nion].first_nlte_level].ilv)
+              {
+                ion[config[n].nion].ntop_ground = ntop_phot;
+              }
 
-// Next section is identical already to case N
-          n = 0;
-          while ((ion[n].z != z || ion[n].istate != istate) && n < nions)
-            n++;
-          if (n == nions)
-          {
 
-            Debug ("get_atomic_data: file %s line %d has level for unknown ion \n", file, lineno);
-            break;
+              if (ion[config[n].nion].phot_info == -1)
+              {
+                ion[config[n].nion].phot_info = 1;      /* Mark this ion as using TOPBASE photo */
+                ion[config[n].nion].ntop_first = ntop_phot;
 
-          }
+              }
+              else if (ion[config[n].nion].phot_info == (0))
+              {
+                Error
+                  ("Get_atomic_data: file %s VFKY and Topbase photoionization x-sections in wrong order for nion %d\n",
+                   file, config[n].nion);
+                Error ("             Read topbase x-sections before VFKY if using both types!!\n");
+                exit (0);
+              }
+              ion[config[n].nion].ntop++;
+              alloc_xsection (&phot_top[ntop_phot], np);
+              for (n = 0; n < np; n++)
+              {
+                phot_top[ntop_phot].freq[n] = xe[n] * EV2ERGS / H;      // convert from eV to freqency
 
-          /* Now either set the type of level that will be used for this ion or set it if
-           * a level type has not been established
-           */
+                phot_top[ntop_phot].x[n] = xx[n];       // leave cross sections in  CGS
+              }
+              if (phot_freq_min > phot_top[ntop_phot].freq[0])
+                phot_freq_min = phot_top[ntop_phot].freq[0];
 
-          if (ion[n].lev_type == (-1))
-          {
-            ion[n].lev_type = lev_type;
-          }
-          else if (ion[n].lev_type != lev_type)
-          {
 
+              ntop_phot_simple++;
+              ntop_phot++;
+              nphot_total++;
+
+              /* check to assure we did not exceed the allowed number of photoionization records */
+              if (nphot_total > nphot_max)
+              {
+                Error ("get_atomicdata: More TopBase photoionization cross sections than were counted (%d)\n", nphot_max);
+                exit (0);
+              }
+            }
+            else
+            {
+              Error
+                ("Get_atomic_data: photoionisation data ignored since previously read Macro Atom input for the same ion. File: %s line: %d \n",
+                 file, lineno);
+            }
             break;
           }
-//  End section known to be idential to case N
 
 
-/* Check whether this is a macro-ion.  If it is a macro-ion, but the level appears to be described as a
-simple level (i.e without a keyword LeVMacro), then skip it, since a macro-ion has to have all the levels
-described as macro-levels. */
-          if (ion[n].macro_info == 1)
+          /* Check that there is an ion which has the same ionization state as this record
+             otherwise it must be a VFKY style record and so read with that format */
+
+          else if (strncmp (word, "PhotVfkyS", 8) == 0)
           {
-            Error ("get_atomic_data: file %s line %d has simple level for ion[%d], which is a macro-ion\n", file, lineno, n);
-            break;
-          }
-/* Check to prevent one from adding simple levels to an ionized that already has some nlte levels.  Note that
-   an ion may have simple levels, i.e. levels with no entries in the plasma structure levden array, but this
-   will only be the case if there are too many of this type of level.
-*/
-          if (ion[n].nlte > 0)
-          {
-            Error ("get_atomic_data:  file %s line %d has simple level for ion[%d], which has non_lte_levels\n", file, lineno, n);
-            break;
-          }
-
-/*  Check whether we already have too many levels specified for this ion. If so, skip */
-          if (ion[n].nmax == ion[n].nlevels)
-          {
-
-            Debug ("get_atomic_data: file %s line %d has level exceeding the number allowed for ion[%d]\n", file, lineno, n);
-
-            break;
-          }
-//  So now we know that this level can be associated with an ion
-
-          config[nlevels].z = z;
-          config[nlevels].istate = istate;
-          config[nlevels].isp = islp;
-          config[nlevels].ilv = ilv;
-          config[nlevels].nion = n;     //Internal index to ion structure
-          config[nlevels].q_num = qqnum;
-          config[nlevels].g = gg;
-          config[nlevels].ex = exx;
-          if (ion[n].firstlevel < 0)
-          {
-            ion[n].firstlevel = nlevels;
-            ion[n].nlevels = 1;
-          }
-          else
-            ion[n].nlevels++;
-
-
-/* Now declare that this level has no corresponding element in the levden array which is part
-   of the plasma stucture.  To do this set config[].ndent to -1
-*/
-
-          config[nlevels].nden = -1;
-
-          config[nlevels].rad_rate = 0.0;       // ?? Set emission oscillator strength for the level to zero
-
-          nlevels_simple++;
-          nlevels++;
-          if (nlevels > NLEVELS)
-          {
-            Error ("getatomic_data: file %s line %d: More energy levels than allowed. Increase NLEVELS in atomic.h\n", file, lineno);
-            exit (0);
-          }
-          break;
-
-
-
-/**
- * @section  Photoionization
- *
- * Until at least Oct 2001, Python used photoionization crossections from Verner, Ferland, Korista, and Yakolev (DFKY)
- * The routine sigma_phot(xptr, freq) calculates the crossection based on this.
- *
- *
- * The original topbase records look like this
- *
- * @verbatim
- *  ================================================
- *        I  NZ  NE  ISLP  ILV        E(RYD)      NP
- *  ================================================
- *        1   2   1   200    1  -4.00000E+00     101
- *   3.960000E+00 1.619E+00
- *   4.000000E+00 1.576E+00
- *   4.101260E+00 1.474E+00
- *   4.205084E+00 1.379E+00
- *   4.311536E+00 1.289E+00
- *   4.420684E+00 1.206E+00
- * @endverbatim
- *
- * They are converted to something that is more compatible with Topbase
- * by py_top_phot
- *
- * The new topbase style records look like this.
- *
- * @verbatim
- * PhotTopS  2  1 200    1    54.422791 101
- * PhotTop    54.422791 1.576e-18
- * PhotTop    66.508772 9.197e-19
- * PhotTop    78.594753 5.817e-19
- * PhotTop    90.680734 3.906e-19
- * PhotTop   102.766715 2.746e-19
- * PhotTop   114.852696 2.001e-19
- * PhotTop   126.938677 1.502e-19
- * PhotTop   139.024658 1.155e-19
- * PhotTop   151.110639 9.057e-20
- * @endverbatim
- *
- * The main changes from the original records are that energy levels
- * have been converted to eV, cross sections to cm**2, and the electron
- * number has been converted to conventional astronomical notiation
- * for the ionstate.
- *
- * ### Macro atoms (SS)
- *
- * For the Macro Atom method the input photoionisation data should look like
- * (one entry for every photoionisation process):
- *
- * @verbatim
- * z  ion ll ul   threshold  npts
- * PhotMacS  1  1  1  1    13.605698  50
- * PhotMac    13.605698 6.304e-18
- * PhotMac    16.627193 3.679e-18
- * PhotMac    19.648688 2.327e-18
- * PhotMac    22.670183 1.563e-18
- * PhotMac    25.691679 1.098e-18
- * PhotMac    28.713174 8.004e-19
- * PhotMac    31.734669 6.006e-19
- * PhotMac    34.756165 4.618e-19
- * @endverbatim
- *
- * Details for the first row of each entry:
- * | Col | Name  | Description
- * | --- | ----- | -----------
- * | 2   | z     | Atomic number
- * | 3   | ion   | Ionisation stage (astronomical convention): LOWER ION (i.e. the one that GETS IONISED)
- * |     |       | it is always assumed that the upper stage is this+1!
- * | 4   | ll    | index for the level in the LOWER ION (must match the index given to the level in input level data)
- * | 5   | ul    | index for the level in the UPPER ION (must match the index given to the level in the input level data)
- * | 6   | thresh| threshold energy of edge (in eV)
- * | 7   | npts  | number of data points in the following table
- *
- * * Then follows the table of energy and cross-section values (same as TopBase above)
- * * 04dec	ksl	Modified this section so that "unknown" level information is skipped so that
- *   		one need modify only the higher level elements_ions file
- */
-
-        case 'w':
-          if (strncmp (word, "PhotMacS", 8) == 0)
-          {
-            // It's a Macro atom entry - similar format to TOPBASE - see below (SS)
-            sscanf (aline, "%*s %d %d %d %d %le %d\n", &z, &istate, &levl, &levu, &exx, &np);
-            islp = -1;
-            ilv = -1;
-
+            // It's a VFKY style photoionization record, beginning with the summary record
+            sscanf (aline, "%*s %d %d %d %d %le %d\n", &z, &istate, &islp, &ilv, &exx, &np);
             for (n = 0; n < np; n++)
             {
-              //Read the photo. records but do nothing with them until verifyina a valid level
+              //Read the topbase photoionization records
               if (fgets (aline, LINELENGTH, fptr) == NULL)
               {
-                Error ("Get_atomic_data: Problem reading topbase photoionization record\n");
+                Error ("Get_atomic_data: Problem reading Vfky photoionization record\n");
                 Error ("Get_atomic_data: %s\n", aline);
                 exit (0);
               }
               sscanf (aline, "%*s %le %le", &xe[n], &xx[n]);
               lineno++;
+
             }
 
-            // Locate upper state
-            n = 0;
-            while ((config[n].z != z || config[n].istate != (istate + 1)        //note that the upper config will (SS)
-                    || config[n].ilv != levu) && n < nlevels)   //be the next ion up (istate +1) (SS)
-              n++;
-            if (n == nlevels)
+            for (nion = 0; nion < nions; nion++)
             {
-              Error_silent ("get_atomic_data: No configuration found to match upper state for phot. line %d\n", lineno);
-              break;            //Need to match the configuration for macro atoms - break if not found.
-            }
+              if (ion[nion].z == z && ion[nion].istate == istate)
+              {
+                if (ion[nion].phot_info == -1)
+                {
+                  /* Then there is a match */
+                  phot_top[nphot_total].nlev = ion[nion].firstlevel;    // ground state
+                  phot_top[nphot_total].nion = nion;
+                  phot_top[nphot_total].z = z;
+                  phot_top[nphot_total].istate = istate;
+                  phot_top[nphot_total].np = np;
+                  phot_top[nphot_total].macro_info = 0;
 
+                  ion[nion].phot_info = 0;      /* Mark this ion as using VFKY photo */
+                  ion[nion].nxphot = nphot_total;
 
-            // Locate lower state
-            m = 0;
-            while ((config[m].z != z || config[m].istate != istate      //Now searching for the lower
-                    || config[m].ilv != levl) && m < nlevels)   //configuration (SS)
-              m++;
-            if (m == nlevels)
-            {
-              Error_silent ("get_atomic_data: No configuration found to match lower state for phot. line %d\n", lineno);
-              break;            //Need to match the configuration for macro atoms - break if not found.
+                  alloc_xsection (&phot_top[nphot_total], np);
+                  for (n = 0; n < np; n++)
+                  {
+                    phot_top[nphot_total].freq[n] = xe[n] * EV2ERGS / H;        // convert from eV to freqency
+                    phot_top[nphot_total].x[n] = xx[n]; // leave cross sections in  CGS
+                  }
+                  if (phot_freq_min > phot_top[ntop_phot].freq[0])
+                    phot_freq_min = phot_top[ntop_phot].freq[0];
+                  nxphot++;
+                  nphot_total++;
+                }
+
+                else if (ion[nion].phot_info == 1 && ion[nion].macro_info != 1)
+                  /* We already have a topbase cross section, but the VFKY
+                     data is superior for the ground state, so we replace that data with the current data
+                     JM 1508 -- don't do this with macro-atoms for the moment */
+                {
+                  phot_top[ion[nion].ntop_ground].nlev = ion[nion].firstlevel;  // ground state
+                  phot_top[ion[nion].ntop_ground].nion = nion;
+                  phot_top[ion[nion].ntop_ground].z = z;
+                  phot_top[ion[nion].ntop_ground].istate = istate;
+                  phot_top[ion[nion].ntop_ground].np = np;
+                  phot_top[ion[nion].ntop_ground].macro_info = 0;
+                  ion[nion].phot_info = 2;      //We mark this as having hybrid data - VFKY ground, TB excited, potentially VFKY innershell
+                  alloc_xsection (&phot_top[ion[nion].ntop_ground], np);
+                  for (n = 0; n < np; n++)
+                  {
+                    phot_top[ion[nion].ntop_ground].freq[n] = xe[n] * EV2ERGS / H;      // convert from eV to freqency
+                    phot_top[ion[nion].ntop_ground].x[n] = xx[n];       // leave cross sections in  CGS
+                  }
+                  if (phot_freq_min > phot_top[ion[nion].ntop_ground].freq[0])
+                    phot_freq_min = phot_top[ion[nion].ntop_ground].freq[0];
+                  Debug
+                    ("Get_atomic_data: file %s  Replacing ground state topbase photoionization for ion %d with VFKY photoionization\n",
+                     file, nion);
+                }
+              }
             }
 
-            // Populate upper state info
-            phot_top[ntop_phot].uplev = n;      //store the level in the upper ion (SS)
-            config[n].bfd_jump[config[n].n_bfd_jump] = ntop_phot;       //record the line index as a downward bf Macro Atom jump (SS)
-            phot_top[ntop_phot].down_index = config[n].n_bfd_jump;      //record jump index in the photoionization structure
-            config[n].n_bfd_jump += 1;  //note that there is one more downwards bf jump available (SS)
-            if (config[n].n_bfd_jump > NBFJUMPS)
+            if (nxphot > NIONS)
             {
-              Error ("get_atomic_data: Too many downward b-f jump for ion %d\n", config[n].istate);
+              Error ("getatomic_data: file %s line %d: More photoionization edges than IONS.\n", file, lineno);
               exit (0);
             }
-
-
-            // Populate lower state info
-            phot_top[ntop_phot].nlev = m;       //store lower configuration then find upper configuration(SS)
-            config[m].bfu_jump[config[m].n_bfu_jump] = ntop_phot;       //record the line index as an upward bf Macro Atom jump (SS)
-            phot_top[ntop_phot].up_index = config[m].n_bfu_jump;        //record the jump index in the photoionization structure
-            config[m].n_bfu_jump += 1;  //note that there is one more upwards bf jump available (SS)
-            if (config[m].n_bfu_jump > NBFJUMPS)
+            if (nphot_total > nphot_max)
             {
-              Error ("get_atomic_data: Too many upward b-f jump for ion %d\n", config[m].istate);
+              Error ("get_atomicdata: More photoionization cross sections than were counted (%d)\n", nphot_max);
               exit (0);
             }
 
+            break;
+          }
+          else
+          {
+            Error ("get_atomic_data: file %s line %d: photoionization line incorrectly formatted\n", file, lineno);
+            Log ("Make sure you are using the tabulated verner cross sections (photo_vfky_tabulated.data)\n");
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
 
-            phot_top[ntop_phot].nion = config[m].nion;
-            phot_top[ntop_phot].z = z;
-            phot_top[ntop_phot].istate = istate;
-            phot_top[ntop_phot].np = np;
-            phot_top[ntop_phot].nlast = -1;
-            phot_top[ntop_phot].macro_info = 1;
-
-            if (ion[config[m].nion].phot_info == -1)
-            {
-              ion[config[m].nion].phot_info = 1;        /* Mark this ion as using TOPBASE photo */
-              ion[config[m].nion].ntop_first = ntop_phot;
-            }
-
-            /* next line sees if the topbase level just read in is the ground state -
-               if it is, the ion structure element ntop_ground is set to that topbase level number
-               note that m is the lower level here */
-            if (m == config[ion[config[n].nion].first_nlte_level].ilv)
-            {
-              ion[config[n].nion].ntop_ground = ntop_phot;
-            }
-
-            ion[config[m].nion].ntop++;
-
-            // Finish up this section by storing the photionization data properly
-
-            for (n = 0; n < np; n++)
-            {
-              phot_top[ntop_phot].freq[n] = xe[n] * EV2ERGS / H;        // convert from eV to freqency
-              phot_top[ntop_phot].x[n] = xx[n]; // leave cross sections in  CGS
-            }
-            if (phot_freq_min > phot_top[ntop_phot].freq[0])
-              phot_freq_min = phot_top[ntop_phot].freq[0];
-
-
-            ntop_phot_macro++;
-            ntop_phot++;
-            nphot_total++;
-
-            if (nphot_total > NTOP_PHOT)
-            {
-              Error ("get_atomicdata: More macro photoionization cross sections that NTOP_PHOT (%d).  Increase in atomic.h\n", NTOP_PHOT);
-              exit (0);
-            }
-            break;
-          }
-
-
-
-          else if (strncmp (word, "PhotTopS", 8) == 0)
-          {
-            // It's a TOPBASE style photoionization record, beginning with the summary record
-            sscanf (aline, "%*s %d %d %d %d %le %d\n", &z, &istate, &islp, &ilv, &exx, &np);
-            for (n = 0; n < np; n++)
-            {                   //Read the topbase photoionization records
-              if (fgets (aline, LINELENGTH, fptr) == NULL)
-              {
-                Error ("Get_atomic_data: Problem reading topbase photoionization record\n");
-                Error ("Get_atomic_data: %s\n", aline);
-                exit (0);
-              }
-              sscanf (aline, "%*s %le %le", &xe[n], &xx[n]);
-              lineno++;
-
-            }
-
-            n = 0;
-
-
-            /* additional check to assure that records were
-             * only matched with levels whose density was being tracked in levden.  This
-             * is now necesary since a change was made to use topbase levels for calculating
-             * partition functions
-             */
-
-            while ((config[n].nden == -1
-                    || config[n].z != z || config[n].istate != istate || config[n].isp != islp || config[n].ilv != ilv) && n < nlevels)
-              n++;
-            if (n == nlevels)
-            {
-
-              Debug ("No level found to match PhotTop data in file %s on line %d. Data ignored.\n", file, lineno);
-              break;            // There was no pre-existing ion
-            }
-            if (ion[config[n].nion].macro_info == 0)    //this is not a macro atom level (SS)
-            {
-              phot_top[ntop_phot].nlev = n;     // level associated with this crossection.
-              phot_top[ntop_phot].nion = config[n].nion;
-              phot_top[ntop_phot].z = z;
-              phot_top[ntop_phot].istate = istate;
-              phot_top[ntop_phot].np = np;
-              phot_top[ntop_phot].nlast = -1;
-              phot_top[ntop_phot].macro_info = 0;
-
-              /* next line sees if the topbase level just read in is the ground state -
-                 if it is, the ion structure element ntop_ground is set to that topbase level number */
-              if (islp == config[ion[config[n].nion].first_nlte_level].isp && ilv == config[ion[config[n].nion].first_nlte_level].ilv)
-              {
-                ion[config[n].nion].ntop_ground = ntop_phot;
-              }
-
-
-              if (ion[config[n].nion].phot_info == -1)
-              {
-                ion[config[n].nion].phot_info = 1;      /* Mark this ion as using TOPBASE photo */
-                ion[config[n].nion].ntop_first = ntop_phot;
-
-              }
-              else if (ion[config[n].nion].phot_info == (0))
-              {
-                Error
-                  ("Get_atomic_data: file %s VFKY and Topbase photoionization x-sections in wrong order for nion %d\n",
-                   file, config[n].nion);
-                Error ("             Read topbase x-sections before VFKY if using both types!!\n");
-                exit (0);
-              }
-              ion[config[n].nion].ntop++;
-              for (n = 0; n < np; n++)
-              {
-                phot_top[ntop_phot].freq[n] = xe[n] * EV2ERGS / H;      // convert from eV to freqency
-
-                phot_top[ntop_phot].x[n] = xx[n];       // leave cross sections in  CGS
-              }
-              if (phot_freq_min > phot_top[ntop_phot].freq[0])
-                phot_freq_min = phot_top[ntop_phot].freq[0];
-
-
-              ntop_phot_simple++;
-              ntop_phot++;
-              nphot_total++;
-
-              /* check to assure we did not exceed the allowed number of photoionization records */
-              if (nphot_total > NTOP_PHOT)
-              {
-                Error
-                  ("get_atomicdata: More TopBase photoionization cross sections that NTOP_PHOT (%d).  Increase in atomic.h\n", NTOP_PHOT);
-                exit (0);
-              }
-            }
-            else
-            {
-              Error
-                ("Get_atomic_data: photoionisation data ignored since previously read Macro Atom input for the same ion. File: %s line: %d \n",
-                 file, lineno);
-            }
-            break;
-          }
-
-
-          /* Check that there is an ion which has the same ionization state as this record
-             otherwise it must be a VFKY style record and so read with that format */
-
-          else if (strncmp (word, "PhotVfkyS", 8) == 0)
-          {
-            // It's a VFKY style photoionization record, beginning with the summary record
-            sscanf (aline, "%*s %d %d %d %d %le %d\n", &z, &istate, &islp, &ilv, &exx, &np);
-            for (n = 0; n < np; n++)
-            {
-              //Read the topbase photoionization records
-              if (fgets (aline, LINELENGTH, fptr) == NULL)
-              {
-                Error ("Get_atomic_data: Problem reading Vfky photoionization record\n");
-                Error ("Get_atomic_data: %s\n", aline);
-                exit (0);
-              }
-              sscanf (aline, "%*s %le %le", &xe[n], &xx[n]);
-              lineno++;
-
-            }
-
-            for (nion = 0; nion < nions; nion++)
-            {
-              if (ion[nion].z == z && ion[nion].istate == istate)
-              {
-                if (ion[nion].phot_info == -1)
-                {
-                  /* Then there is a match */
-                  phot_top[nphot_total].nlev = ion[nion].firstlevel;    // ground state
-                  phot_top[nphot_total].nion = nion;
-                  phot_top[nphot_total].z = z;
-                  phot_top[nphot_total].istate = istate;
-                  phot_top[nphot_total].np = np;
-                  phot_top[nphot_total].nlast = -1;
-                  phot_top[nphot_total].macro_info = 0;
-
-                  ion[nion].phot_info = 0;      /* Mark this ion as using VFKY photo */
-                  ion[nion].nxphot = nphot_total;
-
-                  for (n = 0; n < np; n++)
-                  {
-                    phot_top[nphot_total].freq[n] = xe[n] * EV2ERGS / H;        // convert from eV to freqency
-                    phot_top[nphot_total].x[n] = xx[n]; // leave cross sections in  CGS
-                  }
-                  if (phot_freq_min > phot_top[ntop_phot].freq[0])
-                    phot_freq_min = phot_top[ntop_phot].freq[0];
-                  nxphot++;
-                  nphot_total++;
-                }
-
-                else if (ion[nion].phot_info == 1 && ion[nion].macro_info != 1)
-                  /* We already have a topbase cross section, but the VFKY
-                     data is superior for the ground state, so we replace that data with the current data
-                     JM 1508 -- don't do this with macro-atoms for the moment */
-                {
-                  phot_top[ion[nion].ntop_ground].nlev = ion[nion].firstlevel;  // ground state
-                  phot_top[ion[nion].ntop_ground].nion = nion;
-                  phot_top[ion[nion].ntop_ground].z = z;
-                  phot_top[ion[nion].ntop_ground].istate = istate;
-                  phot_top[ion[nion].ntop_ground].np = np;
-                  phot_top[ion[nion].ntop_ground].nlast = -1;
-                  phot_top[ion[nion].ntop_ground].macro_info = 0;
-                  ion[nion].phot_info = 2;      //We mark this as having hybrid data - VFKY ground, TB excited, potentially VFKY innershell
-                  for (n = 0; n < np; n++)
-                  {
-                    phot_top[ion[nion].ntop_ground].freq[n] = xe[n] * EV2ERGS / H;      // convert from eV to freqency
-                    phot_top[ion[nion].ntop_ground].x[n] = xx[n];       // leave cross sections in  CGS
-                  }
-                  if (phot_freq_min > phot_top[ion[nion].ntop_ground].freq[0])
-                    phot_freq_min = phot_top[ion[nion].ntop_ground].freq[0];
-                  Debug
-                    ("Get_atomic_data: file %s  Replacing ground state topbase photoionization for ion %d with VFKY photoionization\n",
-                     file, nion);
-                }
-              }
-            }
-
-            if (nxphot > NIONS)
-            {
-              Error ("getatomic_data: file %s line %d: More photoionization edges than IONS.\n", file, lineno);
-              exit (0);
-            }
-            if (nphot_total > NTOP_PHOT)
-            {
-              Error ("get_atomicdata: More photoionization cross sections that NTOP_PHOT (%d).  Increase in atomic.h\n", NTOP_PHOT);
-              exit (0);
-            }
-
-            break;
-          }
-          else
-          {
-            Error ("get_atomic_data: file %s line %d: photoionization line incorrectly formatted\n", file, lineno);
-            Log ("Make sure you are using the tabulated verner cross sections (photo_vfky_tabulated.data)\n");
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-
-          /* Input inner shell cross section data */
+          /* Input inner shell cross section data */
 
 
 
@@ -1686,9 +1420,9 @@ described as macro-levels. */
               inner_cross[n_inner_tot].istate = istate;
               inner_cross[n_inner_tot].n = in;
               inner_cross[n_inner_tot].l = il;
-              inner_cross[n_inner_tot].nlast = -1;
               ion[nion].n_inner++;      /*Increment the number of inner shells */
               ion[nion].nxinner[ion[nion].n_inner] = n_inner_tot;
+              alloc_xsection (&inner_cross[n_inner_tot], np);
               for (n = 0; n < np; n++)
               {
                 inner_cross[n_inner_tot].freq[n] = xe[n] * EV2ERGS / H; // convert from eV to freqency
@@ -1700,7 +1434,7 @@ described as macro-levels. */
 
             }
           }
-          if (n_inner_tot > N_INNER * NIONS)
+          if (n_inner_tot > n_inner_max)
           {
             Error ("getatomic_data: file %s line %d: Inner edges than we have room for.\n", file, lineno);
             exit (0);
@@ -1905,1172 +1639,1721 @@ described as macro-levels. */
             nwords = sscanf (aline, "%*s %d %d %le %le %le %le %le %le %d %d", &z, &istate, &freq, &f, &gl, &gu, &el, &eu, &levl, &levu);
             if (nwords != 10)
             {
-              Error ("get_atomic_data: file %s line %d: LinMacro line incorrectly formatted\n", file, lineno);
-              Error ("Get_atomic_data: %s\n", aline);
-              exit (0);
-            }
+              Error ("get_atomic_data: file %s line %d: LinMacro line incorrectly formatted\n", file, lineno);
+              Error ("Get_atomic_data: %s\n", aline);
+              exit (0);
+            }
+
+            el = EV2ERGS * el;
+            eu = EV2ERGS * eu;
+            //need to identify the configurations associated with the upper and lower levels (SS)
+            n = 0;
+            while ((config[n].z != z || config[n].istate != istate || config[n].ilv != levl) && n < nlevels)
+              n++;
+            if (n == nlevels)
+            {
+              Error_silent ("Get_atomic_data: No configuration found to match lower level of line %d\n", lineno);
+              break;
+            }
+
+
+            m = 0;
+            while ((config[m].z != z || config[m].istate != istate || config[m].ilv != levu) && m < nlevels)
+              m++;
+            if (m == nlevels)
+            {
+              Error_silent ("Get_atomic_data: No configuration found to match upper level of line %d\n", lineno);
+              break;
+            }
+
+            /* Now that we know this is a valid transition for the macro atom record the data */
+
+            nconfigl = n;       //record lower configuration (SS)
+            config[n].bbu_jump[config[n].n_bbu_jump] = nlines;  //record the line index as an upward bb Macro Atom jump(SS)
+            line[nlines].down_index = config[n].n_bbu_jump;     //record the index for the jump in the line structure
+            config[n].n_bbu_jump += 1;  //note that there is one more upwards jump available (SS)
+            if (config[n].n_bbu_jump > NBBJUMPS)
+            {
+              Error ("get_atomic_data: Too many upward b-b jumps for ion %d\n", config[n].istate);
+              exit (0);
+            }
+
+            nconfigu = m;       //record upper configuration (SS)
+            config[m].bbd_jump[config[m].n_bbd_jump] = nlines;  //record the line index as a downward bb Macro Atom jump (SS)
+            line[nlines].up_index = config[m].n_bbd_jump;       //record jump index in line structure
+            config[m].n_bbd_jump += 1;  //note that there is one more downwards jump available (SS)
+            if (config[m].n_bbd_jump > NBBJUMPS)
+            {
+              Error ("get_atomic_data: Too many downward b-b jumps for ion %d\n", config[m].istate);
+              exit (0);
+            }
+
+
+          }
+          else
+          {                     //It's not a macro atom line (SS)
+// It would have been better to define mflag = 0 since that is what we want to set
+// macro_info to if it is an old-style line, but keep it this way for now.  ksl
+            mflag = -1;         //a flag to mark this as not a macro atom case (SS)
+            nconfigl = -1;
+            nconfigu = -1;
+            nwords = sscanf (aline, "%*s %d %2d %le %le %le %le %le %le %d %d", &z, &istate, &freq, &f, &gl, &gu, &el, &eu, &levl, &levu);
+            if (nwords == 6)
+            {
+              el = 0.0;
+              eu = H * C / (freq * 1e-8);       // Convert Angstroms to ergs
+              levl = -1;
+              levu = -1;
+
+            }
+            else if (nwords == 8)
+            {                   // Then the file contains the energy levels of the transitions
+
+              el = EV2ERGS * el;
+              eu = EV2ERGS * eu;
+              levl = -1;
+              levu = -1;
+            }
+            else if (nwords == 10)
+            {                   // Then the file contains energy levels and level numbers
+              el = EV2ERGS * el;
+              eu = EV2ERGS * eu;
+            }
+
+            else
+            {
+              Error ("get_atomic_data: file %s line %d: Resonance line incorrectly formatted\n", file, lineno);
+              Error ("Get_atomic_data: %s\n", aline);
+              exit (0);
+            }
+          }
+
+          if (el > eu)
+            Error ("get_atomic_data: file %s line %d : line has el (%f) > eu (%f)\n", file, lineno, el, eu);
+          for (n = 0; n < nions; n++)
+          {
+            if (ion[n].z == z && ion[n].istate == istate)
+            {                   /* Then there is a match */
+              if (freq == 0 || f <= 0 || gl == 0 || gu == 0)
+              {
+                Error_silent ("getatomic_data: line input incomplete: %s\n", aline);
+                break;
+              }
+              //
+              //define macro atom case (SS)
+/* XXXX  04 April ksl -- Right now have enforced a clean separation between macro-ions and simple-ions
+but this is proably not what we want if we move all bf & fb transitions to macro-ion approach.  We
+would like to have simple lines for macro-ions */
+              if (ion[n].macro_info == 1 && mflag == -1)
+              {
+                Error ("Get_atomic_data: Simple line data ignored for Macro-ion: %d\n", n);
+                break;
+              }
+
+              if (ion[n].macro_info == -1 && mflag == 1)
+              {
+                Error ("Getatomic_data: Macro Atom line data supplied for ion %d\n but there is no suitable level data\n", n);
+                exit (0);
+              }
+              line[nlines].nion = n;
+              line[nlines].z = z;
+              line[nlines].istate = istate;
+              line[nlines].freq = C / (freq * 1e-8);    /* convert Angstroms to frequency */
+              line[nlines].f = f;
+              line[nlines].gl = gl;
+              line[nlines].gu = gu;
+              line[nlines].levl = levl;
+              line[nlines].levu = levu;
+              line[nlines].el = el;
+              line[nlines].eu = eu;
+              line[nlines].nconfigl = nconfigl;
+              line[nlines].nconfigu = nconfigu;
+              line[nlines].coll_index = -999;   //Tokick off with we assume there is no collisional strength data
+              if (mflag == -1)
+              {
+                line[nlines].macro_info = 0;    // It's an old-style line`
+                nlines_simple++;
+              }
+              else
+              {
+                line[nlines].macro_info = 1;    //It's a macro line
+                nlines_macro++;
+              }
+              nlines++;
+            }
+          }
+          if (nlines > nlines_max)
+          {
+            Error ("getatomic_data: file %s line %d: More lines than were counted (%d)\n", file, lineno, nlines_max);
+            exit (0);
+          }
+          break;
+
+/** @section Ground state fractions
+ */
+        case 'f':
+          if (sscanf
+              (aline,
+               "%*s %d %d %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le",
+               &z, &istate, &the_ground_frac[0], &the_ground_frac[1],
+               &the_ground_frac[2], &the_ground_frac[3],
+               &the_ground_frac[4], &the_ground_frac[5],
+               &the_ground_frac[6], &the_ground_frac[7],
+               &the_ground_frac[8], &the_ground_frac[9],
+               &the_ground_frac[10], &the_ground_frac[11],
+               &the_ground_frac[12], &the_ground_frac[13],
+               &the_ground_frac[14], &the_ground_frac[15],
+               &the_ground_frac[16], &the_ground_frac[17], &the_ground_frac[18], &the_ground_frac[19]) != 22)
+          {
+            Error ("get_atomic_data: file %s line %d ground state fracs   frac table incorrectly formatted\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+          for (n = 0; n < nions; n++)
+          {
+            if (ion[n].z == z && ion[n].istate == istate)
+            {                   /* Then there is a match */
+              ground_frac[n].z = z;
+              ground_frac[n].istate = istate;
+              for (j = 0; j < 20; j++)
+              {
+                ground_frac[n].frac[j] = the_ground_frac[j];
+              }
+            }
+          }
+          break;
+
+
+// Collision strengths --- Not currently used
+/** @section Collision strengths
+ *  @bug This needs a description
+ */
+        case 'x':              /*The line contains collision strength information--Gaetz & Salpeter */
+          if (sscanf (aline, "%*s %*s %d %d %le %le %le %le %le", &z, &istate, &exx, &lambda, &alpha, &beta, &tm) != 7)
+          {
+            Error ("get_atomic_data: file %s line %d: Collision strengths incorrectly formatted\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+          for (n = 0; n < nions; n++)
+          {
+            if (ion[n].z == z && ion[n].istate == istate)
+            {                   /* Then there is a match */
+              xcol[nxcol].nion = n;
+              xcol[nxcol].z = z;
+              xcol[nxcol].istate = istate;
+              xcol[nxcol].ex = exx * EV2ERGS;
+              xcol[nxcol].freq = C / (lambda * 1.e-8);
+              xcol[nxcol].alpha = alpha;
+              xcol[nxcol].beta = beta;
+              xcol[nxcol].tm = pow (10., tm);
+              nxcol++;
+            }
+          }
+
+          break;
+
+
+
+
+/** @section Dielectronic Recombination - type 1
+ * This section reads in dielectronic recombination rates.
+ * The data comes from Chianti, and there are two types of dielectronic data.
+ * This is type 1 - which has fis decribed by Arnaud & Raymond (1992)
+ * There are two fitting parameters, E and C which represent different
+ * degrees in the fit - one sums over a set of parameters.
+ *
+ * A typical ion data would look like this
+ *
+ *
+ @verbatim
+ * DR_BADNL E 2 2 4.5560e+05 5.5520e+05 8.9820e+05 0.0000e+00 0.0000e+00 0.0000e+00 0.0000e+00 0.0000e+00
+ * DR_BADNL C 2 2 5.9660e-04 1.6130e-04 -2.2230e-05 0.0000e+00 0.0000e+00 0.0000e+00 0.0000e+00 0.0000e+00
+ @endverbatim
+ *
+ * where there are two lines for a given ion - this is for helium (z=2) 2 (istate=2)
+ *
+ */
+
+        case 'D':              /* Dielectronic recombination data read in. */
+          nparam = sscanf (aline, "%*s %s %d %d %le %le %le %le %le %le %le %le %le", &drflag, &z, &ne, &drp[0], &drp[1], &drp[2], &drp[3], &drp[4], &drp[5], &drp[6], &drp[7], &drp[8]);       //split and assign the line
+          nparam -= 3;          //take 4 off the nparam to give the number of actual parameters
+          if (nparam > 9 || nparam < 1) //     trap errors - not as robust as usual because there are a varaible number of parameters...
+          {
+            Error ("Something wrong with dielectronic recombination data\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+
+          istate = ne;          //         get the ionisation state we are recombining from
+
+          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
+          {
+            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
+            {
+              if (ion[n].drflag == 0)   //This is the first time we have dealt with this ion
+              {
+                drecomb[ndrecomb].nion = n;     //put the ion number into the DR structure
+                drecomb[ndrecomb].nparam = nparam;      //Put the number of parameters we ware going to read in, into the DR structure so we know what to iterate over later
+                ion[n].nxdrecomb = ndrecomb;    //put the number of the DR into the ion
+                drecomb[ndrecomb].type = DRTYPE_BADNELL;        //define the type of data
+                ndrecomb++;     //increment the counter of number of dielectronic recombination parameter sets
+                ion[n].drflag++;        //increment the flag by 1. We will do this rather than simply setting it to 1 so we will get errors if we do this more than once....
+
+              }
+              if (drflag == 'E')        // this ion has no parameters, so it must be the first time through
+              {
+
+                n1 = ion[n].nxdrecomb;  //     Get the pointer to the correct bit of the recombination coefficient array. This should already be set from the first time through
+                for (n2 = 0; n2 < nparam; n2++)
+                {
+                  drecomb[n1].e[n2] = drp[n2];  //we are getting e parameters
+                }
+
+
+              }
+              else if (drflag == 'C')   //                  must be the second time though, so no need to read in all the other things
+              {
+                n1 = ion[n].nxdrecomb;  //     Get the pointer to the correct bit of the recombination coefficient array. This should already be set from the first time through
+                for (n2 = 0; n2 < nparam; n2++)
+                {
+                  drecomb[n1].c[n2] = drp[n2];  //           we are getting e parameters
+                }
+              }
+
+            }                   //close if statement that selects appropriate ion to add data to
+          }                     //close loop over ions
+
+
+          break;
+
+/** @section Dielectronic Recombination - type 2
+ * This section reads in type 2 dielectronic recombination rates.
+ * The data comes from Chianti, and there are two types of dielectronic data.
+ * This is type 2 - which has a fit decribed by Shull & van Steenberg (1982)
+ * There are four fitting parameters.
+ * A typical ion data would look like this
+ *
+ *
+ @verbatim
+ * DR_SHULL 17 2 2.6510e-03 2.9300e-02 2.4120e+05 4.9410e+05
+ @endverbatim
+ *
+ * where there are two lines for a given ion - this is for z=17 (istate=2)
+ *
+ */
+
+
+
+        case 'S':
+          nparam = sscanf (aline, "%*s %d %d %le %le %le %le ", &z, &ne, &drp[0], &drp[1], &drp[2], &drp[3]);   //split and assign the line
+          nparam -= 2;          //take 4 off the nparam to give the number of actual parameters
+          if (nparam > 4 || nparam < 1) //     trap errors - not as robust as usual because there are a varaible number of parameters...
+          {
+            Error ("Something wrong with dielectronic recombination data\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+
+          istate = ne;          //         get the ionisation state we are recombining from
+
+          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
+          {
+            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
+            {
+              if (ion[n].drflag == 0)   //This is the first time we have dealt with this ion
+              {
+                drecomb[ndrecomb].nion = n;     //put the ion number into the DR structure
+                drecomb[ndrecomb].nparam = nparam;      //Put the number of parameters we ware going to read in, into the DR structure so we know what to iterate over later
+                ion[n].nxdrecomb = ndrecomb;    //put the number of the DR into the ion
+                drecomb[ndrecomb].type = DRTYPE_SHULL;  //define the type of data
+                ndrecomb++;     //increment the counter of number of dielectronic recombination parameter sets
+                ion[n].drflag++;        //increment the flag by 1. We will do this rather than simply setting it to 1 so we will get errors if we do this more than once....
+
+              }
+              n1 = ion[n].nxdrecomb;    //     Get the pointer to the correct bit of the recombination coefficient array. This should already be set from the first time through
+              for (n2 = 0; n2 < nparam; n2++)
+              {
+                drecomb[n1].shull[n2] = drp[n2];        //we are getting e parameters
+              }
+            }
+          }
+          break;
+
+/**
+ * @section total radiative Recombination rates from Chianti - type 1 and 2
+ * !RR RATE COEFFICIENT FITS (C)20110412 N. R. BADNELL, DEPARTMENT OF PHYSICS, UNIVERSITY OF STRATHCLYDE, GLASGOW G4 0NG, UK.
+ * !This is total radiative rate into all possible states or the recombined ion.
+ * !This data was downloaded from http://amdpp.phys.strath.ac.uk/tamoc/DATA/RR/ on 13/July/2013
+ * !It is described in http://adsabs.harvard.edu/abs/2006ApJS..167..334B
+ * !Only modification to original file is to insert the BAD_T_RR label to the front of each line and comments
+ * !There are metastable levels in here, M=1 means we are recombining from the ground state, which is what we tend to want.
+ * Some of these have one four parameters, a fit introduced by Verner & Ferland (1996) and
+ * some have six, which is from Gu (2003). A four parameter data type is shown below
+ *
+ * @verbatim
+ * !  Z  N  M  W      A        B        T0         T1        C        T2
+ * BAD_T_RR  1  0  1  1  8.318E-11  0.7472  2.965E+00  7.001E+05
+ * BAD_T_RR  2  0  1  1  1.818E-10  0.7492  1.017E+01  2.786E+06
+ * BAD_T_RR  3  0  1  1  2.867E-10  0.7493  2.108E+01  6.268E+06
+ * BAD_T_RR  4  0  1  1  3.375E-10  0.7475  4.628E+01  1.121E+07
+ * BAD_T_RR  5  0  1  1  4.647E-10  0.7484  6.142E+01  1.753E+07
+ * @endverbatim
+ * */
+
+        case 'T':              /*Badnell type total raditive rate coefficients read in */
+
+          nparam = sscanf (aline, "%*s %d %d %d %le %le %le %le %le %le", &z, &ne, &w, &btrr[0], &btrr[1], &btrr[2], &btrr[3], &btrr[4], &btrr[5]);     //split and assign the line
+          nparam -= 3;          //take 4 off the nparam to give the number of actual parameters
+          if (nparam > 6 || nparam < 1) //     trap errors - not as robust as usual because there are a varaible number of parameters...
+          {
+            Error ("Something wrong with badnell total RR data\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+
+          istate = ne;          //         get the traditional ionisation state
+          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
+          {
+            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
+            {
+              if (ion[n].total_rrflag == 0)     // this ion has no parameters, so it must be the first time through
+              {
+                total_rr[n_total_rr].nion = n;  //put the ion number into the bad_t_rr structure
+                ion[n].nxtotalrr = n_total_rr;  /*put the number of the bad_t_rr into the ion
+                                                   structure so we can go either way. */
+                total_rr[n_total_rr].type = RRTYPE_BADNELL;
+                for (n1 = 0; n1 < nparam; n1++)
+                {
+                  total_rr[n_total_rr].params[n1] = btrr[n1];   //we are getting  parameters
+                }
+                ion[n].total_rrflag++;  //increment the flag by 1. We will do this rather than simply setting it to 1 so we will get errors if we do this more than once....
+                n_total_rr++;   //increment the counter of number of dielectronic recombination parameter sets
+              }
+              else if (ion[n].total_rrflag > 0) //       unexpected second line matching z and charge
+              {
+                Error ("More than one badnell total RR rate for ion %i\n", n);
+                Error ("Get_atomic_data: %s\n", aline);
+                exit (0);
+              }
+              else              //if flag is not a positive number, we have a problem
+              {
+                Error ("Total radiative recombination flag giving odd results\n");
+                exit (0);
+              }
+            }                   //close if statement that selects appropriate ion to add data to
+          }                     //close loop over ions
+
+
+
+          break;
+
+/**
+ * @section Total radiative recombination - type 3
+ * These are some rare ion recombination rates that have
+ * a two parameter fit by Aldrovandi & Pequignot (1973)
+ * They have data like
+ * @verbatim
+ * RR_SHULL 22 2 1.0965e-11 6.9901e-01
+ * RR_SHULL 22 3 1.8600e-11 7.2800e-01
+ * @endverbatim
+ *
+ * For erroneous historical reasons they are referred to as SHULL
+ *
+ */
+
+
+
+
+        case 's':
+          nparam = sscanf (aline, "%*s %d %d %le %le ", &z, &ne, &btrr[0], &btrr[1]);   //split and assign the line
+          nparam -= 2;          //take 4 off the nparam to give the number of actual parameters
+          if (nparam > 6 || nparam < 1) //     trap errors - not as robust as usual because there are a varaible number of parameters...
+          {
+            Error ("Something wrong with shull total RR data\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+
+          istate = ne;          //         get the traditional ionisation state
+          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
+          {
+            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
+            {
+              if (ion[n].total_rrflag == 0)     // this ion has no parameters, so it must be the first time through
+              {
+                total_rr[n_total_rr].nion = n;  //put the ion number into the bad_t_rr structure
+                ion[n].nxtotalrr = n_total_rr;  /*put the number of the bad_t_rr into the ion
+                                                   structure so we can go either way. */
+                total_rr[n_total_rr].type = RRTYPE_SHULL;
+                for (n1 = 0; n1 < nparam; n1++)
+                {
+                  total_rr[n_total_rr].params[n1] = btrr[n1];   //we are getting  parameters
+                }
+                ion[n].total_rrflag++;  //increment the flag by 1. We will do this rather than simply setting it to 1 so we will get errors if we do this more than once....
+                n_total_rr++;   //increment the counter of number of dielectronic recombination parameter sets
+              }
+              else if (ion[n].total_rrflag > 0) //       unexpected second line matching z and charge
+              {
+                Error ("More than one total RR rate for ion %i\n", n);
+                Error ("Get_atomic_data: %s\n", aline);
+                exit (0);
+              }
+              else              //if flag is not a positive number, we have a problem
+              {
+                Error ("Total radiative recombination flag giving odd results\n");
+                exit (0);
+              }
+            }                   //close if statement that selects appropriate ion to add data to
+          }                     //close loop over ions
+          break;
+
+
+/**
+ * @section Ground state recombination rate data
+ * !RR RATE COEFFICIENT FITS (C)20110412 N. R. BADNELL, DEPARTMENT OF PHYSICS, UNIVERSITY OF STRATHCLYDE, GLASGOW G4 0NG, UK.
+ * !This is resolved radiative rate from ground state to ground state.
+ * !This data was downloaded from http://amdpp.phys.strath.ac.uk/tamoc/DATA/RR/ on 13/July/2013
+ * !It is described in http://adsabs.harvard.edu/abs/2006ApJS..167..334B
+ * !THe data comes as one file for each ion, with many rates. This file contains the first rate line in each file
+ * ! which should relate to the ground state of the upper ion recombining into the ground state of the recombined ion.
+ * !The data is tabulated in temperature, first line for each ion is temp, second is rate.
+ * !As with other Badnell data, first number is z, second is number of remianing electrons.
+ *
+ * @verbatim
+ * BAD_GS_RR T 1 0 1.00E+01 2.00E+01 5.00E+01 1.00E+02 2.00E+02 5.00E+02 1.00E+03 2.00E+03 5.00E+03 1.00E+04 2.00E+04 5.00E+04 1.00E+05 2.00E+05 5.00E+05 1.00E+06 2.00E+06 5.00E+06 1.00E+07
+ * BAD_GS_RR R 1 0 5.21E-12 3.68E-12 2.33E-12 1.65E-12 1.16E-12 7.35E-13 5.18E-13 3.65E-13 2.28E-13 1.58E-13 1.08E-13 6.21E-14 3.88E-14 2.28E-14 1.01E-14 5.05E-15 2.36E-15 7.90E-16 3.27E-16
+ * @endverbatim
+
+ */
+
+        case 'G':
+          nparam = sscanf (aline, "%*s %s %d %d %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le", &gsflag, &z, &ne, &gstemp[0], &gstemp[1], &gstemp[2], &gstemp[3], &gstemp[4], &gstemp[5], &gstemp[6], &gstemp[7], &gstemp[8], &gstemp[9], &gstemp[10], &gstemp[11], &gstemp[12], &gstemp[13], &gstemp[14], &gstemp[15], &gstemp[16], &gstemp[17], &gstemp[18]);   //split and assign the line
+          nparam -= 3;          //take 4 off the nparam to give the number of actual parameters
+          if (nparam > 19 || nparam < 1)        //     trap errors - not as robust as usual because there are a varaible number of parameters...
+          {
+            Error ("Something wrong with badnell GS RR data\n");
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+          istate = z - ne + 1;  //         get the traditional ionisation state
+          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
+          {
+            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
+            {
+              if (ion[n].bad_gs_rr_t_flag == 0 && ion[n].bad_gs_rr_r_flag == 0) //This is first set of this type of data for this ion
+              {
+                bad_gs_rr[n_bad_gs_rr].nion = n;        //put the ion number into the bad_t_rr structure
+                ion[n].nxbadgsrr = n_bad_gs_rr; //put the number of the bad_t_rr into the ion structure so we can go either way.
+                n_bad_gs_rr++;  //increment the counter of number of ground state RR
+              }
+              /*Now work out what type of line it is, and where it needs to go */
+              if (gsflag == 'T')        //it is a temperature line
+              {
+                if (ion[n].bad_gs_rr_t_flag == 0)       //and we need a temp line for this ion
+                {
+                  if (gstemp[0] > gstmin)
+                    gstmin = gstemp[0];
+                  if (gstemp[18] < gstmax)
+                    gstmax = gstemp[18];
+                  ion[n].bad_gs_rr_t_flag = 1;  //set the flag
+                  for (n1 = 0; n1 < nparam; n1++)
+                  {
+                    bad_gs_rr[ion[n].nxbadgsrr].temps[n1] = gstemp[n1];
+                  }
+                }
+                else if (ion[n].bad_gs_rr_t_flag == 1)  //we already have a temp line for this ion
+                {
+                  Error ("More than one temp line for badnell GS RR rate for ion %i\n", n);
+                  Error ("Get_atomic_data: %s\n", aline);
+                  exit (0);
+                }
+                else            //some other odd thing had happened
+                {
+                  Error ("Get_atomic_data: %s\n", aline);
+                  exit (0);
+                }
+              }
+              else if (gsflag == 'R')   //it is a rate line
+              {
+                if (ion[n].bad_gs_rr_r_flag == 0)       //and we need a rate line for this ion
+                {
+                  ion[n].bad_gs_rr_r_flag = 1;  //set the flag
+                  for (n1 = 0; n1 < nparam; n1++)
+                  {
+                    bad_gs_rr[ion[n].nxbadgsrr].rates[n1] = gstemp[n1];
+                  }
+                }
+                else if (ion[n].bad_gs_rr_r_flag == 1)  //we already have a rate line for this ion
+                {
+                  Error ("More than one rate line for badnell GS RR rate for ion %i\n", n);
+                  Error ("Get_atomic_data: %s\n", aline);
+                  exit (0);
+                }
+                else            //some other odd thing had happened
+                {
+                  Error ("Get_atomic_data: %s\n", aline);
+                  exit (0);
+                }
+              }
+              else              //We have some problem with this line
+              {
+                Error ("Get_atomic_data: %s\n", aline);
+                exit (0);
+              }
+            }                   //end of loop over dealing with data for a discovered ion
+          }                     //end of loop over ions
+
+          break;
+
+/**
+ * @section gaunt factor
+ * The following are lines to read in temperature averaged free-free gaunt factors
+ * from the data of Sutherland (1998). The atomic file is basically unchanged
+ * from the data on the website, just with the top few lines commented out,
+ * and a label prepended to each line
+ * The data is a spline fit to the gaunt factor as a function of g - the reduced
+ * temperature.
+ * @verbatim
+ * # log(g^2) <gff(g^2)>       s1           s2            s3
+ * # ------------------------------------------------------------
+ * FF_GAUNT -4.00 1.113883E+00  1.348000E-02  1.047100E-02 -1.854972E-03
+ * FF_GAUNT -3.80 1.116983E+00  1.744580E-02  9.358014E-03  5.564917E-03
+ * FF_GAUNT -3.60 1.120891E+00  2.185680E-02  1.269696E-02  4.970250E-03
+ * FF_GAUNT -3.40 1.125810E+00  2.753201E-02  1.567911E-02  6.429140E-03
+* @endverbatim
+
+ */
+        case 'g':
+          nparam = sscanf (aline, "%*s %le %le %le %le %le", &gsqrdtemp, &gfftemp, &s1temp, &s2temp, &s3temp);  //split and assign the line
+          if (nparam > 5 || nparam < 1) //     trap errors
+          {
+            Error ("Something wrong with sutherland gaunt data\n");
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+          if (gaunt_n_gsqrd == 0 || gsqrdtemp > gaunt_total[gaunt_n_gsqrd - 1].log_gsqrd)       //We will use it if it's our first piece of data or is in order
+          {
+            gaunt_total[gaunt_n_gsqrd].log_gsqrd = gsqrdtemp;   //The scaled electron temperature squared for this array
+            gaunt_total[gaunt_n_gsqrd].gff = gfftemp;
+            gaunt_total[gaunt_n_gsqrd].s1 = s1temp;
+            gaunt_total[gaunt_n_gsqrd].s2 = s2temp;
+            gaunt_total[gaunt_n_gsqrd].s3 = s3temp;
+            gaunt_n_gsqrd++;
+          }
+          else
+          {
+            Error ("Something wrong with gaunt data\n");
+            Error ("Get_atomic_data %s\n", aline);
+            exit (0);
+          }
+
+
+
+          break;
+/**
+ * @section direct (collisional) ionization data from Dere 07.
+ * #Title: Ionization rate coefficients for elements H to Zn (Dere+, 2007)
+ * #Table  J_A_A_466_771_table29:
+ * #Title: Spline fits, multiplied by a factor of 10^6^, to the scaled ionization rate coefficients
+ * #Column Z       (I2)    [1/30] Nuclear charge   [ucd=phys.atmol.element]
+ * #Column Ion     (I2)    [1/30] Ion (spectroscopic notation)     [ucd=phys.atmol.ionStage]
+ * #Column Nspl    (I2)    [15/20] Number of splines       [ucd=meta.number]
+ * #Column I       (F9.3)  Ionization potential    [ucd=phys.energy;phys.atmol.ionization]
+ * #Column Tmin    (E10.3) Minimum temperature     [ucd=phys.temperature]
+ * #Column x1-X20      (F7.4)  Scaled temperature 1 (1)        [ucd=phys.temperature]
+ * #Column rho1 -rho20   (F8.4)  ? Scaled rate coefficient 1 (2) [ucd=arith.rate;phys.atmol.collisional]
+ */
+        case 'd':
+          nparam = sscanf (aline, "%*s %d %d %d %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le", &z, &istate, &nspline, &et, &tmin, &temp[0], &temp[1], &temp[2], &temp[3], &temp[4], &temp[5], &temp[6], &temp[7], &temp[8], &temp[9], &temp[10], &temp[11], &temp[12], &temp[13], &temp[14], &temp[15], &temp[16], &temp[17], &temp[18], &temp[19], &temp[20], &temp[21], &temp[22], &temp[23], &temp[24], &temp[25], &temp[26], &temp[27], &temp[28], &temp[29], &temp[30], &temp[31], &temp[32], &temp[33], &temp[34], &temp[35], &temp[36], &temp[37], &temp[38], &temp[39]);     //split and assign the line
+
+          if (nparam != 5 + (nspline * 2))      //     trap errors
+          {
+            Error ("Something wrong with Dere DI data\n");
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
+          {
+            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
+            {
+              if (ion[n].dere_di_flag == 0)     //This is first set of this type of data for this ion
+              {
+                ion[n].dere_di_flag = 1;
+                dere_di_rate[n_dere_di_rate].nion = n;  //put the ion number into the dere_di_rate structure
+                ion[n].nxderedi = n_dere_di_rate;       //put the number of the dere_di_rate into the ion structure so we can go either way.
+                dere_di_rate[n_dere_di_rate].xi = et;
+                dere_di_rate[n_dere_di_rate].min_temp = tmin;
+                dere_di_rate[n_dere_di_rate].nspline = nspline;
+                for (n1 = 0; n1 < nspline; n1++)
+                {
+                  dere_di_rate[n_dere_di_rate].temps[n1] = temp[n1];
+                  dere_di_rate[n_dere_di_rate].rates[n1] = temp[n1 + nspline] * 1e-6;
 
-            el = EV2ERGS * el;
-            eu = EV2ERGS * eu;
-            //need to identify the configurations associated with the upper and lower levels (SS)
-            n = 0;
-            while ((config[n].z != z || config[n].istate != istate || config[n].ilv != levl) && n < nlevels)
-              n++;
-            if (n == nlevels)
-            {
-              Error_silent ("Get_atomic_data: No configuration found to match lower level of line %d\n", lineno);
-              break;
+                }
+                n_dere_di_rate++;       //increment the counter of number of ground state RR
+              }
+              else
+              {
+                Error ("Get_atomic_data: More than one Dere DI rate for ion %i\n", n);
+              }
             }
+          }
+          break;
 
+/**
+ * @section Electron yield - goes with auger ionization rates
+ * #This is electron yield data from Kaastra & Mewe (1993) -1993A&AS...97..443K
+ * #It is processed from data downloaded from http://vizier.cfa.harvard.edu/viz-bin/VizieR?-source=J/A+AS/97/443
+ * #Via the python script kaastra_2_py.py. Example lines of file below
+ * #
+ * @verbatim
+ * #Label z state n l IP mean_electron_energy Prob_of_1e Prob_of_2e Prob_of_3e ....
+ * Kelecyield 4 1 1 0 1.1500e+02 9.280e+01 0.000e+00 1.000e+04 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00
+ * Kelecyield 5 1 1 0 1.9200e+02 1.639e+02 6.000e+00 9.994e+03 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00
+ * @endverbatim
 
-            m = 0;
-            while ((config[m].z != z || config[m].istate != istate || config[m].ilv != levu) && m < nlevels)
-              m++;
-            if (m == nlevels)
-            {
-              Error_silent ("Get_atomic_data: No configuration found to match upper level of line %d\n", lineno);
-              break;
-            }
-
-            /* Now that we know this is a valid transition for the macro atom record the data */
+*/
 
-            nconfigl = n;       //record lower configuration (SS)
-            config[n].bbu_jump[config[n].n_bbu_jump] = nlines;  //record the line index as an upward bb Macro Atom jump(SS)
-            line[nlines].down_index = config[n].n_bbu_jump;     //record the index for the jump in the line structure
-            config[n].n_bbu_jump += 1;  //note that there is one more upwards jump available (SS)
-            if (config[n].n_bbu_jump > NBBJUMPS)
+        case 'K':
+          nparam =
+            sscanf (aline,
+                    "%*s %d %d %d %d %le %le %le %le %le %le %le %le %le %le %le %le",
+                    &z, &istate, &in, &il, &I, &Ea, &temp[0],
+                    &temp[1], &temp[2], &temp[3], &temp[4], &temp[5], &temp[6], &temp[7], &temp[8], &temp[9]);
+          if (nparam != 16)
+          {
+            Error ("Something wrong with electron yield data\n");
+            Error ("Get_atomic_data %s\n", aline);
+            exit (0);
+          }
+          for (n = 0; n < n_inner_tot; n++)
+          {
+            if (inner_cross[n].z == z && inner_cross[n].istate == istate && inner_cross[n].n == in && inner_cross[n].l == il)
             {
-              Error ("get_atomic_data: Too many upward b-b jumps for ion %d\n", config[n].istate);
-              exit (0);
+              if (inner_cross[n].n_elec_yield == -1)    /*This is the first yield data for this vacancy */
+              {
+                inner_elec_yield[n_elec_yield_tot].nion = n;    /*This yield refers to this ion */
+                inner_cross[n].n_elec_yield = n_elec_yield_tot;
+                inner_elec_yield[n_elec_yield_tot].z = z;
+                inner_elec_yield[n_elec_yield_tot].istate = istate;
+                inner_elec_yield[n_elec_yield_tot].n = in;
+                inner_elec_yield[n_elec_yield_tot].l = il;
+                inner_elec_yield[n_elec_yield_tot].I = I * EV2ERGS;
+                inner_elec_yield[n_elec_yield_tot].Ea = Ea * EV2ERGS;
+                for (n1 = 0; n1 < 10; n1++)
+                {
+                  inner_elec_yield[n_elec_yield_tot].prob[n1] = temp[n1] / 10000.0;
+                }
+                n_elec_yield_tot++;
+              }
+              else
+              {
+                Error ("Get_atomic_data: more than one electron yield record for inner_cross %i\n", n);
+              }
             }
-
-            nconfigu = m;       //record upper configuration (SS)
-            config[m].bbd_jump[config[m].n_bbd_jump] = nlines;  //record the line index as a downward bb Macro Atom jump (SS)
-            line[nlines].up_index = config[m].n_bbd_jump;       //record jump index in line structure
-            config[m].n_bbd_jump += 1;  //note that there is one more downwards jump available (SS)
-            if (config[m].n_bbd_jump > NBBJUMPS)
+          }
+          break;
+/**
+ * @section Fluorescent photon yield from inner shell ionization - not currently used but read in.
+ * #This is fluorescent yield data from Kaastra & Mewe (1993) -1993A&AS...97..443K
+ * #It is processed from data downloaded from http://vizier.cfa.harvard.edu/viz-bin/VizieR?-source=J/A+AS/97/443
+ * #Via the python script kaastra_2_py.py.
+ * Data format below
+ * #
+ * @verbatim
+ * #Label z state n l photon_energy yield
+ * Kphotyield 5 1 1 0 1.837e+02 6.000e-04
+ * Kphotyield 5 1 1 0 1.690e+01 7.129e-01
+ * @endverbatim
+ */
+        case 'F':
+          nparam = sscanf (aline, "%*s %d %d %d %d %le %le ", &z, &istate, &in, &il, &energy, &yield);
+          if (nparam != 6)
+          {
+            Error ("Something wrong with fluorescent yield data\n");
+            Error ("Get_atomic_data %s\n", aline);
+            exit (0);
+          }
+          for (n = 0; n < n_inner_tot; n++)
+          {
+            if (inner_cross[n].z == z && inner_cross[n].istate == istate && inner_cross[n].n == in && inner_cross[n].l == il)
             {
-              Error ("get_atomic_data: Too many downward b-b jumps for ion %d\n", config[m].istate);
-              exit (0);
+              if (inner_cross[n].n_fluor_yield == -1)   /*This is the first yield data for this vacancy */
+              {
+                inner_fluor_yield[n_fluor_yield_tot].nion = n;  /*This yield refers to this ion */
+                inner_cross[n].n_fluor_yield = n_fluor_yield_tot;
+                inner_fluor_yield[n_fluor_yield_tot].z = z;
+                inner_fluor_yield[n_fluor_yield_tot].istate = istate;
+                inner_fluor_yield[n_fluor_yield_tot].n = in;
+                inner_fluor_yield[n_fluor_yield_tot].l = il;
+                inner_fluor_yield[n_fluor_yield_tot].freq = energy / HEV;
+                inner_fluor_yield[n_fluor_yield_tot].yield = yield;
+                n_fluor_yield_tot++;
+              }
+              else
+              {
+                Error ("Get_atomic_data: more than one electron yield record for inner_cross %i\n", n);
+              }
             }
+          }
+          break;
 
 
-          }
-          else
-          {                     //It's not a macro atom line (SS)
-// It would have been better to define mflag = 0 since that is what we want to set
-// macro_info to if it is an old-style line, but keep it this way for now.  ksl
-            mflag = -1;         //a flag to mark this as not a macro atom case (SS)
-            nconfigl = -1;
-            nconfigu = -1;
-            nwords = sscanf (aline, "%*s %d %2d %le %le %le %le %le %le %d %d", &z, &istate, &freq, &f, &gl, &gu, &el, &eu, &levl, &levu);
-            if (nwords == 6)
-            {
-              el = 0.0;
-              eu = H * C / (freq * 1e-8);       // Convert Angstroms to ergs
-              levl = -1;
-              levu = -1;
+/**
+ * @section Chianti Collision Strengths
+ * The lines below read in collision strength data from Chianti (after Burgess and Tully). The original
+ *		  is stored in .scups files in chianti. The python script searches for matches to the lines_linked_ver_2.py
+ *		  data file, on the basis of energy and oscillator strength (and z and state). As a rather hamfisted
+ *		  approach, all of the line data is stored on the same line as the collision strength data in
+ *		  the file, so it is possible to make a very accurate match. It does mean quite a lot is read in
+ *		  from a line, but most is thrown away. Currently the code below matches based on z, state, upper and
+ *		  lower level numbers and oscillator strength
+ * Each line is defned with a set of three lines
+ * first line is CSTREN - this contains line data to try and match
+ * Second two lines are collision strength data from Burgess and Tully 1992A&A...254..436B
+ * These are generally 5 pojnt but up to 20 point spline fits of the T vs upsilon data. Typical lines are below
+ * @verbatim
+CSTREN Line  1  1 1215.673584  0.139000   2   2     0.000000    10.200121    0    1       1      3   7.500e-01   2.772e-01   1.478e+00    5    1   1.700e+00
+SCT   0.000e+00   2.500e-01   5.000e-01   7.500e-01   1.000e+00
+SCUPS    1.132e-01   2.708e-01   5.017e-01   8.519e-01   1.478e+00
+ * @endverbatim
 
-            }
-            else if (nwords == 8)
-            {                   // Then the file contains the energy levels of the transitions
 
-              el = EV2ERGS * el;
-              eu = EV2ERGS * eu;
-              levl = -1;
-              levu = -1;
-            }
-            else if (nwords == 10)
-            {                   // Then the file contains energy levels and level numbers
-              el = EV2ERGS * el;
-              eu = EV2ERGS * eu;
-            }
 
-            else
-            {
-              Error ("get_atomic_data: file %s line %d: Resonance line incorrectly formatted\n", file, lineno);
-              Error ("Get_atomic_data: %s\n", aline);
-              exit (0);
-            }
-          }
+ *		  */
 
-          if (el > eu)
-            Error ("get_atomic_data: file %s line %d : line has el (%f) > eu (%f)\n", file, lineno, el, eu);
-          for (n = 0; n < nions; n++)
+        case 'C':
+          nparam =
+            (sscanf
+             (aline,
+              "%*s %*s %d %2d %le %le %le %le %le %le %d %d %d %d %le %le %le %d %d %le",
+              &z, &istate, &freq, &f, &gl, &gu, &el, &eu, &levl, &levu, &c_l, &c_u, &en, &gf, &hlt, &np, &type, &sp));
+          if (nparam != 18)
           {
-            if (ion[n].z == z && ion[n].istate == istate)
-            {                   /* Then there is a match */
-              if (freq == 0 || f <= 0 || gl == 0 || gu == 0)
-              {
-                Error_silent ("getatomic_data: line input incomplete: %s\n", aline);
-                break;
-              }
-              //
-              //define macro atom case (SS)
-/* XXXX  04 April ksl -- Right now have enforced a clean separation between macro-ions and simple-ions
-but this is proably not what we want if we move all bf & fb transitions to macro-ion approach.  We
-would like to have simple lines for macro-ions */
-              if (ion[n].macro_info == 1 && mflag == -1)
+            Error ("Get_atomic_data: file %s line %d: Collision strength line incorrectly formatted\n", file, lineno);
+            Error ("Get_atomic_data: %s\n", aline);
+            exit (0);
+          }
+          for (n = 0; n < nlines; n++)  //loop over all the lines we have read in - look for a match
+          {
+            if (line[n].z == z && line[n].istate == istate
+                && line[n].levl == levl && line[n].levu == levu && line[n].gl == gl && line[n].gu == gu && line[n].f == f)
+            {
+              if (line[n].coll_index > -1)      //We already have a collision strength record from this line - throw an error and quit
               {
-                Error ("Get_atomic_data: Simple line data ignored for Macro-ion: %d\n", n);
-                break;
+                Error ("Get_atomic_data More than one collision strength record for line %i\n", n);
+                exit (0);
               }
 
-              if (ion[n].macro_info == -1 && mflag == 1)
+              coll_stren[n_coll_stren].n = n_coll_stren;
+              coll_stren[n_coll_stren].lower = c_l;
+              coll_stren[n_coll_stren].upper = c_u;
+              coll_stren[n_coll_stren].energy = en;
+              coll_stren[n_coll_stren].gf = gf;
+              coll_stren[n_coll_stren].hi_t_lim = hlt;
+              coll_stren[n_coll_stren].n_points = np;
+              coll_stren[n_coll_stren].type = type;
+              coll_stren[n_coll_stren].scaling_param = sp;
+
+              line[n].coll_index = n_coll_stren;        //point the line to its matching collision strength
+
+              //We now read in two lines of fitting data
+              if (fgets (aline, LINELENGTH, fptr) == NULL)
               {
-                Error ("Getatomic_data: Macro Atom line data supplied for ion %d\n but there is no suitable level data\n", n);
+                Error ("Get_atomic_data: Problem reading collision strength record\n");
+                Error ("Get_atomic_data: %s\n", aline);
                 exit (0);
               }
-              line[nlines].nion = n;
-              line[nlines].z = z;
-              line[nlines].istate = istate;
-              line[nlines].freq = C / (freq * 1e-8);    /* convert Angstroms to frequency */
-              line[nlines].f = f;
-              line[nlines].gl = gl;
-              line[nlines].gu = gu;
-              line[nlines].levl = levl;
-              line[nlines].levu = levu;
-              line[nlines].el = el;
-              line[nlines].eu = eu;
-              line[nlines].nconfigl = nconfigl;
-              line[nlines].nconfigu = nconfigu;
-              line[nlines].coll_index = -999;   //Tokick off with we assume there is no collisional strength data
-              if (mflag == -1)
+
+              /* JM 1709 -- increased number of entries read up to max of 20 */
+              nparam =
+                sscanf (aline,
+                        "%*s %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le",
+                        &temp[0], &temp[1], &temp[2], &temp[3],
+                        &temp[4], &temp[5], &temp[6], &temp[7],
+                        &temp[8], &temp[9], &temp[10], &temp[11],
+                        &temp[12], &temp[13], &temp[14], &temp[15], &temp[16], &temp[17], &temp[18], &temp[19]);
+
+              for (nn = 0; nn < np; nn++)
               {
-                line[nlines].macro_info = 0;    // It's an old-style line`
-                nlines_simple++;
+                coll_stren[n_coll_stren].sct[nn] = temp[nn];
               }
-              else
+              if (fgets (aline, LINELENGTH, fptr) == NULL)
               {
-                line[nlines].macro_info = 1;    //It's a macro line
-                nlines_macro++;
+                Error ("Get_atomic_data: Problem reading collision strength record\n");
+                Error ("Get_atomic_data: %s\n", aline);
+                exit (0);
               }
-              nlines++;
-            }
-          }
-          if (nlines > NLINES)
-          {
-            Error ("getatomic_data: file %s line %d: More lines than allowed. Increase NLINES in atomic.h\n", file, lineno);
-            exit (0);
-          }
-          break;
 
-/** @section Ground state fractions
- */
-        case 'f':
-          if (sscanf
-              (aline,
-               "%*s %d %d %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le",
-               &z, &istate, &the_ground_frac[0], &the_ground_frac[1],
-               &the_ground_frac[2], &the_ground_frac[3],
-               &the_ground_frac[4], &the_ground_frac[5],
-               &the_ground_frac[6], &the_ground_frac[7],
-               &the_ground_frac[8], &the_ground_frac[9],
-               &the_ground_frac[10], &the_ground_frac[11],
-               &the_ground_frac[12], &the_ground_frac[13],
-               &the_ground_frac[14], &the_ground_frac[15],
-               &the_ground_frac[16], &the_ground_frac[17], &the_ground_frac[18], &the_ground_frac[19]) != 22)
-          {
-            Error ("get_atomic_data: file %s line %d ground state fracs   frac table incorrectly formatted\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-          for (n = 0; n < nions; n++)
-          {
-            if (ion[n].z == z && ion[n].istate == istate)
-            {                   /* Then there is a match */
-              ground_frac[n].z = z;
-              ground_frac[n].istate = istate;
-              for (j = 0; j < 20; j++)
+              nparam =
+                sscanf (aline,
+                        "%*s %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le",
+                        &temp[0], &temp[1], &temp[2], &temp[3],
+                        &temp[4], &temp[5], &temp[6], &temp[7],
+                        &temp[8], &temp[9], &temp[10], &temp[11],
+                        &temp[12], &temp[13], &temp[14], &temp[15], &temp[16], &temp[17], &temp[18], &temp[19]);
+
+              for (nn = 0; nn < np; nn++)
               {
-                ground_frac[n].frac[j] = the_ground_frac[j];
+                coll_stren[n_coll_stren].scups[nn] = temp[nn];
               }
+              n_coll_stren++;
             }
           }
           break;
 
+        case 'c':              /* It was a comment line so do nothing */
+          break;
+        case 'z':
+        default:
+          Error ("get_atomicdata: Could not interpret line %d in file %s: %s\n", lineno, file, aline);
+          break;
+        }
 
-// Collision strengths --- Not currently used
-/** @section Collision strengths
- *  @bug This needs a description
+        strcpy (aline, "");
+      }
+
+      fclose (fptr);
+    }
+    /*End of do loop for reading a particular file of data */
+  }
+
+/* End of main do loop for reading all of the the data. At this point we can close
+   the masterfile
  */
-        case 'x':              /*The line contains collision strength information--Gaetz & Salpeter */
-          if (sscanf (aline, "%*s %*s %d %d %le %le %le %le %le", &z, &istate, &exx, &lambda, &alpha, &beta, &tm) != 7)
-          {
-            Error ("get_atomic_data: file %s line %d: Collision strengths incorrectly formatted\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-          for (n = 0; n < nions; n++)
-          {
-            if (ion[n].z == z && ion[n].istate == istate)
-            {                   /* Then there is a match */
-              xcol[nxcol].nion = n;
-              xcol[nxcol].z = z;
-              xcol[nxcol].istate = istate;
-              xcol[nxcol].ex = exx * EV2ERGS;
-              xcol[nxcol].freq = C / (lambda * 1.e-8);
-              xcol[nxcol].alpha = alpha;
-              xcol[nxcol].beta = beta;
-              xcol[nxcol].tm = pow (10., tm);
-              nxcol++;
-            }
-          }
 
-          break;
+  fclose (mptr);
+/* OK now summarize the data that has been read*/
 
+  n_elec_yield_tot = 0;         //Reset this numnber, we are now going to use it to check we have yields for all inner shells
+  n_fluor_yield_tot = 0;        //Reset this numnber, we are now going to use it to check we have yields for all inner shells
 
+  for (n = 0; n < n_inner_tot; n++)
+  {
+    if (inner_cross[n].n_elec_yield != -1)
+      n_elec_yield_tot++;
+    else
+      Error ("get_atomicdata: No inner electron yield data for inner cross section %i\n", n);
+    if (inner_cross[n].n_fluor_yield != -1)
+      n_fluor_yield_tot++;
 
+  }
 
-/** @section Dielectronic Recombination - type 1
- * This section reads in dielectronic recombination rates.
- * The data comes from Chianti, and there are two types of dielectronic data.
- * This is type 1 - which has fis decribed by Arnaud & Raymond (1992)
- * There are two fitting parameters, E and C which represent different
- * degrees in the fit - one sums over a set of parameters.
- *
- * A typical ion data would look like this
- *
- *
- @verbatim
- * DR_BADNL E 2 2 4.5560e+05 5.5520e+05 8.9820e+05 0.0000e+00 0.0000e+00 0.0000e+00 0.0000e+00 0.0000e+00
- * DR_BADNL C 2 2 5.9660e-04 1.6130e-04 -2.2230e-05 0.0000e+00 0.0000e+00 0.0000e+00 0.0000e+00 0.0000e+00
- @endverbatim
- *
- * where there are two lines for a given ion - this is for helium (z=2) 2 (istate=2)
- *
- */
+  Log ("Data of %3d elements, %3d ions, %5d levels, %5d lines, and %5d topbase records\n", nelements, nions, nlevels, nlines, ntop_phot);
+  Log
+    ("Macro   %3d elements, %3d ions, %5d levels, %5d lines, and %5d topbase records\n",
+     nelements, nions_macro, nlevels_macro, nlines_macro, ntop_phot_macro);
+  Log
+    ("Simple  %3d elements, %3d ions, %5d levels, %5d lines, and %5d topbase records\n",
+     nelements, nions_simple, nlevels_simple, nlines_simple, ntop_phot_simple);
+  Log ("We have read in %3d photoionization cross sections\n", nphot_total);
+  Log ("                %3d are topbase \n", ntop_phot);
+  Log ("                %3d are VFKY \n", nxphot);
+  Log ("We have read in %5d   Chiantic collision strengths\n", n_coll_stren);   //1701 nsh collision strengths
+  Log ("We have read in %3d Inner shell photoionization cross sections\n", n_inner_tot);        //110818 nsh added a reporting line about dielectronic recombination coefficients
+  Log ("                %3d have matching electron yield data\n", n_elec_yield_tot);
+  Log ("                %3d have matching fluorescent yield data\n", n_fluor_yield_tot);
 
-        case 'D':              /* Dielectronic recombination data read in. */
-          nparam = sscanf (aline, "%*s %s %d %d %le %le %le %le %le %le %le %le %le", &drflag, &z, &ne, &drp[0], &drp[1], &drp[2], &drp[3], &drp[4], &drp[5], &drp[6], &drp[7], &drp[8]);       //split and assign the line
-          nparam -= 3;          //take 4 off the nparam to give the number of actual parameters
-          if (nparam > 9 || nparam < 1) //     trap errors - not as robust as usual because there are a varaible number of parameters...
-          {
-            Error ("Something wrong with dielectronic recombination data\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
+  Log ("We have read in %3d Dielectronic recombination coefficients\n", ndrecomb);      //110818 nsh added a reporting line about dielectronic recombination coefficients
+  Log ("We have read in %3d Badnell totl Radiative rate coefficients\n", n_total_rr);
+  Log ("We have read in %3d Badnell GS   Radiative rate coefficients over the temp range %e to %e\n", n_bad_gs_rr, gstmin, gstmax);
+  Log ("We have read in %3d Scaled electron temperature frequency averaged gaunt factors\n", gaunt_n_gsqrd);
+  Log ("The minimum frequency for photoionization is %8.2e\n", phot_freq_min);
+  Log ("The minimum frequency for inner shell ionization is %8.2e\n", inner_freq_min);
 
-          istate = ne;          //         get the ionisation state we are recombining from
 
-          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
-          {
-            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
-            {
-              if (ion[n].drflag == 0)   //This is the first time we have dealt with this ion
-              {
-                drecomb[ndrecomb].nion = n;     //put the ion number into the DR structure
-                drecomb[ndrecomb].nparam = nparam;      //Put the number of parameters we ware going to read in, into the DR structure so we know what to iterate over later
-                ion[n].nxdrecomb = ndrecomb;    //put the number of the DR into the ion
-                drecomb[ndrecomb].type = DRTYPE_BADNELL;        //define the type of data
-                ndrecomb++;     //increment the counter of number of dielectronic recombination parameter sets
-                ion[n].drflag++;        //increment the flag by 1. We will do this rather than simply setting it to 1 so we will get errors if we do this more than once....
+/* Now begin a series of calculations with the data that has been read in in order
+to prepare it for use by other programs*/
 
-              }
-              if (drflag == 'E')        // this ion has no parameters, so it must be the first time through
-              {
+/* Calculate the conversion factor between rho and nh.  Note that our approximation here is
+somewhat inexact  because it assumes all elements have equal neutrons and protons. */
 
-                n1 = ion[n].nxdrecomb;  //     Get the pointer to the correct bit of the recombination coefficient array. This should already be set from the first time through
-                for (n2 = 0; n2 < nparam; n2++)
-                {
-                  drecomb[n1].e[n2] = drp[n2];  //we are getting e parameters
-                }
+  q = 1.;
+  for (nelem = 1; nelem < nelements; nelem++)
+  {
+    q += ele[nelem].abun * 2. * ele[nelem].z;
+  }
+
+  q = MPROT * q;
+  rho2nh = 1. / q;
+
+
+/* Now find the first and last ion associated with each named element and
+exit if there is an element with no ions */
+
+  for (nelem = 0; nelem < nelements; nelem++)
+  {
+    n = 0;
+    while (ion[n].z != ele[nelem].z && n < nions)
+      n++;                      /* Find the first ion of that element for which there is data */
+    ele[nelem].firstion = n;
+    while (ion[n].z == ele[nelem].z && n < nions)
+      n++;
+    ele[nelem].nions = n - ele[nelem].firstion;
+    if (ele[nelem].firstion == nions)
+    {
+      ele[nelem].firstion = -1; /* There were no ions for this element */
+// In principle, there might be a program which uses elements but not ions, but it seems unlikely,
+// therefore stop if there is not at least one ion for each element
+      Error ("Get_atomic_data: There were no ions for element %d %s\n", nelem, ele[nelem].name);
+      exit (0);
+    }
+  }
+
+
+/* Now attempt to associate lines with levels. If an association is found use, create
+a total emission oscillator strength for the level....really ought to be radiative lifefime */
+
+
+/* This next loop is connects levels to configurations for "simple atoms".
+ For Macro Atoms files, the data files already contain this infomration and
+ so the check is avoided by checking tte macro_info flag SS
+*/
 
 
-              }
-              else if (drflag == 'C')   //                  must be the second time though, so no need to read in all the other things
-              {
-                n1 = ion[n].nxdrecomb;  //     Get the pointer to the correct bit of the recombination coefficient array. This should already be set from the first time through
-                for (n2 = 0; n2 < nparam; n2++)
-                {
-                  drecomb[n1].c[n2] = drp[n2];  //           we are getting e parameters
-                }
-              }
 
-            }                   //close if statement that selects appropriate ion to add data to
-          }                     //close loop over ions
+  for (n = 0; n < nlines; n++)
+  {
+    if (ion[line[n].nion].macro_info == 0)      // not a macro atom (SS)
+    {
+      mstart = ion[line[n].nion].firstlevel;
+      mstop = mstart + ion[line[n].nion].nlevels;
 
+      m = mstart;
+      while (config[m].ilv != line[n].levl && m < mstop)
+        m++;
+      if (m < mstop)
+        line[n].nconfigl = m;
+      else
+        line[n].nconfigl = -9999;
 
-          break;
+      m = mstart;
+      while (config[m].ilv != line[n].levu && m < mstop)
+        m++;
+      if (m < mstop)
+      {
+        line[n].nconfigu = m;
+        config[m].rad_rate += a21 (&line[n]);
+      }
+      else
+        line[n].nconfigu = -9999;
+    }
+  }
 
-/** @section Dielectronic Recombination - type 2
- * This section reads in type 2 dielectronic recombination rates.
- * The data comes from Chianti, and there are two types of dielectronic data.
- * This is type 2 - which has a fit decribed by Shull & van Steenberg (1982)
- * There are four fitting parameters.
- * A typical ion data would look like this
- *
- *
- @verbatim
- * DR_SHULL 17 2 2.6510e-03 2.9300e-02 2.4120e+05 4.9410e+05
- @endverbatim
- *
- * where there are two lines for a given ion - this is for z=17 (istate=2)
- *
- */
+/* Check that all of the macro_info variables are initialized to 1
+or zero so that simple checks of true and false can be used for them */
 
+  for (n = 0; n < nions; n++)
+  {
+    if (ion[n].macro_info == -1)
+    {
+      Error ("Ion %d for element %s and ion %d is of unknown type\n", n, ion[n].z, ion[n].istate);
+      exit (0);
+    }
+  }
 
+  for (n = 0; n < nlevels; n++)
+  {
+    if (config[n].macro_info == -1)
+    {
+      Error ("Level %d for element %s and ion %d is of unknown type\n", n, config[n].z, config[n].istate);
+      exit (0);
+    }
+  }
 
-        case 'S':
-          nparam = sscanf (aline, "%*s %d %d %le %le %le %le ", &z, &ne, &drp[0], &drp[1], &drp[2], &drp[3]);   //split and assign the line
-          nparam -= 2;          //take 4 off the nparam to give the number of actual parameters
-          if (nparam > 4 || nparam < 1) //     trap errors - not as robust as usual because there are a varaible number of parameters...
-          {
-            Error ("Something wrong with dielectronic recombination data\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
+  for (n = 0; n < nlines; n++)
+  {
+    if (line[n].macro_info == -1)
+    {
+      Error ("Level %d for element %s and ion %d is of unknown type\n", n, line[n].z, line[n].istate);
+      exit (0);
+    }
+  }
 
-          istate = ne;          //         get the ionisation state we are recombining from
+  for (n = 0; n < nphot_total; n++)
+  {
+    if (phot_top[n].macro_info == -1)
+    {
+      Error ("Photoionization cross-section %d for element %s and ion %d is of unknown type\n", n, phot_top[n].z, phot_top[n].istate);
+      exit (0);
+    }
+  }
 
-          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
-          {
-            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
-            {
-              if (ion[n].drflag == 0)   //This is the first time we have dealt with this ion
-              {
-                drecomb[ndrecomb].nion = n;     //put the ion number into the DR structure
-                drecomb[ndrecomb].nparam = nparam;      //Put the number of parameters we ware going to read in, into the DR structure so we know what to iterate over later
-                ion[n].nxdrecomb = ndrecomb;    //put the number of the DR into the ion
-                drecomb[ndrecomb].type = DRTYPE_SHULL;  //define the type of data
-                ndrecomb++;     //increment the counter of number of dielectronic recombination parameter sets
-                ion[n].drflag++;        //increment the flag by 1. We will do this rather than simply setting it to 1 so we will get errors if we do this more than once....
+/* Finally evaluate how close we are to limits set in the structures */
 
-              }
-              n1 = ion[n].nxdrecomb;    //     Get the pointer to the correct bit of the recombination coefficient array. This should already be set from the first time through
-              for (n2 = 0; n2 < nparam; n2++)
-              {
-                drecomb[n1].shull[n2] = drp[n2];        //we are getting e parameters
-              }
-            }
-          }
-          break;
+  Log ("get_atomic_data: Evaluation:  There are %6d elements     while %6d are currently allowed\n", nelements, NELEMENTS);
+  Log ("get_atomic_data: Evaluation:  There are %6d ions         while %6d are currently allowed\n", nions, NIONS);
+  Log ("get_atomic_data: Evaluation:  There are %6d levels       while %6d were allocated\n", nlevels, nlevels_max);
+  Log ("get_atomic_data: Evaluation:  There are %6d lines        while %6d were allocated\n", nlines, nlines_max);
+  Log ("get_atomic_data: Evaluation:  There are %6d macro levels while %6d are currently allowed\n", nlevels_macro, NLEVELS_MACRO);
 
-/**
- * @section total radiative Recombination rates from Chianti - type 1 and 2
- * !RR RATE COEFFICIENT FITS (C)20110412 N. R. BADNELL, DEPARTMENT OF PHYSICS, UNIVERSITY OF STRATHCLYDE, GLASGOW G4 0NG, UK.
- * !This is total radiative rate into all possible states or the recombined ion.
- * !This data was downloaded from http://amdpp.phys.strath.ac.uk/tamoc/DATA/RR/ on 13/July/2013
- * !It is described in http://adsabs.harvard.edu/abs/2006ApJS..167..334B
- * !Only modification to original file is to insert the BAD_T_RR label to the front of each line and comments
- * !There are metastable levels in here, M=1 means we are recombining from the ground state, which is what we tend to want.
- * Some of these have one four parameters, a fit introduced by Verner & Ferland (1996) and
- * some have six, which is from Gu (2003). A four parameter data type is shown below
- *
- * @verbatim
- * !  Z  N  M  W      A        B        T0         T1        C        T2
- * BAD_T_RR  1  0  1  1  8.318E-11  0.7472  2.965E+00  7.001E+05
- * BAD_T_RR  2  0  1  1  1.818E-10  0.7492  1.017E+01  2.786E+06
- * BAD_T_RR  3  0  1  1  2.867E-10  0.7493  2.108E+01  6.268E+06
- * BAD_T_RR  4  0  1  1  3.375E-10  0.7475  4.628E+01  1.121E+07
- * BAD_T_RR  5  0  1  1  4.647E-10  0.7484  6.142E+01  1.753E+07
- * @endverbatim
- * */
+  bb_max = 0;
+  bf_max = 0;
 
-        case 'T':              /*Badnell type total raditive rate coefficients read in */
+  for (i = 0; i < nlevels; i++)
+  {
+    if (bb_max < config[i].n_bbu_jump)
+      bb_max = config[i].n_bbu_jump;
+    if (bb_max < config[i].n_bbd_jump)
+      bb_max = config[i].n_bbd_jump;
+    if (bf_max < config[i].n_bfu_jump)
+      bf_max = config[i].n_bfu_jump;
+    if (bf_max < config[i].n_bfd_jump)
+      bf_max = config[i].n_bfd_jump;
+  }
 
-          nparam = sscanf (aline, "%*s %d %d %d %le %le %le %le %le %le", &z, &ne, &w, &btrr[0], &btrr[1], &btrr[2], &btrr[3], &btrr[4], &btrr[5]);     //split and assign the line
-          nparam -= 3;          //take 4 off the nparam to give the number of actual parameters
-          if (nparam > 6 || nparam < 1) //     trap errors - not as robust as usual because there are a varaible number of parameters...
-          {
-            Error ("Something wrong with badnell total RR data\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
 
-          istate = ne;          //         get the traditional ionisation state
-          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
-          {
-            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
-            {
-              if (ion[n].total_rrflag == 0)     // this ion has no parameters, so it must be the first time through
-              {
-                total_rr[n_total_rr].nion = n;  //put the ion number into the bad_t_rr structure
-                ion[n].nxtotalrr = n_total_rr;  /*put the number of the bad_t_rr into the ion
-                                                   structure so we can go either way. */
-                total_rr[n_total_rr].type = RRTYPE_BADNELL;
-                for (n1 = 0; n1 < nparam; n1++)
-                {
-                  total_rr[n_total_rr].params[n1] = btrr[n1];   //we are getting  parameters
-                }
-                ion[n].total_rrflag++;  //increment the flag by 1. We will do this rather than simply setting it to 1 so we will get errors if we do this more than once....
-                n_total_rr++;   //increment the counter of number of dielectronic recombination parameter sets
-              }
-              else if (ion[n].total_rrflag > 0) //       unexpected second line matching z and charge
-              {
-                Error ("More than one badnell total RR rate for ion %i\n", n);
-                Error ("Get_atomic_data: %s\n", aline);
-                exit (0);
-              }
-              else              //if flag is not a positive number, we have a problem
-              {
-                Error ("Total radiative recombination flag giving odd results\n");
-                exit (0);
-              }
-            }                   //close if statement that selects appropriate ion to add data to
-          }                     //close loop over ions
+  Log ("get_atomic_data: Evaluation:  The maximum value bb jumps is %d while %d are currently allowed\n", bb_max, NBBJUMPS);
+  Log ("get_atomic_data: Evaluation:  The maximum value bf jumps is %d while %d are currently allowed\n", bb_max, NBBJUMPS);
 
+/* Now, write the data to a file so you can check it later if you wish */
+/* this is controlled by one of the -d flag modes, defined in atomic.h */
+  if (write_atomicdata)
+  {
 
+    if ((fptr = fopen ("data.out", "w")) == NULL)
+    {
+      Error ("get_atomic data:  Could not open data.out\n");
+      exit (0);
+    }
 
-          break;
+    fprintf (fptr, "This file contains data which was read in by get_atomicdata\n");
 
-/**
- * @section Total radiative recombination - type 3
- * These are some rare ion recombination rates that have
- * a two parameter fit by Aldrovandi & Pequignot (1973)
- * They have data like
- * @verbatim
- * RR_SHULL 22 2 1.0965e-11 6.9901e-01
- * RR_SHULL 22 3 1.8600e-11 7.2800e-01
- * @endverbatim
- *
- * For erroneous historical reasons they are referred to as SHULL
- *
- */
+    fprintf (fptr, "Data of %d elements, %d ions, and %d levels %d lines\n", nelements, nions, nlevels, nlines);
 
 
+    /* Write the element array */
+    fprintf (fptr, "Element Data:\n");
+    for (nelem = 0; nelem < nelements; nelem++)
+    {
+      fprintf (fptr, "Element %2d %5s firstion %2d nions %2d\n", nelem, ele[nelem].name, ele[nelem].firstion, ele[nelem].nions);
+    }
+
+    /* Write the ion array */
+    fprintf (fptr, "Ion data:\n");
+    for (n = 0; n < nions; n++)
+    {
+      fprintf (fptr,
+               "ion %3d z %3d istate %3d firstlevel %3d nlevels %3d potential %8.3g\n",
+               n, ion[n].z, ion[n].istate, ion[n].firstlevel, ion[n].nlevels, ion[n].ip / EV2ERGS);
+    }
 
+    /* Write the excitation level data */
+    fprintf (fptr, "Excitation levels: There are %d levels\n", nlevels);
+    for (n = 0; n < nlevels; n++)
+      fprintf (fptr, "n %3d q %.1f g %3.0f ex %8.3g\n", n, config[n].q_num, config[n].g, config[n].ex);
 
-        case 's':
-          nparam = sscanf (aline, "%*s %d %d %le %le ", &z, &ne, &btrr[0], &btrr[1]);   //split and assign the line
-          nparam -= 2;          //take 4 off the nparam to give the number of actual parameters
-          if (nparam > 6 || nparam < 1) //     trap errors - not as robust as usual because there are a varaible number of parameters...
-          {
-            Error ("Something wrong with shull total RR data\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
+    /* Write the photoionization data  */
+    fprintf (fptr, "Photoionization data: There are %d edges\n", ntop_phot + nxphot);
+    for (n = 0; n < ntop_phot + nxphot; n++)
+    {
+      fprintf (fptr, "n %3d z %2d istate %3d sigma %8.2e freq[0] %8.2e\n",
+               n, phot_top[n].z, phot_top[n].istate, phot_top[n].x[0], phot_top[n].freq[0]);
+    }
 
-          istate = ne;          //         get the traditional ionisation state
-          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
-          {
-            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
-            {
-              if (ion[n].total_rrflag == 0)     // this ion has no parameters, so it must be the first time through
-              {
-                total_rr[n_total_rr].nion = n;  //put the ion number into the bad_t_rr structure
-                ion[n].nxtotalrr = n_total_rr;  /*put the number of the bad_t_rr into the ion
-                                                   structure so we can go either way. */
-                total_rr[n_total_rr].type = RRTYPE_SHULL;
-                for (n1 = 0; n1 < nparam; n1++)
-                {
-                  total_rr[n_total_rr].params[n1] = btrr[n1];   //we are getting  parameters
-                }
-                ion[n].total_rrflag++;  //increment the flag by 1. We will do this rather than simply setting it to 1 so we will get errors if we do this more than once....
-                n_total_rr++;   //increment the counter of number of dielectronic recombination parameter sets
-              }
-              else if (ion[n].total_rrflag > 0) //       unexpected second line matching z and charge
-              {
-                Error ("More than one total RR rate for ion %i\n", n);
-                Error ("Get_atomic_data: %s\n", aline);
-                exit (0);
-              }
-              else              //if flag is not a positive number, we have a problem
-              {
-                Error ("Total radiative recombination flag giving odd results\n");
-                exit (0);
-              }
-            }                   //close if statement that selects appropriate ion to add data to
-          }                     //close loop over ions
-          break;
+    /* Write the resonance line data to the file */
 
+    fprintf (fptr, "Line data: There are %d lines\n", nlines);
 
-/**
- * @section Ground state recombination rate data
- * !RR RATE COEFFICIENT FITS (C)20110412 N. R. BADNELL, DEPARTMENT OF PHYSICS, UNIVERSITY OF STRATHCLYDE, GLASGOW G4 0NG, UK.
- * !This is resolved radiative rate from ground state to ground state.
- * !This data was downloaded from http://amdpp.phys.strath.ac.uk/tamoc/DATA/RR/ on 13/July/2013
- * !It is described in http://adsabs.harvard.edu/abs/2006ApJS..167..334B
- * !THe data comes as one file for each ion, with many rates. This file contains the first rate line in each file
- * ! which should relate to the ground state of the upper ion recombining into the ground state of the recombined ion.
- * !The data is tabulated in temperature, first line for each ion is temp, second is rate.
- * !As with other Badnell data, first number is z, second is number of remianing electrons.
- *
- * @verbatim
- * BAD_GS_RR T 1 0 1.00E+01 2.00E+01 5.00E+01 1.00E+02 2.00E+02 5.00E+02 1.00E+03 2.00E+03 5.00E+03 1.00E+04 2.00E+04 5.00E+04 1.00E+05 2.00E+05 5.00E+05 1.00E+06 2.00E+06 5.00E+06 1.00E+07
- * BAD_GS_RR R 1 0 5.21E-12 3.68E-12 2.33E-12 1.65E-12 1.16E-12 7.35E-13 5.18E-13 3.65E-13 2.28E-13 1.58E-13 1.08E-13 6.21E-14 3.88E-14 2.28E-14 1.01E-14 5.05E-15 2.36E-15 7.90E-16 3.27E-16
- * @endverbatim
+    for (n = 0; n < nlines; n++)
+    {
+      fprintf (fptr, "n %3d ion %3d freq %8.1e f %6.3f\n", n, line[n].nion, line[n].freq, line[n].f);
+    }
 
- */
+    /* Write the ground fraction data to the file */
+    fprintf (fptr, "Ground frac data (just first and last fracs here as a check):\n");
 
-        case 'G':
-          nparam = sscanf (aline, "%*s %s %d %d %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le", &gsflag, &z, &ne, &gstemp[0], &gstemp[1], &gstemp[2], &gstemp[3], &gstemp[4], &gstemp[5], &gstemp[6], &gstemp[7], &gstemp[8], &gstemp[9], &gstemp[10], &gstemp[11], &gstemp[12], &gstemp[13], &gstemp[14], &gstemp[15], &gstemp[16], &gstemp[17], &gstemp[18]);   //split and assign the line
-          nparam -= 3;          //take 4 off the nparam to give the number of actual parameters
-          if (nparam > 19 || nparam < 1)        //     trap errors - not as robust as usual because there are a varaible number of parameters...
-          {
-            Error ("Something wrong with badnell GS RR data\n");
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-          istate = z - ne + 1;  //         get the traditional ionisation state
-          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
-          {
-            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
-            {
-              if (ion[n].bad_gs_rr_t_flag == 0 && ion[n].bad_gs_rr_r_flag == 0) //This is first set of this type of data for this ion
-              {
-                bad_gs_rr[n_bad_gs_rr].nion = n;        //put the ion number into the bad_t_rr structure
-                ion[n].nxbadgsrr = n_bad_gs_rr; //put the number of the bad_t_rr into the ion structure so we can go either way.
-                n_bad_gs_rr++;  //increment the counter of number of ground state RR
-              }
-              /*Now work out what type of line it is, and where it needs to go */
-              if (gsflag == 'T')        //it is a temperature line
-              {
-                if (ion[n].bad_gs_rr_t_flag == 0)       //and we need a temp line for this ion
-                {
-                  if (gstemp[0] > gstmin)
-                    gstmin = gstemp[0];
-                  if (gstemp[18] < gstmax)
-                    gstmax = gstemp[18];
-                  ion[n].bad_gs_rr_t_flag = 1;  //set the flag
-                  for (n1 = 0; n1 < nparam; n1++)
-                  {
-                    bad_gs_rr[ion[n].nxbadgsrr].temps[n1] = gstemp[n1];
-                  }
-                }
-                else if (ion[n].bad_gs_rr_t_flag == 1)  //we already have a temp line for this ion
-                {
-                  Error ("More than one temp line for badnell GS RR rate for ion %i\n", n);
-                  Error ("Get_atomic_data: %s\n", aline);
-                  exit (0);
-                }
-                else            //some other odd thing had happened
-                {
-                  Error ("Get_atomic_data: %s\n", aline);
-                  exit (0);
-                }
-              }
-              else if (gsflag == 'R')   //it is a rate line
-              {
-                if (ion[n].bad_gs_rr_r_flag == 0)       //and we need a rate line for this ion
-                {
-                  ion[n].bad_gs_rr_r_flag = 1;  //set the flag
-                  for (n1 = 0; n1 < nparam; n1++)
-                  {
-                    bad_gs_rr[ion[n].nxbadgsrr].rates[n1] = gstemp[n1];
-                  }
-                }
-                else if (ion[n].bad_gs_rr_r_flag == 1)  //we already have a rate line for this ion
-                {
-                  Error ("More than one rate line for badnell GS RR rate for ion %i\n", n);
-                  Error ("Get_atomic_data: %s\n", aline);
-                  exit (0);
-                }
-                else            //some other odd thing had happened
-                {
-                  Error ("Get_atomic_data: %s\n", aline);
-                  exit (0);
-                }
-              }
-              else              //We have some problem with this line
-              {
-                Error ("Get_atomic_data: %s\n", aline);
-                exit (0);
-              }
-            }                   //end of loop over dealing with data for a discovered ion
-          }                     //end of loop over ions
+    for (n = 0; n < NIONS; n++)
+    {
+      fprintf (fptr, "%3d %3d %6.3f %6.3f\n", ground_frac[n].z, ground_frac[n].istate, ground_frac[n].frac[0], ground_frac[n].frac[19]);
+    }
 
-          break;
+    /* Write the collisions strengths to the file */
 
-/**
- * @section gaunt factor
- * The following are lines to read in temperature averaged free-free gaunt factors
- * from the data of Sutherland (1998). The atomic file is basically unchanged
- * from the data on the website, just with the top few lines commented out,
- * and a label prepended to each line
- * The data is a spline fit to the gaunt factor as a function of g - the reduced
- * temperature.
- * @verbatim
- * # log(g^2) <gff(g^2)>       s1           s2            s3
- * # ------------------------------------------------------------
- * FF_GAUNT -4.00 1.113883E+00  1.348000E-02  1.047100E-02 -1.854972E-03
- * FF_GAUNT -3.80 1.116983E+00  1.744580E-02  9.358014E-03  5.564917E-03
- * FF_GAUNT -3.60 1.120891E+00  2.185680E-02  1.269696E-02  4.970250E-03
- * FF_GAUNT -3.40 1.125810E+00  2.753201E-02  1.567911E-02  6.429140E-03
-* @endverbatim
+    fprintf (fptr, "Collision strengths: There were %d collision strengths\n", nxcol);
 
- */
-        case 'g':
-          nparam = sscanf (aline, "%*s %le %le %le %le %le", &gsqrdtemp, &gfftemp, &s1temp, &s2temp, &s3temp);  //split and assign the line
-          if (nparam > 5 || nparam < 1) //     trap errors
-          {
-            Error ("Something wrong with sutherland gaunt data\n");
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-          if (gaunt_n_gsqrd == 0 || gsqrdtemp > gaunt_total[gaunt_n_gsqrd - 1].log_gsqrd)       //We will use it if it's our first piece of data or is in order
-          {
-            gaunt_total[gaunt_n_gsqrd].log_gsqrd = gsqrdtemp;   //The scaled electron temperature squared for this array
-            gaunt_total[gaunt_n_gsqrd].gff = gfftemp;
-            gaunt_total[gaunt_n_gsqrd].s1 = s1temp;
-            gaunt_total[gaunt_n_gsqrd].s2 = s2temp;
-            gaunt_total[gaunt_n_gsqrd].s3 = s3temp;
-            gaunt_n_gsqrd++;
-          }
-          else
-          {
-            Error ("Something wrong with gaunt data\n");
-            Error ("Get_atomic_data %s\n", aline);
-            exit (0);
-          }
+    for (n = 0; n < nxcol; n++)
+    {
+      fprintf (fptr,
+               "nion %d z,i %d %d freq %8.2e alpha %8.2e beta %8.2e tmax %8.2e\n",
+               xcol[n].nion, xcol[n].z, xcol[n].istate, xcol[n].freq, xcol[n].alpha, xcol[n].beta, xcol[n].tm);
+    }
 
+    fclose (fptr);
+  }                             // end of if statement based on modes.write_atomicdata
 
 
-          break;
-/**
- * @section direct (collisional) ionization data from Dere 07.
- * #Title: Ionization rate coefficients for elements H to Zn (Dere+, 2007)
- * #Table  J_A_A_466_771_table29:
- * #Title: Spline fits, multiplied by a factor of 10^6^, to the scaled ionization rate coefficients
- * #Column Z       (I2)    [1/30] Nuclear charge   [ucd=phys.atmol.element]
- * #Column Ion     (I2)    [1/30] Ion (spectroscopic notation)     [ucd=phys.atmol.ionStage]
- * #Column Nspl    (I2)    [15/20] Number of splines       [ucd=meta.number]
- * #Column I       (F9.3)  Ionization potential    [ucd=phys.energy;phys.atmol.ionization]
- * #Column Tmin    (E10.3) Minimum temperature     [ucd=phys.temperature]
- * #Column x1-X20      (F7.4)  Scaled temperature 1 (1)        [ucd=phys.temperature]
- * #Column rho1 -rho20   (F8.4)  ? Scaled rate coefficient 1 (2) [ucd=arith.rate;phys.atmol.collisional]
- */
-        case 'd':
-          nparam = sscanf (aline, "%*s %d %d %d %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le", &z, &istate, &nspline, &et, &tmin, &temp[0], &temp[1], &temp[2], &temp[3], &temp[4], &temp[5], &temp[6], &temp[7], &temp[8], &temp[9], &temp[10], &temp[11], &temp[12], &temp[13], &temp[14], &temp[15], &temp[16], &temp[17], &temp[18], &temp[19], &temp[20], &temp[21], &temp[22], &temp[23], &temp[24], &temp[25], &temp[26], &temp[27], &temp[28], &temp[29], &temp[30], &temp[31], &temp[32], &temp[33], &temp[34], &temp[35], &temp[36], &temp[37], &temp[38], &temp[39]);     //split and assign the line
 
-          if (nparam != 5 + (nspline * 2))      //     trap errors
-          {
-            Error ("Something wrong with Dere DI data\n");
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-          for (n = 0; n < nions; n++)   //Loop over ions to find the correct place to put the data
-          {
-            if (ion[n].z == z && ion[n].istate == istate)       // this works out which ion we are dealing with
-            {
-              if (ion[n].dere_di_flag == 0)     //This is first set of this type of data for this ion
-              {
-                ion[n].dere_di_flag = 1;
-                dere_di_rate[n_dere_di_rate].nion = n;  //put the ion number into the dere_di_rate structure
-                ion[n].nxderedi = n_dere_di_rate;       //put the number of the dere_di_rate into the ion structure so we can go either way.
-                dere_di_rate[n_dere_di_rate].xi = et;
-                dere_di_rate[n_dere_di_rate].min_temp = tmin;
-                dere_di_rate[n_dere_di_rate].nspline = nspline;
-                for (n1 = 0; n1 < nspline; n1++)
-                {
-                  dere_di_rate[n_dere_di_rate].temps[n1] = temp[n1];
-                  dere_di_rate[n_dere_di_rate].rates[n1] = temp[n1 + nspline] * 1e-6;
+  /* Finally create frequency ordered pointers to the various portions
+   * of the atomic data
+   */
 
-                }
-                n_dere_di_rate++;       //increment the counter of number of ground state RR
-              }
-              else
-              {
-                Error ("Get_atomic_data: More than one Dere DI rate for ion %i\n", n);
-              }
-            }
-          }
-          break;
+  /* Index the lines */
+  index_lines ();
 
-/**
- * @section Electron yield - goes with auger ionization rates
- * #This is electron yield data from Kaastra & Mewe (1993) -1993A&AS...97..443K
- * #It is processed from data downloaded from http://vizier.cfa.harvard.edu/viz-bin/VizieR?-source=J/A+AS/97/443
- * #Via the python script kaastra_2_py.py. Example lines of file below
- * #
- * @verbatim
- * #Label z state n l IP mean_electron_energy Prob_of_1e Prob_of_2e Prob_of_3e ....
- * Kelecyield 4 1 1 0 1.1500e+02 9.280e+01 0.000e+00 1.000e+04 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00
- * Kelecyield 5 1 1 0 1.9200e+02 1.639e+02 6.000e+00 9.994e+03 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00 0.000e+00
- * @endverbatim
+  /* Index the collisions */
+  index_collisions ();
 
-*/
 
-        case 'K':
-          nparam =
-            sscanf (aline,
-                    "%*s %d %d %d %d %le %le %le %le %le %le %le %le %le %le %le %le",
-                    &z, &istate, &in, &il, &I, &Ea, &temp[0],
-                    &temp[1], &temp[2], &temp[3], &temp[4], &temp[5], &temp[6], &temp[7], &temp[8], &temp[9]);
-          if (nparam != 16)
-          {
-            Error ("Something wrong with electron yield data\n");
-            Error ("Get_atomic_data %s\n", aline);
-            exit (0);
-          }
-          for (n = 0; n < n_inner_tot; n++)
-          {
-            if (inner_cross[n].z == z && inner_cross[n].istate == istate && inner_cross[n].n == in && inner_cross[n].l == il)
-            {
-              if (inner_cross[n].n_elec_yield == -1)    /*This is the first yield data for this vacancy */
-              {
-                inner_elec_yield[n_elec_yield_tot].nion = n;    /*This yield refers to this ion */
-                inner_cross[n].n_elec_yield = n_elec_yield_tot;
-                inner_elec_yield[n_elec_yield_tot].z = z;
-                inner_elec_yield[n_elec_yield_tot].istate = istate;
-                inner_elec_yield[n_elec_yield_tot].n = in;
-                inner_elec_yield[n_elec_yield_tot].l = il;
-                inner_elec_yield[n_elec_yield_tot].I = I * EV2ERGS;
-                inner_elec_yield[n_elec_yield_tot].Ea = Ea * EV2ERGS;
-                for (n1 = 0; n1 < 10; n1++)
-                {
-                  inner_elec_yield[n_elec_yield_tot].prob[n1] = temp[n1] / 10000.0;
-                }
-                n_elec_yield_tot++;
-              }
-              else
-              {
-                Error ("Get_atomic_data: more than one electron yield record for inner_cross %i\n", n);
-              }
-            }
-          }
-          break;
-/**
- * @section Fluorescent photon yield from inner shell ionization - not currently used but read in.
- * #This is fluorescent yield data from Kaastra & Mewe (1993) -1993A&AS...97..443K
- * #It is processed from data downloaded from http://vizier.cfa.harvard.edu/viz-bin/VizieR?-source=J/A+AS/97/443
- * #Via the python script kaastra_2_py.py.
- * Data format below
- * #
- * @verbatim
- * #Label z state n l photon_energy yield
- * Kphotyield 5 1 1 0 1.837e+02 6.000e-04
- * Kphotyield 5 1 1 0 1.690e+01 7.129e-01
- * @endverbatim
- */
-        case 'F':
-          nparam = sscanf (aline, "%*s %d %d %d %d %le %le ", &z, &istate, &in, &il, &energy, &yield);
-          if (nparam != 6)
-          {
-            Error ("Something wrong with fluorescent yield data\n");
-            Error ("Get_atomic_data %s\n", aline);
-            exit (0);
-          }
-          for (n = 0; n < n_inner_tot; n++)
-          {
-            if (inner_cross[n].z == z && inner_cross[n].istate == istate && inner_cross[n].n == in && inner_cross[n].l == il)
-            {
-              if (inner_cross[n].n_fluor_yield == -1)   /*This is the first yield data for this vacancy */
-              {
-                inner_fluor_yield[n_fluor_yield_tot].nion = n;  /*This yield refers to this ion */
-                inner_cross[n].n_fluor_yield = n_fluor_yield_tot;
-                inner_fluor_yield[n_fluor_yield_tot].z = z;
-                inner_fluor_yield[n_fluor_yield_tot].istate = istate;
-                inner_fluor_yield[n_fluor_yield_tot].n = in;
-                inner_fluor_yield[n_fluor_yield_tot].l = il;
-                inner_fluor_yield[n_fluor_yield_tot].freq = energy / HEV;
-                inner_fluor_yield[n_fluor_yield_tot].yield = yield;
-                n_fluor_yield_tot++;
-              }
-              else
-              {
-                Error ("Get_atomic_data: more than one electron yield record for inner_cross %i\n", n);
-              }
-            }
-          }
-          break;
+/* Index the topbase photoionization structure by threshold freqeuncy */
+  if (ntop_phot + nxphot > 0)
+    index_phot_top ();
+/* Index the topbase photoionization structure by threshold freqeuncy */
+  if (n_inner_tot > 0)
+    index_inner_cross ();
+
 
+  check_xsections ();           // debug routine, only prints if verbosity > 4
 
-/**
- * @section Chianti Collision Strengths
- * The lines below read in collision strength data from Chianti (after Burgess and Tully). The original
- *		  is stored in .scups files in chianti. The python script searches for matches to the lines_linked_ver_2.py
- *		  data file, on the basis of energy and oscillator strength (and z and state). As a rather hamfisted
- *		  approach, all of the line data is stored on the same line as the collision strength data in
- *		  the file, so it is possible to make a very accurate match. It does mean quite a lot is read in
- *		  from a line, but most is thrown away. Currently the code below matches based on z, state, upper and
- *		  lower level numbers and oscillator strength
- * Each line is defned with a set of three lines
- * first line is CSTREN - this contains line data to try and match
- * Second two lines are collision strength data from Burgess and Tully 1992A&A...254..436B
- * These are generally 5 pojnt but up to 20 point spline fits of the T vs upsilon data. Typical lines are below
- * @verbatim
-CSTREN Line  1  1 1215.673584  0.139000   2   2     0.000000    10.200121    0    1       1      3   7.500e-01   2.772e-01   1.478e+00    5    1   1.700e+00
-SCT   0.000e+00   2.500e-01   5.000e-01   7.500e-01   1.000e+00
-SCUPS    1.132e-01   2.708e-01   5.017e-01   8.519e-01   1.478e+00
- * @endverbatim
+  strcpy (atomic_masterfile, masterfile);
 
+  return (0);
+}
 
 
- *		  */
 
-        case 'C':
-          nparam =
-            (sscanf
-             (aline,
-              "%*s %*s %d %2d %le %le %le %le %le %le %d %d %d %d %le %le %le %d %d %le",
-              &z, &istate, &freq, &f, &gl, &gu, &el, &eu, &levl, &levu, &c_l, &c_u, &en, &gf, &hlt, &np, &type, &sp));
-          if (nparam != 18)
-          {
-            Error ("Get_atomic_data: file %s line %d: Collision strength line incorrectly formatted\n", file, lineno);
-            Error ("Get_atomic_data: %s\n", aline);
-            exit (0);
-          }
-          for (n = 0; n < nlines; n++)  //loop over all the lines we have read in - look for a match
-          {
-            if (line[n].z == z && line[n].istate == istate
-                && line[n].levl == levl && line[n].levu == levu && line[n].gl == gl && line[n].gu == gu && line[n].f == f)
-            {
-              if (line[n].coll_index > -1)      //We already have a collision strength record from this line - throw an error and quit
-              {
-                Error ("Get_atomic_data More than one collision strength record for line %i\n", n);
-                exit (0);
-              }
+/**********************************************************/
+/**
+ * @brief      Allocate the structures which hold the atomic data and set 
+ * them to their initial values
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * The structures which are allocated dynamically are freed first if
+ * they already exist.  Entries which are not filled by reading the 
+ * data are left with these values.
+ *
+ * The numbers of lines, levels, x-sections and collision strengths to
+ * allocate, and the size of atomic_arena, must have been set, either
+ * by count_atomic_data or from a binary image of the data.
+ *
+ * ### Notes ###
+ * This is called by get_atomic_data before the data files are
+ * read, and by atomic_image_read before a binary image of them is read.
+ *
+ **********************************************************/
 
-              coll_stren[n_coll_stren].n = n_coll_stren;
-              coll_stren[n_coll_stren].lower = c_l;
-              coll_stren[n_coll_stren].upper = c_u;
-              coll_stren[n_coll_stren].energy = en;
-              coll_stren[n_coll_stren].gf = gf;
-              coll_stren[n_coll_stren].hi_t_lim = hlt;
-              coll_stren[n_coll_stren].n_points = np;
-              coll_stren[n_coll_stren].type = type;
-              coll_stren[n_coll_stren].scaling_param = sp;
+int
+init_atomic_data ()
+{
+  int n, i, j, n1;
 
-              line[n].coll_index = n_coll_stren;        //point the line to its matching collision strength
+/* Allocate structures for storage of data */
 
-              //We now read in two lines of fitting data
-              if (fgets (aline, LINELENGTH, fptr) == NULL)
-              {
-                Error ("Get_atomic_data: Problem reading collision strength record\n");
-                Error ("Get_atomic_data: %s\n", aline);
-                exit (0);
-              }
+  if (ele != NULL)
+  {
+    free (ele);
+  }
+  ele = (ElemPtr) calloc (sizeof (ele_dummy), NELEMENTS);
 
-              /* JM 1709 -- increased number of entries read up to max of 20 */
-              nparam =
-                sscanf (aline,
-                        "%*s %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le",
-                        &temp[0], &temp[1], &temp[2], &temp[3],
-                        &temp[4], &temp[5], &temp[6], &temp[7],
-                        &temp[8], &temp[9], &temp[10], &temp[11],
-                        &temp[12], &temp[13], &temp[14], &temp[15], &temp[16], &temp[17], &temp[18], &temp[19]);
+  if (ele == NULL)
+  {
+    Error ("There is a problem in allocating memory for the element structure\n");
+    exit (0);
+  }
+  else
+  {
+    Log_silent
+      ("Allocated %10d bytes for each of %6d elements of   elements totaling %10.0f Mb \n",
+       sizeof (ele_dummy), NELEMENTS, 1.e-6 * NELEMENTS * sizeof (ele_dummy));
+  }
 
-              for (nn = 0; nn < np; nn++)
-              {
-                coll_stren[n_coll_stren].sct[nn] = temp[nn];
-              }
-              if (fgets (aline, LINELENGTH, fptr) == NULL)
-              {
-                Error ("Get_atomic_data: Problem reading collision strength record\n");
-                Error ("Get_atomic_data: %s\n", aline);
-                exit (0);
-              }
 
-              nparam =
-                sscanf (aline,
-                        "%*s %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le %le",
-                        &temp[0], &temp[1], &temp[2], &temp[3],
-                        &temp[4], &temp[5], &temp[6], &temp[7],
-                        &temp[8], &temp[9], &temp[10], &temp[11],
-                        &temp[12], &temp[13], &temp[14], &temp[15], &temp[16], &temp[17], &temp[18], &temp[19]);
+  if (ion != NULL)
+  {
+    free (ion);
+  }
+  ion = (IonPtr) calloc (sizeof (ion_dummy), NIONS);
 
-              for (nn = 0; nn < np; nn++)
-              {
-                coll_stren[n_coll_stren].scups[nn] = temp[nn];
-              }
-              n_coll_stren++;
-            }
-          }
-          break;
+  if (ion == NULL)
+  {
+    Error ("There is a problem in allocating memory for the ion structure\n");
+    exit (0);
+  }
+  else
+  {
+    Log_silent
+      ("Allocated %10d bytes for each of %6d elements of       ions totaling %10.1f Mb \n",
+       sizeof (ion_dummy), NIONS, 1.e-6 * NIONS * sizeof (ion_dummy));
+  }
 
-        case 'c':              /* It was a comment line so do nothing */
-          break;
-        case 'z':
-        default:
-          Error ("get_atomicdata: Could not interpret line %d in file %s: %s\n", lineno, file, aline);
-          break;
-        }
 
-        strcpy (aline, "");
-      }
 
-      fclose (fptr);
-    }
-    /*End of do loop for reading a particular file of data */
+  if (config != NULL)
+  {
+    free (config);
   }
+  config = (ConfigPtr) calloc (sizeof (config_dummy), nlevels_max);
 
-/* End of main do loop for reading all of the the data. At this point we can close
-   the masterfile
- */
+  if (config == NULL)
+  {
+    Error ("There is a problem in allocating memory for the config structure\n");
+    exit (0);
+  }
+  else
+  {
+    Log_silent
+      ("Allocated %10d bytes for each of %6d elements of     config totaling %10.1f Mb \n",
+       sizeof (config_dummy), nlevels_max, 1.e-6 * nlevels_max * sizeof (config_dummy));
+  }
 
-  fclose (mptr);
-/* OK now summarize the data that has been read*/
 
-  n_elec_yield_tot = 0;         //Reset this numnber, we are now going to use it to check we have yields for all inner shells
-  n_fluor_yield_tot = 0;        //Reset this numnber, we are now going to use it to check we have yields for all inner shells
 
-  for (n = 0; n < n_inner_tot; n++)
+
+  if (line != NULL)
   {
-    if (inner_cross[n].n_elec_yield != -1)
-      n_elec_yield_tot++;
-    else
-      Error ("get_atomicdata: No inner electron yield data for inner cross section %i\n", n);
-    if (inner_cross[n].n_fluor_yield != -1)
-      n_fluor_yield_tot++;
+    free (line);
+  }
+  line = (LinePtr) calloc (sizeof (line_dummy), nlines_max);
 
+  if (line == NULL)
+  {
+    Error ("There is a problem in allocating memory for the line structure\n");
+    exit (0);
+  }
+  else
+  {
+    Log_silent
+      ("Allocated %10d bytes for each of %6d elements of       line totaling %10.1f Mb \n",
+       sizeof (line_dummy), nlines_max, 1.e-6 * nlines_max * sizeof (line_dummy));
   }
 
-  Log ("Data of %3d elements, %3d ions, %5d levels, %5d lines, and %5d topbase records\n", nelements, nions, nlevels, nlines, ntop_phot);
-  Log
-    ("Macro   %3d elements, %3d ions, %5d levels, %5d lines, and %5d topbase records\n",
-     nelements, nions_macro, nlevels_macro, nlines_macro, ntop_phot_macro);
-  Log
-    ("Simple  %3d elements, %3d ions, %5d levels, %5d lines, and %5d topbase records\n",
-     nelements, nions_simple, nlevels_simple, nlines_simple, ntop_phot_simple);
-  Log ("We have read in %3d photoionization cross sections\n", nphot_total);
-  Log ("                %3d are topbase \n", ntop_phot);
-  Log ("                %3d are VFKY \n", nxphot);
-  Log ("We have read in %5d   Chiantic collision strengths\n", n_coll_stren);   //1701 nsh collision strengths
-  Log ("We have read in %3d Inner shell photoionization cross sections\n", n_inner_tot);        //110818 nsh added a reporting line about dielectronic recombination coefficients
-  Log ("                %3d have matching electron yield data\n", n_elec_yield_tot);
-  Log ("                %3d have matching fluorescent yield data\n", n_fluor_yield_tot);
+  /* Allocate the arrays which order the lines and x-sections by frequency, the x-sections
+     themselves, and the collision strengths */
+
+  free (lin_ptr);
+  free (lin_freq);
+  free (lin_nion);
+  free (coll_stren);
+  free (phot_top);
+  free (phot_top_ptr);
+  free (inner_cross);
+  free (inner_cross_ptr);
+  free (atomic_arena);
+
+  lin_ptr = (LinePtr *) calloc (sizeof (LinePtr), nlines_max);
+  lin_freq = (double *) calloc (sizeof (double), nlines_max);
+  lin_nion = (int *) calloc (sizeof (int), nlines_max);
+  coll_stren = (Coll_stren *) calloc (sizeof (Coll_stren), n_coll_stren_max);
+  phot_top = (Topbase_phot *) calloc (sizeof (Topbase_phot), nphot_max);
+  phot_top_ptr = (TopPhotPtr *) calloc (sizeof (TopPhotPtr), nphot_max);
+  inner_cross = (Topbase_phot *) calloc (sizeof (Topbase_phot), n_inner_max);
+  inner_cross_ptr = (TopPhotPtr *) calloc (sizeof (TopPhotPtr), n_inner_max);
+  atomic_arena = (char *) calloc (1, atomic_arena_size);
+  atomic_arena_used = 0;
+
+  if (lin_ptr == NULL || lin_freq == NULL || lin_nion == NULL || coll_stren == NULL || phot_top == NULL
+      || phot_top_ptr == NULL || inner_cross == NULL || inner_cross_ptr == NULL || atomic_arena == NULL)
+  {
+    Error ("There is a problem in allocating memory for the atomic data\n");
+    exit (0);
+  }
+  else
+  {
+    Log_silent
+      ("Allocated %10.1f Mb for %d photoionization x-sections, %d inner shell x-sections and %d collision strengths\n",
+       1.e-6 * (nphot_max * sizeof (Topbase_phot) + n_inner_max * sizeof (Topbase_phot) + n_coll_stren_max * sizeof (Coll_stren) +
+                atomic_arena_size), nphot_max, n_inner_max, n_coll_stren_max);
+  }
 
-  Log ("We have read in %3d Dielectronic recombination coefficients\n", ndrecomb);      //110818 nsh added a reporting line about dielectronic recombination coefficients
-  Log ("We have read in %3d Badnell totl Radiative rate coefficients\n", n_total_rr);
-  Log ("We have read in %3d Badnell GS   Radiative rate coefficients over the temp range %e to %e\n", n_bad_gs_rr, gstmin, gstmax);
-  Log ("We have read in %3d Scaled electron temperature frequency averaged gaunt factors\n", gaunt_n_gsqrd);
-  Log ("The minimum frequency for photoionization is %8.2e\n", phot_freq_min);
-  Log ("The minimum frequency for inner shell ionization is %8.2e\n", inner_freq_min);
 
 
-/* Now begin a series of calculations with the data that has been read in in order
-to prepare it for use by other programs*/
+  /* Initialize variables */
 
-/* Calculate the conversion factor between rho and nh.  Note that our approximation here is
-somewhat inexact  because it assumes all elements have equal neutrons and protons. */
 
-  q = 1.;
-  for (nelem = 1; nelem < nelements; nelem++)
+
+  phot_freq_min = VERY_BIG;
+  inner_freq_min = VERY_BIG;
+
+  for (n = 0; n < NELEMENTS; n++)
   {
-    q += ele[nelem].abun * 2. * ele[nelem].z;
+    strcpy (ele[n].name, "none");
+    ele[n].z = (-1);
+    ele[n].abun = (-1);
+    ele[n].firstion = (-1);
+    ele[n].nions = (-1);
   }
 
-  q = MPROT * q;
-  rho2nh = 1. / q;
+  for (n = 0; n < NIONS; n++)
+  {
+    ion[n].z = (-1);
+    ion[n].istate = (-1);
+    ion[n].ip = (-1);
+    ion[n].g = (-1);
+    ion[n].nmax = (-1);
+    ion[n].firstlevel = (-1);
+    ion[n].nlevels = (-1);
+    ion[n].first_nlte_level = (-1);
+    ion[n].first_levden = (-1);
+    ion[n].nlte = (-1);
+    ion[n].phot_info = (-1);
+    ion[n].macro_info = (-1);   //Initialise - don't know if using Macro Atoms or not: set to -1 (SS)
+    ion[n].ntop_first = 0;      // The fact that ntop_first and ntop  are initialized to 0 and not -1 is important
+    ion[n].ntop_ground = 0;     //NSH 0312 initialize the new pointer for GS cross sections
+    ion[n].ntop = 0;
+    ion[n].nxphot = (-1);
+    ion[n].lev_type = (-1);     // Initialise to indicate we don't know what types of configurations will be read
+    ion[n].drflag = 0;          //Initialise to indicate as far as we know, there are no dielectronic recombination parameters associated with this ion.
+    ion[n].total_rrflag = 0;    //Initialise to say this ion has no Badnell total recombination data
+    ion[n].nxtotalrr = -1;      //Initialise the pointer into the bad_t_rr structure.
+    ion[n].bad_gs_rr_t_flag = 0;        //Initialise to say this ion has no Badnell ground state recombination data
+    ion[n].bad_gs_rr_r_flag = 0;        //Initialise to say this ion has no Badnell ground state recombination data
+    ion[n].nxbadgsrr = -1;      //Initialise the pointer into the bad_gs_rr structure.
+    ion[n].dere_di_flag = 0;    //Initialise to say this ion has no Dere DI rate data
+    ion[n].nxderedi = -1;       //Initialise the pointer into the Dere DI rate structure
+    ion[n].n_inner = 0;         //Initialise the pointer to say we have no inner shell ionization cross sections
+    for (i = 0; i < N_INNER; i++)
+      ion[n].nxinner[i] = -1;   //Inintialise the inner shell pointer array
+  }
 
+  nlevels = nxphot = nphot_total = ntop_phot = nauger = ndrecomb = n_inner_tot = 0;     //Added counter for DR//
 
-/* Now find the first and last ion associated with each named element and
-exit if there is an element with no ions */
+  /*This initializes the top_phot array - it is used for all ionization processes so some elements
+     are only used in some circumstances
+   */
 
-  for (nelem = 0; nelem < nelements; nelem++)
+  for (n = 0; n < nphot_max; n++)
   {
-    n = 0;
-    while (ion[n].z != ele[nelem].z && n < nions)
-      n++;                      /* Find the first ion of that element for which there is data */
-    ele[nelem].firstion = n;
-    while (ion[n].z == ele[nelem].z && n < nions)
-      n++;
-    ele[nelem].nions = n - ele[nelem].firstion;
-    if (ele[nelem].firstion == nions)
-    {
-      ele[nelem].firstion = -1; /* There were no ions for this element */
-// In principle, there might be a program which uses elements but not ions, but it seems unlikely,
-// therefore stop if there is not at least one ion for each element
-      Error ("Get_atomic_data: There were no ions for element %d %s\n", nelem, ele[nelem].name);
-      exit (0);
-    }
+    phot_top[n].nlev = (-1);
+    phot_top[n].uplev = (-1);
+    phot_top[n].nion = (-1);    //the ion to which this cross section belongs
+    phot_top[n].n_elec_yield = -1;      //pointer to the electron yield array (for inner shell)
+    phot_top[n].n_fluor_yield = -1;     //pointer to the fluorescent photon yield (for inner shell)
+    phot_top[n].n = -1;         //pointer to shell (inner shell)
+    phot_top[n].l = -1;         //pointer to l subshell (inner shell only)
+    phot_top[n].z = (-1);       //atomic number
+    phot_top[n].np = (-1);      //number of points in the fit
+    phot_top[n].macro_info = (-1);      //Initialise - don't know if using Macro Atoms or not: set to -1 (SS)
+    phot_top[n].freq = phot_top[n].x = NULL;    //The x-section is allocated when it is read
   }
 
 
-/* Now attempt to associate lines with levels. If an association is found use, create
-a total emission oscillator strength for the level....really ought to be radiative lifefime */
+  for (n = 0; n < n_inner_max; n++)
+  {
+    inner_cross[n].nlev = (-1);
+    inner_cross[n].uplev = (-1);
+    inner_cross[n].nion = (-1);
+    inner_cross[n].n_elec_yield = -1;
+    inner_cross[n].n_fluor_yield = -1;
+    inner_cross[n].n = (-1);
+    inner_cross[n].l = (-1);
+    inner_cross[n].z = (-1);
+    inner_cross[n].np = (-1);
+    inner_cross[n].macro_info = (-1);   //Initialise - don't know if using Macro Atoms or not: set to -1 (SS)
+    inner_cross[n].freq = inner_cross[n].x = NULL;
+  }
 
+  for (n = 0; n < NIONS * N_INNER; n++) //Initialise atomic arrasy with dimension NIONS*NINNER
+  {
+    inner_elec_yield[n].nion = inner_fluor_yield[n].nion = (-1);
+    inner_elec_yield[n].n = inner_fluor_yield[n].n = (-1);
+    inner_elec_yield[n].l = inner_fluor_yield[n].l = (-1);
+    inner_elec_yield[n].z = inner_fluor_yield[n].z = (-1);
+    inner_elec_yield[n].I = inner_elec_yield[n].Ea = 0.0;
+    inner_fluor_yield[n].freq = inner_fluor_yield[n].yield = 0.0;
+    for (j = 0; j < 10; j++)
+      inner_elec_yield[n].prob[j] = 0.0;
+  }
 
-/* This next loop is connects levels to configurations for "simple atoms".
- For Macro Atoms files, the data files already contain this infomration and
- so the check is avoided by checking tte macro_info flag SS
-*/
 
 
 
-  for (n = 0; n < nlines; n++)
+  for (i = 0; i < nlevels_max; i++)
   {
-    if (ion[line[n].nion].macro_info == 0)      // not a macro atom (SS)
-    {
-      mstart = ion[line[n].nion].firstlevel;
-      mstop = mstart + ion[line[n].nion].nlevels;
+    config[i].n_bbu_jump = 0;   // initialising the number of jumps from each level to 0. (SS)
+    config[i].n_bbd_jump = 0;
+    config[i].n_bfu_jump = 0;
+    config[i].n_bfd_jump = 0;
+  }
 
-      m = mstart;
-      while (config[m].ilv != line[n].levl && m < mstop)
-        m++;
-      if (m < mstop)
-        line[n].nconfigl = m;
-      else
-        line[n].nconfigl = -9999;
+  for (n = 0; n < nlines_max; n++)
+  {
+    line[n].freq = -1;
+    line[n].f = 0;
+    line[n].nion = -1;
+    line[n].gl = line[n].gu = 0;
+    line[n].el = line[n].eu = 0.0;
+    line[n].macro_info = -1;
+    line[n].coll_index = -999;
+  }
 
-      m = mstart;
-      while (config[m].ilv != line[n].levu && m < mstop)
-        m++;
-      if (m < mstop)
-      {
-        line[n].nconfigu = m;
-        config[m].rad_rate += a21 (&line[n]);
-      }
-      else
-        line[n].nconfigu = -9999;
+/* The following lines initialise the dielectronic recombination structure */
+  for (n = 0; n < NIONS; n++)
+  {
+    drecomb[n].nion = -1;
+    drecomb[n].nparam = -1;     //the number of parameters - it varies from ion to ion
+    for (n1 = 0; n1 < MAX_DR_PARAMS; n1++)
+    {
+      drecomb[n].c[n1] = 0.0;
+      drecomb[n].e[n1] = 0.0;
     }
   }
 
-/* Check that all of the macro_info variables are initialized to 1
-or zero so that simple checks of true and false can be used for them */
 
-  for (n = 0; n < nions; n++)
+/* The following lines initialise the badnell total radiative recombination rate structure */
+  for (n = 0; n < NIONS; n++)
   {
-    if (ion[n].macro_info == -1)
+    total_rr[n].nion = -1;
+    for (n1 = 0; n1 < T_RR_PARAMS; n1++)
     {
-      Error ("Ion %d for element %s and ion %d is of unknown type\n", n, ion[n].z, ion[n].istate);
-      exit (0);
+      total_rr[n].params[n1] = 0.0;
     }
+
   }
 
-  for (n = 0; n < nlevels; n++)
+
+/* The following lines initialise the badnell total radiative recombination rate structure */
+  for (n = 0; n < NIONS; n++)
   {
-    if (config[n].macro_info == -1)
+    bad_gs_rr[n].nion = -1;
+    for (n1 = 0; n1 < BAD_GS_RR_PARAMS; n1++)
     {
-      Error ("Level %d for element %s and ion %d is of unknown type\n", n, config[n].z, config[n].istate);
-      exit (0);
+      bad_gs_rr[n].temps[n1] = 0.0;
+      bad_gs_rr[n].rates[n1] = 0.0;
     }
+
   }
 
-  for (n = 0; n < nlines; n++)
+
+/* The following lines initialise the dere direct ionization rate struture */
+  for (n = 0; n < NIONS; n++)
   {
-    if (line[n].macro_info == -1)
+    dere_di_rate[n].nion = -1;
+    dere_di_rate[n].xi = 0.0;
+    dere_di_rate[n].min_temp = 1e99;
+    for (n1 = 0; n1 < DERE_DI_PARAMS; n1++)
     {
-      Error ("Level %d for element %s and ion %d is of unknown type\n", n, line[n].z, line[n].istate);
-      exit (0);
+      dere_di_rate[n].temps[n1] = 0.0;
+      dere_di_rate[n].rates[n1] = 0.0;
     }
+
   }
 
-  for (n = 0; n < nphot_total; n++)
+
+
+
+/* The following lines initialise the Sutherland gaunt factors */
+  gaunt_n_gsqrd = 0;            //The number of sets of scaled temperatures we have data for
+  for (n = 0; n < MAX_GAUNT_N_GSQRD; n++)
+  {
+    gaunt_total[n].log_gsqrd = 0.0;
+    gaunt_total[n].gff = 0.0;
+    gaunt_total[n].s1 = 0.0;
+    gaunt_total[n].s2 = 0.0;
+    gaunt_total[n].s3 = 0.0;
+  }
+
+
+/* The following lines initialise the collision strengths */
+  n_coll_stren = 0;             //The number of data sets
+  for (n = 0; n < n_coll_stren_max; n++)
   {
-    if (phot_top[n].macro_info == -1)
+    coll_stren[n].n = -1;       //Internal index
+    coll_stren[n].lower = -1;   //The lower energy level - this is in Chianti notation and is currently unused
+    coll_stren[n].upper = -1;   //The upper energy level - this is in Chianti notation and is currently unused
+    coll_stren[n].energy = 0.0; //The energy of the transition
+    coll_stren[n].gf = 0.0;
+    coll_stren[n].hi_t_lim = 0.0;       //The high temerature limit
+    coll_stren[n].n_points = 0.0;       //The number of points in the splie fit
+    coll_stren[n].type = -1;    //The type of fit, this defines how one computes the scaled temperature and scaled coll strength
+    coll_stren[n].scaling_param = 0.0;  //The scaling parameter C used in the Burgess and Tully calculations
+    for (n1 = 0; n1 < N_COLL_STREN_PTS; n1++)
     {
-      Error ("Photoionization cross-section %d for element %s and ion %d is of unknown type\n", n, phot_top[n].z, phot_top[n].istate);
-      exit (0);
+      coll_stren[n].sct[n1] = 0.0;      //The scaled temperature points in the fit
+      coll_stren[n].scups[n1] = 0.0;
     }
   }
 
-/* Finally evaluate how close we are to limits set in the structures */
+  return (0);
+}
 
-  Log ("get_atomic_data: Evaluation:  There are %6d elements     while %6d are currently allowed\n", nelements, NELEMENTS);
-  Log ("get_atomic_data: Evaluation:  There are %6d ions         while %6d are currently allowed\n", nions, NIONS);
-  Log ("get_atomic_data: Evaluation:  There are %6d levels       while %6d are currently allowed\n", nlevels, NLEVELS);
-  Log ("get_atomic_data: Evaluation:  There are %6d lines        while %6d are currently allowed\n", nlines, NLINES);
-  Log ("get_atomic_data: Evaluation:  There are %6d macro levels while %6d are currently allowed\n", nlevels_macro, NLEVELS_MACRO);
 
-  bb_max = 0;
-  bf_max = 0;
 
-  for (i = 0; i < nlevels; i++)
-  {
-    if (bb_max < config[i].n_bbu_jump)
-      bb_max = config[i].n_bbu_jump;
-    if (bb_max < config[i].n_bbd_jump)
-      bb_max = config[i].n_bbd_jump;
-    if (bf_max < config[i].n_bfu_jump)
-      bf_max = config[i].n_bfu_jump;
-    if (bf_max < config[i].n_bfd_jump)
-      bf_max = config[i].n_bfd_jump;
-  }
 
+/**********************************************************/
+/**
+ * @brief      Count the entries of each kind in the data files named in
+ * a masterfile, so that the atomic data can be allocated
+ *
+ * @param [in] char  masterfile[]   The masterfile
+ * @return     Always returns 0
+ *
+ * @details
+ * Each of the data files is read once, and the records for lines,
+ * levels, collision strengths and photoionization x-sections are counted
+ * by their keywords.  The results set nlines_max, nlevels_max,
+ * n_coll_stren_max, nphot_max and n_inner_max, and the number of points
+ * in the x-sections sets the size of atomic_arena.
+ *
+ * ### Notes ###
+ * These are upper limits, since get_atomic_data ignores the records for
+ * ions which have not been read.  One extra entry of each kind is
+ * allowed so that none of the arrays is empty.
+ *
+ **********************************************************/
 
-  Log ("get_atomic_data: Evaluation:  The maximum value bb jumps is %d while %d are currently allowed\n", bb_max, NBBJUMPS);
-  Log ("get_atomic_data: Evaluation:  The maximum value bf jumps is %d while %d are currently allowed\n", bb_max, NBBJUMPS);
+int
+count_atomic_data (masterfile)
+     char masterfile[];
+{
+  FILE *fopen (), *fptr, *mptr;
+  char aline[LINELENGTH], file[LINELENGTH], word[LINELENGTH];
+  int z, istate, n1, n2, np;
+  int lineno;
+  double e;
+  long npoints;
 
-/* Now, write the data to a file so you can check it later if you wish */
-/* this is controlled by one of the -d flag modes, defined in atomic.h */
-  if (write_atomicdata)
+  nlines_max = nlevels_max = n_coll_stren_max = nphot_max = n_inner_max = 1;
+  npoints = 0;
+
+  if ((mptr = fopen (masterfile, "r")) == NULL)
   {
+    Error ("count_atomic_data:  Could not open masterfile %s\n", masterfile);
+    exit (0);
+  }
 
-    if ((fptr = fopen ("data.out", "w")) == NULL)
+  while (fgets (aline, LINELENGTH, mptr) != NULL)
+  {
+    if (sscanf (aline, "%s", file) != 1 || file[0] == '#')
     {
-      Error ("get_atomic data:  Could not open data.out\n");
-      exit (0);
+      continue;
     }
 
-    fprintf (fptr, "This file contains data which was read in by get_atomicdata\n");
-
-    fprintf (fptr, "Data of %d elements, %d ions, and %d levels %d lines\n", nelements, nions, nlevels, nlines);
-
-
-    /* Write the element array */
-    fprintf (fptr, "Element Data:\n");
-    for (nelem = 0; nelem < nelements; nelem++)
+    if ((fptr = fopen (file, "r")) == NULL)
     {
-      fprintf (fptr, "Element %2d %5s firstion %2d nions %2d\n", nelem, ele[nelem].name, ele[nelem].firstion, ele[nelem].nions);
+      Error ("count_atomic_data:  Could not open %s\n", file);
+      exit (0);
     }
 
-    /* Write the ion array */
-    fprintf (fptr, "Ion data:\n");
-    for (n = 0; n < nions; n++)
+    lineno = 0;
+    while (fgets (aline, LINELENGTH, fptr) != NULL)
     {
-      fprintf (fptr,
-               "ion %3d z %3d istate %3d firstlevel %3d nlevels %3d potential %8.3g\n",
-               n, ion[n].z, ion[n].istate, ion[n].firstlevel, ion[n].nlevels, ion[n].ip / EV2ERGS);
-    }
-
-    /* Write the excitation level data */
-    fprintf (fptr, "Excitation levels: There are %d levels\n", nlevels);
-    for (n = 0; n < nlevels; n++)
-      fprintf (fptr, "n %3d q %.1f g %3.0f ex %8.3g\n", n, config[n].q_num, config[n].g, config[n].ex);
+      lineno++;
+      if (sscanf (aline, "%s", word) != 1)
+      {
+        continue;
+      }
 
-    /* Write the photoionization data  */
-    fprintf (fptr, "Photoionization data: There are %d edges\n", ntop_phot + nxphot);
-    for (n = 0; n < ntop_phot + nxphot; n++)
-    {
-      fprintf (fptr, "n %3d z %2d istate %3d sigma %8.2e freq[0] %8.2e\n",
-               n, phot_top[n].z, phot_top[n].istate, phot_top[n].sigma, phot_top[n].freq[0]);
+      if (strncmp (word, "Line", 4) == 0 || strncmp (word, "LinMacro", 8) == 0)
+      {
+        nlines_max++;
+      }
+      else if (strncmp (word, "Lev", 3) == 0)
+      {
+        nlevels_max++;
+      }
+      else if (strncmp (word, "CSTREN", 6) == 0)
+      {
+        n_coll_stren_max++;
+      }
+      else if ((strncmp (word, "Phot", 4) == 0 || strncmp (word, "InnerVYS", 8) == 0)
+               && sscanf (aline, "%*s %d %d %d %d %le %d", &z, &istate, &n1, &n2, &e, &np) == 6)
+      {
+        /* This is the first record of a x-section, rather than one of its points */
+        if (np > NCROSS)
+        {
+          Error ("count_atomic_data: file %s line %d: %d points in a x-section, but NCROSS is %d\n", file, lineno, np, NCROSS);
+          exit (0);
+        }
+        if (word[0] == 'P')
+        {
+          nphot_max++;
+        }
+        else
+        {
+          n_inner_max++;
+        }
+        npoints += np;
+      }
     }
 
-    /* Write the resonance line data to the file */
+    fclose (fptr);
+  }
 
-    fprintf (fptr, "Line data: There are %d lines\n", nlines);
+  fclose (mptr);
 
-    for (n = 0; n < nlines; n++)
-    {
-      fprintf (fptr, "n %3d ion %3d freq %8.1e f %6.3f\n", n, line[n].nion, line[n].freq, line[n].f);
-    }
+  if (nlines_max >= NLINES)
+  {
+    Error ("count_atomic_data: There are %d lines, but nres can only distinguish %d. Increase NLINES in atomic.h\n", nlines_max,
+           NLINES);
+    exit (0);
+  }
 
-    /* Write the ground fraction data to the file */
-    fprintf (fptr, "Ground frac data (just first and last fracs here as a check):\n");
+  atomic_arena_size = 2 * (npoints + 1) * sizeof (double);
 
-    for (n = 0; n < NIONS; n++)
-    {
-      fprintf (fptr, "%3d %3d %6.3f %6.3f\n", ground_frac[n].z, ground_frac[n].istate, ground_frac[n].frac[0], ground_frac[n].frac[19]);
-    }
+  Log_silent ("count_atomic_data: %d lines, %d levels, %d collision strengths, %d photoionization and %d inner shell x-sections\n",
+              nlines_max - 1, nlevels_max - 1, n_coll_stren_max - 1, nphot_max - 1, n_inner_max - 1);
 
-    /* Write the collisions strengths to the file */
+  return (0);
+}
 
-    fprintf (fptr, "Collision strengths: There were %d collision strengths\n", nxcol);
 
-    for (n = 0; n < nxcol; n++)
-    {
-      fprintf (fptr,
-               "nion %d z,i %d %d freq %8.2e alpha %8.2e beta %8.2e tmax %8.2e\n",
-               xcol[n].nion, xcol[n].z, xcol[n].istate, xcol[n].freq, xcol[n].alpha, xcol[n].beta, xcol[n].tm);
-    }
 
-    fclose (fptr);
-  }                             // end of if statement based on modes.write_atomicdata
+/**********************************************************/
+/**
+ * @brief      Allocate memory from atomic_arena
+ *
+ * @param [in] long  nbytes   The number of bytes required
+ * @return     A pointer to the memory
+ *
+ * @details
+ * The memory is taken from the block allocated by init_atomic_data,
+ * and is only released when all of the atomic data are.  Each
+ * allocation is a multiple of the size of a double, so that the
+ * next one is aligned.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
 
+void *
+atomic_arena_alloc (nbytes)
+     long nbytes;
+{
+  char *ptr;
 
+  nbytes = (nbytes + sizeof (double) - 1) / sizeof (double) * sizeof (double);
 
-  /* Finally create frequency ordered pointers to the various portions
-   * of the atomic data
-   */
+  if (atomic_arena_used + nbytes > atomic_arena_size)
+  {
+    Error ("atomic_arena_alloc: %ld bytes are needed, but only %ld remain\n", nbytes, atomic_arena_size - atomic_arena_used);
+    exit (0);
+  }
 
-  /* Index the lines */
-  index_lines ();
+  ptr = atomic_arena + atomic_arena_used;
+  atomic_arena_used += nbytes;
 
-  /* Index the collisions */
-  index_collisions ();
+  return (ptr);
+}
 
 
-/* Index the topbase photoionization structure by threshold freqeuncy */
-  if (ntop_phot + nxphot > 0)
-    index_phot_top ();
-/* Index the topbase photoionization structure by threshold freqeuncy */
-  if (n_inner_tot > 0)
-    index_inner_cross ();
 
+/**********************************************************/
+/**
+ * @brief      Allocate the frequencies and values of a photoionization x-section
+ *
+ * @param [in, out] struct topbase_phot *  x_ptr   The x-section
+ * @param [in] int  np   The number of points in the x-section
+ * @return     Always returns 0
+ *
+ * @details
+ * The arrays x_ptr->freq and x_ptr->x are allocated from atomic_arena.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
 
-  check_xsections ();           // debug routine, only prints if verbosity > 4
+int
+alloc_xsection (x_ptr, np)
+     struct topbase_phot *x_ptr;
+     int np;
+{
+  void *atomic_arena_alloc ();
+
+  x_ptr->freq = (double *) atomic_arena_alloc (np * sizeof (double));
+  x_ptr->x = (double *) atomic_arena_alloc (np * sizeof (double));
 
   return (0);
 }
@@ -3084,6 +3367,8 @@ or zero so that simple checks of true and false can be used for them */
  * @return     Always returns 0
  *
  * @details
+ * The pointers to the lines are stored in frequency order in lin_ptr,
+ * and their frequencies and ions in lin_freq and lin_nion.
  *
  * ### Notes ###
  * All use a Numerical recipes routine indexx for this
@@ -3099,8 +3384,8 @@ index_lines ()
   void indexx ();
 
   /* Allocate memory for some modestly large arrays */
-  freqs = calloc (sizeof (foo), NLINES + 2);
-  index = calloc (sizeof (ioo), NLINES + 2);
+  freqs = calloc (sizeof (foo), nlines + 2);
+  index = calloc (sizeof (ioo), nlines + 2);
 
   freqs[0] = 0;
   for (n = 0; n < nlines; n++)
@@ -3124,6 +3409,8 @@ index_lines ()
   {
     lin_ptr[n] = &line[index[n + 1] - 1];
     line[index[n + 1] - 1].where_in_list = n;
+    lin_freq[n] = lin_ptr[n]->freq;
+    lin_nion[n] = lin_ptr[n]->nion;
   }
 
   /* Free the memory for the arrays */
@@ -3430,57 +3717,40 @@ indexx (n, arrin, indx)
 
 /**********************************************************/
 /**
- * @brief      (freqmin,freqmax)  sets the the current values of line_min and line_max in atomic.h
- * 	which can be used to limit the lines searched for resonances to a specific
- * 	frequency range.
+ * @brief      find the range of lines in lin_ptr which lie in a frequency interval
  *
- * @param [in, out] double  freqmin   The minimum frequency we are interested in
- * @param [in, out] double  freqmax   The maximum frequency we are interested in
+ * @param [in] double  freqmin   The minimum frequency we are interested in
+ * @param [in] double  freqmax   The maximum frequency we are interested in
+ * @param [out] int *  line_min   The first line in the range
+ * @param [out] int *  line_max   The last line in the range
  * @return     the number of lines that are potentially in resonance.
  *
- * limit_lines sets the external variables nline_min and nline_max for use with
- * other routines
- *
- *
- *
- * If limit_lines
- * 	returns 0 there are no lines of interest and one does not need to worry about any
- * 	resonances at this frequency.  If limit_lines returns a number greater than 0, then
- * 	the lines of interest are defined by nline_min and nline_max (inclusive) in atomic.h
- * 	nline_delt is also set which is the number of lines that are in the specified range
- *
  * @details
- * limit_lines  define the lines that are close to a given frequency.  The degree of closeness
- * 	is defined by v. The routine must be used in conjuction with get_atomic_data which
- * 	will have created an ordered list of the lines.
+ * This does the work for limit_lines, but returns the range to
+ * the caller rather than storing it in nline_min and nline_max.  
+ * The photon transport uses it to store the range in the transport 
+ * context of the photon.
  *
  * ### Notes ###
- * Limit_lines needs to be used somewhat carefully.  Carefully means checking the
- * 	return value of limit_lines or equivalently nline_delt=0.  If nline_delt=0 then there
- * 	were no lines in the region of interest.  Assuming there were lines in thte range,
- * 	one must sum over lines from nline_min to nline_max inclusive.
- *
- * 	One might wonder why nline_max is not set to one larger than the last line which
- * 	is in range.  This is because depending on how the velocity is trending you may
- * 	want to sum from the highest frequency line to the lowest.
- *
+ * The same cautions apply as for limit_lines; if 0 is returned 
+ * there are no lines in the interval.
  *
  **********************************************************/
 
 int
-limit_lines (freqmin, freqmax)
+line_range (freqmin, freqmax, line_min, line_max)
      double freqmin, freqmax;
+     int *line_min, *line_max;
 {
 
   int nmin, nmax, n;
   double f;
 
 
-  if (freqmin > lin_ptr[nlines - 1]->freq || freqmax < lin_ptr[0]->freq)
+  if (freqmin > lin_freq[nlines - 1] || freqmax < lin_freq[0])
   {
-    nline_min = 0;
-    nline_max = 0;
-    nline_delt = 0;
+    *line_min = 0;
+    *line_max = 0;
     return (0);
   }
 
@@ -3492,14 +3762,14 @@ limit_lines (freqmin, freqmax)
 
   while (n != nmin)
   {
-    if (lin_ptr[n]->freq < f)
+    if (lin_freq[n] < f)
       nmin = n;
-    if (lin_ptr[n]->freq >= f)
+    if (lin_freq[n] >= f)
       nmax = n;
     n = (nmin + nmax) >> 1;     // Compute a midpoint >> is a bitwise right shift
   }
 
-  nline_min = nmin;
+  *line_min = nmin;
 
   f = freqmax;
   nmin = 0;
@@ -3508,22 +3778,74 @@ limit_lines (freqmin, freqmax)
 
   while (n != nmin)
   {
-    if (lin_ptr[n]->freq <= f)
+    if (lin_freq[n] <= f)
       nmin = n;
-    if (lin_ptr[n]->freq > f)
+    if (lin_freq[n] > f)
       nmax = n;
     n = (nmin + nmax) >> 1;     // Compute a midpoint >> is a bitwise right shift
   }
 
-  nline_max = nmax;
+  *line_max = nmax;
+
+
+  return (*line_max - *line_min + 1);
+}
+
 
 
-  return (nline_delt = nline_max - nline_min + 1);
+/**********************************************************/
+/**
+ * @brief      (freqmin,freqmax)  sets the the current values of line_min and line_max in atomic.h
+ * 	which can be used to limit the lines searched for resonances to a specific
+ * 	frequency range.
+ *
+ * @param [in, out] double  freqmin   The minimum frequency we are interested in
+ * @param [in, out] double  freqmax   The maximum frequency we are interested in
+ * @return     the number of lines that are potentially in resonance.
+ *
+ * limit_lines sets the external variables nline_min and nline_max for use with
+ * other routines
+ *
+ *
+ *
+ * If limit_lines
+ * 	returns 0 there are no lines of interest and one does not need to worry about any
+ * 	resonances at this frequency.  If limit_lines returns a number greater than 0, then
+ * 	the lines of interest are defined by nline_min and nline_max (inclusive) in atomic.h
+ * 	nline_delt is also set which is the number of lines that are in the specified range
+ *
+ * @details
+ * limit_lines  define the lines that are close to a given frequency.  The degree of closeness
+ * 	is defined by v. The routine must be used in conjuction with get_atomic_data which
+ * 	will have created an ordered list of the lines.
+ *
+ * ### Notes ###
+ * Limit_lines needs to be used somewhat carefully.  Carefully means checking the
+ * 	return value of limit_lines or equivalently nline_delt=0.  If nline_delt=0 then there
+ * 	were no lines in the region of interest.  Assuming there were lines in thte range,
+ * 	one must sum over lines from nline_min to nline_max inclusive.
+ *
+ * 	One might wonder why nline_max is not set to one larger than the last line which
+ * 	is in range.  This is because depending on how the velocity is trending you may
+ * 	want to sum from the highest frequency line to the lowest.
+ *
+ * 	The search itself is carried out by line_range.
+ *
+ *
+ **********************************************************/
+
+int
+limit_lines (freqmin, freqmax)
+     double freqmin, freqmax;
+{
+  return (nline_delt = line_range (freqmin, freqmax, &nline_min, &nline_max));
 }
 
 
 
 
+
+
 /**********************************************************/
 /**
  * @brief      Perform sanity checks on xsection data
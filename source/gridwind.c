@@ -117,6 +117,92 @@ create_maps ()
 
 
 
+/**********************************************************/
+/** 
+ * @brief      Copy the properties of the wind cells used most in transport into windhot
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * windhot holds the velocity, domain and plasma cell of each element of
+ * wmain, so that routines such as vwind_xyz, which interpolate between
+ * neighbouring cells, need read only a short record for each cell.
+ *
+ * ### Notes ###
+ * None of these quantities changes once the wind has been defined, so the
+ * routine is called at the end of define_wind and of wind_read.  calloc_wind
+ * discards windhot, and until it has been made again the routines which
+ * use it read wmain instead.
+ *
+ **********************************************************/
+
+int
+wind_hot_make ()
+{
+  int n;
+
+  if ((windhot = (WindHotPtr) realloc (windhot, sizeof (wind_hot_dummy) * (NDIM2 + 1))) == NULL)
+  {
+    Error ("wind_hot_make: Could not allocate memory for %d cells\n", NDIM2 + 1);
+    exit (0);
+  }
+
+  for (n = 0; n <= NDIM2; n++)
+  {
+    stuff_v (wmain[n].v, windhot[n].v);
+    windhot[n].ndom = wmain[n].ndom;
+    windhot[n].nplasma = wmain[n].nplasma;
+  }
+
+  return (0);
+}
+
+
+
+
+/**********************************************************/
+/** 
+ * @brief      Copy the properties of the plasma cells used most in transport into plasmahot
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * plasmahot holds the electron density of each element of plasmamain, and 
+ * a pointer to its ion densities.
+ *
+ * ### Notes ###
+ * The densities change whenever the ionization is recalculated, so 
+ * trans_phot calls this routine before each flight of photons, and
+ * plasmahot should only be used for the electron density while photons
+ * are being transported.  The ion densities are not copied, and so
+ * get_ion_density can use plasmahot at any time until calloc_plasma
+ * discards it.
+ *
+ **********************************************************/
+
+int
+plasma_hot_make ()
+{
+  int n;
+
+  if ((plasmahot = (PlasmaHotPtr) realloc (plasmahot, sizeof (plasma_hot_dummy) * (NPLASMA + 1))) == NULL)
+  {
+    Error ("plasma_hot_make: Could not allocate memory for %d cells\n", NPLASMA + 1);
+    exit (0);
+  }
+
+  for (n = 0; n <= NPLASMA; n++)
+  {
+    plasmahot[n].ne = plasmamain[n].ne;
+    plasmahot[n].density = plasmamain[n].density;
+  }
+
+  return (0);
+}
+
+
+
+
 
 /**********************************************************/
 /** 
@@ -145,6 +231,10 @@ calloc_wind (nelem)
     free (wmain);
   }
 
+  /* The copy of the old wind in windhot is no longer valid */
+  free (windhot);
+  windhot = NULL;
+
   wmain = (WindPtr) calloc (sizeof (wind_dummy), nelem + 1);
 
   if (wmain == NULL)
@@ -202,6 +292,10 @@ calloc_plasma (nelem)
     free (plasmamain);
   }
 
+  /* The copy of the old plasma in plasmahot is no longer valid */
+  free (plasmahot);
+  plasmahot = NULL;
+
   /*Allocate one extra element to store data where there is no volume */
 
   plasmamain = (PlasmaPtr) calloc (sizeof (plasma_dummy), (nelem + 1));
@@ -402,6 +496,8 @@ calloc_estimators (nelem)
   size_Jbar_est = 0;
   size_gamma_est = 0;
   size_alpha_est = 0;
+  size_matom_jump = 0;
+  size_matom_emiss = 0;
 
   for (n = 0; n < nlevels_macro; n++)
   {
@@ -414,12 +510,17 @@ calloc_estimators (nelem)
     size_gamma_est += config[n].n_bfu_jump;
     config[n].bfd_indx_first = size_alpha_est;
     size_alpha_est += config[n].n_bfd_jump;
+    config[n].jump_indx_first = size_matom_jump;
+    size_matom_jump += config[n].n_bbd_jump + config[n].n_bfd_jump + config[n].n_bbu_jump + config[n].n_bfu_jump;
+    config[n].emiss_indx_first = size_matom_emiss;
+    size_matom_emiss += config[n].n_bbd_jump + config[n].n_bfd_jump;
   }
 
 
 
 
   Log ("calloc_estimators: size_Jbar_est %d size_gamma_est %d size_alpha_est %d\n", size_Jbar_est, size_gamma_est, size_alpha_est);
+  Log ("calloc_estimators: size_matom_jump %d size_matom_emiss %d\n", size_matom_jump, size_matom_emiss);
 
 
   for (n = 0; n < nelem; n++)
@@ -508,21 +609,52 @@ calloc_estimators (nelem)
       exit (0);
     }
 
-    if ((macromain[n].cooling_bf = calloc (sizeof (double), nphot_total)) == NULL)
+    /* The k-packet destruction channels are allocated by fill_kpkt_rates, since their number depends on the cell */
+    macromain[n].kpkt_nchan = macromain[n].kpkt_nchan_alloc = 0;
+    macromain[n].kpkt_type = macromain[n].kpkt_index = macromain[n].kpkt_alias = NULL;
+    macromain[n].kpkt_rate = macromain[n].kpkt_prob = NULL;
+
+    macromain[n].matom_prbs_t_e = -1;
+
+    if ((macromain[n].matom_prbs_known = calloc (sizeof (int), nlevels_macro)) == NULL)
     {
-      Error ("calloc_estimators: Error in allocating memory for MA estimators\n");
+      Error ("calloc_estimators: Error in allocating memory for MA jumping probabilities\n");
       exit (0);
     }
 
-    if ((macromain[n].cooling_bf_col = calloc (sizeof (double), nphot_total)) == NULL)
+    if ((macromain[n].matom_pjnorm = calloc (sizeof (double), nlevels_macro)) == NULL)
     {
-      Error ("calloc_estimators: Error in allocating memory for MA estimators\n");
+      Error ("calloc_estimators: Error in allocating memory for MA jumping probabilities\n");
       exit (0);
     }
 
-    if ((macromain[n].cooling_bb = calloc (sizeof (double), nlines)) == NULL)
+    if ((macromain[n].matom_penorm = calloc (sizeof (double), nlevels_macro)) == NULL)
     {
-      Error ("calloc_estimators: Error in allocating memory for MA estimators\n");
+      Error ("calloc_estimators: Error in allocating memory for MA jumping probabilities\n");
+      exit (0);
+    }
+
+    if ((macromain[n].matom_jump_prob = calloc (sizeof (double), size_matom_jump)) == NULL)
+    {
+      Error ("calloc_estimators: Error in allocating memory for MA jumping probabilities\n");
+      exit (0);
+    }
+
+    if ((macromain[n].matom_jump_alias = calloc (sizeof (int), size_matom_jump)) == NULL)
+    {
+      Error ("calloc_estimators: Error in allocating memory for MA jumping probabilities\n");
+      exit (0);
+    }
+
+    if ((macromain[n].matom_emiss_prob = calloc (sizeof (double), size_matom_emiss)) == NULL)
+    {
+      Error ("calloc_estimators: Error in allocating memory for MA jumping probabilities\n");
+      exit (0);
+    }
+
+    if ((macromain[n].matom_emiss_alias = calloc (sizeof (int), size_matom_emiss)) == NULL)
+    {
+      Error ("calloc_estimators: Error in allocating memory for MA jumping probabilities\n");
       exit (0);
     }
   }
@@ -534,6 +666,10 @@ calloc_estimators (nelem)
     Log_silent
       ("Allocated %10.1f Mb for MA estimators \n",
        1.e-6 * (nelem + 1) * (2. * nlevels_macro + 2. * size_alpha_est + 8. * size_gamma_est + 2. * size_Jbar_est) * sizeof (double));
+    Log_silent
+      ("Allocated %10.1f Mb for MA jumping probabilities \n",
+       1.e-6 * (nelem + 1) * ((2. * nlevels_macro + size_matom_jump + size_matom_emiss) * sizeof (double) +
+                              (nlevels_macro + size_matom_jump + size_matom_emiss) * sizeof (int)));
   }
   else
   {
@@ -559,6 +695,11 @@ calloc_estimators (nelem)
  * @details
  * This subroutine allocates space for variable length arrays in the plasma structure.
  *
+ * Each array is allocated as a single block for all of the cells, and the
+ * pointers in the plasma structure of each cell point into the block, so the
+ * values for cell n+1 follow those for cell n.  This means a whole array can be
+ * read or written at once, see wind_read.
+ *
  * ### Notes ###
  * Arrays sized to the number of ions are largest,
  * and dominate the size of nplasma, so these were first to be 
@@ -571,100 +712,94 @@ calloc_dyn_plasma (nelem)
      int nelem;
 {
   int n;
+  double *density, *partition, *ioniz, *recomb, *xscatters, *heat_ion, *cool_rr_ion, *lum_rr_ion, *inner_recomb, *cool_dr_ion;
+  double *levden, *recomb_simple, *recomb_simple_upweight;
+  int *scatters, *kbf_use;
 
 
-/*  Loop over all elements in the plasma array, adding one for an empty cell 
+/*  Allocate the arrays for all elements in the plasma array, adding one for an empty cell 
  *  used for extrapolations.
  */
 
+  density = calloc_plasma_block (sizeof (double), nelem + 1, nions, "density");
+  partition = calloc_plasma_block (sizeof (double), nelem + 1, nions, "partition");
+  ioniz = calloc_plasma_block (sizeof (double), nelem + 1, nions, "ioniz");
+  recomb = calloc_plasma_block (sizeof (double), nelem + 1, nions, "recomb");
+  scatters = calloc_plasma_block (sizeof (int), nelem + 1, nions, "scatters");
+  xscatters = calloc_plasma_block (sizeof (double), nelem + 1, nions, "xscatters");
+  heat_ion = calloc_plasma_block (sizeof (double), nelem + 1, nions, "heat_ion");
+  cool_rr_ion = calloc_plasma_block (sizeof (double), nelem + 1, nions, "cool_rr_ion");
+  lum_rr_ion = calloc_plasma_block (sizeof (double), nelem + 1, nions, "lum_rr_ion");
+  inner_recomb = calloc_plasma_block (sizeof (double), nelem + 1, nions, "inner_recomb");
+  cool_dr_ion = calloc_plasma_block (sizeof (double), nelem + 1, nions, "cool_dr_ion");
+
+  levden = calloc_plasma_block (sizeof (double), nelem + 1, nlte_levels, "levden");
+  recomb_simple = calloc_plasma_block (sizeof (double), nelem + 1, nphot_total, "recomb_simple");
+  recomb_simple_upweight = calloc_plasma_block (sizeof (double), nelem + 1, nphot_total, "recomb_simple_upweight");
+  kbf_use = calloc_plasma_block (sizeof (int), nelem + 1, nphot_total, "kbf_use");
+
   for (n = 0; n < nelem + 1; n++)
   {
-    if ((plasmamain[n].density = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for density\n");
-      exit (0);
-    }
-    if ((plasmamain[n].partition = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for partition\n");
-      exit (0);
-    }
-    if ((plasmamain[n].ioniz = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for ioniz\n");
-      exit (0);
-    }
-    if ((plasmamain[n].recomb = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for recomb\n");
-      exit (0);
-    }
-    if ((plasmamain[n].scatters = calloc (sizeof (int), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for scatters\n");
-      exit (0);
-    }
-    if ((plasmamain[n].xscatters = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for xscatters\n");
-      exit (0);
-    }
-    if ((plasmamain[n].heat_ion = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for heat_ion\n");
-      exit (0);
-    }
-    if ((plasmamain[n].cool_rr_ion = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for cool_rr_ion\n");
-      exit (0);
-    }
-    if ((plasmamain[n].lum_rr_ion = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for lum_rr_ion\n");
-      exit (0);
-    }
-    if ((plasmamain[n].inner_recomb = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for inner_recomb\n");
-      exit (0);
-    }
-    if ((plasmamain[n].cool_dr_ion = calloc (sizeof (double), nions)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for lum_inner_recomb\n");
-      exit (0);
-    }
+    plasmamain[n].density = &density[n * nions];
+    plasmamain[n].partition = &partition[n * nions];
+    plasmamain[n].ioniz = &ioniz[n * nions];
+    plasmamain[n].recomb = &recomb[n * nions];
+    plasmamain[n].scatters = &scatters[n * nions];
+    plasmamain[n].xscatters = &xscatters[n * nions];
+    plasmamain[n].heat_ion = &heat_ion[n * nions];
+    plasmamain[n].cool_rr_ion = &cool_rr_ion[n * nions];
+    plasmamain[n].lum_rr_ion = &lum_rr_ion[n * nions];
+    plasmamain[n].inner_recomb = &inner_recomb[n * nions];
+    plasmamain[n].cool_dr_ion = &cool_dr_ion[n * nions];
+
+    plasmamain[n].levden = &levden[n * nlte_levels];
+    plasmamain[n].recomb_simple = &recomb_simple[n * nphot_total];
+    plasmamain[n].recomb_simple_upweight = &recomb_simple_upweight[n * nphot_total];
+    plasmamain[n].kbf_use = &kbf_use[n * nphot_total];
+  }
 
+  Log
+    ("Allocated %10d bytes for each of %5d elements variable length plasma arrays totaling %10.1f Mb \n",
+     sizeof (double) * nions * 14, (nelem + 1), 1.e-6 * (nelem + 1) * sizeof (double) * (nions * 14 + nlte_levels + nphot_total * 2));
 
-    if ((plasmamain[n].levden = calloc (sizeof (double), nlte_levels)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for levden\n");
-      exit (0);
-    }
+  return (0);
+}
 
-    if ((plasmamain[n].recomb_simple = calloc (sizeof (double), nphot_total)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for recomb_simple\n");
-      exit (0);
-    }
 
-    if ((plasmamain[n].recomb_simple_upweight = calloc (sizeof (double), nphot_total)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for recomb_simple_upweight\n");
-      exit (0);
-    }
 
+/**********************************************************/
+/** 
+ * @brief      Allocate one of the variable length arrays of the plasma structure
+ * for all of the cells
+ *
+ * @param [in] size_t  size   The size of one value
+ * @param [in] int  nelem   The number of cells
+ * @param [in] int  nvalues   The number of values for each cell
+ * @param [in] char *  name   The name of the array, used in the error message
+ * @return     A pointer to the zeroed block of memory
+ *
+ * @details
+ * The program exits if the memory cannot be allocated.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+void *
+calloc_plasma_block (size, nelem, nvalues, name)
+     size_t size;
+     int nelem, nvalues;
+     char *name;
+{
+  void *block;
 
-    if ((plasmamain[n].kbf_use = calloc (sizeof (double), nphot_total)) == NULL)
-    {
-      Error ("calloc_dyn_plasma: Error in allocating memory for kbf_use\n");
-      exit (0);
-    }
-  }
+  /* Allocate at least one value, so that calloc returns a pointer even for an empty array */
 
-  Log
-    ("Allocated %10d bytes for each of %5d elements variable length plasma arrays totaling %10.1f Mb \n",
-     sizeof (double) * nions * 14, (nelem + 1), 1.e-6 * (nelem + 1) * sizeof (double) * (nions * 14 + nlte_levels + nphot_total * 2));
+  if ((block = calloc (size, (size_t) nelem * nvalues + 1)) == NULL)
+  {
+    Error ("calloc_dyn_plasma: Error in allocating memory for %s\n", name);
+    exit (0);
+  }
 
-  return (0);
+  return (block);
 }
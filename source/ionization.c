@@ -312,6 +312,9 @@ check_convergence ()
 
 PlasmaPtr xxxplasma;
 
+#define TE_TOL          50.     /* The accuracy in K to which calc_te finds the temperature */
+#define TE_STENCIL_MAX  8       /* The maximum number of temperatures at which te_stencil_root evaluates func */
+
 
 /**********************************************************/
 /**
@@ -441,6 +444,9 @@ meaning in nebular concentrations.
  * ### Notes ###
  * Ion densities are NOT updated in this process.
  *
+ * Each call of zero_emit recalculates all of the cooling of the cell, and so
+ * the root is found with te_stencil_root, which needs fewer calls than zbrent.
+ *
  * xxxplasma is just a way to tranmit information to zero_emit
  *
  **********************************************************/
@@ -473,7 +479,7 @@ calc_te (xplasma, tmin, tmax)
 
   if ((z1 * z2 < 0.0))
   {                             // Then the interval is bracketed
-    xplasma->t_e = zbrent (zero_emit, tmin, tmax, 50.);
+    xplasma->t_e = te_stencil_root (zero_emit, tmin, tmax, z1, z2, TE_TOL);
   }
   else if (fabs (z1) < fabs (z2))
   {
@@ -566,3 +572,149 @@ zero_emit (t)
 
   return (difference);
 }
+
+
+
+/**********************************************************/
+/**
+ * @brief      finds the temperature at which a smooth function of temperature
+ * is zero, with as few evaluations of the function as possible
+ *
+ * @param [in] double (*func) (double)   The function, e.g. zero_emit
+ * @param [in] double  tmin   The lower end of an interval which brackets the root
+ * @param [in] double  tmax   The upper end of the interval
+ * @param [in] double  z1   func (tmin), which has already been calculated
+ * @param [in] double  z2   func (tmax), which has already been calculated
+ * @param [in] double  tol   The accuracy required for the root
+ * @return     The root
+ *
+ * @details
+ * The values of func at a small stencil of temperatures, initially tmin, tmax
+ * and the geometric mean of the two, are interpolated with a monotone
+ * piecewise cubic (Fritsch and Butland 1984) in ln T, and the root of the
+ * interpolant is found.  func is then evaluated at this temperature, which
+ * is accepted if a Newton step from it, using the slope of the interpolant,
+ * is smaller than tol.  Otherwise the new value is added to the stencil
+ * and the process repeated.  The slope used for the Newton step is the
+ * smallest of that of the interpolant and those to the neighbouring points
+ * of the stencil, so that t is not accepted early where the interpolant is poor.
+ *
+ * ### Notes ###
+ * Heating minus cooling varies smoothly with temperature over the range
+ * calc_te searches, so usually the interpolant is good enough after one
+ * or two verifications.  If it is not after TE_STENCIL_MAX evaluations, the
+ * root is found by zbrent in the smallest interval which brackets it.
+ *
+ **********************************************************/
+
+double
+te_stencil_root (func, tmin, tmax, z1, z2, tol)
+     double (*func) (double);
+     double tmin, tmax, z1, z2, tol;
+{
+  double u[TE_STENCIL_MAX], z[TE_STENCIL_MAX], m[TE_STENCIL_MAX];
+  double d0, d1, h0, h1, h, s, t, a, b, ua, ub, um, za, zm, dz, slope;
+  int n, i, k, iter;
+
+  u[0] = log (tmin);
+  z[0] = z1;
+  u[2] = log (tmax);
+  z[2] = z2;
+  u[1] = 0.5 * (u[0] + u[2]);
+  z[1] = (*func) (exp (u[1]));
+  n = 3;
+
+  while (1)
+  {
+    /* Find the interval which brackets the root */
+
+    for (k = 0; k < n - 1; k++)
+    {
+      if (z[k] == 0.0)
+        return (exp (u[k]));
+      if (z[k] * z[k + 1] < 0.0)
+        break;
+    }
+    if (k == n - 1)
+      return (exp (u[n - 1]));
+
+    if (n == TE_STENCIL_MAX)
+      break;
+
+    /* The slopes of the monotone interpolant at the stencil points */
+
+    for (i = 0; i < n; i++)
+    {
+      if (i == 0)
+        m[i] = (z[1] - z[0]) / (u[1] - u[0]);
+      else if (i == n - 1)
+        m[i] = (z[n - 1] - z[n - 2]) / (u[n - 1] - u[n - 2]);
+      else
+      {
+        h0 = u[i] - u[i - 1];
+        h1 = u[i + 1] - u[i];
+        d0 = (z[i] - z[i - 1]) / h0;
+        d1 = (z[i + 1] - z[i]) / h1;
+        if (d0 * d1 <= 0.0)
+          m[i] = 0.0;
+        else
+          m[i] = 3. * (h0 + h1) / ((2. * h1 + h0) / d0 + (h1 + 2. * h0) / d1);
+      }
+    }
+
+    /* Bisect the cubic on the interval k to k + 1, on which it changes sign exactly once */
+
+    h = u[k + 1] - u[k];
+    ua = u[k];
+    ub = u[k + 1];
+    za = z[k];
+    um = zm = dz = 0.0;
+    for (iter = 0; iter < 60; iter++)
+    {
+      um = 0.5 * (ua + ub);
+      s = (um - u[k]) / h;
+      a = (1. + 2. * s) * (1. - s) * (1. - s);
+      b = s * s * (3. - 2. * s);
+      zm = a * z[k] + b * z[k + 1] + h * s * (1. - s) * ((1. - s) * m[k] - s * m[k + 1]);
+      if (zm * za > 0.0)
+      {
+        ua = um;
+        za = zm;
+      }
+      else
+        ub = um;
+    }
+    s = (um - u[k]) / h;
+    dz = (6. * s * (s - 1.) * (z[k] - z[k + 1])) / h + (1. - s) * (1. - 3. * s) * m[k] + s * (3. * s - 2.) * m[k + 1];
+
+    /* Evaluate func at the root of the interpolant, and add it to the stencil */
+
+    t = exp (um);
+    zm = (*func) (t);
+
+    for (i = n; i > k + 1; i--)
+    {
+      u[i] = u[i - 1];
+      z[i] = z[i - 1];
+    }
+    u[k + 1] = um;
+    z[k + 1] = zm;
+    n++;
+
+    /* Accept t if a Newton step from it would be smaller than tol */
+
+    if (zm == 0.0)
+      return (t);
+    slope = fabs (dz) / t;
+    d0 = fabs ((z[k + 1] - z[k]) / (t - exp (u[k])));
+    d1 = fabs ((z[k + 2] - z[k + 1]) / (exp (u[k + 2]) - t));
+    if (d0 < slope)
+      slope = d0;
+    if (d1 < slope)
+      slope = d1;
+    if (slope > 0.0 && fabs (zm) / slope < tol)
+      return (t);
+  }
+
+  return (zbrent (func, exp (u[k]), exp (u[k + 1]), tol));
+}
@@ -199,6 +199,9 @@ lum_lines (one, nmin, nmax)
 
 struct lines *q21_line_ptr;
 double q21_a, q21_t_old;
+#ifdef _OPENMP
+#pragma omp threadprivate(q21_line_ptr, q21_a, q21_t_old)
+#endif
 
 
 /**********************************************************/
@@ -302,6 +305,9 @@ q12 (line_ptr, t)
 
 struct lines *a21_line_ptr;
 double a21_a;
+#ifdef _OPENMP
+#pragma omp threadprivate(a21_line_ptr, a21_a)
+#endif
 
 
 /**********************************************************/
@@ -378,6 +384,9 @@ a21 (line_ptr)
 struct lines *old_line_ptr;
 double old_ne, old_te, old_w, old_tr, old_dd;
 double old_d1, old_d2, old_n2_over_n1;
+#ifdef _OPENMP
+#pragma omp threadprivate(old_line_ptr, old_ne, old_te, old_w, old_tr, old_dd, old_d1, old_d2, old_n2_over_n1)
+#endif
 
 /**********************************************************/
 /**
@@ -406,6 +415,9 @@ double old_d1, old_d2, old_n2_over_n1;
  * This routine is not (should not be) called for macro atoms.
  * The program will exit if this happens
  *
+ * The calculation itself is carried out by two_level_atom_den,
+ * using the ion density stored in xplasma.
+ *
  **********************************************************/
 
 
@@ -414,6 +426,42 @@ two_level_atom (line_ptr, xplasma, d1, d2)
      struct lines *line_ptr;
      PlasmaPtr xplasma;
      double *d1, *d2;
+{
+  return (two_level_atom_den (line_ptr, xplasma, xplasma->density[line_ptr->nion], d1, d2));
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      calculates the ratio n2/n1 and gives the individual
+ * densities for the states of a two level atom, given the density
+ * of the ion
+ *
+ * @param [in] struct lines *  line_ptr   The line of interest
+ * @param [in] PlasmaPtr  xplasma   The plasma cell of interest
+ * @param [in] double  den_ion   The number density of the ion to which the line belongs
+ * @param [out] double *  d1   The calculated density of the lower level for the line of interest
+ * @param [out] double *  d2   The calculated density of the upper levl
+ * @return     The density ratio d2/d1
+ *
+ * @details
+ * This is two_level_atom, but with the ion density passed explicitly
+ * rather than taken from xplasma->density.  sobolev uses this to 
+ * calculate level densities from the ion density at a specific 
+ * position in a cell, without modifying the plasma structure (which
+ * may be shared between threads).
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+double
+two_level_atom_den (line_ptr, xplasma, den_ion, d1, d2)
+     struct lines *line_ptr;
+     PlasmaPtr xplasma;
+     double den_ion;
+     double *d1, *d2;
 {
   double a, a21 ();
   double q, q21 (), c12, c21;
@@ -445,7 +493,7 @@ two_level_atom (line_ptr, xplasma, d1, d2)
   tr = xplasma->t_r;
   w = xplasma->w;
   nion = line_ptr->nion;
-  dd = xplasma->density[nion];
+  dd = den_ion;
 
   /* Calculate the number density of the lower level for the transition using the partition function */
   ;
@@ -736,6 +784,9 @@ scattering_fraction (line_ptr, xplasma)
 struct lines *pe_line_ptr;
 double pe_ne, pe_te, pe_dd, pe_dvds, pe_w, pe_tr;
 double pe_escape;
+#ifdef _OPENMP
+#pragma omp threadprivate(pe_line_ptr, pe_ne, pe_te, pe_dd, pe_dvds, pe_w, pe_tr, pe_escape)
+#endif
 
 /**********************************************************/
 /**
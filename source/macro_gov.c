@@ -22,6 +22,15 @@
 //#include <gsl/gsl_blas.h>
 #include "my_linalg.h"
 
+/* The rates between the levels of an element, and its level populations, are assembled and solved in a
+   workspace which is kept from one call of macro_pops to the next, and which grows as needed */
+
+double *macro_work = NULL;      /* The rates between levels, followed by the populations */
+int macro_work_nlev = 0;        /* The largest number of levels the workspace can hold */
+#ifdef _OPENMP
+#pragma omp threadprivate(macro_work, macro_work_nlev)
+#endif
+
 /**********************************************************/
 /**
  * @brief      is a routine that will sit at a higher level in the code than either matom or kpkt
@@ -128,6 +137,9 @@ macro_gov (p, nres, matom_or_kpkt, which_out)
             //SWM - If reverb is on, and this is the last ionisation cycle, then track the photon path
             if (geo.reverb == REV_MATOM && geo.ioniz_or_extract && geo.fraction_converged > geo.reverb_fraction_converged)
             {
+#ifdef _OPENMP
+#pragma omp critical (reverb)
+#endif
               line_paths_add_phot (&(wmain[p->grid]), p, nres);
             }
             return (1);
@@ -207,13 +219,11 @@ macro_gov (p, nres, matom_or_kpkt, which_out)
  * @details
  *
  * ### Notes ###
- * This routine uses a matrix inversion method to get the level populations.
- * For now the matrix solver used is the LU decomposition method provided
- * by the Gnu Scientific Library (GSL, which is free). This requires the
- * include files that I've added to the top of this file and access to the
- * GSL "library" file (I've added the library into the Makefile too). I found
- * GSL to be very easy to install but if there are problems in the future we
- * may need to switch to another matrix solver. (SS, Apr 04)
+ * The rates between the levels of each element are assembled in a workspace
+ * which only holds the levels of that element, and the level populations
+ * are then found by macro_pops_solve.  Originally this was done by replacing
+ * one of the rate equations with the normalisation and inverting the full
+ * matrix by LU decomposition with GSL. (SS, Apr 04)
  *
  * We also clean for population inversion in this routine.
  *
@@ -230,8 +240,7 @@ macro_pops (xplasma, xne)
   int index_element, index_ion, index_lvl;
   int n_macro_lvl;
   double rate;
-  double rate_matrix[NLEVELS_MACRO][NLEVELS_MACRO];
-  int radiative_flag[NLEVELS_MACRO][NLEVELS_MACRO];     // 140423 JM flag if two levels are radiatively linked
+  double *rate_matrix;
   int conf_to_matrix[NLEVELS_MACRO];
   struct lines *line_ptr;
   struct topbase_phot *cont_ptr;
@@ -242,7 +251,6 @@ macro_pops (xplasma, xne)
   double levden_temp, ionden_temp;
   double inversion_test;
   double q_ioniz (), q_recomb ();
-  double *a_data, *b_data;
   double *populations;
   int index_fast_col, ierr, insane, sane_populations;
 
@@ -256,21 +264,6 @@ macro_pops (xplasma, xne)
   for (index_element = 0; index_element < nelements; index_element++)
   {
 
-
-    /* Zero all elements of the matrix before doing anything else. */
-
-    for (nn = 0; nn < NLEVELS_MACRO; nn++)
-    {
-      for (mm = 0; mm < NLEVELS_MACRO; mm++)
-      {
-        rate_matrix[mm][nn] = 0.0;
-
-        /* 140423 JM -- new int array to flag if  two levels are radiatively linked
-           initialize to 0 */
-        radiative_flag[mm][nn] = 0;
-      }
-    }
-
     /* See if this element uses a macro atom treatment or is a simple element.
        For now I'm assuming that either all ions of a given element are
        treated using the macro atom method, or else none are (mixing and
@@ -288,7 +281,7 @@ macro_pops (xplasma, xne)
 
         /* Having established that the ion requires a macro atom treatment we
            are going to construct a matrix of rates between the levels and
-           invert that matrix to get the level populations. The first thing we need
+           solve it to get the level populations. The first thing we need
            to do is work out how many levels we are dealing with in total. This is
            easily done by summing up the number of levels of each ion. */
 
@@ -308,9 +301,33 @@ macro_pops (xplasma, xne)
         }
 
         /* We now know how many levels there are and therefore how big the matrix we
-           need to invert will be. */
+           need to solve will be.  Make sure the workspace is large enough, and zero the
+           part of it which is needed. */
 
-        /* Now we want to populate the matrix with all the rates between the levels. */
+        if (n_macro_lvl > macro_work_nlev)
+        {
+          free (macro_work);
+          if ((macro_work = calloc (sizeof (double), n_macro_lvl * (n_macro_lvl + 1))) == NULL)
+          {
+            Error ("macro_pops: Could not allocate the workspace for %d levels\n", n_macro_lvl);
+            exit (0);
+          }
+          macro_work_nlev = n_macro_lvl;
+        }
+
+        rate_matrix = macro_work;
+        populations = macro_work + n_macro_lvl * n_macro_lvl;
+
+        for (nn = 0; nn < n_macro_lvl * n_macro_lvl; nn++)
+        {
+          rate_matrix[nn] = 0.0;
+        }
+
+        /* Now we want to populate the matrix with all the rates between the levels.
+           rate_matrix[upper * n_macro_lvl + lower] is the rate at which the level in row lower
+           is depopulated to the level in row upper, and vice versa.  The total rates out of
+           each level, which are on the diagonal of the full rate matrix, are not needed by
+           macro_pops_solve and so are not stored. */
 
         for (index_ion = ele[index_element].firstion; index_ion < (ele[index_element].firstion + ele[index_element].nions); index_ion++)
         {
@@ -336,11 +353,9 @@ macro_pops (xplasma, xne)
                 rate = q12 (&fast_line, xplasma->t_e) * xne;
                 lower = conf_to_matrix[index_lvl];
                 upper = conf_to_matrix[index_fast_col + 1];
-                rate_matrix[lower][lower] += -1. * rate;
-                rate_matrix[upper][lower] += rate;
+                rate_matrix[upper * n_macro_lvl + lower] += rate;
                 rate = q21 (&fast_line, xplasma->t_e) * xne;
-                rate_matrix[upper][upper] += -1. * rate;
-                rate_matrix[lower][upper] += rate;
+                rate_matrix[lower * n_macro_lvl + upper] += rate;
               }
             }
           }
@@ -362,27 +377,20 @@ macro_pops (xplasma, xne)
               rate = b12 (line_ptr) * mplasma->jbar_old[config[index_lvl].bbu_indx_first + index_bbu];
               rate += q12 (line_ptr, xplasma->t_e) * xne;
 
-              /* This is the rate out of the level in question. We need to add it
-                 to the matrix in two places: firstly as a -ve contribution to the
-                 diagonal and secondly as a +ve contribution for the off-diagonal
-                 corresponding to the level populated by this process. */
+              /* This is the rate out of the level in question, which is also the rate
+                 into the level populated by this process. */
 
               /* Get the matix indices for the upper and lower states of the jump. */
 
               lower = conf_to_matrix[index_lvl];
               upper = conf_to_matrix[line_ptr->nconfigu];
 
-              rate_matrix[lower][lower] += -1. * rate;
-              rate_matrix[upper][lower] += rate;
+              rate_matrix[upper * n_macro_lvl + lower] += rate;
 
               if (rate < 0.0 || sane_check (rate))
               {
                 Error ("macro_pops: bbu rate is %8.4e in cell/matom %i\n", rate, xplasma->nplasma);
               }
-
-              /* There's a radiative jump between these levels, so we want to clean
-                 for popualtion inversions. Flag this jump */
-              radiative_flag[index_lvl][line_ptr->nconfigu] = 1;
             }
 
             for (index_bbd = 0; index_bbd < config[index_lvl].n_bbd_jump; index_bbd++)
@@ -396,23 +404,15 @@ macro_pops (xplasma, xne)
               //rate =0.0;
               rate += q21 (line_ptr, xplasma->t_e) * xne;
 
-              /* This is the rate out of the level in question. We need to add it
-                 to the matrix in two places: firstly as a -ve contribution to the
-                 diagonal and secondly as a +ve contribution for the off-diagonal
-                 corresponding to the level populated by this process. */
+              /* This is the rate out of the level in question, which is also the rate
+                 into the level populated by this process. */
 
               /* Get the matix indices for the upper and lower states of the jump. */
 
               upper = conf_to_matrix[index_lvl];
               lower = conf_to_matrix[line_ptr->nconfigl];
 
-              rate_matrix[upper][upper] += -1. * rate;
-              rate_matrix[lower][upper] += rate;
-
-
-              /* There's a radiative jump between these levels, so we want to clean
-                 for popualtion inversions. Flag this jump */
-              radiative_flag[line_ptr->nconfigl][index_lvl] = 1;
+              rate_matrix[lower * n_macro_lvl + upper] += rate;
 
               if (rate < 0.0 || sane_check (rate))
               {
@@ -431,18 +431,15 @@ macro_pops (xplasma, xne)
               rate = mplasma->gamma_old[config[index_lvl].bfu_indx_first + index_bfu];
               rate += q_ioniz (cont_ptr, xplasma->t_e) * xne;
 
-              /* This is the rate out of the level in question. We need to add it
-                 to the matrix in two places: firstly as a -ve contribution to the
-                 diagonal and secondly as a +ve contribution for the off-diagonal
-                 corresponding to the level populated by this process. */
+              /* This is the rate out of the level in question, which is also the rate
+                 into the level populated by this process. */
 
               /* Get the matix indices for the upper and lower states of the jump. */
 
               lower = conf_to_matrix[index_lvl];
               upper = conf_to_matrix[cont_ptr->uplev];
 
-              rate_matrix[lower][lower] += -1. * rate;
-              rate_matrix[upper][lower] += rate;
+              rate_matrix[upper * n_macro_lvl + lower] += rate;
 
               if (rate < 0.0 || sane_check (rate))
               {
@@ -455,8 +452,7 @@ macro_pops (xplasma, xne)
 
               rate = mplasma->alpha_st_old[config[index_lvl].bfu_indx_first + index_bfu] * xne;
 
-              rate_matrix[upper][upper] += -1. * rate;
-              rate_matrix[lower][upper] += rate;
+              rate_matrix[lower * n_macro_lvl + upper] += rate;
 
               if (rate < 0.0 || sane_check (rate))
               {
@@ -479,18 +475,15 @@ macro_pops (xplasma, xne)
               rate += q_recomb (cont_ptr, xplasma->t_e) * xne * xne;
 
 
-              /* This is the rate out of the level in question. We need to add it
-                 to the matrix in two places: firstly as a -ve contribution to the
-                 diagonal and secondly as a +ve contribution for the off-diagonal
-                 corresponding to the level populated by this process. */
+              /* This is the rate out of the level in question, which is also the rate
+                 into the level populated by this process. */
 
               /* Get the matix indices for the upper and lower states of the jump. */
 
               upper = conf_to_matrix[index_lvl];
               lower = conf_to_matrix[cont_ptr->nlev];
 
-              rate_matrix[upper][upper] += -1. * rate;
-              rate_matrix[lower][upper] += rate;
+              rate_matrix[lower * n_macro_lvl + upper] += rate;
 
               if (rate < 0.0 || sane_check (rate))
               {
@@ -500,57 +493,13 @@ macro_pops (xplasma, xne)
           }
         }
 
-        /* The rate matrix is now filled up. Since the problem is not closed as it stands, the next
-           thing is to replace one of the rows of the matrix (say the first row) with the constraint
-           that the sum of all the populations is 1.0 (this will let us get population fractions). */
-
-        for (index_lvl = 0; index_lvl < n_macro_lvl; index_lvl++)
-        {
-          rate_matrix[0][index_lvl] = 1.0;
-        }
-
-        /* Now we can just invert the matrix to get the fractional level populations. */
-
-
-          /********************************************************************************/
-        /* The block that follows (down to next line of ***s) is to do the
-           matrix inversion. It uses LU decomposition - the code for doing this is
-           taken from the GSL manual with very few modifications. */
-        /* here we solve the matrix equation M x = b, where x is our vector containing
-           level populations as a fraction w.r.t the whole element */
-
-        /* Replaced inline array allocaation with calloc, which will work with older version of c compilers */
-
-        a_data = (double *) calloc (sizeof (rate), n_macro_lvl * n_macro_lvl);
-
-        for (nn = 0; nn < n_macro_lvl; nn++)
-        {
-          for (mm = 0; mm < n_macro_lvl; mm++)
-          {
-            a_data[nn * n_macro_lvl + mm] = rate_matrix[nn][mm];
-          }
-        }
-
-
-        /* Replaced inline array allocaation with calloc, which will work with older version of c compilers
-           calloc also sets the elements to zero, which is required */
-
-        b_data = (double *) calloc (sizeof (rate), n_macro_lvl);
-        populations = (double *) calloc (sizeof (rate), n_macro_lvl);
+        /* The rate matrix is now filled up, and we can solve it to get the fractional level
+           populations, which sum to 1.0. */
 
-        /* replace the first entry with 1.0- this is part of the normalisation constraint */
-        b_data[0] = 1.0;
-
-        /* this next routine is a general routine which solves the matrix equation
-           via LU decomposition */
-        ierr = solve_matrix (a_data, b_data, n_macro_lvl, populations, xplasma->nplasma);
+        ierr = macro_pops_solve (rate_matrix, n_macro_lvl, populations);
 
         if (ierr != 0)
-          Error ("macro_pops: bad return from solve_matrix\n");
-
-        /* free memory */
-        free (a_data);
-        free (b_data);
+          Error ("macro_pops: bad return from macro_pops_solve\n");
 
 
         /* MC noise can cause population inversions (particularly amongst highly excited states)
@@ -564,13 +513,15 @@ macro_pops (xplasma, xne)
           for (index_lvl = ion[index_ion].first_nlte_level; index_lvl < ion[index_ion].first_nlte_level + ion[index_ion].nlte; index_lvl++)
           {                     /* Start loop with lowest level of the ion. For each level in turn check to see if there's a population
                                    inversion i.e. is  upper_pop > lower_pop * g_upper / g_lower. If it is then replace upper_pop with
-                                   lower_pop * g_upper / g_lower. We loop over all levels higher than the currently chosen lower level. */
+                                   lower_pop * g_upper / g_lower. We loop over all the higher levels to which there is a radiative
+                                   jump from the currently chosen lower level, since we only clean if there's a radiative jump
+                                   between the levels. */
 
-            for (nn = index_lvl + 1; nn < (ion[index_ion].first_nlte_level + ion[index_ion].nlte); nn++)
+            for (index_bbu = 0; index_bbu < config[index_lvl].n_bbu_jump; index_bbu++)
             {
+              nn = line[config[index_lvl].bbu_jump[index_bbu]].nconfigu;
 
-              /* this if statement means we only clean if there's a radiative jump between the levels */
-              if (radiative_flag[index_lvl][nn])
+              if (nn > index_lvl && nn < (ion[index_ion].first_nlte_level + ion[index_ion].nlte))
               {
                 inversion_test = populations[conf_to_matrix[index_lvl]] * config[nn].g / config[index_lvl].g * 0.999999;        //include a correction factor
 
@@ -680,3 +631,107 @@ macro_pops (xplasma, xne)
   return (0);
   /* All done. (SS, Apr 04) */
 }
+
+
+/**********************************************************/
+/**
+ * @brief      solves the rate equations for the level populations of a macro atom element
+ *
+ * @param [in, out] double  q[] - the rates between the levels, which are destroyed
+ * @param [in] int  nlev - the number of levels
+ * @param [out] double  x[] - the fractional level populations, which sum to one
+ * @return     0 on success, or 4 if some levels could not be solved for
+ *
+ * @details
+ * q[i * nlev + j] is the rate at which level j is depopulated to level i.  The
+ * populations are the solution of the rate equations in which the rate out of
+ * each level is the sum of the rates to all the others.  This routine finds them by
+ * the method of Grassmann, Taksar and Heyman (1985, Operations Research 33, 1107),
+ * which eliminates the levels one at a time, from the last to the first,
+ * and replaces the rates between the remaining levels by the rates of going
+ * between them via the eliminated one.  Only additions, multiplications and
+ * divisions of positive numbers are involved, so the populations are always
+ * positive and accurate to rounding error, however many decades they span.
+ *
+ * ### Notes ###
+ * Rates which are zero are skipped, so the work depends on how many levels are
+ * connected to each other, rather than on the cube of the number of levels.
+ *
+ * A level which has no route to a lower level once the higher levels have been
+ * eliminated is reported, and given no population.
+ *
+ **********************************************************/
+
+int
+macro_pops_solve (q, nlev, x)
+     double q[];
+     int nlev;
+     double x[];
+{
+  int n, i, j, k, nout, ierr;
+  double s, sum;
+  int out[nlev];
+
+  ierr = 0;
+
+  for (n = nlev - 1; n > 0; n--)
+  {
+    /* The total rate out of level n to the levels which remain, and the levels it goes to */
+    s = 0.0;
+    nout = 0;
+    for (j = 0; j < n; j++)
+    {
+      if (q[j * nlev + n] > 0.0)
+      {
+        s += q[j * nlev + n];
+        out[nout++] = j;
+      }
+    }
+
+    if (s <= 0.0)
+    {
+      Error ("macro_pops_solve: level %d of %d cannot be depopulated\n", n, nlev);
+      for (i = 0; i < n; i++)
+      {
+        q[n * nlev + i] = 0.0;
+      }
+      ierr = 4;
+      continue;
+    }
+
+    /* q[n * nlev + i] becomes the rate into level n from level i, per unit rate out of level n */
+    for (i = 0; i < n; i++)
+    {
+      if (q[n * nlev + i] > 0.0)
+      {
+        q[n * nlev + i] /= s;
+        for (k = 0; k < nout; k++)
+        {
+          j = out[k];
+          if (j != i)
+          {
+            q[j * nlev + i] += q[n * nlev + i] * q[j * nlev + n];
+          }
+        }
+      }
+    }
+  }
+
+  x[0] = sum = 1.0;
+  for (n = 1; n < nlev; n++)
+  {
+    x[n] = 0.0;
+    for (i = 0; i < n; i++)
+    {
+      x[n] += x[i] * q[n * nlev + i];
+    }
+    sum += x[n];
+  }
+
+  for (n = 0; n < nlev; n++)
+  {
+    x[n] /= sum;
+  }
+
+  return (ierr);
+}
@@ -18,6 +18,14 @@
 //#include <gsl/gsl_blas.h>
 #include "my_linalg.h"
 
+/* Workspace in which fill_kpkt_rates holds the cooling rates of every bf, collisional
+   ionization and bb process in a cell, before the negligible ones are discarded */
+double *kpkt_work = NULL;
+int kpkt_work_size = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(kpkt_work, kpkt_work_size)
+#endif
+
 /**********************************************************/
 /** 
  * @brief The core of the implementation of Macro Atoms in python
@@ -115,29 +123,17 @@ matom (p, nres, escape)
   struct lines *line_ptr;
   struct topbase_phot *cont_ptr;
   int uplvl, uplvl_old;
-  double jprbs[2 * (NBBJUMPS + NBFJUMPS)];
-  double eprbs[NBBJUMPS + NBFJUMPS];
   double pjnorm, penorm;
-  double threshold, run_tot;
-  double sp_rec_rate;
-  int n, m;
+  double threshold;
+  int n;
   int njumps;
   int nbbd, nbbu, nbfd, nbfu;
   double t_e, ne;
-  double bb_cont, choice, bf_cont;
+  double choice;
   WindPtr one;
   double rad_rate, coll_rate;
   PlasmaPtr xplasma;
   MacroPtr mplasma;
-  double jprbs_known[NLEVELS_MACRO][2 * (NBBJUMPS + NBFJUMPS)], eprbs_known[NLEVELS_MACRO][2 * (NBBJUMPS + NBFJUMPS)];
-  double pjnorm_known[NLEVELS_MACRO], penorm_known[NLEVELS_MACRO];
-  int prbs_known[NLEVELS_MACRO];
-
-
-  for (n = 0; n < NLEVELS_MACRO; n++)
-  {
-    prbs_known[n] = -1;         //flag all as unknown
-  }
 
 
   one = &wmain[p->grid];        //This is to identify the grid cell in which we are
@@ -150,6 +146,19 @@ matom (p, nres, escape)
   t_e = xplasma->t_e;           //electron temperature 
   ne = xplasma->ne;             //electron number density
 
+  /* The jumping and emission probabilities of the levels of this cell are kept from one
+     call to the next.  Forget them if the temperature has changed, or if the wind has
+     been updated, in which case matom_prbs_t_e will have been set to -1 */
+
+  if (mplasma->matom_prbs_t_e != t_e)
+  {
+    for (n = 0; n < nlevels_macro; n++)
+    {
+      mplasma->matom_prbs_known[n] = FALSE;
+    }
+    mplasma->matom_prbs_t_e = t_e;
+  }
+
 
   /* The first step is to identify the configuration that has been excited. */
 
@@ -175,209 +184,46 @@ matom (p, nres, escape)
 
   for (njumps = 0; njumps < MAXJUMPS; njumps++)
   {
-    /*  The excited configuration is now known. Now compute all the probabilities of deactivation
-       /jumping from this configuration. Then choose one. */
+    /*  The excited configuration is now known. Get the probabilities of deactivation
+       /jumping from this configuration, calculating them if this is the first visit to
+       the level. Then choose one. */
 
     nbbd = config[uplvl].n_bbd_jump;    //store these for easy access -- number of bb downward jumps
     nbbu = config[uplvl].n_bbu_jump;    // number of bb upward jump from this configuration
     nbfd = config[uplvl].n_bfd_jump;    // number of bf downward jumps from this transition
     nbfu = config[uplvl].n_bfu_jump;    // number of bf upward jumps from this transiion
 
-    if (prbs_known[uplvl] != 1)
+    if (mplasma->matom_prbs_known[uplvl] != TRUE)
     {
-      /* Start by setting everything to 0  */
-
-      m = 0;                    //m counts the total number of possible ways to leave the level
-      pjnorm = 0.0;             //stores the total jump probability
-      penorm = 0.0;             //stores the total emission probability
-
-      for (n = 0; n < nbbd + nbfd; n++)
-      {
-        eprbs_known[uplvl][n] = eprbs[n] = 0;   //stores the individual emission probabilities SS
-        jprbs_known[uplvl][n] = jprbs[n] = 0;   //stores the individual jump probabilities SS
-      }
-      for (n = nbbd + nbfd; n < nbbd + nbfd + nbbu + nbfu; n++)
-      {
-        jprbs_known[uplvl][n] = jprbs[n] = 0;   /*slots for upward jumps */
-      }
-      /* Finished zeroing. */
-
-
-      /* bb */
-
-      /* First downward jumps. (I.e. those that have emission probabilities. */
-
-      /* For bound-bound decays the jump probability is A-coeff * escape-probability * energy */
-      /* At present the escape probability is only approximated (p_escape). This should be improved. */
-      /* The collisional contribution to both the jumping and deactivation probabilities are now added (SS, Apr04) */
-
-      for (n = 0; n < nbbd; n++)
-      {
-        line_ptr = &line[config[uplvl].bbd_jump[n]];
-
-        rad_rate = (a21 (line_ptr) * p_escape (line_ptr, xplasma));
-        coll_rate = q21 (line_ptr, t_e);        // this is multiplied by ne below
-
-        if (coll_rate < 0)
-        {
-          coll_rate = 0;
-        }
-
-        bb_cont = rad_rate + (coll_rate * ne);
-        jprbs_known[uplvl][m] = jprbs[m] = bb_cont * config[line_ptr->nconfigl].ex;     //energy of lower state
-
-        eprbs_known[uplvl][m] = eprbs[m] = bb_cont * (config[uplvl].ex - config[line[config[uplvl].bbd_jump[n]].nconfigl].ex);  //energy difference
-
-        if (jprbs[m] < 0.)      //test (can be deleted eventually SS)
-        {
-          Error ("Negative probability (matom, 1). Abort.");
-          exit (0);
-        }
-        if (eprbs[m] < 0.)      //test (can be deleted eventually SS)
-        {
-          Error ("Negative probability (matom, 2). Abort.");
-          exit (0);
-        }
-
-        pjnorm += jprbs[m];
-        penorm += eprbs[m];
-        m++;
-      }
-
-      /* bf */
-      for (n = 0; n < nbfd; n++)
-      {
-
-        cont_ptr = &phot_top[config[uplvl].bfd_jump[n]];        //pointer to continuum
-        if (n < 25)
-        {
-          sp_rec_rate = mplasma->recomb_sp[config[uplvl].bfd_indx_first + n];   //need this twice so store it
-          bf_cont = (sp_rec_rate + q_recomb (cont_ptr, t_e) * ne) * ne;
-        }
-        else
-        {
-          bf_cont = 0.0;
-        }
-
-        jprbs_known[uplvl][m] = jprbs[m] = bf_cont * config[phot_top[config[uplvl].bfd_jump[n]].nlev].ex;       //energy of lower state
-        eprbs_known[uplvl][m] = eprbs[m] = bf_cont * (config[uplvl].ex - config[phot_top[config[uplvl].bfd_jump[n]].nlev].ex);  //energy difference
-        if (jprbs[m] < 0.)      //test (can be deleted eventually SS)
-        {
-          Error ("Negative probability (matom, 3). Abort.");
-          exit (0);
-        }
-        if (eprbs[m] < 0.)      //test (can be deleted eventually SS)
-        {
-          Error ("Negative probability (matom, 4). Abort.");
-          exit (0);
-        }
-        pjnorm += jprbs[m];
-        penorm += eprbs[m];
-        m++;
-      }
-
-      /* Now upwards jumps. */
-
-      /* bb */
-      /* For bound-bound excitation the jump probability is B-coeff times Jbar with a correction 
-         for stimulated emission. To avoid the need for recalculation all the time, the code will
-         be designed to include the stimulated correction in Jbar - i.e. the stimulated correction
-         factor will NOT be included here. (SS) */
-      /* There is no emission probability for upwards transitions. */
-      /* Collisional contribution to jumping probability added. (SS,Apr04) */
-
-      for (n = 0; n < nbbu; n++)
-      {
-        line_ptr = &line[config[uplvl].bbu_jump[n]];
-        rad_rate = (b12 (line_ptr) * mplasma->jbar_old[config[uplvl].bbu_indx_first + n]);
-
-        coll_rate = q12 (line_ptr, t_e);        // this is multiplied by ne below
-
-        if (coll_rate < 0)
-        {
-          coll_rate = 0;
-        }
-
-        jprbs_known[uplvl][m] = jprbs[m] = ((rad_rate) + (coll_rate * ne)) * config[uplvl].ex;  //energy of lower state
-
-
-
-        if (jprbs[m] < 0.)      //test (can be deleted eventually SS)
-        {
-          Error ("Negative probability (matom, 5). Abort.");
-          exit (0);
-        }
-        pjnorm += jprbs[m];
-        m++;
-      }
-
-      /* bf */
-      for (n = 0; n < nbfu; n++)
-      {
-        /* For bf ionization the jump probability is just gamma * energy
-           gamma is the photoionisation rate. Stimulated recombination also included. */
-        cont_ptr = &phot_top[config[uplvl].bfu_jump[n]];        //pointer to continuum
-
-        jprbs_known[uplvl][m] = jprbs[m] = (mplasma->gamma_old[config[uplvl].bfu_indx_first + n] - (mplasma->alpha_st_old[config[uplvl].bfu_indx_first + n] * xplasma->ne * den_config (xplasma, cont_ptr->uplev) / den_config (xplasma, cont_ptr->nlev)) + (q_ioniz (cont_ptr, t_e) * ne)) * config[uplvl].ex; //energy of lower state
-
-        /* this error condition can happen in unconverged hot cells where T_R >> T_E.
-           for the moment we set to 0 and hope spontaneous recombiantion takes care of things */
-        /* note that we check and report this in check_stimulated_recomb() in estimators.c once a cycle */
-        if (jprbs[m] < 0.)      //test (can be deleted eventually SS)
-        {
-          //Error ("Negative probability (matom, 6). Abort?\n");
-          jprbs_known[uplvl][m] = jprbs[m] = 0.0;
-
-        }
-        pjnorm += jprbs[m];
-        m++;
-      }
-
-      pjnorm_known[uplvl] = pjnorm;
-      penorm_known[uplvl] = penorm;
-      prbs_known[uplvl] = 1;
-
+      fill_matom_prbs (xplasma, uplvl);
     }
 
-    /* Probabilities of jumping (j) and emission (e) are now known. The normalisation factor pnorm has
-       also been recorded. the integer m now gives the total number of possibilities too. 
-       now select what happens next. Start by choosing the random threshold value at which the
+    pjnorm = mplasma->matom_pjnorm[uplvl];
+    penorm = mplasma->matom_penorm[uplvl];
+
+    /* Probabilities of jumping (j) and emission (e) are now known, along with their totals.
+       Now select what happens next. Start by choosing the random threshold value at which the
        event will occur. */
 
-//    threshold = ((rand () + 0.5) / MAXRAND); DONE
     threshold = random_number (0.0, 1.0);
 
-    if ((pjnorm_known[uplvl] + penorm_known[uplvl]) <= 0.0)
+    if ((pjnorm + penorm) <= 0.0)
     {
-      Error ("matom: macro atom level has no way out %d %g %g\n", uplvl, pjnorm_known[uplvl], penorm_known[uplvl]);
+      Error ("matom: macro atom level has no way out %d %g %g\n", uplvl, pjnorm, penorm);
       exit (0);
     }
 
-    if (((pjnorm_known[uplvl] / (pjnorm_known[uplvl] + penorm_known[uplvl])) < threshold) || (pjnorm_known[uplvl] == 0))
+    if (((pjnorm / (pjnorm + penorm)) < threshold) || (pjnorm == 0))
       break;                    // An emission occurs and so we leave the for loop.
 
     uplvl_old = uplvl;
 
 // Continue on if a jump has occured 
 
-    /* Use a running total to decide where event occurs. */
-    run_tot = 0;
+    /* Choose the jump from the alias table of the level */
 
-    n = 0;
-//    threshold = ((rand () + 0.5) / MAXRAND); //DONE
-    threshold = random_number (0.0, 1.0);
-
-    threshold = threshold * pjnorm_known[uplvl_old];
-    while (run_tot < threshold)
-    {
-      run_tot += jprbs_known[uplvl_old][n];
-      n++;
-    }
-    // This added to prevent case where theshold is essentially 0. It is already checked that the jumping probability is not zero
-    if (n > 0)
-    {
-      n = n - 1;
-    }
+    n = alias_sample (nbbd + nbfd + nbbu + nbfu, &mplasma->matom_jump_prob[config[uplvl].jump_indx_first],
+                      &mplasma->matom_jump_alias[config[uplvl].jump_indx_first]);
 
     /* n now identifies the jump that occurs - now set the new level. */
     if (n < nbbd)
@@ -422,20 +268,11 @@ matom (p, nres, escape)
 
 
   /* If it gets here then an emission has occurred. SS */
-  /* Use a running total to decide where event occurs. SS */
+  /* Choose the emission from the alias table of the level. SS */
 
-  run_tot = 0;
-  n = 0;
-//  threshold = ((rand () + 0.5) / MAXRAND); //DONE
-  threshold = random_number (0.0, 1.0);
+  n = alias_sample (nbbd + nbfd, &mplasma->matom_emiss_prob[config[uplvl].emiss_indx_first],
+                    &mplasma->matom_emiss_alias[config[uplvl].emiss_indx_first]);
 
-  threshold = threshold * penorm_known[uplvl];  //normalise to total emission prob.
-  while (run_tot < threshold)
-  {
-    run_tot += eprbs_known[uplvl][n];
-    n++;
-  }
-  n = n - 1;
   /* n now identifies the jump that occurs - now set nres for the return value. */
   if (n < nbbd)
   {                             /* bb downwards jump */
@@ -521,6 +358,267 @@ matom (p, nres, escape)
 
 
 
+/**********************************************************/
+/** 
+ * @brief      Calculate the jumping and emission probabilities of a macro atom level
+ *
+ * @param [in] PlasmaPtr  xplasma   The plasma cell in which the macro atom lives
+ * @param [in] int  uplvl   The level whose probabilities are required
+ * @param [out] double  jprbs[]   The probabilities of each of the jumps from the level
+ * @param [out] double  eprbs[]   The probabilities of each of the emissions from the level
+ * @param [out] double *  pjnorm   The total jumping probability
+ * @param [out] double *  penorm   The total emission probability
+ * @return     The number of jumps from the level
+ *
+ * @details
+ * The probabilities of all the ways out of level uplvl are calculated, following
+ * Lucy.  The ordering of the jumps is bb downwards, bf downwards, bb upwards and then
+ * bf upwards, and the emissions are bb downwards and then bf downwards.  jprbs must have
+ * room for 2 * (NBBJUMPS + NBFJUMPS) elements and eprbs for NBBJUMPS + NBFJUMPS.
+ *
+ * ### Notes ###
+ * This is used both by fill_matom_prbs, for the Monte Carlo treatment of macro atoms,
+ * and when the emissivities are calculated directly from the rates (see get_matom_f).
+ *
+ **********************************************************/
+
+int
+matom_prbs (xplasma, uplvl, jprbs, eprbs, pjnorm, penorm)
+     PlasmaPtr xplasma;
+     int uplvl;
+     double jprbs[], eprbs[];
+     double *pjnorm, *penorm;
+{
+  struct lines *line_ptr;
+  struct topbase_phot *cont_ptr;
+  double sp_rec_rate;
+  int n, m;
+  int nbbd, nbbu, nbfd, nbfu;
+  double t_e, ne;
+  double bb_cont, bf_cont;
+  double rad_rate, coll_rate;
+  MacroPtr mplasma;
+
+  mplasma = &macromain[xplasma->nplasma];
+
+  t_e = xplasma->t_e;
+  ne = xplasma->ne;
+
+  nbbd = config[uplvl].n_bbd_jump;
+  nbbu = config[uplvl].n_bbu_jump;
+  nbfd = config[uplvl].n_bfd_jump;
+  nbfu = config[uplvl].n_bfu_jump;
+
+  /* Start by setting everything to 0  */
+
+  m = 0;                        //m counts the total number of possible ways to leave the level
+  *pjnorm = 0.0;                //stores the total jump probability
+  *penorm = 0.0;                //stores the total emission probability
+
+  for (n = 0; n < nbbd + nbfd; n++)
+  {
+    eprbs[n] = 0;               //stores the individual emission probabilities SS
+    jprbs[n] = 0;               //stores the individual jump probabilities SS
+  }
+  for (n = nbbd + nbfd; n < nbbd + nbfd + nbbu + nbfu; n++)
+  {
+    jprbs[n] = 0;               /*slots for upward jumps */
+  }
+  /* Finished zeroing. */
+
+
+  /* bb */
+
+  /* First downward jumps. (I.e. those that have emission probabilities. */
+
+  /* For bound-bound decays the jump probability is A-coeff * escape-probability * energy */
+  /* At present the escape probability is only approximated (p_escape). This should be improved. */
+  /* The collisional contribution to both the jumping and deactivation probabilities are now added (SS, Apr04) */
+
+  for (n = 0; n < nbbd; n++)
+  {
+    line_ptr = &line[config[uplvl].bbd_jump[n]];
+
+    rad_rate = (a21 (line_ptr) * p_escape (line_ptr, xplasma));
+    coll_rate = q21 (line_ptr, t_e);    // this is multiplied by ne below
+
+    if (coll_rate < 0)
+    {
+      coll_rate = 0;
+    }
+
+    bb_cont = rad_rate + (coll_rate * ne);
+    jprbs[m] = bb_cont * config[line_ptr->nconfigl].ex; //energy of lower state
+
+    eprbs[m] = bb_cont * (config[uplvl].ex - config[line[config[uplvl].bbd_jump[n]].nconfigl].ex);      //energy difference
+
+    if (jprbs[m] < 0.)          //test (can be deleted eventually SS)
+    {
+      Error ("Negative probability (matom, 1). Abort.");
+      exit (0);
+    }
+    if (eprbs[m] < 0.)          //test (can be deleted eventually SS)
+    {
+      Error ("Negative probability (matom, 2). Abort.");
+      exit (0);
+    }
+
+    *pjnorm += jprbs[m];
+    *penorm += eprbs[m];
+    m++;
+  }
+
+  /* bf */
+  for (n = 0; n < nbfd; n++)
+  {
+
+    cont_ptr = &phot_top[config[uplvl].bfd_jump[n]];    //pointer to continuum
+    if (n < 25)
+    {
+      sp_rec_rate = mplasma->recomb_sp[config[uplvl].bfd_indx_first + n];       //need this twice so store it
+      bf_cont = (sp_rec_rate + q_recomb (cont_ptr, t_e) * ne) * ne;
+    }
+    else
+    {
+      bf_cont = 0.0;
+    }
+
+    jprbs[m] = bf_cont * config[phot_top[config[uplvl].bfd_jump[n]].nlev].ex;   //energy of lower state
+    eprbs[m] = bf_cont * (config[uplvl].ex - config[phot_top[config[uplvl].bfd_jump[n]].nlev].ex);      //energy difference
+    if (jprbs[m] < 0.)          //test (can be deleted eventually SS)
+    {
+      Error ("Negative probability (matom, 3). Abort.");
+      exit (0);
+    }
+    if (eprbs[m] < 0.)          //test (can be deleted eventually SS)
+    {
+      Error ("Negative probability (matom, 4). Abort.");
+      exit (0);
+    }
+    *pjnorm += jprbs[m];
+    *penorm += eprbs[m];
+    m++;
+  }
+
+  /* Now upwards jumps. */
+
+  /* bb */
+  /* For bound-bound excitation the jump probability is B-coeff times Jbar with a correction 
+     for stimulated emission. To avoid the need for recalculation all the time, the code will
+     be designed to include the stimulated correction in Jbar - i.e. the stimulated correction
+     factor will NOT be included here. (SS) */
+  /* There is no emission probability for upwards transitions. */
+  /* Collisional contribution to jumping probability added. (SS,Apr04) */
+
+  for (n = 0; n < nbbu; n++)
+  {
+    line_ptr = &line[config[uplvl].bbu_jump[n]];
+    rad_rate = (b12 (line_ptr) * mplasma->jbar_old[config[uplvl].bbu_indx_first + n]);
+
+    coll_rate = q12 (line_ptr, t_e);    // this is multiplied by ne below
+
+    if (coll_rate < 0)
+    {
+      coll_rate = 0;
+    }
+
+    jprbs[m] = ((rad_rate) + (coll_rate * ne)) * config[uplvl].ex;      //energy of lower state
+
+
+
+    if (jprbs[m] < 0.)          //test (can be deleted eventually SS)
+    {
+      Error ("Negative probability (matom, 5). Abort.");
+      exit (0);
+    }
+    *pjnorm += jprbs[m];
+    m++;
+  }
+
+  /* bf */
+  for (n = 0; n < nbfu; n++)
+  {
+    /* For bf ionization the jump probability is just gamma * energy
+       gamma is the photoionisation rate. Stimulated recombination also included. */
+    cont_ptr = &phot_top[config[uplvl].bfu_jump[n]];    //pointer to continuum
+
+    jprbs[m] = (mplasma->gamma_old[config[uplvl].bfu_indx_first + n] - (mplasma->alpha_st_old[config[uplvl].bfu_indx_first + n] * xplasma->ne * den_config (xplasma, cont_ptr->uplev) / den_config (xplasma, cont_ptr->nlev)) + (q_ioniz (cont_ptr, t_e) * ne)) * config[uplvl].ex;     //energy of lower state
+
+    /* this error condition can happen in unconverged hot cells where T_R >> T_E.
+       for the moment we set to 0 and hope spontaneous recombiantion takes care of things */
+    /* note that we check and report this in check_stimulated_recomb() in estimators.c once a cycle */
+    if (jprbs[m] < 0.)          //test (can be deleted eventually SS)
+    {
+      jprbs[m] = 0.0;
+    }
+    *pjnorm += jprbs[m];
+    m++;
+  }
+
+  return (m);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief      Store the jumping and emission probabilities of a macro atom level for matom
+ *
+ * @param [in] PlasmaPtr  xplasma   The plasma cell in which the macro atom lives
+ * @param [in] int  uplvl   The level whose probabilities are required
+ * @return     Always returns 0
+ *
+ * @details
+ * The probabilities calculated by matom_prbs are stored in the macro structure of
+ * the cell, together with their totals pjnorm and penorm.  The individual jump and
+ * emission probabilities are stored as Walker alias tables, in the locations given
+ * by config[uplvl].jump_indx_first and config[uplvl].emiss_indx_first, so that matom
+ * can choose a jump or an emission at a cost that does not depend on the number of
+ * possibilities.
+ *
+ * ### Notes ###
+ * The probabilities depend on jbar_old, gamma_old, alpha_st_old and the electron
+ * temperature and density of the cell, and so must be recalculated whenever any of
+ * these change.  matom_prbs_known flags the levels for which the probabilities are
+ * current; these flags are cleared by matom when the temperature of the cell changes,
+ * and for all cells when the wind is updated (which sets matom_prbs_t_e to -1).
+ *
+ **********************************************************/
+
+int
+fill_matom_prbs (xplasma, uplvl)
+     PlasmaPtr xplasma;
+     int uplvl;
+{
+  double jprbs[2 * (NBBJUMPS + NBFJUMPS)];
+  double eprbs[NBBJUMPS + NBFJUMPS];
+  double pjnorm, penorm;
+  int m, nemiss;
+  MacroPtr mplasma;
+
+  mplasma = &macromain[xplasma->nplasma];
+
+  m = matom_prbs (xplasma, uplvl, jprbs, eprbs, &pjnorm, &penorm);
+  nemiss = config[uplvl].n_bbd_jump + config[uplvl].n_bfd_jump;
+
+  /* Now convert the individual probabilities to alias tables.  A table for which the total
+     is zero is never sampled, since matom only jumps if pjnorm > 0 and only emits if penorm > 0 */
+
+  alias_setup (m, jprbs, &mplasma->matom_jump_prob[config[uplvl].jump_indx_first], &mplasma->matom_jump_alias[config[uplvl].jump_indx_first]);
+  alias_setup (nemiss, eprbs, &mplasma->matom_emiss_prob[config[uplvl].emiss_indx_first],
+               &mplasma->matom_emiss_alias[config[uplvl].emiss_indx_first]);
+
+  mplasma->matom_pjnorm[uplvl] = pjnorm;
+  mplasma->matom_penorm[uplvl] = penorm;
+  mplasma->matom_prbs_known[uplvl] = TRUE;
+
+  return (0);
+}
+
+
+
+
+
 /************************************
 **  
 * @brief the b12 Einstein coefficient.
@@ -539,6 +637,9 @@ matom (p, nres, escape)
 
 struct lines *b12_line_ptr;
 double b12_a;
+#ifdef _OPENMP
+#pragma omp threadprivate(b12_line_ptr, b12_a)
+#endif
 
 double
 b12 (line_ptr)
@@ -564,6 +665,9 @@ b12 (line_ptr)
 struct topbase_phot *cont_ext_ptr;      //continuum pointer passed externally
 double temp_ext;                //temperature passed externally
 int temp_choice;                //choice of type of calcualation for alpha_sp
+#ifdef _OPENMP
+#pragma omp threadprivate(cont_ext_ptr, temp_ext, temp_choice)
+#endif
 
 /*****************************************************************************/
 
@@ -655,7 +759,7 @@ alpha_sp_integrand (freq)
   if (freq < fthresh)
     return (0.0);               // No recombination at frequencies lower than the threshold freq occur
 
-  x = sigma_phot (cont_ext_ptr, freq);  //this is the cross-section
+  x = sigma_phot (NULL, cont_ext_ptr, freq);  //this is the cross-section
   integrand = x * freq * freq * exp (H_OVER_K * (fthresh - freq) / tt);
 
 
@@ -669,6 +773,377 @@ alpha_sp_integrand (freq)
 
 
 
+/**********************************************************/
+/** 
+ * @brief calculates the rates at which k-packets are destroyed in a cell
+ *
+ * @param [in]     PlasmaPtr xplasma   the plasma cell of interest
+ * @return 0
+ *
+ * The cooling rates of all of the processes by which a k-packet can be
+ * destroyed (bound-free, collisional ionization and excitation, free-free 
+ * and adiabatic cooling) are calculated, and kpkt_rates_known is set.  
+ * The processes whose rates are at least KPKT_CHANNEL_MIN of the total
+ * are stored as the k-packet destruction channels of the cell, together
+ * with an alias table to choose between them and the totals of each kind.
+ *
+ * ###Notes###
+ * This was originally part of kpkt, which calls it whenever the rates
+ * for the cell are not known, that is once each time the wind is updated.
+ * When the photons are transported on several threads, trans_phot calls it 
+ * for all of the cells beforehand, since the rates are shared by all threads.
+ *
+ * Most of the lines have negligible collisional cooling rates in any
+ * one cell, so storing only the channels that matter saves both memory
+ * and the time to choose one.
+ *
+***********************************************************/
+
+int
+fill_kpkt_rates (xplasma)
+     PlasmaPtr xplasma;
+{
+  int i;
+  int ulvl;
+  double cooling_adiabatic;
+  struct topbase_phot *cont_ptr;
+  struct lines *line_ptr;
+  double cooling_normalisation;
+  double electron_temperature;
+  double cooling_bbtot, cooling_bftot, cooling_bf_coltot;
+  double lower_density, upper_density;
+  double cooling_ff;
+  double coll_rate, rad_rate;
+  double *cooling_bf, *cooling_bf_col, *cooling_bb;
+  double rate_min;
+  int nchan;
+  WindPtr one;
+  MacroPtr mplasma;
+
+  one = &wmain[xplasma->nwind];
+  mplasma = &macromain[xplasma->nplasma];
+  electron_temperature = xplasma->t_e;
+
+  if (kpkt_work_size < 2 * nphot_total + nlines)
+  {
+    free (kpkt_work);
+    kpkt_work_size = 2 * nphot_total + nlines;
+    if ((kpkt_work = calloc (sizeof (double), kpkt_work_size)) == NULL)
+    {
+      Error ("fill_kpkt_rates: Could not allocate memory for the cooling rates\n");
+      exit (0);
+    }
+  }
+
+  cooling_bf = kpkt_work;
+  cooling_bf_col = kpkt_work + nphot_total;
+  cooling_bb = kpkt_work + 2 * nphot_total;
+
+  cooling_normalisation = 0.0;
+  cooling_bftot = 0.0;
+  cooling_bbtot = 0.0;
+  cooling_ff = 0.0;
+  cooling_bf_coltot = 0.0;
+
+  /* JM 1503 -- we used to loop over ntop_phot here, 
+     but we should really loop over the tabulated Verner Xsections too
+     see #86, #141 */
+  for (i = 0; i < nphot_total; i++)
+  {
+    cont_ptr = &phot_top[i];
+    ulvl = cont_ptr->uplev;
+
+    if (cont_ptr->macro_info == 1 && geo.macro_simple == 0)
+    {
+      upper_density = den_config (xplasma, ulvl);
+      /* SS July 04 - for macro atoms the recombination coefficients are stored so use the
+         stored values rather than recompue them. */
+      cooling_bf[i] =
+        upper_density * H * cont_ptr->freq[0] * (mplasma->recomb_sp_e[config[ulvl].bfd_indx_first + cont_ptr->down_index]);
+      // _sp_e is defined as the difference 
+    }
+    else
+    {
+      upper_density = xplasma->density[cont_ptr->nion + 1];
+
+      cooling_bf[i] = upper_density * H * cont_ptr->freq[0] * (xplasma->recomb_simple[i]);
+    }
+
+
+    /* Note that the electron density is not included here -- all cooling rates scale
+       with the electron density so I've factored it out. */
+    if (cooling_bf[i] < 0)
+    {
+      Error ("kpkt: bf cooling rate negative. Density was %g\n", upper_density);
+      Error ("alpha_sp(cont_ptr, xplasma,2) %g \n", alpha_sp (cont_ptr, xplasma, 2));
+      Error ("i, ulvl, nphot_total, nion %d %d %d %d\n", i, ulvl, nphot_total, cont_ptr->nion);
+      Error ("nlev, z, istate %d %d %d \n", cont_ptr->nlev, cont_ptr->z, cont_ptr->istate);
+      Error ("freq[0] %g\n", cont_ptr->freq[0]);
+      cooling_bf[i] = 0.0;
+    }
+    else
+    {
+      cooling_bftot += cooling_bf[i];
+    }
+
+    cooling_normalisation += cooling_bf[i];
+
+    if (cont_ptr->macro_info == 1 && geo.macro_simple == 0)
+    {
+      /* Include collisional ionization as a cooling term in macro atoms. Don't include
+         for simple ions for now.  SS */
+
+      lower_density = den_config (xplasma, cont_ptr->nlev);
+      cooling_bf_col[i] = lower_density * H * cont_ptr->freq[0] * q_ioniz (cont_ptr, electron_temperature);
+
+      cooling_bf_coltot += cooling_bf_col[i];
+
+      cooling_normalisation += cooling_bf_col[i];
+
+    }
+    else
+    {
+      cooling_bf_col[i] = 0.0;
+    }
+
+
+
+  }
+
+  /* end of loop over nphot_total */
+
+  for (i = 0; i < nlines; i++)
+  {
+    line_ptr = &line[i];
+    if (line_ptr->macro_info == 1 && geo.macro_simple == 0)
+    {                         //It's a macro atom line and so the density of the upper level is stored
+      cooling_bb[i] =
+        den_config (xplasma, line_ptr->nconfigl) * q12 (line_ptr, electron_temperature) * line_ptr->freq * H;
+
+      /* Note that the electron density is not included here -- all cooling rates scale
+         with the electron density so I've factored it out. */
+    }
+    else
+    {                         //It's a simple line. Get the upper level density using two_level_atom
+
+      two_level_atom (line_ptr, xplasma, &lower_density, &upper_density);
+
+      /* the collisional rate is multiplied by ne later */
+      coll_rate = q21 (line_ptr, electron_temperature) * (1. - exp (-H_OVER_K * line_ptr->freq / electron_temperature));
+
+      cooling_bb[i] =
+        (lower_density * line_ptr->gu / line_ptr->gl -
+         upper_density) * coll_rate / (exp (H_OVER_K * line_ptr->freq / electron_temperature) - 1.) * line_ptr->freq * H;
+
+      rad_rate = a21 (line_ptr) * p_escape (line_ptr, xplasma);
+
+      /* Now multiply by the scattering probability - i.e. we are only going to consider bb cooling when
+         the photon actually escapes - we don't to waste time by exciting a two-level macro atom only so that
+         it makes another k-packet for us! (SS May 04) */
+
+
+      cooling_bb[i] *= rad_rate / (rad_rate + (coll_rate * xplasma->ne));
+    }
+
+    if (cooling_bb[i] < 0)
+    {
+      cooling_bb[i] = 0.0;
+    }
+    else
+    {
+      cooling_bbtot += cooling_bb[i];
+    }
+    cooling_normalisation += cooling_bb[i];
+  }
+
+  /* end of loop over nlines  */
+
+
+  /* 57+ -- This might be modified later since we "know" that xplasma cannot be for a grid with zero
+     volume.  Recall however that vol is part of the windPtr */
+  if (one->vol > 0)
+  {
+    cooling_ff = mplasma->cooling_ff = total_free (one, xplasma->t_e, 0.0, VERY_BIG) / xplasma->vol / xplasma->ne;    // JM 1411 - changed to use filled volume
+  }
+  else
+  {
+    /* SS June 04 - This should never happen, but sometimes it does. I think it is because of 
+       photons leaking from one cell to another due to the push-through-distance. It is sufficiently
+       rare (~1 photon in a complete run of the code) that I'm not worrying about it for now but it does
+       indicate a real problem somewhere. */
+
+    /* SS Nov 09: actually I've not seen this problem for a long
+       time. Don't recall that we ever actually fixed it,
+       however. Perhaps the improved volume calculations
+       removed it? We delete this whole "else" if we're sure
+       volumes are never zero. */
+
+    cooling_ff = mplasma->cooling_ff = 0.0;
+    Error ("kpkt: A scattering event in cell %d with vol = 0???\n", one->nwind);
+    //Diagnostic      return(-1);  //57g -- Cannot diagnose with an exit
+    exit (0);
+  }
+
+
+  if (cooling_ff < 0)
+  {
+    Error ("kpkt: ff cooling rate negative. Abort.");
+    exit (0);
+  }
+  else
+  {
+    cooling_normalisation += cooling_ff;
+  }
+
+
+  /* JM -- 1310 -- we now want to add adiabatic cooling as another way of destroying kpkts
+     this should have already been calculated and stored in the plasma structure. Note that 
+     adiabatic cooling does not depend on type of macro atom excited */
+
+  /* note the units here- we divide the total luminosity of the cell by volume and ne to give cooling rate */
+
+  cooling_adiabatic = xplasma->cool_adiabatic / xplasma->vol / xplasma->ne;   // JM 1411 - changed to use filled volume
+
+  if (geo.adiabatic == 0 && cooling_adiabatic > 0.0)
+  {
+    Error ("Adiabatic cooling turned off, but non zero in cell %d", xplasma->nplasma);
+  }
+
+
+  /* JM 1302 -- Negative adiabatic coooling- this used to happen due to issue #70, where we incorrectly calculated dvdy, 
+     but this is now resolved. Now it should only happen for cellspartly in wind, because we don't treat these very well.
+     Now, if cooling_adiabatic < 0 then set it to zero to avoid runs exiting for part in wind cells. */
+  if (cooling_adiabatic < 0)
+  {
+    Error ("kpkt: Adiabatic cooling negative! Major problem if inwind (%d) == 0\n", one->inwind);
+    Log ("kpkt: Setting adiabatic kpkt destruction probability to zero for this matom.\n");
+    cooling_adiabatic = 0.0;
+  }
+
+
+  cooling_normalisation += cooling_adiabatic;
+
+
+  /* Now store the channels which are not negligible, in the order bf, bb, ff, adiabatic
+     and collisional ionization, and recalculate the totals from the channels which are kept */
+
+  rate_min = KPKT_CHANNEL_MIN * cooling_normalisation;
+
+  nchan = 0;
+  for (i = 0; i < nphot_total; i++)
+  {
+    if (cooling_bf[i] > 0.0 && cooling_bf[i] >= rate_min)
+      nchan++;
+    if (cooling_bf_col[i] > 0.0 && cooling_bf_col[i] >= rate_min)
+      nchan++;
+  }
+  for (i = 0; i < nlines; i++)
+  {
+    if (cooling_bb[i] > 0.0 && cooling_bb[i] >= rate_min)
+      nchan++;
+  }
+  nchan += 2;
+
+  if (nchan > mplasma->kpkt_nchan_alloc || nchan < mplasma->kpkt_nchan_alloc / 2)
+  {
+    free (mplasma->kpkt_type);
+    free (mplasma->kpkt_index);
+    free (mplasma->kpkt_rate);
+    free (mplasma->kpkt_prob);
+    free (mplasma->kpkt_alias);
+
+    mplasma->kpkt_type = calloc (sizeof (int), nchan);
+    mplasma->kpkt_index = calloc (sizeof (int), nchan);
+    mplasma->kpkt_rate = calloc (sizeof (double), nchan);
+    mplasma->kpkt_prob = calloc (sizeof (double), nchan);
+    mplasma->kpkt_alias = calloc (sizeof (int), nchan);
+    if (mplasma->kpkt_type == NULL || mplasma->kpkt_index == NULL || mplasma->kpkt_rate == NULL || mplasma->kpkt_prob == NULL
+        || mplasma->kpkt_alias == NULL)
+    {
+      Error ("fill_kpkt_rates: Could not allocate memory for %d k-packet channels in cell %d\n", nchan, xplasma->nplasma);
+      exit (0);
+    }
+    mplasma->kpkt_nchan_alloc = nchan;
+  }
+
+  cooling_bftot = cooling_bbtot = cooling_bf_coltot = cooling_normalisation = 0.0;
+  nchan = 0;
+
+  for (i = 0; i < nphot_total; i++)
+  {
+    if (cooling_bf[i] > 0.0 && cooling_bf[i] >= rate_min)
+    {
+      mplasma->kpkt_type[nchan] = KPKT_BF;
+      mplasma->kpkt_index[nchan] = i;
+      mplasma->kpkt_rate[nchan++] = cooling_bf[i];
+      cooling_bftot += cooling_bf[i];
+    }
+  }
+
+  for (i = 0; i < nlines; i++)
+  {
+    if (cooling_bb[i] > 0.0 && cooling_bb[i] >= rate_min)
+    {
+      mplasma->kpkt_type[nchan] = KPKT_BB;
+      mplasma->kpkt_index[nchan] = i;
+      mplasma->kpkt_rate[nchan++] = cooling_bb[i];
+      cooling_bbtot += cooling_bb[i];
+    }
+  }
+
+  if (cooling_ff > 0.0 && cooling_ff >= rate_min)
+  {
+    mplasma->kpkt_type[nchan] = KPKT_FF;
+    mplasma->kpkt_index[nchan] = -1;
+    mplasma->kpkt_rate[nchan++] = cooling_ff;
+  }
+  else
+  {
+    cooling_ff = mplasma->cooling_ff = 0.0;
+  }
+
+  if (cooling_adiabatic > 0.0 && cooling_adiabatic >= rate_min)
+  {
+    mplasma->kpkt_type[nchan] = KPKT_ADIABATIC;
+    mplasma->kpkt_index[nchan] = -1;
+    mplasma->kpkt_rate[nchan++] = cooling_adiabatic;
+  }
+  else
+  {
+    cooling_adiabatic = 0.0;
+  }
+
+  for (i = 0; i < nphot_total; i++)
+  {
+    if (cooling_bf_col[i] > 0.0 && cooling_bf_col[i] >= rate_min)
+    {
+      mplasma->kpkt_type[nchan] = KPKT_BF_COL;
+      mplasma->kpkt_index[nchan] = i;
+      mplasma->kpkt_rate[nchan++] = cooling_bf_col[i];
+      cooling_bf_coltot += cooling_bf_col[i];
+    }
+  }
+
+  mplasma->kpkt_nchan = nchan;
+  cooling_normalisation = cooling_bftot + cooling_bbtot + cooling_ff + cooling_adiabatic + cooling_bf_coltot;
+
+  if (alias_setup (nchan, mplasma->kpkt_rate, mplasma->kpkt_prob, mplasma->kpkt_alias))
+  {
+    mplasma->kpkt_nchan = 0;
+  }
+
+  mplasma->cooling_bbtot = cooling_bbtot;
+  mplasma->cooling_bftot = cooling_bftot;
+  mplasma->cooling_bf_coltot = cooling_bf_coltot;
+  mplasma->cooling_adiabatic = cooling_adiabatic;
+  mplasma->cooling_normalisation = cooling_normalisation;
+  mplasma->kpkt_rates_known = 1;
+
+  return (0);
+}
+
+
+
 /**********************************************************/
 /** 
  * @brief deals with the elimination of k-packets.
@@ -701,7 +1176,6 @@ alpha_sp_integrand (freq)
  *			entire w array
  *	131030	JM 		-- Added adiabatic cooling as possible kpkt destruction choice
 ************************************************************/
-#define ALPHA_FF 100.           // maximum h nu / kT to create the free free CDF
 
 int
 kpkt (p, nres, escape)
@@ -710,25 +1184,12 @@ kpkt (p, nres, escape)
      int *escape;
 {
 
-  int i;
-  int ulvl;
-  double cooling_bf[nphot_total];
-  double cooling_bf_col[nphot_total];   //collisional cooling in bf transitions
-  double cooling_bb[NLINES];
-  double cooling_adiabatic;
-  struct topbase_phot *cont_ptr;
-  struct lines *line_ptr;
-  double cooling_normalisation;
-  double destruction_choice;
-  double electron_temperature;
-  double cooling_bbtot, cooling_bftot, cooling_bf_coltot;
-  double lower_density, upper_density;
-  double cooling_ff, upweight_factor;
+  int i, n;
+  double upweight_factor;
   WindPtr one;
   PlasmaPtr xplasma;
   MacroPtr mplasma;
 
-  double coll_rate, rad_rate;
   double freqmin, freqmax;
 
 
@@ -749,8 +1210,6 @@ kpkt (p, nres, escape)
   check_plasma (xplasma, "kpkt");
   mplasma = &macromain[xplasma->nplasma];
 
-  electron_temperature = xplasma->t_e;
-
   /* JM 1511 -- Fix for issue 187. We need band limits for free free packet
      generation (see call to one_ff below) */
   if (geo.ioniz_or_extract)
@@ -774,374 +1233,137 @@ kpkt (p, nres, escape)
 
   if (mplasma->kpkt_rates_known != 1)
   {
-    cooling_normalisation = 0.0;
-    cooling_bftot = 0.0;
-    cooling_bbtot = 0.0;
-    cooling_ff = 0.0;
-    cooling_bf_coltot = 0.0;
-
-    /* JM 1503 -- we used to loop over ntop_phot here, 
-       but we should really loop over the tabulated Verner Xsections too
-       see #86, #141 */
-    for (i = 0; i < nphot_total; i++)
-    {
-      cont_ptr = &phot_top[i];
-      ulvl = cont_ptr->uplev;
+    fill_kpkt_rates (xplasma);
+  }
 
-      if (cont_ptr->macro_info == 1 && geo.macro_simple == 0)
-      {
-        upper_density = den_config (xplasma, ulvl);
-        /* SS July 04 - for macro atoms the recombination coefficients are stored so use the
-           stored values rather than recompue them. */
-        cooling_bf[i] = mplasma->cooling_bf[i] =
-          upper_density * H * cont_ptr->freq[0] * (mplasma->recomb_sp_e[config[ulvl].bfd_indx_first + cont_ptr->down_index]);
-        // _sp_e is defined as the difference 
-      }
-      else
-      {
-        upper_density = xplasma->density[cont_ptr->nion + 1];
 
-        cooling_bf[i] = mplasma->cooling_bf[i] = upper_density * H * cont_ptr->freq[0] * (xplasma->recomb_simple[i]);
-      }
 
 
-      /* Note that the electron density is not included here -- all cooling rates scale
-         with the electron density so I've factored it out. */
-      if (cooling_bf[i] < 0)
-      {
-        Error ("kpkt: bf cooling rate negative. Density was %g\n", upper_density);
-        Error ("alpha_sp(cont_ptr, xplasma,2) %g \n", alpha_sp (cont_ptr, xplasma, 2));
-        Error ("i, ulvl, nphot_total, nion %d %d %d %d\n", i, ulvl, nphot_total, cont_ptr->nion);
-        Error ("nlev, z, istate %d %d %d \n", cont_ptr->nlev, cont_ptr->z, cont_ptr->istate);
-        Error ("freq[0] %g\n", cont_ptr->freq[0]);
-        cooling_bf[i] = mplasma->cooling_bf[i] = 0.0;
-      }
-      else
-      {
-        cooling_bftot += cooling_bf[i];
-      }
 
-      cooling_normalisation += cooling_bf[i];
+  /* The cooling rates for the recombination and collisional processes are now known. 
+     Choose which process destroys the k-packet from the alias table of the channels. */
 
-      if (cont_ptr->macro_info == 1 && geo.macro_simple == 0)
-      {
-        /* Include collisional ionization as a cooling term in macro atoms. Don't include
-           for simple ions for now.  SS */
+  if (mplasma->kpkt_nchan > 0)
+  {
+    n = alias_sample (mplasma->kpkt_nchan, mplasma->kpkt_prob, mplasma->kpkt_alias);
+    i = mplasma->kpkt_index[n];
 
-        lower_density = den_config (xplasma, cont_ptr->nlev);
-        cooling_bf_col[i] = mplasma->cooling_bf_col[i] = lower_density * H * cont_ptr->freq[0] * q_ioniz (cont_ptr, electron_temperature);
+    if (mplasma->kpkt_type[n] == KPKT_BF)
+    {                           //destruction by bf
 
-        cooling_bf_coltot += cooling_bf_col[i];
+      /* JM 1503 -- we used to consider only ntop_phot here, 
+         but we should really include the tabulated Verner Xsections too
+         see #86, #141 */
 
-        cooling_normalisation += cooling_bf_col[i];
+      /* Having got here we know that desturction of the k-packet was via the process labelled
+         by i. Now set nres for the destruction process. */
 
-      }
+      *nres = i + NLINES + 1;
+      *escape = 1;              //record that an r-packet is made - no need to excite a macro atom again
 
 
+      /* Now (as in matom) choose a frequency for the new packet. */
 
-    }
+      //p->freq = phot_top[i].freq[0] - (log (1. - random_number(0.0,1.0)) * xplasma->t_e / H_OVER_K);
+      p->freq = matom_select_bf_freq (one, i);
 
-    /* end of loop over nphot_total */
+      /* if the cross-section corresponds to a simple ion (macro_info == 0)
+         or if we are treating all ions as simple, then adopt the total emissivity
+         approach to choosing photon weights - this means we 
+         multipy down the photon weight by a factor nu/(nu-nu_0)
+         and we force a kpkt to be created */
+#if BF_SIMPLE_EMISSIVITY_APPROACH
+      if (phot_top[i].macro_info == 0 || geo.macro_simple == 1)
+      {
+        upweight_factor = xplasma->recomb_simple_upweight[i];
+        p->w *= upweight_factor;
 
-    for (i = 0; i < nlines; i++)
-    {
-      line_ptr = &line[i];
-      if (line_ptr->macro_info == 1 && geo.macro_simple == 0)
-      {                         //It's a macro atom line and so the density of the upper level is stored
-        cooling_bb[i] = mplasma->cooling_bb[i] =
-          den_config (xplasma, line_ptr->nconfigl) * q12 (line_ptr, electron_temperature) * line_ptr->freq * H;
-
-        /* Note that the electron density is not included here -- all cooling rates scale
-           with the electron density so I've factored it out. */
+        /* record the amount of energy being extracted from the simple ion ionization pool */
+        xplasma->bf_simple_ionpool_out += p->w - (p->w / upweight_factor);
       }
-      else
-      {                         //It's a simple line. Get the upper level density using two_level_atom
-
-        two_level_atom (line_ptr, xplasma, &lower_density, &upper_density);
-
-        /* the collisional rate is multiplied by ne later */
-        coll_rate = q21 (line_ptr, electron_temperature) * (1. - exp (-H_OVER_K * line_ptr->freq / electron_temperature));
-
-        cooling_bb[i] =
-          (lower_density * line_ptr->gu / line_ptr->gl -
-           upper_density) * coll_rate / (exp (H_OVER_K * line_ptr->freq / electron_temperature) - 1.) * line_ptr->freq * H;
+#endif
 
-        rad_rate = a21 (line_ptr) * p_escape (line_ptr, xplasma);
+      /* Co-moving frequency - changed to rest frequency by doppler */
+      /* Currently this assumed hydrogenic shape cross-section - Improve */
 
-        /* Now multiply by the scattering probability - i.e. we are only going to consider bb cooling when
-           the photon actually escapes - we don't to waste time by exciting a two-level macro atom only so that
-           it makes another k-packet for us! (SS May 04) */
+      /* k-packet is now eliminated. All done. */
+      return (0);
+    }
+    else if (mplasma->kpkt_type[n] == KPKT_BB)
+    {                           //this means that a collisional destruction has occurred - this results in 
+      //a macro atom being excited. Choose which macro atom and level to excite
+      *nres = line[i].where_in_list;    //label for bb process 
+      if (line[i].macro_info == 1 && geo.macro_simple == 0)     //line is for a macro atom
+      {
 
+        /* escape = 0 flag returned to tell macro_gov that
+           a macro atom should be excited, rather than making a call to matom here. */
 
-        cooling_bb[i] *= rad_rate / (rad_rate + (coll_rate * xplasma->ne));
-        mplasma->cooling_bb[i] = cooling_bb[i];
-      }
+        *escape = 0;
 
-      if (cooling_bb[i] < 0)
-      {
-        cooling_bb[i] = mplasma->cooling_bb[i] = 0.0;
       }
-      else
+      else                      //line is not for a macro atom - use simple method
       {
-        cooling_bbtot += cooling_bb[i];
-      }
-      cooling_normalisation += cooling_bb[i];
-    }
+        /* Since the cooling rate accounts for the scattering fraction we know that if we
+           get here we want a line emission, not just an excited macro atom. (SS May 04) */
+        *escape = 1;            //No need for re-exciting a macro atom.
+        p->freq = line[i].freq;
 
-    /* end of loop over nlines  */
 
-
-    /* 57+ -- This might be modified later since we "know" that xplasma cannot be for a grid with zero
-       volume.  Recall however that vol is part of the windPtr */
-    if (one->vol > 0)
-    {
-      cooling_ff = mplasma->cooling_ff = total_free (one, xplasma->t_e, 0.0, VERY_BIG) / xplasma->vol / xplasma->ne;    // JM 1411 - changed to use filled volume
-    }
-    else
-    {
-      /* SS June 04 - This should never happen, but sometimes it does. I think it is because of 
-         photons leaking from one cell to another due to the push-through-distance. It is sufficiently
-         rare (~1 photon in a complete run of the code) that I'm not worrying about it for now but it does
-         indicate a real problem somewhere. */
-
-      /* SS Nov 09: actually I've not seen this problem for a long
-         time. Don't recall that we ever actually fixed it,
-         however. Perhaps the improved volume calculations
-         removed it? We delete this whole "else" if we're sure
-         volumes are never zero. */
-
-      cooling_ff = mplasma->cooling_ff = 0.0;
-      Error ("kpkt: A scattering event in cell %d with vol = 0???\n", one->nwind);
-      //Diagnostic      return(-1);  //57g -- Cannot diagnose with an exit
-      exit (0);
-    }
-
-
-    if (cooling_ff < 0)
-    {
-      Error ("kpkt: ff cooling rate negative. Abort.");
-      exit (0);
-    }
-    else
-    {
-      cooling_normalisation += cooling_ff;
+      }
+      /* When it gets here the packet is back to an
+         r-packet and the emission mechanism is identified by nres
+         i.e. that's it finished. (SS, Apr 04). */
+      return (0);
     }
+    else if (mplasma->kpkt_type[n] == KPKT_FF)
+    {                           //this is a ff destruction
 
+      /* The limits for ff emission are hard-wired: 40 microns ->
+         twice energy of He II edge. Shouldn't be a problem unless
+         we're in plasma with temperatures that gives significant ff
+         emission outside this range. */
 
-    /* JM -- 1310 -- we now want to add adiabatic cooling as another way of destroying kpkts
-       this should have already been calculated and stored in the plasma structure. Note that 
-       adiabatic cooling does not depend on type of macro atom excited */
+      *escape = 1;              //we are making an r-packet not exciting a macro atom
 
-    /* note the units here- we divide the total luminosity of the cell by volume and ne to give cooling rate */
+      *nres = -2;
 
-    cooling_adiabatic = xplasma->cool_adiabatic / xplasma->vol / xplasma->ne;   // JM 1411 - changed to use filled volume
+      /* used to do one_ff (one, 7.5e12, 2.626e16) here,
+         but now use the band boundaries, see #187. */
+      p->freq = one_ff (one, freqmin, freqmax); //get frequency of resulting energy packet
 
-    if (geo.adiabatic == 0 && cooling_adiabatic > 0.0)
-    {
-      Error ("Adiabatic cooling turned off, but non zero in cell %d", xplasma->nplasma);
+      return (0);
     }
 
 
-    /* JM 1302 -- Negative adiabatic coooling- this used to happen due to issue #70, where we incorrectly calculated dvdy, 
-       but this is now resolved. Now it should only happen for cellspartly in wind, because we don't treat these very well.
-       Now, if cooling_adiabatic < 0 then set it to zero to avoid runs exiting for part in wind cells. */
-    if (cooling_adiabatic < 0)
+    /* JM 1310 -- added check for destruction via adiabatic cooling */
+    else if (mplasma->kpkt_type[n] == KPKT_ADIABATIC)
     {
-      Error ("kpkt: Adiabatic cooling negative! Major problem if inwind (%d) == 0\n", one->inwind);
-      Log ("kpkt: Setting adiabatic kpkt destruction probability to zero for this matom.\n");
-      cooling_adiabatic = 0.0;
-    }
-
-
-    cooling_normalisation += cooling_adiabatic;
-
-
-
-    mplasma->cooling_bbtot = cooling_bbtot;
-    mplasma->cooling_bftot = cooling_bftot;
-    mplasma->cooling_bf_coltot = cooling_bf_coltot;
-    mplasma->cooling_adiabatic = cooling_adiabatic;
-    mplasma->cooling_normalisation = cooling_normalisation;
-    mplasma->kpkt_rates_known = 1;
-
-  }
-
-
-
-
-
-  /* The cooling rates for the recombination and collisional processes are now known. 
-     Choose which process destroys the k-packet with a random number. */
-
-//  destruction_choice = ((rand () + 0.5) / MAXRAND) * mplasma->cooling_normalisation; //DONE
-  destruction_choice = random_number (0.0, 1.0) * mplasma->cooling_normalisation;
-
-  if (destruction_choice < mplasma->cooling_bftot)
-  {                             //destruction by bf
-
-    /* JM 1503 -- we used to loop over ntop_phot here, 
-       but we should really loop over the tabulated Verner Xsections too
-       see #86, #141 */
-    for (i = 0; i < nphot_total; i++)
-    {
-      if (destruction_choice < mplasma->cooling_bf[i])
-      {
-        /* Having got here we know that desturction of the k-packet was via the process labelled
-           by i. Let's just check that i is a sensible number. */
-
-        if (i > nphot_total - 1)
-        {
-          Error ("kpkt (matom.c): trying to destroy k-packet in unknown process. Abort.\n");
-          exit (0);
-        }
-
-        /* If it gets here, all seems fine. Now set nres for the destruction process. */
-
-        *nres = i + NLINES + 1;
-        *escape = 1;            //record that an r-packet is made - no need to excite a macro atom again
-
-
-        /* Now (as in matom) choose a frequency for the new packet. */
-
-        //p->freq = phot_top[i].freq[0] - (log (1. - random_number(0.0,1.0)) * xplasma->t_e / H_OVER_K);
-        p->freq = matom_select_bf_freq (one, i);
-
-        /* if the cross-section corresponds to a simple ion (macro_info == 0)
-           or if we are treating all ions as simple, then adopt the total emissivity
-           approach to choosing photon weights - this means we 
-           multipy down the photon weight by a factor nu/(nu-nu_0)
-           and we force a kpkt to be created */
-#if BF_SIMPLE_EMISSIVITY_APPROACH
-        if (phot_top[i].macro_info == 0 || geo.macro_simple == 1)
-        {
-          upweight_factor = xplasma->recomb_simple_upweight[i];
-          p->w *= upweight_factor;
-
-          /* record the amount of energy being extracted from the simple ion ionization pool */
-          xplasma->bf_simple_ionpool_out += p->w - (p->w / upweight_factor);
-        }
-#endif
 
-        /* Co-moving frequency - changed to rest frequency by doppler */
-        /* Currently this assumed hydrogenic shape cross-section - Improve */
-
-        /* k-packet is now eliminated. All done. */
-        return (0);
-      }
-      else
-      {
-        destruction_choice = destruction_choice - mplasma->cooling_bf[i];
-      }
-    }
-  }
-  else if (destruction_choice < (mplasma->cooling_bftot + mplasma->cooling_bbtot))
-  {                             //this means that a collisional destruction has occurred - this results in 
-    //a macro atom being excited. Choose which macro atom and level to excite
-    destruction_choice = destruction_choice - mplasma->cooling_bftot;
-    for (i = 0; i < nlines; i++)
-    {
-      if (destruction_choice < mplasma->cooling_bb[i])
-      {                         //This is the bb collision which removes the k-packet
-        *nres = line[i].where_in_list;  //label for bb process 
-        if (line[i].macro_info == 1 && geo.macro_simple == 0)   //line is for a macro atom
-        {
-
-          /* escape = 0 flag returned to tell macro_gov that
-             a macro atom should be excited, rather than making a call to matom here. */
-
-          *escape = 0;
-
-        }
-        else                    //line is not for a macro atom - use simple method
-        {
-          /* Since the cooling rate accounts for the scattering fraction we know that if we
-             get here we want a line emission, not just an excited macro atom. (SS May 04) */
-          *escape = 1;          //No need for re-exciting a macro atom.
-          p->freq = line[i].freq;
-
-
-        }
-        /* When it gets here the packet is back to an
-           r-packet and the emission mechanism is identified by nres
-           i.e. that's it finished. (SS, Apr 04). */
-        return (0);
-      }
-      else
+      if (geo.adiabatic == 0)
       {
-        destruction_choice = destruction_choice - mplasma->cooling_bb[i];
+        Error ("Destroying kpkt by adiabatic cooling even though it is turned off.");
       }
-    }
-  }
-  else if (destruction_choice < (mplasma->cooling_bftot + mplasma->cooling_bbtot + mplasma->cooling_ff))
-  {                             //this is a ff destruction
-
-    /* The limits for ff emission are hard-wired: 40 microns ->
-       twice energy of He II edge. Shouldn't be a problem unless
-       we're in plasma with temperatures that gives significant ff
-       emission outside this range. */
-
-    *escape = 1;                //we are making an r-packet not exciting a macro atom
-
-    *nres = -2;
-
-    /* used to do one_ff (one, 7.5e12, 2.626e16) here,
-       but now use the band boundaries, see #187. */
-    p->freq = one_ff (one, freqmin, freqmax);   //get frequency of resulting energy packet
-
-    return (0);
-  }
+      *escape = 1;              // we want to escape but set photon weight to zero
+      *nres = -2;
+      //p->w = 0.0;             // JM131030 set photon weight to zero as energy is taken up in adiabatic expansion
 
+      p->istat = P_ADIABATIC;   // record that this photon went into a kpkt destruction from adiabatic cooling
 
-  /* JM 1310 -- added loop to check if destruction occurs via adiabatic cooling */
-  else if (destruction_choice < (mplasma->cooling_bftot + mplasma->cooling_bbtot + mplasma->cooling_ff + mplasma->cooling_adiabatic))
-  {
-
-    if (geo.adiabatic == 0)
-    {
-      Error ("Destroying kpkt by adiabatic cooling even though it is turned off.");
+      return (0);
     }
-    *escape = 1;                // we want to escape but set photon weight to zero
-    *nres = -2;
-    //p->w = 0.0;             // JM131030 set photon weight to zero as energy is taken up in adiabatic expansion
-
-    p->istat = P_ADIABATIC;     // record that this photon went into a kpkt destruction from adiabatic cooling
-
-    return (0);
-  }
 
 
-  else
-  {
-    /* We want destruction by collisional ionization in a macro atom. */
-    destruction_choice =
-      destruction_choice - mplasma->cooling_bftot - mplasma->cooling_bbtot - mplasma->cooling_ff - mplasma->cooling_adiabatic;
-
-    for (i = 0; i < nphot_total; i++)
+    else if (mplasma->kpkt_type[n] == KPKT_BF_COL)
     {
-      if (destruction_choice < mplasma->cooling_bf_col[i])
-      {
-        /* Having got here we know that destruction of the k-packet was via the process labelled
-           by i. Let's just check that i is a sensible number. */
-
-        if (i > nphot_total - 1)
-        {
-          Error ("kpkt (matom.c): trying to destroy k-packet in unknown process. Abort.\n");
-          exit (0);
-        }
-
-        /* Now set nres for the destruction process. */
+      /* We want destruction by collisional ionization in a macro atom. Now set nres for the destruction process. */
 
-        *nres = i + NLINES + 1;
-        *escape = 0;            //collisional ionization makes an excited macro atom
+      *nres = i + NLINES + 1;
+      *escape = 0;              //collisional ionization makes an excited macro atom
 
 
-        /* k-packet is now eliminated. All done. */
-        return (0);
-      }
-      else
-      {
-        destruction_choice = destruction_choice - mplasma->cooling_bf_col[i];
-      }
+      /* k-packet is now eliminated. All done. */
+      return (0);
     }
   }
 
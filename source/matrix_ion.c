@@ -26,6 +26,18 @@
 #include "my_linalg.h"
 
 
+/* The rate matrix is block diagonal, with one block for the ions of each element.  Within a block
+   each ion is only ionized to the next one, apart from Auger ionization which can take an ion
+   to several higher ones.  The structure of the blocks is the same for every cell, and is found
+   by ion_matrix_structure the first time it is needed */
+
+int ion_matrix_nions = 0;       /* The number of ions when the structure was found, or 0 if it has not been */
+int ion_block_offset[NELEMENTS];        /* The position of the block for each element in the storage for all the blocks */
+int ion_block_lower[NELEMENTS]; /* The number of ions below the diagonal of each block which are connected to an ion */
+int ion_block_size;             /* The total number of elements in all the blocks */
+int ion_block_elem[NIONS];      /* The element of each ion */
+
+
 /**********************************************************/
 /**
  * @brief      A matrix solver for the ionization state in a cell
@@ -43,14 +55,20 @@
  * We make an initial guess at the electron density
  * We attempt to solve the ionization rates matrix, and produce a new guess at the electron density
  * We then calculate new rates, re-solve and proceed until the electron density converges.
- * We solve the matrix equation A x = b for the vector x, where A is a square rate matrix linking
- * each state with each other state (often containing zeros if the ions arent linked) b is a vector
- * containing the total density of each element arranged in a certain way (see later) and
- * x is a vector containing the relative ion populations. We invert A to get x=bA^-1
+ * The rate matrix A links each ionization stage of an element with the others, and x, the
+ * vector of relative ion populations, satisfies A x = 0 together with the condition that
+ * the populations of each element sum to one.  Since ions of different elements are not
+ * linked, each element is solved separately by solve_ion_block.
  *
  * ### Notes ###
  * Uses a relative abundance scheme - reduces large number issues
  *
+ * The rate matrix is solved one element at a time, so the work grows with the sum over the
+ * elements of k * k * ml, where k is the number of ions of an element and ml the width of
+ * the band below the diagonal of its block, rather than with the cube of the total number
+ * of ions.  It is not linear in k, since the part of each block above the diagonal
+ * is treated as dense (see solve_ion_block).
+ *
  **********************************************************/
 
 int
@@ -60,18 +78,14 @@ matrix_ion_populations (xplasma, mode)
 
 {
   double elem_dens[NELEMENTS];  //The density of each element
-  int nn, mm, nrows;
-  double rate_matrix[nions][nions];     //The rate matrix that we are going to try and sol ve
+  int nn, mm;
+  double *rate_blocks;          //The blocks of the rate matrix, one for each element
   double newden[NIONS];         //A temporary array to hold our intermediate solutions
+  double populations[NIONS];    //The solution for the ion populations
   double nh, t_e;
   double xne, xxne, xxxne;      //Various stores for intermediate guesses at electron density
-  double b_temp[nions];         //The b matrix
-  double *b_data, *a_data;      //These arrays are allocated later and sent to the matrix solver
-  double *populations;          //This array is allocated later and is retrieved from the matrix solver
-  int ierr, niterate;           //counters for errors and the number of iterations we have tried to get a converged electron density
+  int ierr, ierr_block, niterate;       //counters for errors and the number of iterations we have tried to get a converged electron density
   double xnew;
-  int xion[nions];              // This array keeps track of what ion is in each line
-  int xelem[nions];             // This array keeps track of the element for each ion
   double pi_rates[nions];       //photoionization rate coefficients
   double rr_rates[nions];       //radiative recombination rate coefficients
   double inner_rates[n_inner_tot];      //This array contains the rates for each of the inner shells. Where they go to requires the electron yield array
@@ -113,7 +127,6 @@ matrix_ion_populations (xplasma, mode)
   for (mm = 0; mm < nions; mm++)
   {
     newden[mm] = xplasma->density[mm] / elem_dens[ion[mm].z];   // newden is our local fractional density array
-    xion[mm] = mm;              // xion is an array we use to track which ion is in which row of the matrix
     if (ion[mm].istate != 1)    // We can recombine since we are not in the first ionization stage
     {
       rr_rates[mm] = total_rrate (mm, xplasma->t_e);    // radiative recombination rates          
@@ -135,16 +148,6 @@ matrix_ion_populations (xplasma, mode)
         exit (0);
       }
     }
-
-    for (nn = 0; nn < nelements; nn++)
-    {
-      if (ion[mm].z == ele[nn].z)
-      {
-        xelem[mm] = nn;         /* xelem logs which element each row in the arrays refers to. This is important because we need
-                                   to know what the total density will be for a group of rows all representing the same
-                                   element. */
-      }
-    }
   }
 
 
@@ -204,80 +207,49 @@ matrix_ion_populations (xplasma, mode)
   /* We are now going to iterate on the electron density - MAXITERATIONS is set in python.h and is currently (78) set to 200.
      We would normally expect to converge much fater than this */
 
+  ion_matrix_structure ();
+
+  if ((rate_blocks = (double *) calloc (sizeof (double), ion_block_size)) == NULL)
+  {
+    Error ("matrix_ion_populations: Could not allocate memory for the rate matrix\n");
+    exit (0);
+  }
+
   niterate = 0;
   while (niterate < MAXITERATIONS)
   {
 
 
-    populate_ion_rate_matrix (rate_matrix, pi_rates, inner_rates, rr_rates, b_temp, xne);
-
+    populate_ion_rate_matrix (rate_blocks, pi_rates, inner_rates, rr_rates, xne);
 
-    /* The array is now fully populated, and we can begin the process of solving it */
 
-    nrows = nions;              /* This is a placeholder, we may end up removing rows and columns that have no rates (or very
-                                   low rates) connecting them to other rows. This may improve stability but will need to be
-                                   done carefully */
+    /* The array is now fully populated, and we can solve for the populations of each element in turn. The
+       current populations are passed so that the solution can be scaled to the ion which is most
+       abundant. */
 
-    /* The solver routine was taken largely wholesale from the matom routine. I have left in most of the original comments, and
-       added a few of my own for clarification */
-
-
-
-    /* The block that follows (down to next line of ***s) is to do the matrix inversion. It uses LU decomposition - the code
-       for doing this is taken from the GSL manual with very few modifications. */
-    /* here we solve the matrix equation M x = b, where x is our vector containing level populations as a fraction w.r.t the
-       whole element */
-    /* The actual LU decomposition- the process of obtaining a solution - is done by the routine solve_matrix() */
-
-
-    /* This next line produces an array of the correct size to hold the rate matrix */
-
-    a_data = (double *) calloc (sizeof (double), nrows * nrows);
-    /* We now copy our rate matrix into the prepared matrix */
-    for (mm = 0; mm < nrows; mm++)
+    ierr = 0;
+    for (nn = 0; nn < nelements; nn++)
     {
-      for (nn = 0; nn < nrows; nn++)
+      if (ele[nn].nions > 0)
       {
-//                                              printf ("%30.25e ",rate_matrix[mm][nn]);
-        a_data[mm * nrows + nn] = rate_matrix[mm][nn];
+        ierr_block = solve_ion_block (nn, &rate_blocks[ion_block_offset[nn]], &newden[ele[nn].firstion], &populations[ele[nn].firstion]);
+        if (ierr_block > ierr)
+        {
+          ierr = ierr_block;
+        }
       }
     }
 
-    /* Replaced inline array allocaation with calloc, which will work with older version of c compilers calloc also sets the
-       elements to zero, which is required */
-
-    b_data = (double *) calloc (sizeof (double), nrows);
-    populations = (double *) calloc (sizeof (double), nrows);
-
-    /* This b_data column matrix is the total number density for each element, placed into the row which relates to the neutral
-       ion. This matches the row in the rate matrix which is just 1 1 1 1 for all stages. NB, we could have chosen any line for
-       this. */
-
-    for (nn = 0; nn < nrows; nn++)
-    {
-      b_data[nn] = b_temp[nn];
-    }
-
-    ierr = solve_matrix (a_data, b_data, nrows, populations, xplasma->nplasma);
-
     if (ierr != 0)
-      Error ("matrix_ion_populations: bad return from solve_matrix\n", ierr);
+      Error ("matrix_ion_populations: bad return from solve_ion_block\n", ierr);
     if (ierr == 2)
       Error ("matrix_ion_populations: some matrix rows failing relative error check\n");
-    else if (ierr == 3)
-      Error ("matrix_ion_populations: some matrix rows failing absolute error check\n");
     else if (ierr == 4)
       Error ("matrix_ion_populations: Unsolvable matrix! Determinant is zero. Defaulting to no change.\n");
 
-
-
-    /* free memory */
-    free (a_data);
-    free (b_data);
-
     if (ierr == 4)
     {
-      free (populations);
+      free (rate_blocks);
       return (-1);
     }
 
@@ -289,33 +261,15 @@ matrix_ion_populations (xplasma, mode)
 
     /* We now have the populations of all the ions stored in the matrix populations. We copy this data into the newden array
        which will temperarily store all the populations. We wont copy this to the plasma structure until we are sure thatwe
-       have made things better. We just loop over all ions, and copy. The complexity in the loop is to future proof us against
-       the possibility that there are some ions that are not included in the matrix scheme becuse there is no route into or
-       out of it. */
+       have made things better. */
 
     for (nn = 0; nn < nions; nn++)
     {
-      newden[nn] = 0.0;         // initialise the array element
-
-      /* if the ion is being treated by macro_pops then use the populations just computed */
-      if ((ion[nn].macro_info == 1) && (geo.macro_simple == 0) && (geo.macro_ioniz_mode == 1))
-      {
-        newden[nn] = xplasma->density[nn] / elem_dens[ion[nn].z];
-      }
-
-      for (mm = 0; mm < nrows; mm++)    // inner loop over the elements of the population array
-      {
-        if (xion[mm] == nn)     // if this element contains the population of the ion is question
-        {
-          newden[nn] = populations[mm]; // get the population
-        }
-      }
-
+      newden[nn] = populations[nn];
 
       if (newden[nn] < DENSITY_MIN)     // this wil also capture the case where population doesnt have a value for this ion
         newden[nn] = DENSITY_MIN;
     }
-    free (populations);
 
 
 /* We need to get the 'true' new electron density so we need to do a little loop here to compute it */
@@ -359,10 +313,13 @@ matrix_ion_populations (xplasma, mode)
 
       Error ("matrix_ion_populations: xxne %e theta %e\n", xxne);
 
+      free (rate_blocks);
       return (-1);              /* If we get to MAXITERATIONS, we return without copying the new populations into plasma */
     }
   }                             /* This is the end of the iteration loop */
 
+  free (rate_blocks);
+
 
   xplasma->ne = xnew;
   for (nn = 0; nn < nions; nn++)
@@ -394,217 +351,450 @@ matrix_ion_populations (xplasma, mode)
 
 /**********************************************************/
 /**
- * @brief      populates a rate_matrix
+ * @brief      finds the structure of the blocks of the ionization rate matrix
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * The ions of each element are one block of the rate matrix.  The
+ * position of each block in the storage for all of them, and the number
+ * of ions below the diagonal to which an ion can be ionized, which is
+ * one unless Auger ionization is included, are found and stored in
+ * external variables.
+ *
+ * ### Notes ###
+ * The structure depends only on the atomic data, so this only does
+ * any work the first time it is called.
+ *
+ **********************************************************/
+
+int
+ion_matrix_structure ()
+{
+  int nelem, nn, mm, n_elec, ion_out, nlower;
+
+  if (ion_matrix_nions == nions)
+    return (0);
+
+  ion_block_size = 0;
+  for (nelem = 0; nelem < nelements; nelem++)
+  {
+    ion_block_offset[nelem] = ion_block_size;
+    ion_block_size += ele[nelem].nions * ele[nelem].nions;
+    ion_block_lower[nelem] = 1;
+
+    for (nn = ele[nelem].firstion; nn < ele[nelem].firstion + ele[nelem].nions; nn++)
+    {
+      ion_block_elem[nn] = nelem;
+    }
+  }
+
+  for (mm = 0; mm < n_inner_tot; mm++)
+  {
+    if (inner_cross[mm].n_elec_yield != -1)
+    {
+      ion_out = inner_cross[mm].nion;
+      nelem = ion_block_elem[ion_out];
+      n_elec = ion[ion_out].z - ion[ion_out].istate + 1;
+      if (n_elec > 11)
+        n_elec = 11;
+
+      nlower = n_elec - 1;
+      if (nlower > ele[nelem].firstion + ele[nelem].nions - 1 - ion_out)
+        nlower = ele[nelem].firstion + ele[nelem].nions - 1 - ion_out;
+      if (nlower > ion_block_lower[nelem])
+        ion_block_lower[nelem] = nlower;
+    }
+  }
+
+  ion_matrix_nions = nions;
+
+  return (0);
+}
+
+
+/**********************************************************/
+/**
+ * @brief      adds one process to a block of the ionization rate matrix
+ *
+ * @param [in, out] double  a[] - the block of the rate matrix for an element
+ * @param [in] int  k - the number of ions of the element
+ * @param [in] int  j - the ion which is depopulated
+ * @param [in] int  t - the ion which is populated, or -1 if none is
+ * @param [in] double  rate - the rate of the process
+ * @param [in] int  lose - TRUE if ion j is depopulated, FALSE if the process only populates ion t
+ * @return - zero
+ *
+ * @details
+ * Row i of the block, for i > 0, is the balance of the rates at which the ions
+ * below i are moved to i or above, and vice versa, so the process adds the rate to
+ * column j of the rows between j and t.  A process which takes ions out of
+ * the element subtracts it from rows 1 to j, and one which populates t without
+ * depopulating j adds it to rows 1 to t.
+ *
+ **********************************************************/
+
+int
+ion_rate_add (a, k, j, t, rate, lose)
+     double a[];
+     int k, j, t;
+     double rate;
+     int lose;
+{
+  int i;
+
+  if (lose && t >= 0)
+  {
+    for (i = j + 1; i <= t; i++)
+      a[i * k + j] += rate;
+    for (i = t + 1; i <= j; i++)
+      a[i * k + j] -= rate;
+  }
+  else if (lose)
+  {
+    for (i = 1; i <= j; i++)
+      a[i * k + j] -= rate;
+  }
+  else if (t >= 0)
+  {
+    for (i = 1; i <= t; i++)
+      a[i * k + j] += rate;
+  }
+
+  return (0);
+}
+
+
+/**********************************************************/
+/**
+ * @brief      populates the blocks of the ionization rate matrix
  *
- * @param [out] double  rate_matrix[nions][nions] - the rate matrix that will be filled by this array
+ * @param [out] double  rate_blocks[] - the blocks of the rate matrix, one for each element, which are filled by this routine
  * @param [in] double  pi_rates[nions] - vector of photionization rates
  * @param [in] double  inner_rates[n_inner_tot] - vector of inner shell photoionization rates
  * @param [in] double  rr_rates[nions] - vector of radiative recobination rates
- * @param [out] double  b_temp[nions] - the vector of total elemental densities that we also fill here
  * @param [in] double  xne - current electron density
  * @return - zero if successful
  *
  * @details
- * populate_ion_rate_matrix populates a rate_matrix of shape nions x nions
+ * populate_ion_rate_matrix populates the blocks of the rate matrix
  * with the pi_rates and rr_rates supplied at the density xne in question.
- * It also populates the b matrix - that is the total elemental abundance -
- * we use relative abundances so this is just a set of 1s and 0s.
+ * The block for element nelem starts at ion_block_offset[nelem], and
+ * element i * k + j of it, where k is the number of ions of the element,
+ * is the coefficient of the population of ion j in equation i.
+ *
+ * Equation i, for i > 0, is the sum of the rate equations for ions i and
+ * above, that is the balance between the rates at which ions cross from
+ * stage i - 1 to stage i and back (see ion_rate_add).  Since each equation
+ * is built from the rates of the processes themselves, rather than as the
+ * small difference of the total rates into and out of an ion, it can be
+ * solved accurately even when the populations span many decades.
  *
  * ### Notes ###
- * This routine includes the process of replacing the first row of the matrix with
- *     1s in order to make the problem soluble.
+ * As in the original form of this routine, the first equation of each element
+ * is replaced by the condition that the populations sum to one, which is
+ * equivalent to replacing the rate equation of the first ion.
+ *
+ * Auger ionization to stages beyond the last ion of the element in the
+ * atomic data removes ions from the element, just as photoionization of the
+ * last ion does if the bare ion is not in the atomic data.
  *
  **********************************************************/
 
 int
-populate_ion_rate_matrix (rate_matrix, pi_rates, inner_rates, rr_rates, b_temp, xne)
-     double rate_matrix[nions][nions];
+populate_ion_rate_matrix (rate_blocks, pi_rates, inner_rates, rr_rates, xne)
+     double rate_blocks[];
      double pi_rates[nions];
      double inner_rates[n_inner_tot];
      double rr_rates[nions];
      double xne;
-     double b_temp[nions];
-
 {
-  int nn, mm, zcount;
+  int nn, mm, i, k, nelem;
   int n_elec, d_elec, ion_out;  //The number of electrons left in a current ion
-
+  double *a, rate;
 
 
   /* First we initialise the matrix */
-  for (nn = 0; nn < nions; nn++)
+  for (nn = 0; nn < ion_block_size; nn++)
   {
-    for (mm = 0; mm < nions; mm++)
-    {
-      rate_matrix[nn][mm] = 0.0;
-    }
+    rate_blocks[nn] = 0.0;
   }
 
 
-  /* The next block of loops populate the matrix. For simplicity of reading the code each process has its own loop. Some rates
-     actually dont change during each iteration, but those that depend on n_e will. All are dealt with together at the moment,
-     but this could be streamlined if it turns out that there is a bottleneck. */
-
-  /* Now we populate the elements relating to PI depopulating a state */
-
+  /* The next loop populates the matrix. Some rates actually dont change during each iteration, but those that depend
+     on n_e will. All are dealt with together at the moment, but this could be streamlined if it turns out that there is
+     a bottleneck. */
 
-  for (mm = 0; mm < nions; mm++)
+  for (nelem = 0; nelem < nelements; nelem++)
   {
-    if (ion[mm].istate != ion[mm].z + 1)        // we have electrons
-    {
-      rate_matrix[mm][mm] -= pi_rates[mm];
-    }
-  }
+    a = &rate_blocks[ion_block_offset[nelem]];
+    k = ele[nelem].nions;
 
-
-  /* Now we populate the elements relating to PI populating a state */
-
-  for (mm = 0; mm < nions; mm++)
-  {
-    for (nn = 0; nn < nions; nn++)
+    for (i = 0; i < k; i++)
     {
+      mm = ele[nelem].firstion + i;
 
-      if (mm == nn + 1 && ion[nn].istate != ion[nn].z + 1 && ion[mm].z == ion[nn].z)
+      /* The sum of the populations is one */
+      a[i] = 1.0;
+
+      /* PI and direct ionization depopulating this state and populating the next one */
+      if (ion[mm].istate != ion[mm].z + 1)      // we have electrons
       {
-        rate_matrix[mm][nn] += pi_rates[nn];
+        rate = pi_rates[mm];
+        if (ion[mm].dere_di_flag > 0)   // and a DI rate
+        {
+          rate += xne * di_coeffs[mm];
+        }
+        ion_rate_add (a, k, i, i + 1 < k ? i + 1 : -1, rate, TRUE);
       }
-    }
-  }
 
-  /* Now we populate the elements relating to direct ionization depopulating a state */
+      /* Radiative, three body and dielectronic recombination depopulating this state and populating the one below.
+         Dielectronic recombination only populates the state below if that has dielectronic recombination data */
+      if (ion[mm].istate != 1)  // we have space for electrons
+      {
+        ion_rate_add (a, k, i, i - 1, xne * (rr_rates[mm] + xne * qrecomb_coeffs[mm]), TRUE);
 
-  for (mm = 0; mm < nions; mm++)
-  {
-    if (ion[mm].istate != ion[mm].z + 1 && ion[mm].dere_di_flag > 0)    // we have electrons and a DI rate
-    {
-      rate_matrix[mm][mm] -= (xne * di_coeffs[mm]);
+        if (ion[mm].drflag > 0 && i > 0 && ion[mm - 1].drflag > 0)
+        {
+          ion_rate_add (a, k, i, i - 1, xne * dr_coeffs[mm], TRUE);
+        }
+        else if (ion[mm].drflag > 0)
+        {
+          ion_rate_add (a, k, i, -1, xne * dr_coeffs[mm], TRUE);
+        }
+        else if (i > 0 && ion[mm - 1].drflag > 0)
+        {
+          ion_rate_add (a, k, i, i - 1, xne * dr_coeffs[mm], FALSE);
+        }
+      }
     }
   }
 
-  /* Now we populate the elements relating to direct ionization populating a state - this does depend on the electron density */
 
-  for (mm = 0; mm < nions; mm++)
+  for (mm = 0; mm < n_inner_tot; mm++)  //There mare be several rates for each ion, so we loop over all the rates
   {
-    for (nn = 0; nn < nions; nn++)
+    if (inner_cross[mm].n_elec_yield != -1)     //we only want to treat ionization where we have info about the yield
     {
-      if (mm == nn + 1 && ion[nn].istate != ion[nn].z + 1 && ion[mm].z == ion[nn].z && ion[nn].dere_di_flag > 0)
+      ion_out = inner_cross[mm].nion;   //this is the ion which is being depopulated
+      nelem = ion_block_elem[ion_out];
+      a = &rate_blocks[ion_block_offset[nelem]];
+      k = ele[nelem].nions;
+      i = ion_out - ele[nelem].firstion;
+
+      /* The depopulation, which is split between the states d_elec stages higher that are populated */
+      rate = inner_rates[mm];
+      n_elec = ion[ion_out].z - ion[ion_out].istate + 1;
+      if (n_elec > 11)
+        n_elec = 11;
+      for (d_elec = 1; d_elec < n_elec && i + d_elec < k; d_elec++)     //We do a loop over the number of remaining electrons
+      {
+        ion_rate_add (a, k, i, i + d_elec, inner_rates[mm] * inner_elec_yield[inner_cross[mm].n_elec_yield].prob[d_elec - 1], TRUE);
+        rate -= inner_rates[mm] * inner_elec_yield[inner_cross[mm].n_elec_yield].prob[d_elec - 1];
+      }
+      if (rate > 0.0)
       {
-        rate_matrix[mm][nn] += (xne * di_coeffs[nn]);
+        ion_rate_add (a, k, i, -1, rate, TRUE);
       }
     }
   }
 
+  return (0);
+}
 
-  /* Now we populate the elements relating to radiative recomb depopulating a state */
 
-  for (mm = 0; mm < nions; mm++)
-  {
-    if (ion[mm].istate != 1)    // we have space for electrons
-    {
-      rate_matrix[mm][mm] -= xne * (rr_rates[mm] + xne * qrecomb_coeffs[mm]);
-    }
-  }
+/**********************************************************/
+/**
+ * @brief      solves for the relative populations of the ions of one element
+ *
+ * @param [in] int  nelem - the element
+ * @param [in] double  a[] - the block of the rate matrix for the element, from populate_ion_rate_matrix
+ * @param [in] double  guess[] - the current relative populations of the ions of the element
+ * @param [out] double  x[] - the relative populations of the ions calculated here
+ * @return  0 on success, 2 if the solution fails the check on its accuracy, or 4 if the equations cannot be solved
+ *
+ * @details
+ * The populations x satisfy a x = 0, apart from the first equation,
+ * which is the condition that the populations sum to one.  The population
+ * of one ion, p, is first set to one, which leaves k - 1 equations for the other k - 1
+ * populations.  These are solved with Gaussian elimination with partial pivoting,
+ * in which the search for the pivot is restricted to the band below the diagonal: an
+ * ion can only be ionized to at most ion_block_lower[nelem] ions above it, so that the
+ * equation for each stage only involves that many lower ones.
+ * The populations are then normalised.
+ *
+ * ### Notes ###
+ * p is the ion with the largest population in guess, so that the other populations
+ * are not so large that they overflow.  If the solution shows that a different ion
+ * dominates by a large factor, the equations are solved again for that one.
+ *
+ * Above the diagonal a is usually zero, apart from the diagonal above it, but processes
+ * which remove ions from the element, such as dielectronic recombination of an ion when
+ * the one below has no dielectronic recombination data, make it full, and so the upper
+ * part is treated as dense.
+ * The elimination therefore takes of order k * k * ml operations, and m holds
+ * the full (k - 1) x (k - 1) block.
+ *
+ * Each equation is checked against the solution to a fractional accuracy
+ * of EPSILON.
+ *
+ * This routine uses no external variables apart from the structure of the blocks,
+ * and so the ionization of several cells could be solved at the same time.
+ *
+ **********************************************************/
 
+int
+solve_ion_block (nelem, a, guess, x)
+     int nelem;
+     double a[];
+     double guess[];
+     double x[];
+{
+  int k, n, ml, i, j, r, c, p, piv, last, ntry, ierr;
+  double f, sum, xmax, res, scale;
 
-  /* Now we populate the elements relating to radiative recomb populating a state */
+  k = ele[nelem].nions;
 
-  for (mm = 0; mm < nions; mm++)
+  if (k == 1)
   {
-    for (nn = 0; nn < nions; nn++)
-    {
-      if (mm == nn - 1 && ion[nn].istate != 1 && ion[mm].z == ion[nn].z)
-      {
-        rate_matrix[mm][nn] += xne * (rr_rates[nn] + xne * qrecomb_coeffs[nn]);
-      }
-    }
+    x[0] = 1.0;
+    return (0);
   }
 
-  /* Now we populate the elements relating to dielectronic recombination depopulating a state */
+  n = k - 1;
+  ml = ion_block_lower[nelem];
 
-  for (mm = 0; mm < nions; mm++)
   {
-    if (ion[mm].istate != 1 && ion[mm].drflag > 0)      // we have space for electrons
+    double m[n][n], rhs[n];
+
+    p = 0;
+    for (i = 1; i < k; i++)
     {
-      rate_matrix[mm][mm] -= (xne * dr_coeffs[mm]);
+      if (guess[i] > guess[p])
+        p = i;
     }
-  }
 
+    for (ntry = 0; ntry < 2; ntry++)
+    {
+      /* Row r of m is the equation for ion r + 1, and column c is the population of ion c, or c + 1 if c is p or more */
 
-  /* Now we populate the elements relating to dielectronic recombination populating a state */
+      for (r = 0; r < n; r++)
+      {
+        for (c = 0; c < n; c++)
+        {
+          j = c < p ? c : c + 1;
+          m[r][c] = a[(r + 1) * k + j];
+        }
+        rhs[r] = -a[(r + 1) * k + p];
+      }
 
+      for (c = 0; c < n; c++)
+      {
+        last = c + ml < n - 1 ? c + ml : n - 1;
 
+        piv = c;
+        for (r = c + 1; r <= last; r++)
+        {
+          if (fabs (m[r][c]) > fabs (m[piv][c]))
+            piv = r;
+        }
 
-  for (mm = 0; mm < nions; mm++)
-  {
-    for (nn = 0; nn < nions; nn++)
-    {
-      if (mm == nn - 1 && ion[nn].istate != 1 && ion[mm].z == ion[nn].z && ion[mm].drflag > 0)
+        if (m[piv][c] == 0.0)
+        {
+          Error ("solve_ion_block: The rate matrix for element %d is singular\n", ele[nelem].z);
+          return (4);
+        }
+
+        if (piv != c)
+        {
+          for (j = c; j < n; j++)
+          {
+            f = m[c][j];
+            m[c][j] = m[piv][j];
+            m[piv][j] = f;
+          }
+          f = rhs[c];
+          rhs[c] = rhs[piv];
+          rhs[piv] = f;
+        }
+
+        for (r = c + 1; r <= last; r++)
+        {
+          if ((f = m[r][c] / m[c][c]) != 0.0)
+          {
+            for (j = c + 1; j < n; j++)
+            {
+              m[r][j] -= f * m[c][j];
+            }
+            rhs[r] -= f * rhs[c];
+          }
+        }
+      }
+
+      for (r = n - 1; r >= 0; r--)
       {
-        rate_matrix[mm][nn] += (xne * dr_coeffs[nn]);
+        f = rhs[r];
+        for (j = r + 1; j < n; j++)
+        {
+          f -= m[r][j] * rhs[j];
+        }
+        rhs[r] = f / m[r][r];
       }
-    }
-  }
 
+      /* Put the populations back in order, and find the largest */
+
+      sum = xmax = 0.0;
+      for (i = 0; i < k; i++)
+      {
+        if (i == p)
+          x[i] = 1.0;
+        else
+          x[i] = rhs[i < p ? i : i - 1];
+        sum += x[i];
+        if (fabs (x[i]) > xmax)
+          xmax = fabs (x[i]);
+      }
 
+      if (isfinite (sum) && xmax < 1.e100)
+        break;
 
-  for (mm = 0; mm < n_inner_tot; mm++)  //There mare be several rates for each ion, so we loop over all the rates
-  {
-    if (inner_cross[mm].n_elec_yield != -1)     //we only want to treat ionization where we have info about the yield
-    {
-      ion_out = inner_cross[mm].nion;   //this is the ion which is being depopulated
-      rate_matrix[ion_out][ion_out] -= inner_rates[mm]; //This is the depopulation
-      n_elec = ion[ion_out].z - ion[ion_out].istate + 1;
-      if (n_elec > 11)
-        n_elec = 11;
-      for (d_elec = 1; d_elec < n_elec; d_elec++)       //We do a loop over the number of remaining electrons
+      for (i = 0; i < k; i++)
       {
-        nn = ion_out + d_elec;  //We will be populating a state d_elec stages higher
-        rate_matrix[nn][ion_out] += inner_rates[mm] * inner_elec_yield[inner_cross[mm].n_elec_yield].prob[d_elec - 1];
+        if (!isfinite (x[i]) || fabs (x[i]) == xmax)
+          p = i;
       }
     }
   }
 
+  if (!isfinite (sum) || sum == 0.0)
+  {
+    Error ("solve_ion_block: Could not normalise the populations of element %d\n", ele[nelem].z);
+    return (4);
+  }
 
+  for (i = 0; i < k; i++)
+  {
+    x[i] /= sum;
+  }
 
+  /* Check that the solution does satisfy the equations */
 
-
-
-  /* Now, we replace the first line for each element with 1's and 0's. This is done because we actually have more equations
-     than unknowns. We replace the array elements relating to each ion stage in this element with a 1, and all the other array
-     elements (which relate to other elements (in the chemicalsense) with zeros. This is equivalent to the equation
-     1*n1+1*n2+1*n3 = n_total - i.e. the sum of all the partial number densities adds up to the total number density for that
-     element. This loop also produces the 'b matrix'. This is the right hand side of the matrix equation, and represents the
-     total number density for each element. This can be a series of 1's for each row in the matrix relating to the ground
-     state of the repsective element, however one can just use the total number density for that elements and then the
-     densities which the solver computes are just the actual number densities for each ion. This does mean that different rows
-     are orders of magnitude different, so one can imagine numerical issues. However each element is essentially solved for
-     seperately.. Something to watch */
-  zcount = 0;
-  for (nn = 0; nn < nions; nn++)
+  ierr = 0;
+  for (i = 1; i < k; i++)
   {
-    if (ion[nn].istate == 1)
+    res = scale = 0.0;
+    for (j = 0; j < k; j++)
     {
-      b_temp[nn] = 1.0;         //In the relative abundance schene this equals one.
-
-      for (mm = 0; mm < nions; mm++)
-      {
-        if (ion[mm].z == ion[nn].z)
-        {
-          rate_matrix[nn][mm] = 1.0;
-        }
-        else
-        {
-          rate_matrix[nn][mm] = 0.0;
-        }
-      }
+      res += a[i * k + j] * x[j];
+      scale += fabs (a[i * k + j] * x[j]);
     }
-    else
+    if (fabs (res) > EPSILON * scale)
     {
-      b_temp[nn] = 0.0;
+      Error ("solve_ion_block: test solution fails relative error for element %d ion %d %e of %e\n", ele[nelem].z, i, res, scale);
+      ierr = 2;
     }
   }
 
-  return (0);
+  return (ierr);
 }
 
 
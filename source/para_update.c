@@ -4,12 +4,16 @@
  * @author ksl, jm
  * @date   January, 2018
  *
- * @brief  routines for communicating MC estimators and spectra between MPI threads.
+ * @brief  routines for communicating MC estimators, spectra and the results of
+ * wind_update between MPI threads.
+ * The last two routines do the same for the threads which transport photons within a single
+ * process, when Python is compiled with OpenMP.
  *
  ***********************************************************/
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <math.h>
 #include "atomic.h"
 #include "python.h"
@@ -22,8 +26,9 @@
  * communicates the MC estimators between tasks relating to 
  * spectral models, heating and cooling and cell diagnostics like IP. 
  * In the case of some variables, the quantities are maxima and minima so the 
- * flag MPI_MAX or MPI_MIN is used in MPI_Reduce. For summed
- * quantities like heating we use MPI_SUM.
+ * flag MPI_MAX or MPI_MIN is used in MPI_Allreduce. For summed
+ * quantities like heating we use MPI_SUM.  MPI_Allreduce leaves the
+ * result in every task, so no separate broadcast is needed.
  *  
  * This routine should only do anything if the MPI_ON flag was present 
  * in compilation. It communicates all the information
@@ -70,8 +75,7 @@ communicate_estimators_para ()
   qdisk_helper = calloc (sizeof (double), NRINGS * 2);
   qdisk_helper2 = calloc (sizeof (double), NRINGS * 2);
 
-  MPI_Barrier (MPI_COMM_WORLD);
-  // the following blocks gather all the estimators to the zeroth (Master) thread
+  // the following blocks combine the estimators of all the threads
 
 
   for (mpi_i = 0; mpi_i < NPLASMA; mpi_i++)
@@ -114,31 +118,15 @@ communicate_estimators_para ()
 
 
   /* 131213 NSH communiate the min and max band frequencies these use MPI_MIN or MPI_MAX */
-  MPI_Barrier (MPI_COMM_WORLD);
-  MPI_Reduce (minbandfreqhelper, minbandfreqhelper2, NPLASMA * NXBANDS, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
-  MPI_Reduce (maxbandfreqhelper, maxbandfreqhelper2, NPLASMA * NXBANDS, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-  MPI_Reduce (maxfreqhelper, maxfreqhelper2, NPLASMA, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-  MPI_Reduce (redhelper, redhelper2, plasma_double_helpers, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-  MPI_Reduce (redhelper, redhelper2, plasma_double_helpers, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Allreduce (minbandfreqhelper, minbandfreqhelper2, NPLASMA * NXBANDS, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+  MPI_Allreduce (maxbandfreqhelper, maxbandfreqhelper2, NPLASMA * NXBANDS, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce (maxfreqhelper, maxfreqhelper2, NPLASMA, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce (redhelper, redhelper2, plasma_double_helpers, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
   /* JM 1607 -- seum up the qdisk values */
-  MPI_Reduce (qdisk_helper, qdisk_helper2, 2 * NRINGS, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-
-  if (rank_global == 0)
-  {
-
-    Log_parallel ("Zeroth thread successfully received the normalised estimators. About to broadcast.\n");
-  }
-
-  MPI_Barrier (MPI_COMM_WORLD);
-  MPI_Bcast (redhelper2, plasma_double_helpers, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-  MPI_Bcast (maxfreqhelper2, NPLASMA, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-  /* 131213 NSH Send out the global min and max band limited frequencies to all threads */
-  MPI_Bcast (minbandfreqhelper2, NPLASMA * NXBANDS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-  MPI_Bcast (maxbandfreqhelper2, NPLASMA * NXBANDS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Allreduce (qdisk_helper, qdisk_helper2, 2 * NRINGS, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 
-  /* JM 1607 -- send out the qdisk values to all threads */
-  MPI_Bcast (qdisk_helper2, NRINGS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  Log_parallel ("Thread %d successfully received the normalised estimators.\n", rank_global);
 
 
   for (mpi_i = 0; mpi_i < NPLASMA; mpi_i++)
@@ -177,8 +165,6 @@ communicate_estimators_para ()
     qdisk.heat[mpi_i] = qdisk_helper2[mpi_i];
     qdisk.ave_freq[mpi_i] = qdisk_helper2[mpi_i + NRINGS];
   }
-  Log_parallel ("Thread %d happy after broadcast.\n", rank_global);
-
   /* now we've done all the doubles so we can free their helper arrays */
   free (qdisk_helper);
   free (qdisk_helper2);
@@ -191,12 +177,11 @@ communicate_estimators_para ()
   free (minbandfreqhelper);
   free (minbandfreqhelper2);
 
-  /* allocate the integer helper arrays, set a barrier, then do all the integers. */
+  /* allocate the integer helper arrays, then do all the integers. */
   iqdisk_helper = calloc (sizeof (int), NRINGS * 2);
   iqdisk_helper2 = calloc (sizeof (int), NRINGS * 2);
   iredhelper = calloc (sizeof (int), plasma_int_helpers);
   iredhelper2 = calloc (sizeof (int), plasma_int_helpers);
-  MPI_Barrier (MPI_COMM_WORLD);
 
   for (mpi_i = 0; mpi_i < NPLASMA; mpi_i++)
   {
@@ -220,18 +205,10 @@ communicate_estimators_para ()
     iqdisk_helper[mpi_i + NRINGS] = qdisk.nhit[mpi_i];
   }
 
-  MPI_Barrier (MPI_COMM_WORLD);
-  MPI_Reduce (iredhelper, iredhelper2, plasma_int_helpers, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-  MPI_Reduce (iqdisk_helper, iqdisk_helper2, 2 * NRINGS, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-
-  if (rank_global == 0)
-  {
-    Log_parallel ("Zeroth thread successfully received the integer sum. About to broadcast.\n");
-  }
+  MPI_Allreduce (iredhelper, iredhelper2, plasma_int_helpers, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce (iqdisk_helper, iqdisk_helper2, 2 * NRINGS, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
 
-  MPI_Barrier (MPI_COMM_WORLD);
-  MPI_Bcast (iredhelper2, plasma_int_helpers, MPI_INT, 0, MPI_COMM_WORLD);
-  MPI_Bcast (iqdisk_helper2, NRINGS, MPI_INT, 0, MPI_COMM_WORLD);
+  Log_parallel ("Thread %d successfully received the integer sum.\n", rank_global);
 
 
   for (mpi_i = 0; mpi_i < NPLASMA; mpi_i++)
@@ -266,6 +243,286 @@ communicate_estimators_para ()
 }
 
 
+
+#ifdef MPI_ON
+
+/* The members of the plasma structure which are calculated in wind_update.  Those with a
+   fixed size are exchanged directly between the plasma structures of the tasks, using an
+   MPI datatype which describes where they lie in the structure.  Those which are
+   allocated separately for each cell are copied to and from a contiguous buffer, with the
+   values of one member for all of the cells of a task next to one another */
+
+#define PLASMA_DOUBLE 0
+#define PLASMA_INT    1
+
+typedef struct plasma_member
+{
+  size_t offset;                /* The offset of the member in the plasma structure */
+  int type;                     /* PLASMA_DOUBLE or PLASMA_INT */
+  int n;                        /* The number of elements of a fixed size member */
+} plasma_member_dummy;
+
+#define PLASMA_MEMBER(m, t, n) {offsetof (plasma_dummy, m), t, n}
+
+plasma_member_dummy plasma_fixed[] = {
+  PLASMA_MEMBER (nwind, PLASMA_INT, 1), PLASMA_MEMBER (nplasma, PLASMA_INT, 1),
+  PLASMA_MEMBER (ne, PLASMA_DOUBLE, 1), PLASMA_MEMBER (rho, PLASMA_DOUBLE, 1), PLASMA_MEMBER (vol, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (kappa_ff_factor, PLASMA_DOUBLE, 1), PLASMA_MEMBER (nscat_es, PLASMA_INT, 1),
+  PLASMA_MEMBER (kpkt_emiss, PLASMA_DOUBLE, 1), PLASMA_MEMBER (kpkt_abs, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (kbf_nuse, PLASMA_INT, 1),
+  PLASMA_MEMBER (t_r, PLASMA_DOUBLE, 1), PLASMA_MEMBER (t_r_old, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (t_e, PLASMA_DOUBLE, 1), PLASMA_MEMBER (t_e_old, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (dt_e, PLASMA_DOUBLE, 1), PLASMA_MEMBER (dt_e_old, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (heat_tot, PLASMA_DOUBLE, 1), PLASMA_MEMBER (abs_tot, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (heat_tot_old, PLASMA_DOUBLE, 1), PLASMA_MEMBER (heat_lines, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (heat_ff, PLASMA_DOUBLE, 1), PLASMA_MEMBER (heat_comp, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (heat_ind_comp, PLASMA_DOUBLE, 1), PLASMA_MEMBER (heat_lines_macro, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (heat_photo_macro, PLASMA_DOUBLE, 1), PLASMA_MEMBER (heat_photo, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (heat_auger, PLASMA_DOUBLE, 1), PLASMA_MEMBER (abs_photo, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (abs_auger, PLASMA_DOUBLE, 1), PLASMA_MEMBER (heat_z, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (w, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (ntot, PLASMA_INT, 1), PLASMA_MEMBER (ntot_star, PLASMA_INT, 1), PLASMA_MEMBER (ntot_bl, PLASMA_INT, 1),
+  PLASMA_MEMBER (ntot_disk, PLASMA_INT, 1), PLASMA_MEMBER (ntot_wind, PLASMA_INT, 1), PLASMA_MEMBER (ntot_agn, PLASMA_INT, 1),
+  PLASMA_MEMBER (mean_ds, PLASMA_DOUBLE, 1), PLASMA_MEMBER (n_ds, PLASMA_INT, 1),
+  PLASMA_MEMBER (nrad, PLASMA_INT, 1), PLASMA_MEMBER (nioniz, PLASMA_INT, 1),
+  PLASMA_MEMBER (j, PLASMA_DOUBLE, 1), PLASMA_MEMBER (j_direct, PLASMA_DOUBLE, 1), PLASMA_MEMBER (j_scatt, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (ave_freq, PLASMA_DOUBLE, 1), PLASMA_MEMBER (cool_tot, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (xj, PLASMA_DOUBLE, NXBANDS), PLASMA_MEMBER (xave_freq, PLASMA_DOUBLE, NXBANDS),
+  PLASMA_MEMBER (xsd_freq, PLASMA_DOUBLE, NXBANDS), PLASMA_MEMBER (nxtot, PLASMA_INT, NXBANDS),
+  PLASMA_MEMBER (max_freq, PLASMA_DOUBLE, 1), PLASMA_MEMBER (lum_lines, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (lum_ff, PLASMA_DOUBLE, 1), PLASMA_MEMBER (cool_adiabatic, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (comp_nujnu, PLASMA_DOUBLE, 1), PLASMA_MEMBER (cool_comp, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (cool_dr, PLASMA_DOUBLE, 1), PLASMA_MEMBER (cool_di, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (cool_rr, PLASMA_DOUBLE, 1), PLASMA_MEMBER (lum_rr, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (cool_rr_metals, PLASMA_DOUBLE, 1), PLASMA_MEMBER (lum_rr_metals, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (lum_tot, PLASMA_DOUBLE, 1), PLASMA_MEMBER (lum_tot_old, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (cool_tot_ioniz, PLASMA_DOUBLE, 1), PLASMA_MEMBER (lum_lines_ioniz, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (lum_ff_ioniz, PLASMA_DOUBLE, 1), PLASMA_MEMBER (cool_adiabatic_ioniz, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (cool_comp_ioniz, PLASMA_DOUBLE, 1), PLASMA_MEMBER (cool_dr_ioniz, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (cool_di_ioniz, PLASMA_DOUBLE, 1), PLASMA_MEMBER (cool_rr_ioniz, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (lum_rr_ioniz, PLASMA_DOUBLE, 1), PLASMA_MEMBER (cool_rr_metals_ioniz, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (lum_tot_ioniz, PLASMA_DOUBLE, 1), PLASMA_MEMBER (dmo_dt, PLASMA_DOUBLE, 3),
+  PLASMA_MEMBER (gain, PLASMA_DOUBLE, 1), PLASMA_MEMBER (converge_t_r, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (converge_t_e, PLASMA_DOUBLE, 1), PLASMA_MEMBER (converge_hc, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (trcheck, PLASMA_INT, 1), PLASMA_MEMBER (techeck, PLASMA_INT, 1), PLASMA_MEMBER (hccheck, PLASMA_INT, 1),
+  PLASMA_MEMBER (converge_whole, PLASMA_INT, 1), PLASMA_MEMBER (converging, PLASMA_INT, 1),
+  PLASMA_MEMBER (spec_mod_type, PLASMA_INT, NXBANDS), PLASMA_MEMBER (pl_alpha, PLASMA_DOUBLE, NXBANDS),
+  PLASMA_MEMBER (pl_log_w, PLASMA_DOUBLE, NXBANDS), PLASMA_MEMBER (exp_temp, PLASMA_DOUBLE, NXBANDS),
+  PLASMA_MEMBER (exp_w, PLASMA_DOUBLE, NXBANDS), PLASMA_MEMBER (fmin_mod, PLASMA_DOUBLE, NXBANDS),
+  PLASMA_MEMBER (fmax_mod, PLASMA_DOUBLE, NXBANDS),
+  PLASMA_MEMBER (ip, PLASMA_DOUBLE, 1), PLASMA_MEMBER (ip_direct, PLASMA_DOUBLE, 1), PLASMA_MEMBER (ip_scatt, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (xi, PLASMA_DOUBLE, 1),
+  PLASMA_MEMBER (bf_simple_ionpool_in, PLASMA_DOUBLE, 1), PLASMA_MEMBER (bf_simple_ionpool_out, PLASMA_DOUBLE, 1)
+};
+
+/* For the members which are pointers the number of elements is set when the
+   exchange is made, since it depends on the atomic data */
+
+#define NION_ARRAY     0
+#define NLTE_ARRAY     1
+#define NPHOT_ARRAY    2
+
+plasma_member_dummy plasma_alloc[] = {
+  PLASMA_MEMBER (density, PLASMA_DOUBLE, NION_ARRAY), PLASMA_MEMBER (partition, PLASMA_DOUBLE, NION_ARRAY),
+  PLASMA_MEMBER (levden, PLASMA_DOUBLE, NLTE_ARRAY),
+  PLASMA_MEMBER (recomb_simple, PLASMA_DOUBLE, NPHOT_ARRAY), PLASMA_MEMBER (recomb_simple_upweight, PLASMA_DOUBLE, NPHOT_ARRAY),
+  PLASMA_MEMBER (ioniz, PLASMA_DOUBLE, NION_ARRAY), PLASMA_MEMBER (recomb, PLASMA_DOUBLE, NION_ARRAY),
+  PLASMA_MEMBER (xscatters, PLASMA_DOUBLE, NION_ARRAY), PLASMA_MEMBER (heat_ion, PLASMA_DOUBLE, NION_ARRAY),
+  PLASMA_MEMBER (cool_rr_ion, PLASMA_DOUBLE, NION_ARRAY), PLASMA_MEMBER (lum_rr_ion, PLASMA_DOUBLE, NION_ARRAY),
+  PLASMA_MEMBER (kbf_use, PLASMA_INT, NPHOT_ARRAY), PLASMA_MEMBER (scatters, PLASMA_INT, NION_ARRAY)
+};
+
+#define NPLASMA_FIXED (sizeof (plasma_fixed) / sizeof (plasma_member_dummy))
+#define NPLASMA_ALLOC (sizeof (plasma_alloc) / sizeof (plasma_member_dummy))
+
+MPI_Datatype plasma_update_type = MPI_DATATYPE_NULL;
+
+#endif
+
+
+
+/**********************************************************/
+/**
+ * @brief      exchanges the results of wind_update between tasks
+ *
+ * @param [in] int  my_nmin   The first plasma cell updated by this task
+ * @param [in] int  my_nmax   One more than the last plasma cell updated by this task
+ * @return     Always returns 0
+ *
+ * @details
+ * wind_update divides the plasma cells between the tasks, each of which
+ * updates a contiguous range of cells.  When they have finished, this
+ * routine gives every task the updated values of all of the cells with
+ * three calls to MPI_Allgatherv, whatever the number of tasks.
+ *
+ * The members of the plasma structure which have a fixed size are
+ * exchanged in place, using an MPI datatype which describes them.  The
+ * members which are allocated separately for each cell (densities,
+ * partition functions, level populations and so on) are first copied to
+ * a contiguous buffer, in which each task's cells take up one block, and
+ * within a block the values of a member for all the cells of the block
+ * are stored together.  The buffer is exchanged as doubles and, for the
+ * integer arrays, as ints, and then copied back.
+ *
+ * ### Notes ###
+ * The members which are exchanged are listed in plasma_fixed and
+ * plasma_alloc.  Anything which is calculated in wind_update and needed
+ * by all tasks must be added to one of these.
+ *
+ **********************************************************/
+
+int
+communicate_plasma_cells (my_nmin, my_nmax)
+     int my_nmin, my_nmax;
+{
+#ifdef MPI_ON
+  int *ncells, *nfirst, *nbuf, *nbuf_first;
+  int blocklengths[NPLASMA_FIXED];
+  MPI_Aint displacements[NPLASMA_FIXED];
+  MPI_Datatype types[NPLASMA_FIXED], xtype;
+  int nelem[NPLASMA_ALLOC];
+  int ndouble, nint, nblock, ntask;
+  int i, k, m, n, off;
+  double *dbuf, *dsrc;
+  int *ibuf, *isrc;
+  char *base;
+
+  /* Describe the fixed size members the first time the routine is called */
+
+  if (plasma_update_type == MPI_DATATYPE_NULL)
+  {
+    for (m = 0; m < (int) NPLASMA_FIXED; m++)
+    {
+      blocklengths[m] = plasma_fixed[m].n;
+      displacements[m] = plasma_fixed[m].offset;
+      types[m] = (plasma_fixed[m].type == PLASMA_INT) ? MPI_INT : MPI_DOUBLE;
+    }
+    MPI_Type_create_struct (NPLASMA_FIXED, blocklengths, displacements, types, &xtype);
+    MPI_Type_create_resized (xtype, 0, sizeof (plasma_dummy), &plasma_update_type);
+    MPI_Type_commit (&plasma_update_type);
+    MPI_Type_free (&xtype);
+  }
+
+  /* Find out which cells each task has updated */
+
+  ncells = calloc (sizeof (int), np_mpi_global);
+  nfirst = calloc (sizeof (int), np_mpi_global);
+  nbuf = calloc (sizeof (int), np_mpi_global);
+  nbuf_first = calloc (sizeof (int), np_mpi_global);
+
+  nblock = my_nmax - my_nmin;
+  MPI_Allgather (&nblock, 1, MPI_INT, ncells, 1, MPI_INT, MPI_COMM_WORLD);
+  MPI_Allgather (&my_nmin, 1, MPI_INT, nfirst, 1, MPI_INT, MPI_COMM_WORLD);
+
+  MPI_Allgatherv (MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, plasmamain, ncells, nfirst, plasma_update_type, MPI_COMM_WORLD);
+
+  /* Now the members which are allocated for each cell */
+
+  ndouble = nint = 0;
+  for (m = 0; m < (int) NPLASMA_ALLOC; m++)
+  {
+    if (plasma_alloc[m].n == NION_ARRAY)
+      nelem[m] = nions;
+    else if (plasma_alloc[m].n == NLTE_ARRAY)
+      nelem[m] = nlte_levels;
+    else
+      nelem[m] = nphot_total;
+
+    if (plasma_alloc[m].type == PLASMA_INT)
+      nint += nelem[m];
+    else
+      ndouble += nelem[m];
+  }
+
+  dbuf = calloc (sizeof (double), (size_t) ndouble * NPLASMA + 1);
+  ibuf = calloc (sizeof (int), (size_t) nint * NPLASMA + 1);
+
+  if (dbuf == NULL || ibuf == NULL)
+  {
+    Error ("communicate_plasma_cells: Could not allocate the buffers for %d cells\n", NPLASMA);
+    exit (0);
+  }
+
+  for (k = 0; k < 2; k++)
+  {
+    /* k=0 copies this task's cells into the buffers, and k=1 copies all the cells out of them */
+
+    for (ntask = 0; ntask < np_mpi_global; ntask++)
+    {
+      if (k == 0 && ntask != rank_global)
+        continue;
+
+      nblock = ncells[ntask];
+      dsrc = &dbuf[(size_t) nfirst[ntask] * ndouble];
+      isrc = &ibuf[(size_t) nfirst[ntask] * nint];
+
+      for (m = 0; m < (int) NPLASMA_ALLOC; m++)
+      {
+        for (n = 0; n < nblock; n++)
+        {
+          base = (char *) &plasmamain[nfirst[ntask] + n] + plasma_alloc[m].offset;
+          off = n * nelem[m];
+          if (plasma_alloc[m].type == PLASMA_INT)
+          {
+            for (i = 0; i < nelem[m]; i++)
+            {
+              if (k == 0)
+                isrc[off + i] = (*(int **) base)[i];
+              else
+                (*(int **) base)[i] = isrc[off + i];
+            }
+          }
+          else
+          {
+            for (i = 0; i < nelem[m]; i++)
+            {
+              if (k == 0)
+                dsrc[off + i] = (*(double **) base)[i];
+              else
+                (*(double **) base)[i] = dsrc[off + i];
+            }
+          }
+        }
+        if (plasma_alloc[m].type == PLASMA_INT)
+          isrc += nblock * nelem[m];
+        else
+          dsrc += nblock * nelem[m];
+      }
+    }
+
+    if (k == 0)
+    {
+      for (ntask = 0; ntask < np_mpi_global; ntask++)
+      {
+        nbuf[ntask] = ncells[ntask] * ndouble;
+        nbuf_first[ntask] = nfirst[ntask] * ndouble;
+      }
+      MPI_Allgatherv (MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, dbuf, nbuf, nbuf_first, MPI_DOUBLE, MPI_COMM_WORLD);
+
+      for (ntask = 0; ntask < np_mpi_global; ntask++)
+      {
+        nbuf[ntask] = ncells[ntask] * nint;
+        nbuf_first[ntask] = nfirst[ntask] * nint;
+      }
+      MPI_Allgatherv (MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, ibuf, nbuf, nbuf_first, MPI_INT, MPI_COMM_WORLD);
+    }
+  }
+
+  Log_parallel ("communicate_plasma_cells: Task %d received the updates of all %d cells\n", rank_global, NPLASMA);
+
+  free (dbuf);
+  free (ibuf);
+  free (ncells);
+  free (nfirst);
+  free (nbuf);
+  free (nbuf_first);
+#endif
+
+  return (0);
+}
+
+
+
 /**********************************************************/
 /** 
  * @brief sum up the synthetic spectra between threads.   
@@ -355,8 +612,6 @@ communicate_matom_estimators_para ()
   double *level_helper, *cell_helper, *jbar_helper;
   double *gamma_helper2, *alpha_helper2;
   double *level_helper2, *cell_helper2, *jbar_helper2;
-  double *cooling_bf_helper, *cooling_bb_helper;
-  double *cooling_bf_helper2, *cooling_bb_helper2;
 
   if (nlevels_macro == 0 && geo.nmacro == 0)
   {
@@ -377,16 +632,12 @@ communicate_matom_estimators_para ()
   alpha_helper = calloc (sizeof (double), NPLASMA * 2 * size_alpha_est);
   level_helper = calloc (sizeof (double), NPLASMA * nlevels_macro);
   cell_helper = calloc (sizeof (double), 7 * NPLASMA);
-  cooling_bf_helper = calloc (sizeof (double), NPLASMA * 2 * nphot_total);
-  cooling_bb_helper = calloc (sizeof (double), NPLASMA * nlines);
 
   jbar_helper2 = calloc (sizeof (double), NPLASMA * size_Jbar_est);
   gamma_helper2 = calloc (sizeof (double), NPLASMA * 4 * size_gamma_est);
   alpha_helper2 = calloc (sizeof (double), NPLASMA * 2 * size_alpha_est);
   level_helper2 = calloc (sizeof (double), NPLASMA * nlevels_macro);
   cell_helper2 = calloc (sizeof (double), 7 * NPLASMA);
-  cooling_bf_helper2 = calloc (sizeof (double), NPLASMA * 2 * nphot_total);
-  cooling_bb_helper2 = calloc (sizeof (double), NPLASMA * nlines);
 
 
   /* set an mpi barrier before we start */
@@ -401,7 +652,9 @@ communicate_matom_estimators_para ()
     /* one kpkt_abs quantity per cell */
     cell_helper[mpi_i] = plasmamain[mpi_i].kpkt_abs / np_mpi_global;
 
-    /* each of the cooling sums and normalisations also have one quantity per cell */
+    /* each of the cooling sums and normalisations also have one quantity per cell. The k-packet
+       channels themselves are not communicated, since every thread finds the same ones from the
+       plasma properties in fill_kpkt_rates */
     cell_helper[mpi_i + NPLASMA] = macromain[mpi_i].cooling_normalisation / np_mpi_global;
     cell_helper[mpi_i + 2 * NPLASMA] = macromain[mpi_i].cooling_bftot / np_mpi_global;
     cell_helper[mpi_i + 3 * NPLASMA] = macromain[mpi_i].cooling_bf_coltot / np_mpi_global;
@@ -434,17 +687,6 @@ communicate_matom_estimators_para ()
       alpha_helper[mpi_i + (n * NPLASMA)] = macromain[mpi_i].recomb_sp[n] / np_mpi_global;
       alpha_helper[mpi_i + ((n + size_alpha_est) * NPLASMA)] = macromain[mpi_i].recomb_sp_e[n] / np_mpi_global;
     }
-
-    for (n = 0; n < nphot_total; n++)
-    {
-      cooling_bf_helper[mpi_i + (n * NPLASMA)] = macromain[mpi_i].cooling_bf[n] / np_mpi_global;
-      cooling_bf_helper[mpi_i + ((n + nphot_total) * NPLASMA)] = macromain[mpi_i].cooling_bf_col[n] / np_mpi_global;
-    }
-
-    for (n = 0; n < nlines; n++)
-    {
-      cooling_bb_helper[mpi_i + (n * NPLASMA)] = macromain[mpi_i].cooling_bb[n] / np_mpi_global;
-    }
   }
 
   /* because in the above loop we have already divided by number of processes, we can now do a sum
@@ -455,8 +697,6 @@ communicate_matom_estimators_para ()
   MPI_Reduce (jbar_helper, jbar_helper2, NPLASMA * size_Jbar_est, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
   MPI_Reduce (gamma_helper, gamma_helper2, NPLASMA * 4 * size_gamma_est, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
   MPI_Reduce (alpha_helper, alpha_helper2, NPLASMA * 2 * size_alpha_est, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-  MPI_Reduce (cooling_bf_helper, cooling_bf_helper2, NPLASMA * 2 * nphot_total, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-  MPI_Reduce (cooling_bb_helper, cooling_bb_helper2, NPLASMA * nlines, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 
 
   if (rank_global == 0)
@@ -470,8 +710,6 @@ communicate_matom_estimators_para ()
   MPI_Bcast (jbar_helper2, NPLASMA * size_Jbar_est, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast (gamma_helper2, NPLASMA * 4 * size_gamma_est, MPI_DOUBLE, 0, MPI_COMM_WORLD);
   MPI_Bcast (alpha_helper2, NPLASMA * 2 * size_alpha_est, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-  MPI_Bcast (cooling_bf_helper2, NPLASMA * 2 * nphot_total, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-  MPI_Bcast (cooling_bb_helper2, NPLASMA * nlines, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
 
 
@@ -516,17 +754,6 @@ communicate_matom_estimators_para ()
       macromain[mpi_i].recomb_sp[n] = alpha_helper2[mpi_i + (n * NPLASMA)];
       macromain[mpi_i].recomb_sp_e[n] = alpha_helper2[mpi_i + ((n + size_alpha_est) * NPLASMA)];
     }
-
-    for (n = 0; n < nphot_total; n++)
-    {
-      macromain[mpi_i].cooling_bf[n] = cooling_bf_helper2[mpi_i + (n * NPLASMA)];
-      macromain[mpi_i].cooling_bf_col[n] = cooling_bf_helper2[mpi_i + ((n + nphot_total) * NPLASMA)];
-    }
-
-    for (n = 0; n < nlines; n++)
-    {
-      macromain[mpi_i].cooling_bb[n] = cooling_bb_helper2[mpi_i + (n * NPLASMA)];
-    }
   }
 
 
@@ -544,18 +771,547 @@ communicate_matom_estimators_para ()
   free (jbar_helper);
   free (gamma_helper);
   free (alpha_helper);
-  free (cooling_bf_helper);
-  free (cooling_bb_helper);
 
   free (cell_helper2);
   free (level_helper2);
   free (jbar_helper2);
   free (gamma_helper2);
   free (alpha_helper2);
-  free (cooling_bf_helper2);
-  free (cooling_bb_helper2);
 #endif
 
 
   return (0);
 }
+
+
+
+/**********************************************************/
+/** 
+ * @brief      gives the calling thread its own copies of the structures
+ * in which the MC estimators are accumulated during photon transport
+ *
+ * @param [in] PlasmaPtr  master_plasma   plasmamain of the master thread
+ * @param [in] MacroPtr  master_macro   macromain of the master thread
+ * @param [in] PhotStorePtr  master_photstore   photstoremain of the master thread
+ * @param [in] MatomPhotStorePtr  master_matomphotstore   matomphotstoremain of the master thread
+ * @return     Always returns 0
+ *
+ * @details
+ * When photons are transported on several threads (see trans_phot), each 
+ * thread other than the master accumulates the MC estimators in its own 
+ * copies of plasmamain and macromain, so that no two threads ever increment 
+ * the same estimator.  The copies contain the same values as the master 
+ * structures, except that the estimators which are summed during photon 
+ * transport start from zero, and the arrays of estimators are allocated 
+ * afresh.  All other arrays are shared with the master structures, which 
+ * are only read during transport.  The photon stores, which cache photon 
+ * frequencies, are replaced by empty ones.
+ *
+ * The estimators are added into the master structures, and the copies 
+ * freed, by reduce_estimators_thread.  The maximum and minimum frequencies
+ * seen in each cell are not reset, since they are combined by taking the 
+ * maximum or minimum.
+ **********************************************************/
+
+int
+copy_estimators_thread (master_plasma, master_macro, master_photstore, master_matomphotstore)
+     PlasmaPtr master_plasma;
+     MacroPtr master_macro;
+     PhotStorePtr master_photstore;
+     MatomPhotStorePtr master_matomphotstore;
+{
+  int n, i;
+  PlasmaPtr xplasma;
+  MacroPtr mplasma;
+
+  plasmamain = (PlasmaPtr) calloc (sizeof (plasma_dummy), NPLASMA + 1);
+  photstoremain = (PhotStorePtr) calloc (sizeof (photon_store_dummy), NPLASMA + 1);
+  matomphotstoremain = (MatomPhotStorePtr) calloc (sizeof (matom_photon_store_dummy), NPLASMA + 1);
+
+  if (plasmamain == NULL || photstoremain == NULL || matomphotstoremain == NULL)
+  {
+    Error ("copy_estimators_thread: There is a problem in allocating memory for the plasma structure\n");
+    exit (0);
+  }
+
+  memcpy (plasmamain, master_plasma, (NPLASMA + 1) * sizeof (plasma_dummy));
+
+  for (n = 0; n < NPLASMA + 1; n++)
+  {
+    xplasma = &plasmamain[n];
+
+    xplasma->ntot = xplasma->ntot_star = xplasma->ntot_bl = xplasma->ntot_disk = xplasma->ntot_wind = xplasma->ntot_agn = 0;
+    xplasma->nscat_es = xplasma->nscat_res = 0;
+    xplasma->nioniz = xplasma->n_ds = 0;
+
+    xplasma->j = xplasma->j_direct = xplasma->j_scatt = xplasma->ave_freq = xplasma->mean_ds = 0.0;
+    xplasma->ip = xplasma->ip_direct = xplasma->ip_scatt = xplasma->xi = 0.0;
+    xplasma->heat_tot = xplasma->heat_ff = xplasma->heat_comp = xplasma->heat_ind_comp = 0.0;
+    xplasma->heat_lines = xplasma->heat_photo = xplasma->heat_z = xplasma->heat_auger = 0.0;
+    xplasma->abs_tot = xplasma->abs_photo = xplasma->abs_auger = 0.0;
+    xplasma->kpkt_abs = 0.0;
+    xplasma->bf_simple_ionpool_in = xplasma->bf_simple_ionpool_out = 0.0;
+
+    for (i = 0; i < 3; i++)
+      xplasma->dmo_dt[i] = 0.0;
+
+    for (i = 0; i < NXBANDS; i++)
+    {
+      xplasma->xj[i] = xplasma->xave_freq[i] = xplasma->xsd_freq[i] = 0.0;
+      xplasma->nxtot[i] = 0;
+    }
+
+    if ((xplasma->ioniz = calloc (sizeof (double), nions)) == NULL
+        || (xplasma->heat_ion = calloc (sizeof (double), nions)) == NULL
+        || (xplasma->scatters = calloc (sizeof (int), nions)) == NULL || (xplasma->xscatters = calloc (sizeof (double), nions)) == NULL)
+    {
+      Error ("copy_estimators_thread: Error in allocating memory for estimators\n");
+      exit (0);
+    }
+  }
+
+  if (nlevels_macro == 0 && geo.nmacro == 0)
+  {
+    /* There are no macro atom estimators, so there is nothing to copy */
+    macromain = master_macro;
+    return (0);
+  }
+
+  if ((macromain = (MacroPtr) calloc (sizeof (macro_dummy), NPLASMA + 1)) == NULL)
+  {
+    Error ("copy_estimators_thread: There is a problem in allocating memory for the macro structure\n");
+    exit (0);
+  }
+
+  memcpy (macromain, master_macro, (NPLASMA + 1) * sizeof (macro_dummy));
+
+  for (n = 0; n < NPLASMA; n++)
+  {
+    mplasma = &macromain[n];
+
+    if ((mplasma->jbar = calloc (sizeof (double), size_Jbar_est)) == NULL
+        || (mplasma->gamma = calloc (sizeof (double), size_gamma_est)) == NULL
+        || (mplasma->gamma_e = calloc (sizeof (double), size_gamma_est)) == NULL
+        || (mplasma->alpha_st = calloc (sizeof (double), size_gamma_est)) == NULL
+        || (mplasma->alpha_st_e = calloc (sizeof (double), size_gamma_est)) == NULL
+        || (mplasma->matom_abs = calloc (sizeof (double), nlevels_macro)) == NULL)
+    {
+      Error ("copy_estimators_thread: Error in allocating memory for MA estimators\n");
+      exit (0);
+    }
+  }
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief      adds the MC estimators accumulated by the calling thread 
+ * into the master structures
+ *
+ * @param [in] PlasmaPtr  master_plasma   plasmamain of the master thread
+ * @param [in] MacroPtr  master_macro   macromain of the master thread
+ * @param [in] PhotStorePtr  master_photstore   photstoremain of the master thread
+ * @param [in] MatomPhotStorePtr  master_matomphotstore   matomphotstoremain of the master thread
+ * @return     Always returns 0
+ *
+ * @details
+ * This is the counterpart of copy_estimators_thread.  The estimators in 
+ * the copies belonging to the calling thread are summed into the master
+ * structures (or for the maximum and minimum frequencies, the larger or
+ * smaller value is kept), the copies are freed, and the thread's pointers 
+ * are set back to the master structures.
+ *
+ * The threads add their estimators one at a time.  The order in which they 
+ * do so is not fixed, so the sums can differ in the last few bits from one
+ * run to the next.
+ **********************************************************/
+
+int
+reduce_estimators_thread (master_plasma, master_macro, master_photstore, master_matomphotstore)
+     PlasmaPtr master_plasma;
+     MacroPtr master_macro;
+     PhotStorePtr master_photstore;
+     MatomPhotStorePtr master_matomphotstore;
+{
+  int n, i;
+  PlasmaPtr xplasma, xmaster;
+  MacroPtr mplasma, mmaster;
+
+#ifdef _OPENMP
+#pragma omp critical (reduce_estimators_thread)
+#endif
+  {
+    for (n = 0; n < NPLASMA + 1; n++)
+    {
+      xplasma = &plasmamain[n];
+      xmaster = &master_plasma[n];
+
+      xmaster->ntot += xplasma->ntot;
+      xmaster->ntot_star += xplasma->ntot_star;
+      xmaster->ntot_bl += xplasma->ntot_bl;
+      xmaster->ntot_disk += xplasma->ntot_disk;
+      xmaster->ntot_wind += xplasma->ntot_wind;
+      xmaster->ntot_agn += xplasma->ntot_agn;
+      xmaster->nscat_es += xplasma->nscat_es;
+      xmaster->nscat_res += xplasma->nscat_res;
+      xmaster->nioniz += xplasma->nioniz;
+      xmaster->n_ds += xplasma->n_ds;
+
+      xmaster->j += xplasma->j;
+      xmaster->j_direct += xplasma->j_direct;
+      xmaster->j_scatt += xplasma->j_scatt;
+      xmaster->ave_freq += xplasma->ave_freq;
+      xmaster->mean_ds += xplasma->mean_ds;
+      xmaster->ip += xplasma->ip;
+      xmaster->ip_direct += xplasma->ip_direct;
+      xmaster->ip_scatt += xplasma->ip_scatt;
+      xmaster->xi += xplasma->xi;
+      xmaster->heat_tot += xplasma->heat_tot;
+      xmaster->heat_ff += xplasma->heat_ff;
+      xmaster->heat_comp += xplasma->heat_comp;
+      xmaster->heat_ind_comp += xplasma->heat_ind_comp;
+      xmaster->heat_lines += xplasma->heat_lines;
+      xmaster->heat_photo += xplasma->heat_photo;
+      xmaster->heat_z += xplasma->heat_z;
+      xmaster->heat_auger += xplasma->heat_auger;
+      xmaster->abs_tot += xplasma->abs_tot;
+      xmaster->abs_photo += xplasma->abs_photo;
+      xmaster->abs_auger += xplasma->abs_auger;
+      xmaster->kpkt_abs += xplasma->kpkt_abs;
+      xmaster->bf_simple_ionpool_in += xplasma->bf_simple_ionpool_in;
+      xmaster->bf_simple_ionpool_out += xplasma->bf_simple_ionpool_out;
+
+      if (xplasma->max_freq > xmaster->max_freq)
+        xmaster->max_freq = xplasma->max_freq;
+
+      for (i = 0; i < 3; i++)
+        xmaster->dmo_dt[i] += xplasma->dmo_dt[i];
+
+      for (i = 0; i < NXBANDS; i++)
+      {
+        xmaster->xj[i] += xplasma->xj[i];
+        xmaster->xave_freq[i] += xplasma->xave_freq[i];
+        xmaster->xsd_freq[i] += xplasma->xsd_freq[i];
+        xmaster->nxtot[i] += xplasma->nxtot[i];
+        if (xplasma->fmin[i] < xmaster->fmin[i])
+          xmaster->fmin[i] = xplasma->fmin[i];
+        if (xplasma->fmax[i] > xmaster->fmax[i])
+          xmaster->fmax[i] = xplasma->fmax[i];
+      }
+
+      for (i = 0; i < nions; i++)
+      {
+        xmaster->ioniz[i] += xplasma->ioniz[i];
+        xmaster->heat_ion[i] += xplasma->heat_ion[i];
+        xmaster->scatters[i] += xplasma->scatters[i];
+        xmaster->xscatters[i] += xplasma->xscatters[i];
+      }
+    }
+
+    if (macromain != master_macro)
+    {
+      for (n = 0; n < NPLASMA; n++)
+      {
+        mplasma = &macromain[n];
+        mmaster = &master_macro[n];
+
+        for (i = 0; i < size_Jbar_est; i++)
+          mmaster->jbar[i] += mplasma->jbar[i];
+
+        for (i = 0; i < size_gamma_est; i++)
+        {
+          mmaster->gamma[i] += mplasma->gamma[i];
+          mmaster->gamma_e[i] += mplasma->gamma_e[i];
+          mmaster->alpha_st[i] += mplasma->alpha_st[i];
+          mmaster->alpha_st_e[i] += mplasma->alpha_st_e[i];
+        }
+
+        for (i = 0; i < nlevels_macro; i++)
+          mmaster->matom_abs[i] += mplasma->matom_abs[i];
+      }
+    }
+  }
+
+  /* Free the copies and point the thread back at the master structures */
+
+  for (n = 0; n < NPLASMA + 1; n++)
+  {
+    free (plasmamain[n].ioniz);
+    free (plasmamain[n].heat_ion);
+    free (plasmamain[n].scatters);
+    free (plasmamain[n].xscatters);
+  }
+  free (plasmamain);
+  free (photstoremain);
+  free (matomphotstoremain);
+
+  if (macromain != master_macro)
+  {
+    for (n = 0; n < NPLASMA; n++)
+    {
+      free (macromain[n].jbar);
+      free (macromain[n].gamma);
+      free (macromain[n].gamma_e);
+      free (macromain[n].alpha_st);
+      free (macromain[n].alpha_st_e);
+      free (macromain[n].matom_abs);
+    }
+    free (macromain);
+  }
+
+  plasmamain = master_plasma;
+  macromain = master_macro;
+  photstoremain = master_photstore;
+  matomphotstoremain = master_matomphotstore;
+
+  return (0);
+}
+
+
+
+/* The state of the division of a flight of photons into batches, see phot_batch_next */
+
+PhotPtr phot_batch_home;        /* The photons of this task */
+PhotPtr phot_batch_buffer = NULL;       /* Space for photons taken from another task */
+int phot_batch_size;            /* The number of photons in a full batch */
+int phot_batch_dynamic;         /* TRUE if the photons are shared dynamically between tasks */
+int phot_batch_task;            /* The task whose photons are being taken */
+int phot_batch_first, phot_batch_n;     /* The first photon and the number of photons of the current batch */
+int phot_batch_next_phot;       /* The next photon of this task which has not been claimed, exposed to the other tasks */
+long phot_batch_nown, phot_batch_nother;        /* The number of photons of this task, and of others, transported here */
+#ifdef MPI_ON
+MPI_Win phot_batch_counter_win, phot_batch_phot_win;
+#endif
+
+
+
+/**********************************************************/
+/**
+ * @brief      prepares to divide a flight of photons into batches
+ *
+ * @param [in] PhotPtr  p   The photons of this task
+ * @return     Always returns 0
+ *
+ * @details
+ * Normally each task transports the NPHOT photons it has generated, in
+ * a single batch.  If modes.dynamic_photons is set and there is more
+ * than one task, the photons are instead handed out in batches of
+ * NPHOT / NPHOT_BATCHES.  Each task first claims batches of its own
+ * photons, and when these are exhausted claims batches from the
+ * other tasks, so a task whose photons happen to be quick to transport
+ * helps those whose photons are slow.
+ *
+ * The next unclaimed photon of each task is kept in a counter which
+ * the other tasks read and increment with MPI one-sided operations, and
+ * the photons themselves are fetched from, and returned to, the task
+ * which generated them in the same way.  This must be called by all
+ * of the tasks.
+ *
+ * ### Notes ###
+ * The luminosity of the photons is not altered.  A photon carries the
+ * same weight whichever task transports it, and since the estimators
+ * and spectra of the tasks are added together (and divided by the
+ * number of tasks) at the end of a cycle, it does not matter which
+ * task a photon contributes to.  The photons are returned to the task
+ * which generated them, so that the spectra and checks which are made
+ * from the photons after transport are unchanged.
+ *
+ **********************************************************/
+
+int
+phot_batch_init (p)
+     PhotPtr p;
+{
+  phot_batch_home = p;
+  phot_batch_dynamic = FALSE;
+  phot_batch_size = NPHOT;
+  phot_batch_task = rank_global;
+  phot_batch_first = phot_batch_n = 0;
+  phot_batch_next_phot = 0;
+  phot_batch_nown = phot_batch_nother = 0;
+
+#ifdef MPI_ON
+  if (modes.dynamic_photons && np_mpi_global > 1)
+  {
+    phot_batch_dynamic = TRUE;
+    phot_batch_size = NPHOT / NPHOT_BATCHES;
+    if (phot_batch_size < 1)
+      phot_batch_size = 1;
+
+    if (phot_batch_buffer == NULL && (phot_batch_buffer = calloc (sizeof (p_dummy), phot_batch_size)) == NULL)
+    {
+      Error ("phot_batch_init: Could not allocate space for %d photons\n", phot_batch_size);
+      exit (0);
+    }
+
+    MPI_Win_create (&phot_batch_next_phot, sizeof (int), sizeof (int), MPI_INFO_NULL, MPI_COMM_WORLD, &phot_batch_counter_win);
+    MPI_Win_create (p, (MPI_Aint) NPHOT * sizeof (p_dummy), sizeof (p_dummy), MPI_INFO_NULL, MPI_COMM_WORLD, &phot_batch_phot_win);
+    MPI_Win_lock_all (0, phot_batch_counter_win);
+    MPI_Win_lock_all (0, phot_batch_phot_win);
+
+    /* No task may claim photons until every task has reset its counter */
+    MPI_Barrier (MPI_COMM_WORLD);
+  }
+#endif
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      finds the next batch of photons to be transported by this task
+ *
+ * @param [out] PhotPtr *  pbatch   The first photon of the batch
+ * @param [out] int *  nfirst   The number of the first photon of the batch amongst the photons of the task which generated it
+ * @param [out] int *  nbatch   The number of photons in the batch
+ * @return     TRUE if there is a batch to transport, FALSE if all the photons have been claimed
+ *
+ * @details
+ * When the photons are not shared between tasks, the first call returns
+ * all of the photons of this task, and the second returns FALSE.
+ *
+ * Otherwise the next batch of this task's photons is claimed, or if all
+ * of them have been claimed, the next batch of another task's photons,
+ * which is copied into phot_batch_buffer.  phot_batch_done must be called
+ * when a batch has been transported.
+ *
+ * ### Notes ###
+ * With OpenMP this is called by one thread only.
+ *
+ **********************************************************/
+
+int
+phot_batch_next (pbatch, nfirst, nbatch)
+     PhotPtr *pbatch;
+     int *nfirst, *nbatch;
+{
+#ifdef MPI_ON
+  int nadd;
+#endif
+
+  if (!phot_batch_dynamic)
+  {
+    if (phot_batch_first > 0 || phot_batch_n > 0)
+      return (FALSE);
+    *pbatch = phot_batch_home;
+    *nfirst = phot_batch_first = 0;
+    *nbatch = phot_batch_n = NPHOT;
+    phot_batch_nown += NPHOT;
+    return (TRUE);
+  }
+
+#ifdef MPI_ON
+  nadd = phot_batch_size;
+
+  while (TRUE)
+  {
+    MPI_Fetch_and_op (&nadd, &phot_batch_first, MPI_INT, phot_batch_task, 0, MPI_SUM, phot_batch_counter_win);
+    MPI_Win_flush (phot_batch_task, phot_batch_counter_win);
+
+    if (phot_batch_first < NPHOT)
+      break;
+
+    /* All the photons of this task have been claimed, so move on to the next */
+
+    phot_batch_task = (phot_batch_task + 1) % np_mpi_global;
+    if (phot_batch_task == rank_global)
+    {
+      phot_batch_n = 0;
+      return (FALSE);
+    }
+  }
+
+  phot_batch_n = NPHOT - phot_batch_first;
+  if (phot_batch_n > phot_batch_size)
+    phot_batch_n = phot_batch_size;
+
+  if (phot_batch_task == rank_global)
+  {
+    *pbatch = &phot_batch_home[phot_batch_first];
+    phot_batch_nown += phot_batch_n;
+  }
+  else
+  {
+    MPI_Get (phot_batch_buffer, phot_batch_n * sizeof (p_dummy), MPI_BYTE, phot_batch_task, phot_batch_first,
+             phot_batch_n * sizeof (p_dummy), MPI_BYTE, phot_batch_phot_win);
+    MPI_Win_flush (phot_batch_task, phot_batch_phot_win);
+    *pbatch = phot_batch_buffer;
+    phot_batch_nother += phot_batch_n;
+  }
+
+  *nfirst = phot_batch_first;
+  *nbatch = phot_batch_n;
+  return (TRUE);
+#else
+  return (FALSE);
+#endif
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      returns a batch of photons which has been transported to
+ * the task which generated it
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * Nothing needs to be done unless the batch was claimed from another
+ * task, in which case the transported photons are copied back to it.
+ *
+ **********************************************************/
+
+int
+phot_batch_done ()
+{
+#ifdef MPI_ON
+  if (phot_batch_dynamic && phot_batch_task != rank_global && phot_batch_n > 0)
+  {
+    MPI_Put (phot_batch_buffer, phot_batch_n * sizeof (p_dummy), MPI_BYTE, phot_batch_task, phot_batch_first,
+             phot_batch_n * sizeof (p_dummy), MPI_BYTE, phot_batch_phot_win);
+    MPI_Win_flush (phot_batch_task, phot_batch_phot_win);
+  }
+#endif
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      waits for all the photons of all the tasks to be transported
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * When the photons are shared between tasks, a task must not use its
+ * photons until any which other tasks have taken have been returned.
+ * This must be called by all of the tasks.
+ *
+ **********************************************************/
+
+int
+phot_batch_finish ()
+{
+#ifdef MPI_ON
+  if (phot_batch_dynamic)
+  {
+    MPI_Win_unlock_all (phot_batch_phot_win);
+    MPI_Win_unlock_all (phot_batch_counter_win);
+    MPI_Win_free (&phot_batch_phot_win);
+    MPI_Win_free (&phot_batch_counter_win);
+    MPI_Barrier (MPI_COMM_WORLD);
+
+    Log ("phot_batch_finish: Transported %ld photons of this task and %ld of other tasks\n", phot_batch_nown, phot_batch_nother);
+  }
+#endif
+
+  return (0);
+}
@@ -136,6 +136,12 @@ parse_command_line (argc, argv)
         j = i;
         Log ("Using a random seed in random number generator\n");
       }
+      else if (strcmp (argv[i], "--dynamic") == 0)
+      {
+        modes.dynamic_photons = 1;
+        j = i;
+        Log ("Sharing the photons of each cycle dynamically between MPI tasks\n");
+      }
       else if (strcmp (argv[i], "-z") == 0)
       {
         modes.zeus_connect = 1;
@@ -253,6 +259,8 @@ This program simulates radiative transfer in a (biconical) CV, YSO, quasar or (s
    --version	print out python version, commit hash and if there were files with uncommitted \n\
                 changes \n\
       --rseed   set the random number seed to be time based, rather than fixed. \n\
+    --dynamic   when running with MPI, let tasks which finish transporting their photons \n\
+                take batches of photons from tasks which have not \n\
 \n\
 (Certain other switches exist but these are largely diagnostic, or for special cases) \n\
 \n\
@@ -25,6 +25,26 @@
 ***********************************************************/
 double *reverb_path_bin;
 
+/**********************************************************/
+/** @var int wind_paths_reduced
+ * @brief	Whether the path histograms have been combined
+ *
+ * Set in wind_paths_reduce(), and unset by trans_phot() at the
+ * start of each flight of photons, so that the histograms of the
+ * processes are only combined once.  wind_paths_reduce() makes
+ * collective MPI calls, so the flag must change in the same way on
+ * every process: it is only changed at points which all of the
+ * processes reach, and not as photons are added to the histograms.
+ *
+ * ###Notes###
+ * 10/26	-	Written
+***********************************************************/
+int wind_paths_reduced = FALSE;
+
+/* The number of path bins combined at a time by wind_paths_reduce(), which bounds the
+   size of each MPI call and of the buffers it needs */
+#define WIND_PATHS_REDUCE_BLOCK 262144
+
 /**********************************************************/
 /** 
  * @brief	Allocates the arrays for a path histogram
@@ -49,21 +69,122 @@ wind_paths_constructor (WindPtr wind)
     exit (0);
   }
 
-  paths->ad_path_flux = (double *) calloc (sizeof (double), geo.reverb_path_bins);
-  paths->ai_path_num = (int *) calloc (sizeof (int), geo.reverb_path_bins);
-  paths->ad_path_flux_cent = (double *) calloc (sizeof (double), geo.reverb_path_bins);
-  paths->ai_path_num_cent = (int *) calloc (sizeof (int), geo.reverb_path_bins);
-  paths->ad_path_flux_disk = (double *) calloc (sizeof (double), geo.reverb_path_bins);
-  paths->ai_path_num_disk = (int *) calloc (sizeof (int), geo.reverb_path_bins);
-  paths->ad_path_flux_wind = (double *) calloc (sizeof (double), geo.reverb_path_bins);
-  paths->ai_path_num_wind = (int *) calloc (sizeof (int), geo.reverb_path_bins);
+  /* The bins are allocated as photons arrive in them, by wind_paths_bin() */
+  paths->i_bins = paths->i_bins_alloc = 0;
+  return (paths);
+}
 
-  if (paths->ad_path_flux == NULL || paths->ai_path_num_wind == NULL)
-  {
-    Error ("wind_paths_constructor: Could not allocate memory for cell %d bins\n", wind->nwind);
-    exit (0);
+/**********************************************************/
+/** 
+ * @brief	Finds the path bin a path falls in
+ *
+ * @param [in] r_path		Path length
+ * @return 					Index of the bin in reverb_path_bin, or -1 if outside them
+ *
+ * Bisects the bin boundaries.  A path on the boundary between
+ * two bins is put in the lower one.
+ *
+ * ###Notes###
+ * 10/26	-	Written
+***********************************************************/
+int
+wind_paths_find_bin (double r_path)
+{
+  int i_lo, i_hi, i_mid;
+
+  if (r_path < reverb_path_bin[0] || r_path > reverb_path_bin[geo.reverb_path_bins])
+    return (-1);
+
+  i_lo = 0;
+  i_hi = geo.reverb_path_bins;
+  while (i_hi - i_lo > 1)
+  {                             //reverb_path_bin[i_lo] <= r_path <= reverb_path_bin[i_hi]
+    i_mid = (i_lo + i_hi) / 2;
+    if (r_path > reverb_path_bin[i_mid])
+      i_lo = i_mid;
+    else
+      i_hi = i_mid;
   }
-  return (paths);
+  return (i_lo);
+}
+
+/**********************************************************/
+/** 
+ * @brief	Finds or adds a path bin in a path histogram
+ *
+ * @param [in,out] paths	Path histogram
+ * @param [in] i_bin		Index of the bin in reverb_path_bin
+ * @param [in] i_add		TRUE to add the bin if it is not stored
+ * @return 					Index of the stored bin, or -1 if it is not stored and i_add is FALSE
+ *
+ * The stored bins are kept in order, so they are bisected.  A new
+ * bin is inserted empty, and the arrays are doubled in size when
+ * they are full.
+ *
+ * ###Notes###
+ * 10/26	-	Written
+***********************************************************/
+int
+wind_paths_bin (Wind_Paths_Ptr paths, int i_bin, int i_add)
+{
+  int i_lo, i_hi, i_mid, n_move;
+
+  i_lo = 0;
+  i_hi = paths->i_bins;
+  while (i_lo < i_hi)
+  {                             //Find the first stored bin which is not below i_bin
+    i_mid = (i_lo + i_hi) / 2;
+    if (paths->ai_path_bin[i_mid] < i_bin)
+      i_lo = i_mid + 1;
+    else
+      i_hi = i_mid;
+  }
+  if (i_lo < paths->i_bins && paths->ai_path_bin[i_lo] == i_bin)
+    return (i_lo);
+  if (!i_add)
+    return (-1);
+
+  if (paths->i_bins == paths->i_bins_alloc)
+  {                             //Make more space
+    paths->i_bins_alloc = (paths->i_bins_alloc > 0) ? 2 * paths->i_bins_alloc : 8;
+    paths->ai_path_bin = (int *) realloc (paths->ai_path_bin, sizeof (int) * paths->i_bins_alloc);
+    paths->ad_path_flux = (double *) realloc (paths->ad_path_flux, sizeof (double) * paths->i_bins_alloc);
+    paths->ad_path_flux_cent = (double *) realloc (paths->ad_path_flux_cent, sizeof (double) * paths->i_bins_alloc);
+    paths->ad_path_flux_disk = (double *) realloc (paths->ad_path_flux_disk, sizeof (double) * paths->i_bins_alloc);
+    paths->ad_path_flux_wind = (double *) realloc (paths->ad_path_flux_wind, sizeof (double) * paths->i_bins_alloc);
+    paths->ai_path_num = (int *) realloc (paths->ai_path_num, sizeof (int) * paths->i_bins_alloc);
+    paths->ai_path_num_cent = (int *) realloc (paths->ai_path_num_cent, sizeof (int) * paths->i_bins_alloc);
+    paths->ai_path_num_disk = (int *) realloc (paths->ai_path_num_disk, sizeof (int) * paths->i_bins_alloc);
+    paths->ai_path_num_wind = (int *) realloc (paths->ai_path_num_wind, sizeof (int) * paths->i_bins_alloc);
+
+    if (paths->ai_path_bin == NULL || paths->ad_path_flux == NULL || paths->ad_path_flux_cent == NULL
+        || paths->ad_path_flux_disk == NULL || paths->ad_path_flux_wind == NULL || paths->ai_path_num == NULL
+        || paths->ai_path_num_cent == NULL || paths->ai_path_num_disk == NULL || paths->ai_path_num_wind == NULL)
+    {
+      Error ("wind_paths_bin: Could not allocate memory for %d bins\n", paths->i_bins_alloc);
+      exit (0);
+    }
+  }
+
+  n_move = paths->i_bins - i_lo;
+  if (n_move > 0)
+  {                             //Move the later bins up to make room
+    memmove (&paths->ai_path_bin[i_lo + 1], &paths->ai_path_bin[i_lo], sizeof (int) * n_move);
+    memmove (&paths->ad_path_flux[i_lo + 1], &paths->ad_path_flux[i_lo], sizeof (double) * n_move);
+    memmove (&paths->ad_path_flux_cent[i_lo + 1], &paths->ad_path_flux_cent[i_lo], sizeof (double) * n_move);
+    memmove (&paths->ad_path_flux_disk[i_lo + 1], &paths->ad_path_flux_disk[i_lo], sizeof (double) * n_move);
+    memmove (&paths->ad_path_flux_wind[i_lo + 1], &paths->ad_path_flux_wind[i_lo], sizeof (double) * n_move);
+    memmove (&paths->ai_path_num[i_lo + 1], &paths->ai_path_num[i_lo], sizeof (int) * n_move);
+    memmove (&paths->ai_path_num_cent[i_lo + 1], &paths->ai_path_num_cent[i_lo], sizeof (int) * n_move);
+    memmove (&paths->ai_path_num_disk[i_lo + 1], &paths->ai_path_num_disk[i_lo], sizeof (int) * n_move);
+    memmove (&paths->ai_path_num_wind[i_lo + 1], &paths->ai_path_num_wind[i_lo], sizeof (int) * n_move);
+  }
+
+  paths->ai_path_bin[i_lo] = i_bin;
+  paths->ad_path_flux[i_lo] = paths->ad_path_flux_cent[i_lo] = paths->ad_path_flux_disk[i_lo] = paths->ad_path_flux_wind[i_lo] = 0.0;
+  paths->ai_path_num[i_lo] = paths->ai_path_num_cent[i_lo] = paths->ai_path_num_disk[i_lo] = paths->ai_path_num_wind[i_lo] = 0;
+  paths->i_bins++;
+  return (i_lo);
 }
 
 /**********************************************************/
@@ -211,7 +332,8 @@ wind_paths_init (WindPtr wind)
 int
 line_paths_add_phot (WindPtr wind, PhotPtr pp, int *nres)
 {
-  int i, j;
+  int i, j, k;
+  Wind_Paths_Ptr paths;
 
   if (geo.reverb_disk == REV_DISK_IGNORE && pp->origin_orig == PTYPE_DISK)
     return (0);
@@ -222,34 +344,32 @@ line_paths_add_phot (WindPtr wind, PhotPtr pp, int *nres)
   {                             //Iterate over each tracked line
     if (lin_ptr[*nres]->where_in_list == geo.reverb_line[i])
     {                           //If the passed line exists within the tracked line array
-      for (j = 0; j < geo.reverb_path_bins; j++)
-      {                         //Iterate over the path bins
-        if (pp->path >= reverb_path_bin[j] && pp->path <= reverb_path_bin[j + 1])
-        {                       //If the photon's path lies in this bin's bounds, record it
-          //printf("DEBUG: Added to line %d in cell %d - path %g weight %g\n",geo.reverb_line[i], wind->nwind, pp->path, pp->w);
-          wind->line_paths[i]->ad_path_flux[j] += pp->w;
-          wind->line_paths[i]->ai_path_num[j]++;
-          switch (pp->origin)
-          {
-          case PTYPE_STAR:
-          case PTYPE_AGN:
-          case PTYPE_BL:
-            wind->line_paths[i]->ad_path_flux_cent[j] += pp->w;
-            wind->line_paths[i]->ai_path_num_cent[j]++;
-            break;
-          case PTYPE_DISK:
-            wind->line_paths[i]->ad_path_flux_disk[j] += pp->w;
-            wind->line_paths[i]->ai_path_num_disk[j]++;
-            break;
-          default:
-            wind->line_paths[i]->ad_path_flux_wind[j] += pp->w;
-            wind->line_paths[i]->ai_path_num_wind[j]++;
-            break;
-          }
-          //Exit out of this loop
-          return (0);
+      if ((j = wind_paths_find_bin (pp->path)) >= 0)
+      {                         //If the photon's path lies in a bin's bounds, record it
+        paths = wind->line_paths[i];
+        k = wind_paths_bin (paths, j, TRUE);
+        paths->ad_path_flux[k] += pp->w;
+        paths->ai_path_num[k]++;
+        switch (pp->origin)
+        {
+        case PTYPE_STAR:
+        case PTYPE_AGN:
+        case PTYPE_BL:
+          paths->ad_path_flux_cent[k] += pp->w;
+          paths->ai_path_num_cent[k]++;
+          break;
+        case PTYPE_DISK:
+          paths->ad_path_flux_disk[k] += pp->w;
+          paths->ai_path_num_disk[k]++;
+          break;
+        default:
+          paths->ad_path_flux_wind[k] += pp->w;
+          paths->ai_path_num_wind[k]++;
+          break;
         }
       }
+      //Exit out of this loop
+      return (0);
     }
   }
   return (0);
@@ -272,35 +392,32 @@ line_paths_add_phot (WindPtr wind, PhotPtr pp, int *nres)
 int
 wind_paths_add_phot (WindPtr wind, PhotPtr pp)
 {
-  int i;
+  int i, k;
   if (geo.reverb_disk == REV_DISK_IGNORE && pp->origin_orig == PTYPE_DISK)
     return (0);
 
-  for (i = 0; i < geo.reverb_path_bins; i++)
-  {                             //For each bin
-    if (pp->path >= reverb_path_bin[i] && pp->path <= reverb_path_bin[i + 1])
-    {                           //If the path falls within its bounds, add photon weight
-      wind->paths->ad_path_flux[i] += pp->w;
-      wind->paths->ai_path_num[i]++;
+  if ((i = wind_paths_find_bin (pp->path)) >= 0)
+  {                             //If the path falls within the bins, add photon weight
+    k = wind_paths_bin (wind->paths, i, TRUE);
+    wind->paths->ad_path_flux[k] += pp->w;
+    wind->paths->ai_path_num[k]++;
 
-      switch (pp->origin)
-      {
-      case PTYPE_STAR:
-      case PTYPE_AGN:
-      case PTYPE_BL:
-        wind->paths->ad_path_flux_cent[i] += pp->w;
-        wind->paths->ai_path_num_cent[i]++;
-        break;
-      case PTYPE_DISK:
-        wind->paths->ad_path_flux_disk[i] += pp->w;
-        wind->paths->ai_path_num_disk[i]++;
-        break;
-      default:
-        wind->paths->ad_path_flux_wind[i] += pp->w;
-        wind->paths->ai_path_num_wind[i]++;
-        break;
-      }
-      return (0);
+    switch (pp->origin)
+    {
+    case PTYPE_STAR:
+    case PTYPE_AGN:
+    case PTYPE_BL:
+      wind->paths->ad_path_flux_cent[k] += pp->w;
+      wind->paths->ai_path_num_cent[k]++;
+      break;
+    case PTYPE_DISK:
+      wind->paths->ad_path_flux_disk[k] += pp->w;
+      wind->paths->ai_path_num_disk[k]++;
+      break;
+    default:
+      wind->paths->ad_path_flux_wind[k] += pp->w;
+      wind->paths->ai_path_num_wind[k]++;
+      break;
     }
   }
   return (0);
@@ -341,28 +458,32 @@ simple_paths_gen_phot (PhotPtr pp)
  * ###Notes###
  * 26/2/15	-	Written by SWM
  * 24/7/15	-	Removed frequency
+ * 10/26	-	The bin is found by bisecting the cumulative
+ * 				distribution made by wind_paths_evaluate_single()
 ***********************************************************/
 double
 r_draw_from_path_histogram (Wind_Paths_Ptr PathPtr)
 {
-  double r_rand, r_total, r_bin_min, r_bin_rand, r_path, r_bin_max;
-  int i_path = -1;
+  double r_rand, r_bin_min, r_bin_rand, r_path, r_bin_max;
+  int i_lo, i_hi, i_mid;
 
-  r_total = 0.0;
-//  r_rand = PathPtr->d_flux * rand () / MAXRAND; DONE
-  r_rand = PathPtr->d_flux * random_number (0.0, 1.0);
-  i_path = -1;
+  r_rand = random_number (0.0, 1.0);
 
-  //printf("DEBUG: r_rand %g out of total %g\n",r_rand, PathPtr->d_flux);
-  while (r_rand > r_total)
+  //Find the first stored bin whose cumulative fraction of the flux exceeds r_rand
+  i_lo = 0;
+  i_hi = PathPtr->i_bins - 1;
+  while (i_lo < i_hi)
   {
-    r_total += PathPtr->ad_path_flux[++i_path];
+    i_mid = (i_lo + i_hi) / 2;
+    if (PathPtr->ad_path_cdf[i_mid] > r_rand)
+      i_hi = i_mid;
+    else
+      i_lo = i_mid + 1;
   }
 
   //Assign photon path to a random position within the bin.
-  r_bin_min = reverb_path_bin[i_path - 1];
-  r_bin_max = reverb_path_bin[i_path];
-//  r_bin_rand = (rand () / MAXRAND) * (r_bin_max - r_bin_min); DONE
+  r_bin_min = reverb_path_bin[PathPtr->ai_path_bin[i_lo]];
+  r_bin_max = reverb_path_bin[PathPtr->ai_path_bin[i_lo] + 1];
   r_bin_rand = random_number (0.0, 1.0) * (r_bin_max - r_bin_min);
   r_path = r_bin_min + r_bin_rand;
   return (r_path);
@@ -495,21 +616,220 @@ int
 wind_paths_evaluate_single (Wind_Paths_Ptr paths)
 {
   int i;
+  double r_total;
   paths->d_flux = 0.0;
   paths->d_path = 0.0;
   paths->i_num = 0;
 
-  for (i = 0; i < geo.reverb_path_bins; i++)
+  for (i = 0; i < paths->i_bins; i++)
   {                             //For each path bin, add its contribution to total flux & avg path
     paths->d_flux += paths->ad_path_flux[i];
     paths->i_num += paths->ai_path_num[i];
-    paths->d_path += paths->ad_path_flux[i] * (reverb_path_bin[i] + reverb_path_bin[i + 1]) / 2.0;
+    paths->d_path += paths->ad_path_flux[i] * (reverb_path_bin[paths->ai_path_bin[i]] + reverb_path_bin[paths->ai_path_bin[i] + 1]) / 2.0;
   }
 
   //If there was any data in this cell, calculate avg. path
   if (paths->i_num > 0)
     paths->d_path /= paths->d_flux;
 
+  //Make the cumulative distribution of the flux, from which paths are drawn
+  free (paths->ad_path_cdf);
+  paths->ad_path_cdf = NULL;
+  if (paths->i_bins > 0)
+  {
+    if ((paths->ad_path_cdf = (double *) calloc (sizeof (double), paths->i_bins)) == NULL)
+    {
+      Error ("wind_paths_evaluate_single: Could not allocate memory for %d bins\n", paths->i_bins);
+      exit (0);
+    }
+    r_total = 0.0;
+    for (i = 0; i < paths->i_bins; i++)
+    {
+      r_total += paths->ad_path_flux[i];
+      paths->ad_path_cdf[i] = (paths->d_flux > 0.0) ? r_total / paths->d_flux : (i + 1.0) / paths->i_bins;
+    }
+    paths->ad_path_cdf[paths->i_bins - 1] = 1.0;
+  }
+
+  return (0);
+}
+
+
+/****************************************************************/
+/** 
+ * @brief	Combines the path histograms of all the processes
+ *
+ * @param [in,out] wind	Wind whose histograms are combined
+ * @return 				0
+ *
+ * The histograms are combined a block at a time, by
+ * wind_paths_reduce_block(), so that the buffers each process
+ * needs are limited by the size of a block rather than growing
+ * with the number of processes or of cells.  A block holds as
+ * many histograms as there are path bins in 
+ * WIND_PATHS_REDUCE_BLOCK.  All processes end up with the same
+ * histograms.
+ *
+ * ###Notes###
+ * 10/26	-	Written
+*****************************************************************/
+int
+wind_paths_reduce (WindPtr wind)
+{
+#ifdef MPI_ON
+  int i, j, n_hist, n_block, n_paths;
+  Wind_Paths_Ptr *a_paths;
+
+  n_hist = 1 + geo.reverb_lines;
+  n_block = WIND_PATHS_REDUCE_BLOCK / geo.reverb_path_bins;
+  if (n_block < 1)
+    n_block = 1;
+
+  if ((a_paths = (Wind_Paths_Ptr *) calloc (sizeof (Wind_Paths_Ptr), n_block)) == NULL)
+  {
+    Error ("wind_paths_reduce: Could not allocate memory for a block of %d histograms\n", n_block);
+    exit (0);
+  }
+
+  /* Every process has the same cells in the wind, so the blocks are the same for all of them */
+  n_paths = 0;
+  for (i = 0; i < geo.ndim2; i++)
+  {
+    if (wind[i].inwind >= 0)
+    {
+      for (j = 0; j < n_hist; j++)
+      {
+        a_paths[n_paths++] = (j == 0) ? wind[i].paths : wind[i].line_paths[j - 1];
+        if (n_paths == n_block)
+        {
+          wind_paths_reduce_block (a_paths, n_paths);
+          n_paths = 0;
+        }
+      }
+    }
+  }
+  if (n_paths > 0)
+    wind_paths_reduce_block (a_paths, n_paths);
+
+  free (a_paths);
+#endif
+
+  wind_paths_reduced = TRUE;
+  return (0);
+}
+
+
+/****************************************************************/
+/** 
+ * @brief	Combines a block of path histograms across all the processes
+ *
+ * @param [in,out] a_paths	The histograms in the block
+ * @param [in] n_paths		The number of histograms in the block
+ * @return 				0
+ *
+ * The processes first agree which bins of each histogram have
+ * been hit by any of them, by taking the maximum of a flag for
+ * each bin.  Each then packs its values for those bins, with
+ * zeros for the ones it has not hit, into a buffer which is 
+ * summed across the processes, and rebuilds the histograms from
+ * the sums.  Only the bins which have been hit by some process
+ * are sent.
+ *
+ * ###Notes###
+ * 10/26	-	Written
+*****************************************************************/
+int
+wind_paths_reduce_block (Wind_Paths_Ptr * a_paths, int n_paths)
+{
+#ifdef MPI_ON
+  int i, k, i_bin, n_bins;
+  long n_flag, n_union, l;
+  int *ai_flag;
+  double *ad_buf, *ad_ptr;
+  Wind_Paths_Ptr paths;
+
+  n_bins = geo.reverb_path_bins;
+  n_flag = (long) n_paths * n_bins;     //No more than WIND_PATHS_REDUCE_BLOCK, unless one histogram has more bins
+
+  if ((ai_flag = (int *) calloc (sizeof (int), n_flag)) == NULL)
+  {
+    Error ("wind_paths_reduce_block: Could not allocate memory for %ld flags\n", n_flag);
+    exit (0);
+  }
+
+  for (i = 0; i < n_paths; i++)
+  {
+    paths = a_paths[i];
+    for (k = 0; k < paths->i_bins; k++)
+      ai_flag[(long) i * n_bins + paths->ai_path_bin[k]] = 1;
+  }
+  MPI_Allreduce (MPI_IN_PLACE, ai_flag, (int) n_flag, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+  n_union = 0;
+  for (l = 0; l < n_flag; l++)
+    n_union += ai_flag[l];
+
+  /* Eight values for each bin: the four fluxes, then the four numbers of photons */
+  if ((ad_buf = (double *) calloc (sizeof (double), 8 * n_union + 1)) == NULL)
+  {
+    Error ("wind_paths_reduce_block: Could not allocate memory for %ld bins\n", n_union);
+    exit (0);
+  }
+
+  ad_ptr = ad_buf;
+  for (i = 0; i < n_paths; i++)
+  {
+    paths = a_paths[i];
+    k = 0;                      //The stored bins are in order, so step through them as the flags are
+    for (i_bin = 0; i_bin < n_bins; i_bin++)
+    {
+      if (ai_flag[(long) i * n_bins + i_bin])
+      {
+        if (k < paths->i_bins && paths->ai_path_bin[k] == i_bin)
+        {
+          ad_ptr[0] = paths->ad_path_flux[k];
+          ad_ptr[1] = paths->ad_path_flux_cent[k];
+          ad_ptr[2] = paths->ad_path_flux_disk[k];
+          ad_ptr[3] = paths->ad_path_flux_wind[k];
+          ad_ptr[4] = paths->ai_path_num[k];
+          ad_ptr[5] = paths->ai_path_num_cent[k];
+          ad_ptr[6] = paths->ai_path_num_disk[k];
+          ad_ptr[7] = paths->ai_path_num_wind[k];
+          k++;
+        }
+        ad_ptr += 8;
+      }
+    }
+  }
+  MPI_Allreduce (MPI_IN_PLACE, ad_buf, (int) (8 * n_union), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+  ad_ptr = ad_buf;
+  for (i = 0; i < n_paths; i++)
+  {
+    paths = a_paths[i];
+    paths->i_bins = 0;          //The bins are added back in order, so they are appended
+    for (i_bin = 0; i_bin < n_bins; i_bin++)
+    {
+      if (ai_flag[(long) i * n_bins + i_bin])
+      {
+        k = wind_paths_bin (paths, i_bin, TRUE);
+        paths->ad_path_flux[k] = ad_ptr[0];
+        paths->ad_path_flux_cent[k] = ad_ptr[1];
+        paths->ad_path_flux_disk[k] = ad_ptr[2];
+        paths->ad_path_flux_wind[k] = ad_ptr[3];
+        paths->ai_path_num[k] = (int) ad_ptr[4];
+        paths->ai_path_num_cent[k] = (int) ad_ptr[5];
+        paths->ai_path_num_disk[k] = (int) ad_ptr[6];
+        paths->ai_path_num_wind[k] = (int) ad_ptr[7];
+        ad_ptr += 8;
+      }
+    }
+  }
+
+  free (ad_buf);
+  free (ai_flag);
+#endif
+
   return (0);
 }
 
@@ -533,6 +853,12 @@ int
 wind_paths_evaluate (WindPtr wind, int i_rank)
 {
   int i, j;
+
+  if (!wind_paths_reduced)
+  {                             //Combine the histograms of all the processes
+    wind_paths_reduce (wind);
+  }
+
   for (i = 0; i < geo.ndim2; i++)
   {                             //For each cell in the wind
     if (wind[i].inwind >= 0)
@@ -583,7 +909,7 @@ wind_paths_dump (WindPtr wind, int rank_global)
 {
   FILE *fopen (), *fptr;
   char c_file[LINELENGTH];
-  int j, k;
+  int i, j, k;
 
   //Setup file name and open the file
   sprintf (c_file, "%s.wind_paths_%d.%d.csv", files.root, wind->nwind, rank_global);
@@ -603,17 +929,23 @@ wind_paths_dump (WindPtr wind, int rank_global)
   fprintf (fptr, "\n");
 
   for (k = 0; k < geo.reverb_path_bins; k++)
-  {                             //For each path bin, print the 'wind' weight 
-    fprintf (fptr, "%g, %g, %g, %g, %g", reverb_path_bin[k],
-             wind->paths->ad_path_flux[k],
-             wind->paths->ad_path_flux_cent[k], wind->paths->ad_path_flux_disk[k], wind->paths->ad_path_flux_wind[k]);
+  {                             //For each path bin, print the 'wind' weight, which is zero if the bin is not stored
+    if ((i = wind_paths_bin (wind->paths, k, FALSE)) >= 0)
+      fprintf (fptr, "%g, %g, %g, %g, %g", reverb_path_bin[k],
+               wind->paths->ad_path_flux[i],
+               wind->paths->ad_path_flux_cent[i], wind->paths->ad_path_flux_disk[i], wind->paths->ad_path_flux_wind[i]);
+    else
+      fprintf (fptr, "%g, %g, %g, %g, %g", reverb_path_bin[k], 0.0, 0.0, 0.0, 0.0);
 
     for (j = 0; j < geo.reverb_lines; j++)
     {                           //For each tracked line, print the weight in this bin
-      fprintf (fptr, ", %g, %g, %g, %g",
-               wind->line_paths[j]->ad_path_flux[k],
-               wind->line_paths[j]->ad_path_flux_cent[k],
-               wind->line_paths[j]->ad_path_flux_disk[k], wind->line_paths[j]->ad_path_flux_wind[k]);
+      if ((i = wind_paths_bin (wind->line_paths[j], k, FALSE)) >= 0)
+        fprintf (fptr, ", %g, %g, %g, %g",
+                 wind->line_paths[j]->ad_path_flux[i],
+                 wind->line_paths[j]->ad_path_flux_cent[i],
+                 wind->line_paths[j]->ad_path_flux_disk[i], wind->line_paths[j]->ad_path_flux_wind[i]);
+      else
+        fprintf (fptr, ", %g, %g, %g, %g", 0.0, 0.0, 0.0, 0.0);
     }
     fprintf (fptr, "\n");
   }
@@ -649,7 +981,7 @@ wind_paths_output_dump (WindPtr wind, int i_rank)
 
     for (d = 0; d < geo.ndomain; d++)
     {                           //For each domain, check if this position is within it
-      n = where_in_grid (d, x);
+      n = where_in_grid (NULL, d, x);
       if (n >= 0)
       {                         //If it is, then dump the delay information 
         wind_paths_dump (&wind[n], i_rank);
@@ -137,7 +137,14 @@ get_matom_f (mode)
 
 
 
-    Log ("Calculating macro-atom and k-packet emissivities- this might take a while...\n");
+    if (geo.matom_emiss_method == MATOM_EMISS_DETERMINISTIC)
+    {
+      Log ("Calculating macro-atom and k-packet emissivities directly from the macro-atom rates\n");
+    }
+    else
+    {
+      Log ("Calculating macro-atom and k-packet emissivities- this might take a while...\n");
+    }
     Log ("Number of macro-atom levels: %d\n", nlevels_macro);
 
     /* For MPI parallelisation, the following loop will be distributed over multiple tasks. 
@@ -186,6 +193,18 @@ get_matom_f (mode)
         Log ("Calculating macro atom emissivity for macro atom %7d of %7d or %6.3f per cent\n", n, my_nmax, n * 100. / my_nmax);
 #endif
 
+      /* If requested, find the emissivities directly from the rates.  The Monte Carlo
+         calculation is only used if this fails */
+
+      if (geo.matom_emiss_method == MATOM_EMISS_DETERMINISTIC)
+      {
+        if (matom_emiss_direct (&plasmamain[n]) == 0)
+        {
+          continue;
+        }
+        Error ("get_matom_f: Could not find the emissivities of cell %d directly, so following packets instead\n", n);
+      }
+
       for (m = 0; m < nlevels_macro + 1; m++)
       {
         if ((m == nlevels_macro && plasmamain[n].kpkt_abs > 0) || (m < nlevels_macro && macromain[n].matom_abs[m] > 0))
@@ -464,6 +483,321 @@ get_matom_f (mode)
 /* All done. */
 
 
+
+/**********************************************************/
+/** 
+ * @brief      calculates the macro atom and k-packet emissivities of a cell
+ *        directly from the macro atom jumping and emission probabilities
+ *
+ * @param [in] PlasmaPtr  xplasma   the plasma cell of interest
+ * @return     0 on success, otherwise the error returned by solve_matrix, in which
+ *        case the emissivities of the cell are left unchanged
+ *
+ * @details
+ * This is an alternative to following macro atom and k-packet chains through
+ * macro_gov in get_matom_f, and gives the same emissivities without Monte Carlo noise.
+ *
+ * The levels of the macro atoms and the k-packet pool of the cell are treated
+ * as the states of an absorbing Markov chain.  The probabilities of moving from
+ * one state to another are those used by matom (see matom_prbs) and kpkt (see
+ * fill_kpkt_rates), and a state is left for good when an r-packet is made.  If
+ * b is the energy absorbed by each state (matom_abs and kpkt_abs), and Q is the
+ * matrix of the probabilities of going from one state to another, the energy
+ * passing through each state, x, satisfies
+ *
+ *    (I - Q^T) x = b
+ *
+ * The emissivity of each state is then x times the probability that an r-packet
+ * made in that state lies in the frequency range of the spectrum.
+ *
+ * ### Notes ###
+ * Only the states which can be reached from those which absorb energy are
+ * included in the matrix, which is solved with solve_matrix.  As in the Monte
+ * Carlo calculation, r-packets emitted by a macro atom level contribute to
+ * matom_emiss, and those made when a k-packet is destroyed to kpkt_emiss.
+ *
+ **********************************************************/
+
+int
+matom_emiss_direct (xplasma)
+     PlasmaPtr xplasma;
+{
+  double jprbs[2 * (NBBJUMPS + NBFJUMPS)];
+  double eprbs[NBBJUMPS + NBFJUMPS];
+  double pjnorm, penorm, ptot, cnorm;
+  double rad_rate, coll_rate, prad;
+  double freqmin, freqmax, f1, f2;
+  double total_abs;
+  double *q, *r, *a_data, *b_data, *x;
+  int *reached, *indx, *stack;
+  int nstate, kstate, nrows, nstack;
+  int i, j, n, nchan, nbbd, nbfd, nbbu, nbfu;
+  int ierr;
+  struct lines *line_ptr;
+  struct topbase_phot *cont_ptr;
+  MacroPtr mplasma;
+  WindPtr one;
+
+  mplasma = &macromain[xplasma->nplasma];
+  one = &wmain[xplasma->nwind];
+
+  /* The states are the macro atom levels followed by the k-packet pool */
+  nstate = nlevels_macro + 1;
+  kstate = nlevels_macro;
+
+  q = calloc (sizeof (double), nstate * nstate);
+  r = calloc (sizeof (double), nstate);
+  reached = calloc (sizeof (int), nstate);
+  indx = calloc (sizeof (int), nstate);
+  stack = calloc (sizeof (int), nstate);
+
+  if (q == NULL || r == NULL || reached == NULL || indx == NULL || stack == NULL)
+  {
+    Error ("matom_emiss_direct: Could not allocate memory for cell %d\n", xplasma->nplasma);
+    exit (0);
+  }
+
+  /* First the macro atom levels.  q[i*nstate+j] is the probability of going from state i to
+     state j, and r[i] is the probability that state i makes an r-packet in the spectral range */
+
+  for (i = 0; i < nlevels_macro; i++)
+  {
+    matom_prbs (xplasma, i, jprbs, eprbs, &pjnorm, &penorm);
+
+    if ((ptot = pjnorm + penorm) <= 0.0)
+    {
+      if (mplasma->matom_abs[i] > 0.0)
+      {
+        Error ("matom_emiss_direct: macro atom level %d in cell %d has no way out\n", i, xplasma->nplasma);
+      }
+      continue;
+    }
+
+    nbbd = config[i].n_bbd_jump;
+    nbfd = config[i].n_bfd_jump;
+    nbbu = config[i].n_bbu_jump;
+    nbfu = config[i].n_bfu_jump;
+
+    for (n = 0; n < nbbd; n++)
+    {
+      line_ptr = &line[config[i].bbd_jump[n]];
+      q[i * nstate + line_ptr->nconfigl] += jprbs[n] / ptot;
+
+      if (eprbs[n] > 0.0)
+      {
+        /* As in matom, decide between radiative and collisional deactivation */
+        rad_rate = a21 (line_ptr) * p_escape (line_ptr, xplasma);
+        coll_rate = q21 (line_ptr, xplasma->t_e) * xplasma->ne;
+        if (coll_rate < 0)
+        {
+          coll_rate = 0.;
+        }
+        prad = rad_rate / (rad_rate + coll_rate);
+
+        if (line_ptr->freq > em_rnge.fmin && line_ptr->freq < em_rnge.fmax)
+        {
+          r[i] += prad * eprbs[n] / ptot;
+        }
+        q[i * nstate + kstate] += (1. - prad) * eprbs[n] / ptot;
+      }
+    }
+
+    for (n = 0; n < nbfd; n++)
+    {
+      cont_ptr = &phot_top[config[i].bfd_jump[n]];
+      q[i * nstate + cont_ptr->nlev] += jprbs[nbbd + n] / ptot;
+
+      if (eprbs[nbbd + n] > 0.0)
+      {
+        rad_rate = mplasma->recomb_sp[config[i].bfd_indx_first + n];
+        coll_rate = q_recomb (cont_ptr, xplasma->t_e) * xplasma->ne;
+        prad = rad_rate / (rad_rate + coll_rate);
+
+        r[i] += prad * matom_bf_freq_fraction (xplasma, config[i].bfd_jump[n], em_rnge.fmin, em_rnge.fmax) * eprbs[nbbd + n] / ptot;
+        q[i * nstate + kstate] += (1. - prad) * eprbs[nbbd + n] / ptot;
+      }
+    }
+
+    for (n = 0; n < nbbu; n++)
+    {
+      q[i * nstate + line[config[i].bbu_jump[n]].nconfigu] += jprbs[nbbd + nbfd + n] / ptot;
+    }
+
+    for (n = 0; n < nbfu; n++)
+    {
+      q[i * nstate + phot_top[config[i].bfu_jump[n]].uplev] += jprbs[nbbd + nbfd + nbbu + n] / ptot;
+    }
+  }
+
+  /* Now the k-packets, which are destroyed in the ways chosen by kpkt */
+
+  if (mplasma->kpkt_rates_known != 1)
+  {
+    fill_kpkt_rates (xplasma);
+  }
+
+  if ((cnorm = mplasma->cooling_normalisation) > 0.0)
+  {
+    for (nchan = 0; nchan < mplasma->kpkt_nchan; nchan++)
+    {
+      n = mplasma->kpkt_index[nchan];
+      if (mplasma->kpkt_type[nchan] == KPKT_BF)
+      {
+        r[kstate] += mplasma->kpkt_rate[nchan] / cnorm * matom_bf_freq_fraction (xplasma, n, em_rnge.fmin, em_rnge.fmax);
+      }
+      else if (mplasma->kpkt_type[nchan] == KPKT_BF_COL)
+      {
+        q[kstate * nstate + phot_top[n].uplev] += mplasma->kpkt_rate[nchan] / cnorm;
+      }
+      else if (mplasma->kpkt_type[nchan] == KPKT_BB)
+      {
+        if (line[n].macro_info == 1 && geo.macro_simple == 0)
+        {
+          q[kstate * nstate + line[n].nconfigu] += mplasma->kpkt_rate[nchan] / cnorm;
+        }
+        else if (line[n].freq > em_rnge.fmin && line[n].freq < em_rnge.fmax)
+        {
+          r[kstate] += mplasma->kpkt_rate[nchan] / cnorm;
+        }
+      }
+    }
+
+    /* ff photons are made by kpkt over a range of frequencies which depends on the type of cycle */
+    if (mplasma->cooling_ff > 0.0)
+    {
+      if (geo.ioniz_or_extract)
+      {
+        freqmin = xband.f1[0];
+        freqmax = ALPHA_FF * xplasma->t_e / H_OVER_K;
+      }
+      else
+      {
+        freqmin = em_rnge.fmin;
+        freqmax = em_rnge.fmax;
+      }
+
+      f1 = (freqmin > em_rnge.fmin) ? freqmin : em_rnge.fmin;
+      f2 = (freqmax < em_rnge.fmax) ? freqmax : em_rnge.fmax;
+
+      if (f1 <= freqmin && f2 >= freqmax)
+      {
+        r[kstate] += mplasma->cooling_ff / cnorm;
+      }
+      else if (f2 > f1)
+      {
+        r[kstate] += mplasma->cooling_ff / cnorm * total_free (one, xplasma->t_e, f1, f2) / total_free (one, xplasma->t_e, freqmin, freqmax);
+      }
+    }
+  }
+
+  /* Find the states which can be reached from those which have absorbed energy */
+
+  total_abs = 0.0;
+  nstack = 0;
+  for (i = 0; i < nstate; i++)
+  {
+    if ((i < kstate && mplasma->matom_abs[i] > 0.0) || (i == kstate && xplasma->kpkt_abs > 0.0))
+    {
+      total_abs += (i < kstate) ? mplasma->matom_abs[i] : xplasma->kpkt_abs;
+      reached[i] = TRUE;
+      stack[nstack++] = i;
+    }
+  }
+
+  while (nstack > 0)
+  {
+    i = stack[--nstack];
+    for (j = 0; j < nstate; j++)
+    {
+      if (q[i * nstate + j] > 0.0 && reached[j] == FALSE)
+      {
+        reached[j] = TRUE;
+        stack[nstack++] = j;
+      }
+    }
+  }
+
+  nrows = 0;
+  for (i = 0; i < nstate; i++)
+  {
+    indx[i] = reached[i] ? nrows++ : -1;
+  }
+
+  ierr = 0;
+
+  if (nrows > 0)
+  {
+    a_data = calloc (sizeof (double), nrows * nrows);
+    b_data = calloc (sizeof (double), nrows);
+    x = calloc (sizeof (double), nrows);
+
+    if (a_data == NULL || b_data == NULL || x == NULL)
+    {
+      Error ("matom_emiss_direct: Could not allocate memory for the matrix of cell %d\n", xplasma->nplasma);
+      exit (0);
+    }
+
+    /* The absorbed energies are normalised to keep the checks in solve_matrix meaningful */
+
+    for (i = 0; i < nstate; i++)
+    {
+      if (indx[i] < 0)
+        continue;
+
+      a_data[indx[i] * nrows + indx[i]] += 1.0;
+      for (j = 0; j < nstate; j++)
+      {
+        if (q[i * nstate + j] > 0.0)
+        {
+          a_data[indx[j] * nrows + indx[i]] -= q[i * nstate + j];
+        }
+      }
+
+      if (i < kstate)
+      {
+        b_data[indx[i]] = mplasma->matom_abs[i] / total_abs;
+      }
+      else
+      {
+        b_data[indx[i]] = xplasma->kpkt_abs / total_abs;
+      }
+    }
+
+    ierr = solve_matrix (a_data, b_data, nrows, x, xplasma->nplasma);
+
+    if (ierr != 4)
+    {
+      for (i = 0; i < nlevels_macro; i++)
+      {
+        mplasma->matom_emiss[i] = (indx[i] < 0) ? 0.0 : x[indx[i]] * r[i] * total_abs;
+      }
+      xplasma->kpkt_emiss = (indx[kstate] < 0) ? 0.0 : x[indx[kstate]] * r[kstate] * total_abs;
+      ierr = 0;
+    }
+
+    free (a_data);
+    free (b_data);
+    free (x);
+  }
+  else
+  {
+    for (i = 0; i < nlevels_macro; i++)
+    {
+      mplasma->matom_emiss[i] = 0.0;
+    }
+    xplasma->kpkt_emiss = 0.0;
+  }
+
+  free (q);
+  free (r);
+  free (reached);
+  free (indx);
+  free (stack);
+
+  return (ierr);
+}
+
+
 /**********************************************************/
 /** 
  * @brief      produces photon packets to account for creating of r-packets
@@ -490,7 +824,8 @@ photo_gen_kpkt (p, weight, photstart, nphot)
 {
   int photstop;
   int icell;
-  double xlum, xlumsum;
+  double *xlum;
+  unsigned int *ncell, nleft;
   struct photon pp;
   int nres, esc_ptr;
   int n;
@@ -507,25 +842,45 @@ photo_gen_kpkt (p, weight, photstart, nphot)
   photstop = photstart + nphot;
   Log ("photo_gen_kpkt creates nphot %5d photons from %5d to %5d \n", nphot, photstart, photstop);
 
+  /* Decide how many photons originate in each cell, before generating them cell by cell */
+
+  xlum = calloc (sizeof (double), NPLASMA);
+  ncell = calloc (sizeof (unsigned int), NPLASMA);
+
+  if (xlum == NULL || ncell == NULL)
+  {
+    Error ("photo_gen_kpkt: Could not allocate memory for %d cells\n", NPLASMA);
+    exit (0);
+  }
+
+  for (nplasma = 0; nplasma < NPLASMA; nplasma++)
+  {
+    if (wmain[plasmamain[nplasma].nwind].vol > 0.0)
+    {
+      xlum[nplasma] = plasmamain[nplasma].kpkt_emiss;
+    }
+  }
+
+  if (random_multinomial (NPLASMA, nphot, xlum, ncell))
+  {
+    Error ("photo_gen_kpkt: There is no k-packet emission in the wind\n");
+    exit (0);
+  }
+
+  nplasma = -1;
+  nleft = 0;
+
   for (n = photstart; n < photstop; n++)
   {
     /* locate the wind_cell in which the photon bundle originates. */
 
-//    xlum = (rand () + 0.5) / (MAXRAND) * geo.f_kpkt; DONE
-    xlum = random_number (0.0, 1.0) * geo.f_kpkt;
-
-    xlumsum = 0;
-    icell = 0;
-    while (xlumsum < xlum)
+    while (nleft == 0)
     {
-      if (wmain[icell].vol > 0.0)
-      {
-        nplasma = wmain[icell].nplasma;
-        xlumsum += plasmamain[nplasma].kpkt_emiss;
-      }
-      icell++;
+      nplasma++;
+      nleft = ncell[nplasma];
     }
-    icell--;                    /* This is the cell in which the photon must be generated */
+    nleft--;
+    icell = plasmamain[nplasma].nwind;  /* This is the cell in which the photon must be generated */
 
     /* Now generate a single photon in this cell */
     p[n].w = weight;
@@ -615,6 +970,8 @@ photo_gen_kpkt (p, weight, photstart, nphot)
 
   }
 
+  free (xlum);
+  free (ncell);
 
 
   return (nphot);               /* Return the number of photons generated */
@@ -652,10 +1009,11 @@ photo_gen_matom (p, weight, photstart, nphot)
 {
   int photstop;
   int icell;
-  double xlum, xlumsum;
+  double *xlum;
+  unsigned int *ncell, *nlevel, nleft;
   struct photon pp;
   int nres;
-  int n;
+  int n, m;
   double v[3];
   double dot ();
   int emit_matom ();
@@ -671,46 +1029,72 @@ photo_gen_matom (p, weight, photstart, nphot)
   photstop = photstart + nphot;
   Log ("photo_gen_matom creates nphot %5d photons from %5d to %5d \n", nphot, photstart, photstop);
 
+  /* Decide how many photons originate in each cell, and then as each cell is reached
+     how many come from each of the macro atom levels */
+
+  xlum = calloc (sizeof (double), NPLASMA);
+  ncell = calloc (sizeof (unsigned int), NPLASMA);
+  nlevel = calloc (sizeof (unsigned int), nlevels_macro);
+
+  if (xlum == NULL || ncell == NULL || nlevel == NULL)
+  {
+    Error ("photo_gen_matom: Could not allocate memory for %d cells\n", NPLASMA);
+    exit (0);
+  }
+
+  for (nplasma = 0; nplasma < NPLASMA; nplasma++)
+  {
+    if (wmain[plasmamain[nplasma].nwind].vol > 0.0)
+    {
+      for (m = 0; m < nlevels_macro; m++)
+      {
+        xlum[nplasma] += macromain[nplasma].matom_emiss[m];
+      }
+    }
+  }
+
+  if (random_multinomial (NPLASMA, nphot, xlum, ncell))
+  {
+    Error ("photo_gen_matom: There is no macro atom emission in the wind\n");
+    exit (0);
+  }
+
+  nplasma = -1;
+  upper = nlevels_macro;
+  nleft = 0;
+
   for (n = photstart; n < photstop; n++)
   {
     /* locate the wind_cell in which the photon bundle originates. And also decide which of the macro
        atom levels will be sampled (identify that level as "upper"). */
-    xlum = random_number (0.0, 1.0) * geo.f_matom;
-
 
-    xlumsum = 0;
-    icell = 0;
-    upper = 0;
-    while (xlumsum < xlum)
+    while (nleft == 0)
     {
-      if (wmain[icell].vol > 0.0)
+      if (upper == nlevels_macro)
       {
-        nplasma = wmain[icell].nplasma;
-        xlumsum += macromain[nplasma].matom_emiss[upper];
-        upper++;
-        if (upper == nlevels_macro)
+        nplasma++;
+        if (ncell[nplasma] > 0)
+        {
+          random_multinomial (nlevels_macro, ncell[nplasma], macromain[nplasma].matom_emiss, nlevel);
+        }
+        else
         {
-          upper = 0;
-          icell++;
+          continue;
         }
+        upper = 0;
       }
       else
       {
-        icell++;
-        upper = 0;
+        upper++;
+      }
+      if (upper < nlevels_macro)
+      {
+        nleft = nlevel[upper];
       }
     }
+    nleft--;                    /* upper is now the macro atom level that deactivates. */
 
-    if (upper == 0)
-    {
-      /* If upper = 0 at this point it means the loop above finished with an increment of
-         icell and setting upper = 0. In such a case the process we want was the LAST process
-         in the previous cell. */
-      icell--;
-      upper = nlevels_macro;
-    }
-
-    upper--;                    /* This leaves the macro atom level that deactivaties. */
+    icell = plasmamain[nplasma].nwind;
 
     /* Now generate a single photon in this cell */
     p[n].w = weight;
@@ -798,6 +1182,10 @@ photo_gen_matom (p, weight, photstart, nphot)
     }
   }
 
+  free (xlum);
+  free (ncell);
+  free (nlevel);
+
 
   return (nphot);               /* Return the number of photons generated */
 
@@ -43,6 +43,7 @@
  * @brief      a steering routine that either calls _in_space or _in_wind  depending upon the
  * 	current location of the photon.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] WindPtr  w   A pointer to the wind
  * @param [in, out] PhotPtr  pp   A photon
  * @param [in] double  tau_scat   the depth at which the photon should scatter
@@ -76,7 +77,8 @@
  **********************************************************/
 
 int
-translate (w, pp, tau_scat, tau, nres)
+translate (ctx, w, pp, tau_scat, tau, nres)
+     CtxPtr ctx;
      WindPtr w;                 //w here refers to entire wind, not a single element
      PhotPtr pp;
      double tau_scat;
@@ -88,11 +90,11 @@ translate (w, pp, tau_scat, tau, nres)
 
   if (where_in_wind (pp->x, &ndomain) < 0)
   {
-    istat = translate_in_space (pp);
+    istat = translate_in_space (ctx, pp);
   }
-  else if ((pp->grid = where_in_grid (ndomain, pp->x)) >= 0)
+  else if ((pp->grid = where_in_grid (ctx, ndomain, pp->x)) >= 0)
   {
-    istat = translate_in_wind (w, pp, tau_scat, tau, nres);
+    istat = translate_in_wind (ctx, w, pp, tau_scat, tau, nres);
   }
   else
   {
@@ -111,6 +113,7 @@ translate (w, pp, tau_scat, tau, nres)
  * @brief      translates the photon from its current position to the
  * 	edge of the wind.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in, out] PhotPtr  pp   A photon
  * @return     A status flag indication why the photon stopped
  *
@@ -131,7 +134,8 @@ translate (w, pp, tau_scat, tau, nres)
  **********************************************************/
 
 int
-translate_in_space (pp)
+translate_in_space (ctx, pp)
+     CtxPtr ctx;
      PhotPtr pp;
 {
   double ds, delta, s, smax;
@@ -152,7 +156,7 @@ translate_in_space (pp)
                                            From here on we should be in the grid  */
 
 
-    if ((ifail = where_in_grid (ndom, ptest.x)) < 0)
+    if ((ifail = where_in_grid (ctx, ndom, ptest.x)) < 0)
     {
     }
 
@@ -173,7 +177,7 @@ translate_in_space (pp)
       s = 0;
       while (s < smax && where_in_wind (ptest.x, &ndom_next) < 0)
       {
-        if ((delta = ds_in_cell (ndom, &ptest)) > 0)
+        if ((delta = ds_in_cell (ctx, ndom, &ptest)) > 0)
         {
           move_phot (&ptest, delta + DFUDGE);
           s += delta + DFUDGE;  // The distance the photon has moved
@@ -396,11 +400,15 @@ ds_to_wind (pp, ndom_current)
  */
 int neglible_vol_count = 0;
 int translate_in_wind_failure = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(neglible_vol_count, translate_in_wind_failure)
+#endif
 
 /**********************************************************/
 /**
  * @brief      translates the photon within a single cell in the wind.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] WindPtr  w   The entire wind
  * @param [in, out] PhotPtr  p   A photon
  * @param [in] double  tau_scat   The depth at which the photon will scatter
@@ -426,7 +434,8 @@ int translate_in_wind_failure = 0;
  *
  **********************************************************/
 int
-translate_in_wind (w, p, tau_scat, tau, nres)
+translate_in_wind (ctx, w, p, tau_scat, tau, nres)
+     CtxPtr ctx;
      WindPtr w;                 //w here refers to entire wind, not a single element
      PhotPtr p;
      double tau_scat, *tau;
@@ -449,7 +458,7 @@ translate_in_wind (w, p, tau_scat, tau, nres)
 /* First verify that the photon is in the grid, and if not
 return and record an error */
 
-  if ((p->grid = n = where_in_grid (wmain[p->grid].ndom, p->x)) < 0)
+  if ((p->grid = n = where_in_grid (ctx, wmain[p->grid].ndom, p->x)) < 0)
   {
     if (translate_in_wind_failure < 1000)
     {
@@ -472,7 +481,7 @@ return and record an error */
 
 /* Calculate the maximum distance the photon can travel in the cell */
 
-  if ((smax = ds_in_cell (ndom, p)) < 0)
+  if ((smax = ds_in_cell (ctx, ndom, p)) < 0)
   {
     return ((int) smax);
   }
@@ -528,7 +537,7 @@ The choice of SMAX_FRAC can affect execution time.*/
 
 /* Note that ds_current does not alter p in any way */
 
-  ds_current = calculate_ds (w, p, tau_scat, tau, nres, smax, &istat);
+  ds_current = calculate_ds (ctx, w, p, tau_scat, tau, nres, smax, &istat);
 
   if (p->nres < 0)
     xplasma->nscat_es++;
@@ -557,7 +566,7 @@ The choice of SMAX_FRAC can affect execution time.*/
     if (geo.ioniz_or_extract == 1)
     {
       /* For an ionization cycle */
-      bf_estimators_increment (one, p, ds_current);
+      bf_estimators_increment (ctx, one, p, ds_current);
 
       /*photon weight times distance in the shell is proportional to the mean intensity */
       xplasma->j += p->w * ds_current;
@@ -570,7 +579,7 @@ The choice of SMAX_FRAC can affect execution time.*/
   }
   else
   {
-    radiation (p, ds_current);
+    radiation (ctx, p, ds_current);
   }
 
 
@@ -591,6 +600,7 @@ The choice of SMAX_FRAC can affect execution time.*/
  * @brief      calculates the distance photon can travel within the cell
  * 	that it is currently in.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in, out] int  ndom   The current domain
  * @param [in, out] PhotPtr  p   A photon
  * @return     A distance indicating how far the photon can travel
@@ -607,7 +617,8 @@ The choice of SMAX_FRAC can affect execution time.*/
  **********************************************************/
 
 double
-ds_in_cell (ndom, p)
+ds_in_cell (ctx, ndom, p)
+     CtxPtr ctx;
      int ndom;
      PhotPtr p;
 
@@ -622,7 +633,7 @@ ds_in_cell (ndom, p)
 /* First verify that the photon is in the grid, and if not
 return and record an error */
 
-  if ((p->grid = n = where_in_grid (ndom, p->x)) < 0)
+  if ((p->grid = n = where_in_grid (ctx, ndom, p->x)) < 0)
   {
 //OLD      if (modes.save_photons)
 //OLD   {
@@ -640,19 +651,19 @@ return and record an error */
 
   if (zdom[ndom].coord_type == CYLIND)
   {
-    smax = cylind_ds_in_cell (ndom, p); // maximum distance the photon can travel in a cell
+    smax = cylind_ds_in_cell (ctx, ndom, p); // maximum distance the photon can travel in a cell
   }
   else if (zdom[ndom].coord_type == RTHETA)
   {
-    smax = rtheta_ds_in_cell (ndom, p);
+    smax = rtheta_ds_in_cell (ctx, ndom, p);
   }
   else if (zdom[ndom].coord_type == SPHERICAL)
   {
-    smax = spherical_ds_in_cell (ndom, p);
+    smax = spherical_ds_in_cell (ctx, ndom, p);
   }
   else if (zdom[ndom].coord_type == CYLVAR)
   {
-    smax = cylvar_ds_in_cell (ndom, p);
+    smax = cylvar_ds_in_cell (ctx, ndom, p);
   }
   else
   {
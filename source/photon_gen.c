@@ -59,6 +59,10 @@ int iwind_old = 0;
  * still used for detailed spectrum calculation. Which of this choices to use is controlled by freq_sampling
  * (The weights are established here)
  *
+ * In the banded approach, the band limited luminosities are only calculated if xband.flux_known
+ * is FALSE, so that the caller can reuse them for several sets of photons which are generated
+ * with the same wind, star and disk.
+ *
  * iwind is a variable that determines how or whether to create photons from the wind:
  * * -1-> Do not consider wind photons under any circumstances
  * * 0  ->Consider wind photons.  There is no need to recalculate the
@@ -112,7 +116,16 @@ define_phot (p, f1, f2, nphot_tot, ioniz_or_final, iwind, freq_sampling)
                                    bands.  This is used for the for ionization calculation where one wants to assure
                                    that you have "enough" photons at high energy */
 
-    ftot = populate_bands (ioniz_or_final, iwind, &xband);
+    if (xband.flux_known)
+    {                           /* The band limited luminosities have not changed since the last chunk of photons */
+      for (ftot = 0.0, n = 0; n < xband.nbands; n++)
+        ftot += xband.flux[n];
+    }
+    else
+    {
+      ftot = populate_bands (ioniz_or_final, iwind, &xband);
+      xband.flux_known = TRUE;
+    }
 
     for (n = 0; n < NPHOT; n++)
       p[n].path = -1.0;         /* SWM - Zero photon paths */
@@ -1057,6 +1070,12 @@ disk_init (rmin, rmax, m, mdot, freqmin, freqmax, ioniz_or_final, ftot)
  *
  * ### Notes ###
  *
+ * The number of photons to be generated in each ring is decided
+ * first, and the photons are then generated ring by ring.  This
+ * is so that planck (and one_continuum), which only remember
+ * the last temperature they were called with, need to set up their
+ * cdfs only once for each ring, rather than for nearly every photon.
+ *
  **********************************************************/
 
 int
@@ -1074,6 +1093,8 @@ photo_gen_disk (p, weight, f1, f2, spectype, istart, nphot)
   double t, r, z, theta, phi;
   int nring;
   double north[3], v[3];
+  double ring_weight[NRINGS - 1];
+  unsigned int ring_nphot[NRINGS - 1], nleft;
   if ((iend = istart + nphot) > NPHOT)
   {
     Error ("photo_gen_disk: iend %d > NPHOT %d\n", iend, NPHOT);
@@ -1087,6 +1108,22 @@ photo_gen_disk (p, weight, f1, f2, spectype, istart, nphot)
   Log_silent ("photo_gen_disk creates nphot %5d photons from %5d to %5d \n", nphot, istart, iend);
   freqmin = f1;
   freqmax = f2;
+
+/* The ring boundaries are defined so that an equal number of photons are
+ * generated in each ring.  Howver, there is a possibility that the number
+ * of photons to be generated is small, and therefore we, we still randomly
+ * generate photon.  04march -- ksl
+ */
+
+  for (nring = 0; nring < NRINGS - 1; nring++)
+  {
+    ring_weight[nring] = 1.0;
+  }
+  random_multinomial (NRINGS - 1, nphot, ring_weight, ring_nphot);
+
+  nring = -1;
+  nleft = 0;
+
   for (i = istart; i < iend; i++)
   {
     p[i].origin = PTYPE_DISK;   // identify this as a disk photon
@@ -1098,13 +1135,12 @@ photo_gen_disk (p, weight, f1, f2, spectype, istart, nphot)
     if (geo.reverb_disk == REV_DISK_UNCORRELATED)
       p[i].path = 0;            //If we're assuming disk photons are uncorrelated, leave them at 0
 
-/* The ring boundaries are defined so that an equal number of photons are
- * generated in each ring.  Howver, there is a possibility that the number
- * of photons to be generated is small, and therefore we, we still randomly
- * generate photon.  04march -- ksl
- */
-
-    nring = random_number (0.0, 1.0) * (NRINGS - 1);
+    while (nleft == 0)
+    {
+      nring++;
+      nleft = ring_nphot[nring];
+    }
+    nleft--;
 
 
     if ((nring < 0) || (nring > NRINGS - 2))
@@ -21,10 +21,20 @@ struct topbase_phot *xtop;      //Topbase description of a photoionization x-sec
 
 double qromb_temp;              //Temperature used in integrations - has to be an external variable so qromb can use it
 
-//Model parameters for integrations, also passed externally so qromb can use them
+/* The photoionization rate kernels, one for each phot_top x-section followed by one for each inner_cross x-section */
 
-double xpl_alpha, xpl_w, xpl_logw;
-double xexp_temp, xexp_w;
+PiKernelPtr pi_kernels = NULL;
+int pi_nkernels = 0;
+
+/* The abscissas and weights of the 8 point Gauss-Legendre quadrature used for the exponential models */
+
+double pi_gl_x[8] = { -0.9602898564975363, -0.7966664774136267, -0.5255324099163290, -0.1834346424956498,
+  0.1834346424956498, 0.5255324099163290, 0.7966664774136267, 0.9602898564975363
+};
+
+double pi_gl_w[8] = { 0.1012285362903763, 0.2223810344533745, 0.3137066458778873, 0.3626837833783620,
+  0.3626837833783620, 0.3137066458778873, 0.2223810344533745, 0.1012285362903763
+};
 
 
 
@@ -57,6 +67,9 @@ double xexp_temp, xexp_w;
  * have ben combined into one - hence the requirement for the mode parameter.It was further extended
  * to deal with inner shell rates - hence the type parameter
  *
+ * For the modelled J, the integrals in each band are found from the rate kernel of the x-section
+ * (see pi_kernel_pl and pi_kernel_exp) rather than with qromb.
+ *
  **********************************************************/
 
 double
@@ -71,11 +84,7 @@ calc_pi_rate (nion, xplasma, mode, type)
   int ntmin, nvmin;
   double fthresh, fmax, fmaxtemp;
   double f1, f2;
-  double exp_qromb, pl_qromb;
-
-
-  exp_qromb = 1e-4;             /*These are the two tolerance values for the rhomberg integrals */
-  pl_qromb = 1e-4;
+  PiKernelPtr kernel;
 
   ntmin = nvmin = -1;           /* Initialize these to an unreasonable number. We dont use them all the time */
 
@@ -140,64 +149,30 @@ calc_pi_rate (nion, xplasma, mode, type)
 
   if (mode == 1)                //Modelled version of J
   {
+    kernel = pi_rate_kernel (xtop);
     for (j = 0; j < geo.nxfreq; j++)    //We loop over all the bands
     {
-      xpl_alpha = xplasma->pl_alpha[j]; //set the various model parameters to those for this model
-      xpl_logw = xplasma->pl_log_w[j];
-      xexp_temp = xplasma->exp_temp[j];
-      xexp_w = xplasma->exp_w[j];
       if (xplasma->spec_mod_type[j] != SPEC_MOD_FAIL)   //Only bother doing the integrals if we have a model in this band
       {
+        /* The integral runs over the part of the x-section to which the model applies */
         f1 = xplasma->fmin_mod[j];      //NSH 131114 - Set the low frequency limit to the lowest frequency that the model applies to
         f2 = xplasma->fmax_mod[j];      //NSH 131114 - Set the high frequency limit to the highest frequency that the model applies to
-        if (f1 < fthresh && fthresh < f2 && f1 < fmax && fmax < f2)     //Case 1-
-        {
-          if (xplasma->spec_mod_type[j] == SPEC_MOD_PL)
-          {
-            pi_rate += qromb (tb_logpow1, fthresh, fmax, pl_qromb);
-          }
-          else
-          {
-            pi_rate += qromb (tb_exp1, fthresh, fmax, exp_qromb);
-          }
-        }
-        else if (f1 < fthresh && fthresh < f2 && f2 < fmax)     //case 2
-        {
-          if (xplasma->spec_mod_type[j] == SPEC_MOD_PL)
-          {
-            pi_rate += qromb (tb_logpow1, fthresh, f2, pl_qromb);
-          }
-          else
-          {
-            pi_rate += qromb (tb_exp1, fthresh, f2, exp_qromb);
-          }
-        }
-        else if (f1 > fthresh && f1 < fmax && fmax < f2)        //case 3
-        {
-          if (xplasma->spec_mod_type[j] == SPEC_MOD_PL)
-          {
-            pi_rate += qromb (tb_logpow1, f1, fmax, pl_qromb);
-          }
-          else
-          {
-            pi_rate += qromb (tb_exp1, f1, fmax, exp_qromb);
-          }
-        }
-        else if (f1 > fthresh && f2 < fmax)     // case 4
+        if (f1 < fthresh)
+          f1 = fthresh;
+        if (f2 > fmax)
+          f2 = fmax;
+
+        if (f1 < f2)
         {
           if (xplasma->spec_mod_type[j] == SPEC_MOD_PL)
           {
-            pi_rate += qromb (tb_logpow1, f1, f2, pl_qromb);
+            pi_rate += pi_kernel_pl (kernel, f1, f2, xplasma->pl_log_w[j], xplasma->pl_alpha[j]);
           }
           else
           {
-            pi_rate += qromb (tb_exp1, f1, f2, exp_qromb);
+            pi_rate += pi_kernel_exp (kernel, f1, f2, xplasma->exp_w[j], xplasma->exp_temp[j]);
           }
         }
-        else                    //case 5 - should only be the case where the band is outside the range for the integral.
-        {
-          pi_rate += 0;         // Add nothing - bit of a null statement, but makes the code look nice.
-        }
       }                         //End of loop to only integrate in this band if there is power
     }
 
@@ -251,7 +226,7 @@ tb_planck1 (freq)
   answer = (2. * H * pow (freq, 3.)) / (pow (C, 2));
   answer *= (1 / (bbe - 1));
 //      answer*=weight;
-  answer *= sigma_phot (xtop, freq);
+  answer *= sigma_phot (NULL, xtop, freq);
   answer /= freq;
 
   return (answer);
@@ -260,55 +235,241 @@ tb_planck1 (freq)
 
 /**********************************************************/
 /**
- * @brief      The integrand for working out the PI rate in a radiation field modelled by a power law
+ * @brief      Find the photoionization rate kernel of an x-section, making it if necessary
  *
- * @param [in] double  freq   the frequency
- * @return     value of sigma J_nu/nu at nu
+ * @param [in] struct topbase_phot *  x_ptr   A phot_top or inner_cross x-section
+ * @return     A pointer to the kernel
+ *
+ * @details
+ * The kernel holds the logs of the frequencies and x-sections of the
+ * points of the x-section, and the power law index of the x-section
+ * between each pair of points, so that calc_pi_rate can integrate over
+ * each interval between points without interpolating the x-section.
+ *
+ * ### Notes ###
+ * The kernels are made the first time each x-section is needed, and
+ * made again if the atomic data are read again.
+ *
+ **********************************************************/
+
+PiKernelPtr
+pi_rate_kernel (x_ptr)
+     struct topbase_phot *x_ptr;
+{
+  int n, i, np;
+  PiKernelPtr kernel;
+
+  if (phot_top != NULL && x_ptr >= phot_top && x_ptr < phot_top + nphot_max)
+  {
+    n = x_ptr - phot_top;
+  }
+  else if (inner_cross != NULL && x_ptr >= inner_cross && x_ptr < inner_cross + n_inner_max)
+  {
+    n = nphot_max + (x_ptr - inner_cross);
+  }
+  else
+  {
+    Error ("pi_rate_kernel: x-section is not in phot_top or inner_cross\n");
+    exit (0);
+  }
+
+  if (pi_nkernels != nphot_max + n_inner_max)
+  {
+    if (pi_kernels != NULL)
+    {
+      for (i = 0; i < pi_nkernels; i++)
+      {
+        free (pi_kernels[i].lnf);
+        free (pi_kernels[i].lnx);
+        free (pi_kernels[i].slope);
+        free (pi_kernels[i].zero);
+      }
+      free (pi_kernels);
+    }
+
+    pi_nkernels = nphot_max + n_inner_max;
+    if ((pi_kernels = (PiKernelPtr) calloc (sizeof (pi_kernel_dummy), pi_nkernels)) == NULL)
+    {
+      Error ("pi_rate_kernel: Could not allocate memory for %d kernels\n", pi_nkernels);
+      exit (0);
+    }
+  }
+
+  kernel = &pi_kernels[n];
+
+  if (kernel->freq == x_ptr->freq && kernel->np == x_ptr->np)
+    return (kernel);
+
+  /* The kernel has not been made, or the atomic data have changed since it was */
+
+  free (kernel->lnf);
+  free (kernel->lnx);
+  free (kernel->slope);
+  free (kernel->zero);
+
+  np = x_ptr->np;
+  kernel->lnf = calloc (sizeof (double), np);
+  kernel->lnx = calloc (sizeof (double), np);
+  kernel->slope = calloc (sizeof (double), np);
+  kernel->zero = calloc (sizeof (int), np);
+  if (kernel->lnf == NULL || kernel->lnx == NULL || kernel->slope == NULL || kernel->zero == NULL)
+  {
+    Error ("pi_rate_kernel: Could not allocate memory for the kernel of x-section %d\n", n);
+    exit (0);
+  }
+
+  for (i = 0; i < np; i++)
+  {
+    kernel->lnf[i] = log (x_ptr->freq[i]);
+    kernel->lnx[i] = x_ptr->x[i] > 0.0 ? log (x_ptr->x[i]) : 0.0;
+  }
+
+  /* The last point only ends an interval, and sigma_phot gives zero wherever either end of an interval is zero */
+
+  kernel->zero[np - 1] = TRUE;
+  for (i = 0; i < np - 1; i++)
+  {
+    if (x_ptr->x[i] <= 0.0 || x_ptr->x[i + 1] <= 0.0 || x_ptr->freq[i + 1] <= x_ptr->freq[i])
+    {
+      kernel->zero[i] = TRUE;
+    }
+    else
+    {
+      kernel->zero[i] = FALSE;
+      kernel->slope[i] = (kernel->lnx[i + 1] - kernel->lnx[i]) / (kernel->lnf[i + 1] - kernel->lnf[i]);
+    }
+  }
+
+  kernel->freq = x_ptr->freq;
+  kernel->np = np;
+
+  return (kernel);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Integrate an x-section times a power law model of J_nu / nu
+ *
+ * @param [in] PiKernelPtr  kernel   The rate kernel of the x-section
+ * @param [in] double  f1   The lower frequency limit
+ * @param [in] double  f2   The upper frequency limit
+ * @param [in] double  logw   The log10 of the weight of the power law
+ * @param [in] double  alpha   The index of the power law
+ * @return     The integral of sigma J_nu / nu from f1 to f2
  *
  * @details
- * This is the integrand for computing the PI rate coefficient when j_nu is described by a power
- * law. The returned value is J_nu x cross section / nu. The power law is computed in log space to
- * allow a larger range of possible values.
+ * J_nu is 10**logw nu**alpha.  Between each pair of points the
+ * x-section is a power law too, and so the integral over each interval
+ * is found exactly.
  *
  * ### Notes ###
+ * The integral over an interval from a to b of a power law nu**(p-1) is
+ * written a**p expm1 (p log (b/a)) / p, which is accurate when p is small.
  *
  **********************************************************/
 
 double
-tb_logpow1 (freq)
-     double freq;
+pi_kernel_pl (kernel, f1, f2, logw, alpha)
+     PiKernelPtr kernel;
+     double f1, f2;
+     double logw, alpha;
 {
-  double answer;
-  answer = pow (10, xpl_logw + (xpl_alpha - 1.0) * log10 (freq));       //NB - the alpha-1.0 appears because we divide by nu
-  answer *= sigma_phot (xtop, freq);    // and finally multiply by the cross section.
+  int i;
+  double a, b, lna, dlnf, p, lnval, sum;
 
-  return (answer);
+  sum = 0.0;
+  for (i = 0; i < kernel->np - 1 && kernel->freq[i] < f2; i++)
+  {
+    if (kernel->zero[i] || kernel->freq[i + 1] <= f1)
+      continue;
+
+    a = kernel->freq[i] > f1 ? kernel->freq[i] : f1;
+    b = kernel->freq[i + 1] < f2 ? kernel->freq[i + 1] : f2;
+
+    lna = log (a);
+    dlnf = log (b) - lna;
+    p = alpha + kernel->slope[i];
+
+    /* This is the log of J_nu sigma at a */
+    lnval = logw * log (10.) + alpha * lna + kernel->lnx[i] + kernel->slope[i] * (lna - kernel->lnf[i]);
+
+    if (p != 0.0)
+      sum += exp (lnval) * expm1 (p * dlnf) / p;
+    else
+      sum += exp (lnval) * dlnf;
+  }
+
+  return (sum);
 }
 
 
+
 /**********************************************************/
 /**
- * @brief      The integrand for working out the PI rate in a radiation field modelled by an exponential
+ * @brief      Integrate an x-section times an exponential model of J_nu / nu
  *
- * @param [in] double  freq   the frequency
- * @return     value of sigma J_nu/nu at nu
+ * @param [in] PiKernelPtr  kernel   The rate kernel of the x-section
+ * @param [in] double  f1   The lower frequency limit
+ * @param [in] double  f2   The upper frequency limit
+ * @param [in] double  w   The weight of the exponential
+ * @param [in] double  temp   The temperature of the exponential, which may be negative
+ * @return     The integral of sigma J_nu / nu from f1 to f2
  *
  * @details
- * This is the integrand for computing the PI rate coefficient when j_nu is described by an exponential
- * law. The returned value is J_nu x cross section / nu.
+ * J_nu is w exp (-h nu / k temp).  Each interval between points of
+ * the x-section is divided into pieces over which neither the x-section
+ * nor the exponential change by more than about a factor of e, and each
+ * piece is integrated in log nu with 8 point Gauss-Legendre quadrature.
  *
  * ### Notes ###
+ * For a positive temperature the integral stops where h nu / k temp
+ * exceeds its value at f1 by PI_KERNEL_EXP_LIMIT.
  *
  **********************************************************/
 
 double
-tb_exp1 (freq)
-     double freq;
+pi_kernel_exp (kernel, f1, f2, w, temp)
+     PiKernelPtr kernel;
+     double f1, f2;
+     double w, temp;
 {
-  double answer;
+  int i, k, m, npiece;
+  double a, b, lna, dlnf, du, umid, u, beta, sum, piece;
 
-  answer = xexp_w * exp ((-1.0 * H * freq) / (BOLTZMANN * xexp_temp));
-  answer *= sigma_phot (xtop, freq);    // and finally multiply by the cross section.
-  answer /= freq;               //then finally finally divide by the frequency
-  return (answer);
+  beta = H / (BOLTZMANN * temp);
+
+  if (beta > 0.0 && f2 > f1 + PI_KERNEL_EXP_LIMIT / beta)
+    f2 = f1 + PI_KERNEL_EXP_LIMIT / beta;
+
+  sum = 0.0;
+  for (i = 0; i < kernel->np - 1 && kernel->freq[i] < f2; i++)
+  {
+    if (kernel->zero[i] || kernel->freq[i + 1] <= f1)
+      continue;
+
+    a = kernel->freq[i] > f1 ? kernel->freq[i] : f1;
+    b = kernel->freq[i + 1] < f2 ? kernel->freq[i + 1] : f2;
+
+    lna = log (a);
+    dlnf = log (b) - lna;
+
+    npiece = 1 + (int) (fabs (beta) * (b - a) + fabs (kernel->slope[i]) * dlnf);
+    du = dlnf / npiece;
+
+    for (m = 0; m < npiece; m++)
+    {
+      umid = lna + (m + 0.5) * du;
+      piece = 0.0;
+      for (k = 0; k < 8; k++)
+      {
+        u = umid + 0.5 * du * pi_gl_x[k];
+        piece += pi_gl_w[k] * exp (kernel->lnx[i] + kernel->slope[i] * (u - kernel->lnf[i]) - beta * exp (u));
+      }
+      sum += 0.5 * du * piece;
+    }
+  }
+
+  return (w * sum);
 }
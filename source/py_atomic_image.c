@@ -0,0 +1,77 @@
+
+/***********************************************************/
+/** @file  py_atomic_image.c
+ * @date   October, 2026
+ *
+ * @brief  A standalone routine which compiles the atomic data named
+ * in a masterfile into a binary image
+ *
+ * This routine is run from the command line, as follows
+ *
+ * py_atomic_image  masterfile
+ *
+ * where masterfile is the name of the masterfile, e.g. data/standard80.
+ * The image is written to masterfile.image, and it is used by
+ * get_atomic_data in place of the data files for as long as it is
+ * newer than all of them.
+ *
+ * ### Notes ###
+ *
+ * The real work is done in atomic_image.c
+ *
+ ***********************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "atomic.h"
+#include "python.h"
+
+
+
+/**********************************************************/
+/**
+ * @brief      py_atomic_image reads the atomic data from a masterfile
+ * and writes them to a binary image.  This is the main routine.
+ *
+ * @param [in] int  argc   The number of argments in the command line
+ * @param [in] char *  argv[]   The command line
+ * @return     Always returns 0
+ *
+ * @details
+ * The only command line argument is the name of the masterfile.  The
+ * data files are always read, even if an image of them already exists.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+int
+main (argc, argv)
+     int argc;
+     char *argv[];
+{
+  char masterfile[LINELENGTH], imagefile[LINELENGTH + 8];
+
+  Log_set_verbosity (3);
+
+  if (argc != 2)
+  {
+    printf ("Usage: py_atomic_image masterfile\n");
+    exit (0);
+  }
+
+  strcpy (masterfile, argv[1]);
+  sprintf (imagefile, "%s.image", masterfile);
+
+  ignore_atomic_image = TRUE;
+  get_atomic_data (masterfile);
+
+  atomic_image_write (masterfile, imagefile);
+
+  printf ("Wrote the atomic data from %s to %s\n", masterfile, imagefile);
+
+  return (0);
+}
@@ -211,7 +211,7 @@ a:Log ("Input x=0,y=0,z=0 to return to main routine\n");
     ndom = 0;
   }
 
-  n = where_in_grid (ndom, x);
+  n = where_in_grid (NULL, ndom, x);
   nplasma = wmain[n].nplasma;
 
   Log ("Position %8.2e  %8.2e %8.2e  Cell %5d\n", x[0], x[1], x[2], n);
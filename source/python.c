@@ -302,13 +302,18 @@ main (argc, argv)
 
   int my_rank;                  // these two variables are used regardless of parallel mode
   int np_mpi;                   // rank and number of processes, 0 and 1 in non-parallel
+#ifdef MPI_ON
+  int mpi_thread_support;       // the level of thread support provided by the MPI library
+#endif
 
 
 
 
 
 #ifdef MPI_ON
-  MPI_Init (&argc, &argv);
+  /* The batches of photons are handed out with one-sided MPI calls (see phot_batch_next), which are
+     made by the master thread from inside the parallel transport region when OpenMP is used */
+  MPI_Init_thread (&argc, &argv, MPI_THREAD_FUNNELED, &mpi_thread_support);
   MPI_Comm_rank (MPI_COMM_WORLD, &my_rank);
   MPI_Comm_size (MPI_COMM_WORLD, &np_mpi);
 #else
@@ -320,6 +325,14 @@ main (argc, argv)
   rank_global = my_rank;        // Global variable which holds the rank of the active MPI process
   Log_set_mpi_rank (my_rank, np_mpi);   // communicates my_rank to kpar
 
+#if defined(MPI_ON) && defined(_OPENMP)
+  if (mpi_thread_support < MPI_THREAD_FUNNELED)
+  {
+    Error ("python: The MPI library does not support calls from the master thread of a parallel region\n");
+    exit (0);
+  }
+#endif
+
 
   opar_stat = 0;                /* Initialize opar_stat to indicate that if we do not open a rdpar file,
                                    the assumption is that we are reading from the command line */
@@ -90,8 +90,15 @@ double DENSITY_PHOT_MIN;        /* This constant is a minimum density for the pu
                                    angle over which photons will be accepted must be defined */
 
 
-int NPHOT;                      /* The number of photon bundles created.  defined in python.c */
+int NPHOT;                      /* The number of photon bundles created at one time.  defined in python.c */
+int NPHOT_CHUNKS;               /* The number of chunks of NPHOT photons which are generated and transported
+                                   one after the other in each cycle, see init_photons */
+#define NPHOT_BATCHES   100     /* The number of batches into which the photons of a task are divided when
+                                   they are shared dynamically between MPI tasks, see phot_batch_init */
 int CURRENT_PHOT;               /* A diagnostic so that one can always determine what the current photon number being run is */
+#ifdef _OPENMP
+#pragma omp threadprivate(CURRENT_PHOT)
+#endif
 
 #define NWAVE  			       10000    //Increasing from 4000 to 10000 (SS June 04)
 #define MAXSCAT 			500
@@ -403,6 +410,8 @@ struct geometry
   int matom_radiation;          /* Added by SS Jun 2004: for use in macro atom computations of detailed spectra
                                    - 1 means use emissivities for BOTH macro atom levels and kpkts. 0 means don't
                                    (which is correct for the ionization cycles. */
+  int matom_emiss_method;       /* How the macro atom and k-packet emissivities for the detailed spectra are
+                                   found, either MATOM_EMISS_MONTE_CARLO or MATOM_EMISS_DETERMINISTIC */
   int ioniz_mode;               /* describes the type of ionization calculation which will
                                    be carried out.  0=on the spot, 1=LTE, 2=fixed ionization
                                    fractions,  3 means to recalculate the ionization structure 
@@ -638,21 +647,80 @@ blmod;
     For each frequency:
       For each path bin:
         What's the total fluxback of all these photons entering the cell?
+    Only the path bins which photons have entered are stored, in order of path, so the arrays
+    below are indexed by the stored bin, and ai_path_bin gives the bin in reverb_path_bin.
 */
 typedef struct wind_paths
 {
-  double *ad_path_flux;         //Array[by frequency, then path] of total flux of photons with the given v&p
+  int i_bins, i_bins_alloc;     //Number of path bins stored, and the number there is space for
+  int *ai_path_bin;             //Array [by stored bin] of the index of the bin in reverb_path_bin
+  double *ad_path_flux;         //Array [by stored bin] of total flux of photons with the given path
   double *ad_path_flux_disk;
   double *ad_path_flux_wind;
   double *ad_path_flux_cent;    // As above, by source
-  int *ai_path_num;             //Array [by frequency, then path] of the number of photons in this bin
+  int *ai_path_num;             //Array [by stored bin] of the number of photons in this bin
   int *ai_path_num_disk;
   int *ai_path_num_wind;
   int *ai_path_num_cent;        // As above, by source
+  double *ad_path_cdf;          //Array [by stored bin] of the fraction of the flux in this bin and those before it
   double d_flux, d_path;        //Total flux, average path
   int i_num;                    //Number of photons hitting this cell
 } wind_paths_dummy, *Wind_Paths_Ptr;
 
+int wind_paths_reduced;         /* TRUE if the path histograms of all the processes have been combined, see paths.c */
+
+/*
+ * The delay dump file is binary.  It begins with a header, and is followed by one record
+ * for each photon which is dumped.  delay_dump2text converts it to the text format
+ * which was written originally.
+ */
+#define DELAY_DUMP_MAGIC "PYDELAY"
+#define DELAY_DUMP_FORMAT 1
+#define DELAY_DUMP_BUFFER 1048576       // The size of the stdio buffer for each rank's delay dump file
+
+typedef struct delay_dump_header
+{
+  char magic[8];                // DELAY_DUMP_MAGIC
+  int format;                   // DELAY_DUMP_FORMAT
+  int record_size;              // The size of a delay_dump_record
+  long nrecords;                // The number of records which follow the header
+  char version[32];             // The version of python which wrote the file
+  char date[LINELENGTH];        // When the file was started
+} delay_dump_header_dummy;
+
+typedef struct delay_dump_record
+{
+  double freq, w;               // Frequency and weight of the photon
+  double x[3];                  // Last position of the photon
+  double delay;                 // Delay relative to a photon from the origin
+  int nscat, nrscat;            // Number of scatters, and of resonant scatters
+  int spec;                     // The spectrum the photon was extracted into, minus MSPEC
+  int origin, nres;             // Origin of the photon, and its last resonance
+  int pad;                      // Unused, so the size of the record does not depend on the compiler
+} delay_dump_record_dummy;
+
+/*
+ * The windsave file begins with a header and a table of the sections which follow it, see
+ * windsave.c.  The members of the wind, plasma and macro structures are each saved as a
+ * section, which is described when the file is written by a windsave_field.
+ */
+typedef struct windsave_section
+{
+  char name[32];
+  long offset;                  /* The position of the section in bytes from the beginning of the file */
+  long size;                    /* The size of one value */
+  long nvalues;                 /* The number of values for each cell */
+  long ncells;                  /* The number of cells, or of structures */
+} windsave_section_dummy;
+
+typedef struct windsave_field
+{
+  char *name;                   /* The name of the section, e.g. plasma.t_e */
+  size_t offset;                /* The position of the member in the structure */
+  size_t size;                  /* The size of one value */
+  long nvalues;                 /* The number of values in the member, more than one for an array */
+} windsave_field_dummy;
+
 /* 	This structure defines the wind.  The structure w is allocated in the main
 	routine.  The total size of the structure will be NDIM x MDIM, and the two
 	dimenssions do not need to be the same.  The order of the
@@ -898,6 +966,36 @@ typedef struct plasma
 
 PlasmaPtr plasmamain;
 
+/* When the photons are transported on several threads, each thread other than the master points plasmamain (and
+   macromain, photstoremain and matomphotstoremain) at its own copy of the structure, in which the Monte Carlo
+   estimators are accumulated.  The copies are summed back into the master structures at the end of trans_phot. */
+#ifdef _OPENMP
+#pragma omp threadprivate(plasmamain)
+#endif
+
+/* The few properties of the wind and plasma cells which are read over and over as photons are transported,
+   copied into compact arrays indexed in the same way as wmain and plasmamain.  Interpolating between
+   neighbouring cells then touches one short record per cell rather than the full structures, which
+   for plasmamain are also copied for each thread.  wmain and plasmamain remain the master copies.
+   windhot is made by wind_hot_make when the wind has been defined or read, and plasmahot by
+   plasma_hot_make before each flight of photons; both are NULL until they have been made. */
+typedef struct wind_hot
+{
+  double v[3];                  /* velocity at inner vertex of cell, as in wmain */
+  int ndom;                     /* The domain associated with this element of the wind */
+  int nplasma;                  /* The corresponding cell in the plasma structure */
+} wind_hot_dummy, *WindHotPtr;
+
+WindHotPtr windhot;
+
+typedef struct plasma_hot
+{
+  double ne;                    /* electron density in the cell, as in plasmamain */
+  double *density;              /* The number density of each ion, which points into the master plasmamain */
+} plasma_hot_dummy, *PlasmaHotPtr;
+
+PlasmaHotPtr plasmahot;
+
 /* A storage area for photons.  The idea is that it is sometimes time-consuming to create the
 cumulative distribution function for a process, but trivial to create more than one photon 
 of a particular type once one has the cdf,  This appears to be case for f fb photons.  But 
@@ -912,6 +1010,9 @@ typedef struct photon_store
 } photon_store_dummy, *PhotStorePtr;
 
 PhotStorePtr photstoremain;
+#ifdef _OPENMP
+#pragma omp threadprivate(photstoremain)
+#endif
 
 /* A second photon store: this is very similar to photon_store above but for use in generating macro atom bf photons from cfds*/
 typedef struct matom_photon_store
@@ -922,6 +1023,9 @@ typedef struct matom_photon_store
 } matom_photon_store_dummy, *MatomPhotStorePtr;
 
 MatomPhotStorePtr matomphotstoremain;
+#ifdef _OPENMP
+#pragma omp threadprivate(matomphotstoremain)
+#endif
 #define MATOM_BF_PDF 1000       //number of points to use in a macro atom bf PDF
 
 typedef struct macro
@@ -973,9 +1077,16 @@ typedef struct macro
   /* This portion of the macro structure  is not written out by windsave */
   int kpkt_rates_known;
 
-  double *cooling_bf;
-  double *cooling_bf_col;
-  double *cooling_bb;
+  /* The channels by which k-packets can be destroyed, which are found by fill_kpkt_rates.  Only
+     the channels whose cooling rates are at least KPKT_CHANNEL_MIN of the total are kept, and the
+     choice between them is made with an alias table */
+  int kpkt_nchan;               /* The number of channels */
+  int kpkt_nchan_alloc;         /* The number of channels for which there is space */
+  int *kpkt_type;               /* The kind of each channel, KPKT_BF, KPKT_BB etc */
+  int *kpkt_index;              /* The element of phot_top or line for the channel, if any */
+  double *kpkt_rate;            /* The cooling rate of the channel */
+  double *kpkt_prob;            /* Alias table probabilities */
+  int *kpkt_alias;              /* Alias table aliases */
 
   /* set of cooling rate stores, which are calculated for each macro atom each cycle,
      and used to select destruction rates for kpkts */
@@ -984,14 +1095,46 @@ typedef struct macro
   double cooling_ff;
   double cooling_adiabatic;     // this is just cool_adiabatic / vol / ne
 
+  /* jumping and emission probabilities of the levels, which are calculated by fill_matom_prbs
+     the first time a level is reached in a cycle, and stored as alias tables for matom */
+  double matom_prbs_t_e;        /* The electron temperature for which the probabilities were calculated, -1 if none */
+  int *matom_prbs_known;        /* TRUE if the probabilities for a level are current */
+  double *matom_pjnorm;         /* Total jumping probability of a level */
+  double *matom_penorm;         /* Total emission probability of a level */
+  double *matom_jump_prob, *matom_emiss_prob;   /* Alias table probabilities, located by jump_indx_first and emiss_indx_first */
+  int *matom_jump_alias, *matom_emiss_alias;    /* Alias table aliases */
 
 } macro_dummy, *MacroPtr;
 
 MacroPtr macromain;
+#ifdef _OPENMP
+#pragma omp threadprivate(macromain)
+#endif
 
 int xxxpdfwind;                 // When 1, line luminosity calculates pdf
 
 int size_Jbar_est, size_gamma_est, size_alpha_est;
+int size_matom_jump, size_matom_emiss;
+
+/* The kinds of channel by which a k-packet can be destroyed, see fill_kpkt_rates */
+#define KPKT_BF         0       /* Recombination */
+#define KPKT_BB         1       /* Collisional excitation */
+#define KPKT_FF         2       /* Free-free emission */
+#define KPKT_ADIABATIC  3       /* Adiabatic cooling */
+#define KPKT_BF_COL     4       /* Collisional ionization of a macro atom */
+
+#define KPKT_CHANNEL_MIN 1e-12  /* The fraction of the total cooling rate below which a channel is ignored */
+
+/* The absorptive continuum opacity of each plasma cell tabulated on a logarithmic frequency
+   grid for the spectral cycles, see kappa_cont_tab_make */
+#define NKAPPA_TAB      1000    /* The number of frequencies in the table */
+#define KAPPA_TAB_MARGIN 1.2    /* The factor by which the table extends beyond the frequencies of the spectrum */
+double *kappa_tab;              /* The table, with nkappa_tab values for each plasma cell */
+int nkappa_tab;                 /* The number of frequencies in the table, 0 if there is no table */
+double kappa_tab_lfmin, kappa_tab_dlf;  /* The log of the lowest frequency and the log spacing of the table */
+
+char *ion_populated;            /* For each plasma cell, nions flags which are TRUE if the lines of the ion
+                                   can be in resonance in the cell, see ion_populated_make */
 
 #define TMAX_FACTOR			1.5     /*Factor by which t_e can exceed
                                                    t_r in order for absorbed to 
@@ -1102,6 +1245,63 @@ PhotPtr photmain;               /* A pointer to all of the photons that have bee
                                    breaking the main routine of python into separate rooutines for inputs and running the
                                    program */
 
+
+/* A transport context holds the state that the photon transport routines remember from one
+   call to the next, together with the random number stream used by one worker.  There is one
+   context per thread in trans_phot, and it is passed explicitly to the routines on the transport
+   path (translate, calculate_ds, radiation, where_in_grid etc).  Routines that are used outside
+   of the transport, e.g in setting up the wind, accept a NULL context, in which case nothing is
+   remembered. */
+
+typedef struct transport_context
+{
+  int nthread;                  /* The worker (thread) that owns this context */
+  void *rng;                    /* The gsl_rng stream of this worker. This is void so that python.h does not need the gsl headers */
+  int own_rng;                  /* TRUE if the stream was allocated for the context, FALSE if it is the one set up by init_rand */
+
+  /* where_in_grid: the last position that was located, and the domain and cell it was in */
+  int wig_ndom, wig_n;
+  double wig_x, wig_y, wig_z;
+
+  /* limit_lines_ctx: the range of lines in lin_ptr which lie in the current frequency interval */
+  int nline_min, nline_max, nline_delt;
+
+  /* calculate_ds: the photon at the end of the last step, and its velocity along the line of sight */
+  struct photon cds_phot_old;
+  double cds_v2_old;
+
+  /* sigma_phot: for each cross-section the last frequency, the last x-section, and the element of
+     the freq array used for the interpolation.  The phot_top x-sections come first followed
+     by the inner_cross x-sections */
+  int nsigma;
+  double *sigma_f, *sigma_x;
+  int *sigma_nlast;
+
+  /* Counters of how often the remembered values could be used, and for where_in_grid how often the
+     position was found next to the last one */
+  long wig_calls, wig_hits, wig_nearby;
+  long cds_calls, cds_hits;
+  long sigma_calls, sigma_hits;
+} transport_dummy, *CtxPtr;
+
+
+/* A photoionization rate kernel holds what calc_pi_rate needs to integrate the product of a
+   tabulated x-section and a modelled mean intensity without evaluating the x-section point
+   by point.  sigma_phot interpolates the x-section in log-log, so between each pair of
+   points it is a power law, sigma = exp (lnx[i] + slope[i] * (log (freq) - lnf[i])).  A
+   kernel is made for each phot_top or inner_cross x-section the first time it is needed. */
+
+typedef struct pi_kernel
+{
+  int np;                       /* The number of points in the x-section */
+  double *freq;                 /* The frequencies of the points, which are those of the x-section */
+  double *lnf, *lnx;            /* The logs of the frequencies and x-sections at the points */
+  double *slope;                /* The power law index of the x-section between point i and i+1 */
+  int *zero;                    /* TRUE if the x-section is zero between point i and i+1 */
+} pi_kernel_dummy, *PiKernelPtr;
+
+#define PI_KERNEL_EXP_LIMIT 50  /* h nu / kT beyond which an exponential model is not integrated */
+
     /* minimum value for tau for p_escape_from_tau function- below this we 
        set to p_escape_ to 1 */
 #define TAU_MIN 1e-6
@@ -1115,6 +1315,9 @@ PhotPtr photmain;               /* A pointer to all of the photons that have bee
 #define MAX_PHOT_HIST	1000
 int n_phot_hist, phot_hist_on, phot_history_spectrum;
 struct photon xphot_hist[MAX_PHOT_HIST];
+#ifdef _OPENMP
+#pragma omp threadprivate(n_phot_hist, phot_hist_on, phot_history_spectrum, xphot_hist)
+#endif
 
 struct basis
 {
@@ -1156,6 +1359,8 @@ typedef struct spectrum
   float freqmin, freqmax, dfreq;
   float lfreqmin, lfreqmax, ldfreq;     /* NSH 1302 - values for logarithmic spectra */
   double lmn[3];
+  int ndirection;               /* The first extracted spectrum with the same direction as this one, used in 
+                                   extract to trace a photon once for all of the spectra in a direction */
   double mmax, mmin;            /* Used only in live or die situations, mmax=cos(angle-DANG_LIVE_OR_DIE)
                                    and mmim=cos(angle+DANG_LIVE_OR_DIE).   In actually defining this
                                    one has to worry about signs and exactly whether you are above
@@ -1228,6 +1433,9 @@ typedef struct Cdf
 
 struct Cdf cdf_ff;
 struct Cdf cdf_fb;
+#ifdef _OPENMP
+#pragma omp threadprivate(cdf_ff, cdf_fb)
+#endif
 struct Cdf cdf_vcos;
 struct Cdf cdf_bb;
 struct Cdf cdf_brem;
@@ -1284,6 +1492,8 @@ struct xbands
   double weight[NBANDS];
   int nphot[NBANDS];
   int nbands;                   // Actual number of bands in use
+  int flux_known;               // TRUE if flux and nphot are those for this cycle, so that define_phot
+                                // can reuse them for the later chunks of photons, see calculate_ionization
 }
 xband;
 
@@ -1330,7 +1540,11 @@ em_rnge;
 #include "recipes.h"
 
 // 04apr ksl -- made kap_bf external so can be passed around variables
-double kap_bf[NLEVELS];
+double *kap_bf;
+int kap_bf_size;                /* The number of x-sections for which kap_bf has space, see kappa_bf */
+#ifdef _OPENMP
+#pragma omp threadprivate(kap_bf, kap_bf_size)
+#endif
 
 
 
@@ -1366,10 +1580,12 @@ struct advanced_modes
   int use_debug;                // print out debug statements
   int print_dvds_info;          // print out information on the velocity gradients
   int keep_photoabs;            // keep photoabsorption in final spectrum
+  int kappa_table;              // tabulate the continuum opacity of each cell for the final spectrum
   int quit_after_inputs;        // quit after inputs read in, testing mode
   int fixed_temp;               // do not alter temperature from that set in the parameter file
   int zeus_connect;             // We are connecting to zeus, do not seek new temp and output a heating and cooling file
   int rand_seed_usetime;        // default random number seed is fixed, not based on time
+  int dynamic_photons;          // share the photons of a cycle dynamically between MPI tasks
 }
 modes;
 
@@ -1414,12 +1630,25 @@ files;
 #define CALCULATE_MATOM_EMISSIVITIES 0
 #define USE_STORED_MATOM_EMISSIVITIES 1
 
+/* these control whether get_matom_f() finds the emissivities by following
+   macro atom packets, or directly from the jumping and emission rates */
+#define MATOM_EMISS_MONTE_CARLO 0
+#define MATOM_EMISS_DETERMINISTIC 1
+
 /* this variable controls whether to use the 
    Altered mode for bound-free in "simple-macro mode" */
 #define BF_SIMPLE_EMISSIVITY_APPROACH 1
 
 /* Variable introducted to cut off macroatom / estimator integrals when exponential function reaches extreme values. Effectivevly a max limit imposed on x = hnu/kT terms */
 #define ALPHA_MATOM_NUMAX_LIMIT 30      /* maximum value for h nu / k T to be considered in integrals */
+#define ALPHA_FF 100.           // maximum h nu / kT to create the free free CDF in kpkt
+
+/* These control the tables of the integrals used for the macro atom gamma and alpha_st estimators (see estimators.c) */
+#define MATOM_RATE_TMIN 10.     /* the lowest temperature in the tables */
+#define MATOM_RATE_TMAX 1.e9    /* the highest temperature in the tables */
+#define MATOM_RATE_NTEMP 321    /* the number of temperatures, which are spaced evenly in log T */
+#define MATOM_RATE_ACCURACY 1.e-5       /* the fractional accuracy to which the series of table values are summed */
+#define MATOM_RATE_NTERMS 1000  /* the maximum number of terms in the series before integrating directly */
 
 
 /* DIAGNOSTIC for understanding problems imported models
@@ -1438,3 +1667,6 @@ files;
 #define BOUND_OUTER_RHO 8
 
 int xxxbound;
+#ifdef _OPENMP
+#pragma omp threadprivate(xxxbound)
+#endif
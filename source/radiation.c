@@ -119,6 +119,9 @@
 #define COLMIN	0.01
 
 int iicount = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(iicount)
+#endif
 
 
 /**********************************************************/
@@ -129,6 +132,7 @@ int iicount = 0;
  * also keeps track of the number of photoionizations for H and He in the
  * cell.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in,out] PhotPtr  p   the photon
  * @param [in] double  ds   the distance the photon has travelled in the cell
  * @return     Always returns 0.  The pieces of the wind structure which are updated are
@@ -149,13 +153,13 @@ int iicount = 0;
  **********************************************************/
 
 int
-radiation (p, ds)
+radiation (ctx, p, ds)
+     CtxPtr ctx;
      PhotPtr p;
      double ds;
 {
   TopPhotPtr x_top_ptr;
 
-  WindPtr one;
   PlasmaPtr xplasma;
 
   double freq, freq_store;
@@ -181,10 +185,10 @@ radiation (p, ds)
   struct photon phot;
   int ndom;
 
-  one = &wmain[p->grid];        /* So one is the grid cell of interest */
+  /* Find the domain and the plasma cell of the grid cell of interest from the compact copy of wmain */
 
-  ndom = one->ndom;
-  xplasma = &plasmamain[one->nplasma];
+  ndom = windhot[p->grid].ndom;
+  xplasma = &plasmamain[windhot[p->grid].nplasma];
   check_plasma (xplasma, "radiation");
 
   /* JM 140321 -- #73 Bugfix
@@ -215,21 +219,6 @@ radiation (p, ds)
   /* take the average of the frequencies at original position and original+ds */
   freq = 0.5 * (freq_inner + freq_outer);
 
-  /* calculate free-free, compton and ind-compton opacities 
-     note that we also call these with the average frequency along ds */
-
-  kappa_tot = frac_ff = kappa_ff (xplasma, freq);       /* Add ff opacity */
-  kappa_tot += frac_comp = kappa_comp (xplasma, freq);  /* Calculate compton opacity, 
-                                                           store it in kappa_comp and also add it to kappa_tot, 
-                                                           the total opacity for the photon path */
-
-  kappa_tot += frac_ind_comp = kappa_ind_comp (xplasma, freq);
-
-  frac_tot = frac_z = 0;        /* 59a - ksl - Moved this line out of loop to avoid warning, but notes 
-                                   indicate this is all diagnostic and might be removed */
-  frac_auger = 0;
-  frac_tot_abs = frac_auger_abs = 0.0;
-
   /* Check which of the frequencies is larger.  */
 
   if (freq_outer > freq_inner)
@@ -243,159 +232,185 @@ radiation (p, ds)
     freq_min = freq_outer;
   }
 
-  if (freq > phot_freq_min)
-
-  {
-    if (geo.ioniz_or_extract)
-    {                           // Initialize during ionization cycles only
-      for (nion = 0; nion < nions; nion++)
-      {
-        kappa_ion[nion] = 0;
-        frac_ion[nion] = 0;
-      }
-    }
+  frac_tot = frac_z = 0;        /* 59a - ksl - Moved this line out of loop to avoid warning, but notes 
+                                   indicate this is all diagnostic and might be removed */
+  frac_auger = 0;
+  frac_tot_abs = frac_auger_abs = 0.0;
 
-    /* Next section is for photoionization with Topbase.  There may be more
-       than one x-section associated with an ion, and so one has to keep track
-       of the energy that goes into heating electrons carefully.  */
+  /* In the spectral cycles only the absorptive part of the continuum opacity is needed, and
+     if it has been tabulated for the cell this can be interpolated rather than calculated
+     from the individual x-sections */
 
-    /* JM 1405 -- I've added a check here that checks if a photoionization edge has been crossed.
-       If it has, then we multiply sigma*density by a factor frac_path, which is equal to the how far along 
-       ds the edge occurs in frequency space  [(ft - freq_min) / (freq_max - freq_min)] */
+  if (geo.ioniz_or_extract == 0 && (kappa_tot = kappa_cont_tab (xplasma, freq_min, freq, freq_max)) >= 0.0)
+  {
+    frac_ff = frac_comp = frac_ind_comp = 0.0;
+  }
+  else
+  {
+    /* calculate free-free, compton and ind-compton opacities 
+       note that we also call these with the average frequency along ds */
 
+    kappa_tot = frac_ff = kappa_ff (xplasma, freq);     /* Add ff opacity */
+    kappa_tot += frac_comp = kappa_comp (xplasma, freq);  /* Calculate compton opacity, 
+                                                             store it in kappa_comp and also add it to kappa_tot, 
+                                                             the total opacity for the photon path */
 
-    /* Next steps are a way to avoid the loop over photoionization x sections when it should not matter */
-    if (DENSITY_PHOT_MIN > 0)
-    {                           // Initialize during ionization cycles only
+    kappa_tot += frac_ind_comp = kappa_ind_comp (xplasma, freq);
 
+    if (freq > phot_freq_min)
 
-      /* Loop over all photoionization xsections */
-      for (n = 0; n < nphot_total; n++)
-      {
-        x_top_ptr = phot_top_ptr[n];
-        ft = x_top_ptr->freq[0];
-        if (ft > freq_min && ft < freq_max)
+    {
+      if (geo.ioniz_or_extract)
+      {                         // Initialize during ionization cycles only
+        for (nion = 0; nion < nions; nion++)
         {
-          /* then the shifting of the photon causes it to cross an edge. 
-             Find out where between fmin and fmax the edge would be in freq space.
-             frac_path is the fraction of the total path length above the absorption edge
-             freq_xs is freq halfway between the edge and the max freq if an edge gets crossed */
-          frac_path = (freq_max - ft) / (freq_max - freq_min);
-          freq_xs = 0.5 * (ft + freq_max);
+          kappa_ion[nion] = 0;
+          frac_ion[nion] = 0;
         }
+      }
 
-        else if (ft > freq_max)
-          break;                // The remaining transitions will have higher thresholds
+      /* Next section is for photoionization with Topbase.  There may be more
+         than one x-section associated with an ion, and so one has to keep track
+         of the energy that goes into heating electrons carefully.  */
 
-        else if (ft < freq_min)
-        {
-          frac_path = 1.0;      // then the frequency of the photon is above the threshold all along the path
-          freq_xs = freq;       // use the average frequency
-        }
+      /* JM 1405 -- I've added a check here that checks if a photoionization edge has been crossed.
+         If it has, then we multiply sigma*density by a factor frac_path, which is equal to the how far along 
+         ds the edge occurs in frequency space  [(ft - freq_min) / (freq_max - freq_min)] */
 
-        if (freq_xs < x_top_ptr->freq[x_top_ptr->np - 1])
-        {
-          /* Need the appropriate density at this point. 
-             how we get this depends if we have a topbase (level by level) 
-             or vfky cross-section (ion by ion) */
 
-          nion = x_top_ptr->nion;
-          if (ion[nion].phot_info > 0)  // topbase or hybrid
+      /* Next steps are a way to avoid the loop over photoionization x sections when it should not matter */
+      if (DENSITY_PHOT_MIN > 0)
+      {                         // Initialize during ionization cycles only
+
+
+        /* Loop over all photoionization xsections */
+        for (n = 0; n < nphot_total; n++)
+        {
+          x_top_ptr = phot_top_ptr[n];
+          ft = x_top_ptr->freq[0];
+          if (ft > freq_min && ft < freq_max)
           {
-            nconf = x_top_ptr->nlev;
-            density = den_config (xplasma, nconf);
+            /* then the shifting of the photon causes it to cross an edge. 
+               Find out where between fmin and fmax the edge would be in freq space.
+               frac_path is the fraction of the total path length above the absorption edge
+               freq_xs is freq halfway between the edge and the max freq if an edge gets crossed */
+            frac_path = (freq_max - ft) / (freq_max - freq_min);
+            freq_xs = 0.5 * (ft + freq_max);
           }
 
-          else if (ion[nion].phot_info == 0)    // verner
-            density = xplasma->density[nion];
+          else if (ft > freq_max)
+            break;              // The remaining transitions will have higher thresholds
 
-          else
+          else if (ft < freq_min)
           {
-            Error ("radiation.c: No type (%i) for xsection!\n");
-            density = 0.0;
+            frac_path = 1.0;    // then the frequency of the photon is above the threshold all along the path
+            freq_xs = freq;     // use the average frequency
           }
 
-          if (density > DENSITY_PHOT_MIN)
+          if (freq_xs < x_top_ptr->freq[x_top_ptr->np - 1])
           {
+            /* Need the appropriate density at this point. 
+               how we get this depends if we have a topbase (level by level) 
+               or vfky cross-section (ion by ion) */
+
+            nion = x_top_ptr->nion;
+            if (ion[nion].phot_info > 0)  // topbase or hybrid
+            {
+              nconf = x_top_ptr->nlev;
+              density = den_config (xplasma, nconf);
+            }
 
-            /* Note that this includes a filling factor  */
-            kappa_tot += x = sigma_phot (x_top_ptr, freq_xs) * density * frac_path * zdom[ndom].fill;
+            else if (ion[nion].phot_info == 0)  // verner
+              density = xplasma->density[nion];
 
+            else
+            {
+              Error ("radiation.c: No type (%i) for xsection!\n");
+              density = 0.0;
+            }
 
-            if (geo.ioniz_or_extract)
-            {                   // Calculate during ionization cycles only
+            if (density > DENSITY_PHOT_MIN)
+            {
 
-              //This is the heating effect - i.e. the absorbed photon energy less the binding energy of the lost electron
-              frac_tot += z = x * (freq_xs - ft) / freq_xs;
-              //This is the absorbed energy fraction
-              frac_tot_abs += z_abs = x;
+              /* Note that this includes a filling factor  */
+              kappa_tot += x = sigma_phot (ctx, x_top_ptr, freq_xs) * density * frac_path * zdom[ndom].fill;
 
-              if (nion > 3)
-              {
-                frac_z += z;
+
+              if (geo.ioniz_or_extract)
+              {                 // Calculate during ionization cycles only
+
+                //This is the heating effect - i.e. the absorbed photon energy less the binding energy of the lost electron
+                frac_tot += z = x * (freq_xs - ft) / freq_xs;
+                //This is the absorbed energy fraction
+                frac_tot_abs += z_abs = x;
+
+                if (nion > 3)
+                {
+                  frac_z += z;
+                }
+
+                frac_ion[nion] += z;
+                kappa_ion[nion] += x;
               }
 
-              frac_ion[nion] += z;
-              kappa_ion[nion] += x;
             }
 
-          }
-
 
+          }
         }
-      }
 
-      /* Loop over all inner shell cross sections as well! But only for VFKY ions - topbase has those edges in */
+        /* Loop over all inner shell cross sections as well! But only for VFKY ions - topbase has those edges in */
 
-      if (freq > inner_freq_min)
-      {
-        for (n = 0; n < n_inner_tot; n++)
+        if (freq > inner_freq_min)
         {
-          if (ion[inner_cross[n].nion].phot_info != 1)
+          for (n = 0; n < n_inner_tot; n++)
           {
-            x_top_ptr = inner_cross_ptr[n];
-            if (x_top_ptr->n_elec_yield != -1)  //Only any point in doing this if we know the energy of elecrons
+            if (ion[inner_cross[n].nion].phot_info != 1)
             {
-              ft = x_top_ptr->freq[0];
-
-              if (ft > freq_min && ft < freq_max)
-              {
-                frac_path = (freq_max - ft) / (freq_max - freq_min);
-                freq_xs = 0.5 * (ft + freq_max);
-              }
-              else if (ft > freq_max)
-                break;          // The remaining transitions will have higher thresholds
-              else if (ft < freq_min)
-              {
-                frac_path = 1.0;        // then all frequency along ds are above edge
-                freq_xs = freq; // use the average frequency
-              }
-              if (freq_xs < x_top_ptr->freq[x_top_ptr->np - 1])
+              x_top_ptr = inner_cross_ptr[n];
+              if (x_top_ptr->n_elec_yield != -1)  //Only any point in doing this if we know the energy of elecrons
               {
-                nion = x_top_ptr->nion;
-                if (ion[nion].phot_info == 0)   // verner only ion
+                ft = x_top_ptr->freq[0];
+
+                if (ft > freq_min && ft < freq_max)
                 {
-                  density = xplasma->density[nion];     //All these rates are from the ground state, so we just need the density of the ion.
+                  frac_path = (freq_max - ft) / (freq_max - freq_min);
+                  freq_xs = 0.5 * (ft + freq_max);
                 }
-                else
+                else if (ft > freq_max)
+                  break;        // The remaining transitions will have higher thresholds
+                else if (ft < freq_min)
                 {
-                  nconf = phot_top[ion[nion].ntop_ground].nlev; //The lower level of the ground state Pi cross section (should be GS!)
-                  density = den_config (xplasma, nconf);
+                  frac_path = 1.0;      // then all frequency along ds are above edge
+                  freq_xs = freq; // use the average frequency
                 }
-                if (density > DENSITY_PHOT_MIN)
+                if (freq_xs < x_top_ptr->freq[x_top_ptr->np - 1])
                 {
-                  kappa_tot += x = sigma_phot (x_top_ptr, freq_xs) * density * frac_path * zdom[ndom].fill;
-                  if (geo.ioniz_or_extract && x_top_ptr->n_elec_yield != -1)    // Calculate during ionization cycles only
+                  nion = x_top_ptr->nion;
+                  if (ion[nion].phot_info == 0) // verner only ion
                   {
-                    frac_auger += z = x * (inner_elec_yield[x_top_ptr->n_elec_yield].Ea / EV2ERGS) / (freq_xs * HEV);
-                    frac_auger_abs += z_abs = x;        //This is the absorbed energy fraction
-
-                    if (nion > 3)
+                    density = xplasma->density[nion];   //All these rates are from the ground state, so we just need the density of the ion.
+                  }
+                  else
+                  {
+                    nconf = phot_top[ion[nion].ntop_ground].nlev; //The lower level of the ground state Pi cross section (should be GS!)
+                    density = den_config (xplasma, nconf);
+                  }
+                  if (density > DENSITY_PHOT_MIN)
+                  {
+                    kappa_tot += x = sigma_phot (ctx, x_top_ptr, freq_xs) * density * frac_path * zdom[ndom].fill;
+                    if (geo.ioniz_or_extract && x_top_ptr->n_elec_yield != -1)  // Calculate during ionization cycles only
                     {
-                      frac_z += z;
+                      frac_auger += z = x * (inner_elec_yield[x_top_ptr->n_elec_yield].Ea / EV2ERGS) / (freq_xs * HEV);
+                      frac_auger_abs += z_abs = x;      //This is the absorbed energy fraction
+
+                      if (nion > 3)
+                      {
+                        frac_z += z;
+                      }
+                      frac_ion[nion] += z;
+                      kappa_ion[nion] += x;
                     }
-                    frac_ion[nion] += z;
-                    kappa_ion[nion] += x;
                   }
                 }
               }
@@ -498,7 +513,7 @@ radiation (p, ds)
 
   if (modes.save_cell_stats && ncstat > 0)
   {
-    save_photon_stats (one, p, ds, w_ave);      // save photon statistics (extra diagnostics)
+    save_photon_stats (&wmain[p->grid], p, ds, w_ave); // save photon statistics (extra diagnostics)
   }
 
 
@@ -716,6 +731,7 @@ kappa_ff (xplasma, freq)
  * 	photionization crossection due to a Topbase level associated with
  * 	x_ptr at frequency freq
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of a photon being transported, or NULL
  * @param [in,out] struct topbase_phot *  x_ptr   The structure that contains
  * TopBase information about the photoionization x-section
  * @param [in] double  freq   The frequency where the x-section is to be calculated
@@ -730,46 +746,78 @@ kappa_ff (xplasma, freq)
  *
  * ### Notes ###
  *
+ * The photon transport asks for the same x-section at the same or a
+ * nearby frequency many times, so when a transport context is given
+ * the last frequency, x-section and element of the freq array are 
+ * remembered in it.  The shared x-section structures are not modified.
+ *
  **********************************************************/
 
 double
-sigma_phot (x_ptr, freq)
+sigma_phot (ctx, x_ptr, freq)
+     CtxPtr ctx;
      struct topbase_phot *x_ptr;
      double freq;
 {
-  int nmax;
   double xsection;
   double frac, fbot, ftop;
   int linterp ();
-  int nlast;
+  int nlast, nx;
 
   if (freq < x_ptr->freq[0])
     return (0.0);               // Since this was below threshold
-  if (freq == x_ptr->f)
-    return (x_ptr->sigma);      // Avoid recalculating xsection
 
-  if (x_ptr->nlast > -1)
+  /* Without a transport context, or for an x-section which is not in phot_top or inner_cross,
+     nothing is remembered */
+
+  nx = -1;
+  if (ctx != NULL)
+  {
+    if (x_ptr >= phot_top && x_ptr < phot_top + nphot_max)
+    {
+      nx = x_ptr - phot_top;
+    }
+    else if (x_ptr >= inner_cross && x_ptr < inner_cross + n_inner_max)
+    {
+      nx = nphot_max + (x_ptr - inner_cross);
+    }
+  }
+
+  if (nx < 0)
+  {
+    linterp (freq, &x_ptr->freq[0], &x_ptr->x[0], x_ptr->np, &xsection, 1);
+    return (xsection);
+  }
+
+  ctx->sigma_calls++;
+
+  if (freq == ctx->sigma_f[nx])
+  {
+    ctx->sigma_hits++;
+    return (ctx->sigma_x[nx]);  // Avoid recalculating xsection
+  }
+
+  if ((nlast = ctx->sigma_nlast[nx]) > -1)
   {
-    nlast = x_ptr->nlast;
     if ((fbot = x_ptr->freq[nlast]) < freq && freq < (ftop = x_ptr->freq[nlast + 1]))
     {
       frac = (log (freq) - log (fbot)) / (log (ftop) - log (fbot));
       xsection = exp ((1. - frac) * log (x_ptr->x[nlast]) + frac * log (x_ptr->x[nlast + 1]));
       //Store the results
-      x_ptr->sigma = xsection;
-      x_ptr->f = freq;
+      ctx->sigma_x[nx] = xsection;
+      ctx->sigma_f[nx] = freq;
+      ctx->sigma_hits++;
       return (xsection);
     }
   }
 
 /* If got to here, have to go the whole hog in calculating the x-section */
-  nmax = x_ptr->np;
-  x_ptr->nlast = linterp (freq, &x_ptr->freq[0], &x_ptr->x[0], nmax, &xsection, 1);     //call linterp in log space
+  ctx->sigma_nlast[nx] = linterp (freq, &x_ptr->freq[0], &x_ptr->x[0], x_ptr->np, &xsection, 1);        //call linterp in log space
 
 
   //Store the results
-  x_ptr->sigma = xsection;
-  x_ptr->f = freq;
+  ctx->sigma_x[nx] = xsection;
+  ctx->sigma_f[nx] = freq;
 
 
   return (xsection);
@@ -1321,6 +1369,9 @@ mean_intensity (xplasma, freq, mode)
               /* JM140723 -- originally we threw an error here. No we count these errors and 
                  in wind_updates because you actually expect 
                  it to happen in a converging run */
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
               nerr_Jmodel_wrong_freq++;
             }
           }
@@ -1331,6 +1382,9 @@ mean_intensity (xplasma, freq, mode)
             /* JM140723 -- originally we threw an error here. No we count these errors and 
                in wind_updates because you actually expect 
                it to happen in a converging run */
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
             nerr_no_Jmodel++;
           }
 
@@ -1366,3 +1420,209 @@ mean_intensity (xplasma, freq, mode)
 
   return J;
 }
+
+
+
+/**********************************************************/
+/**
+ * @brief      Tabulate the absorptive continuum opacity of each cell on a
+ * common logarithmic frequency grid for use in the spectral cycles
+ *
+ * @param [in] double  fmin   The lowest frequency of the detailed spectrum
+ * @param [in] double  fmax   The highest frequency of the detailed spectrum
+ * @return     The number of frequencies in the table, or 0 if no table was made
+ *
+ * @details
+ * For every plasma cell the free-free, induced Compton and bound-free
+ * (including inner shell) opacity is evaluated at NKAPPA_TAB frequencies
+ * spaced uniformly in log between fmin / KAPPA_TAB_MARGIN and
+ * fmax * KAPPA_TAB_MARGIN.  The bound-free part is built one x-section
+ * at a time; the x-section is evaluated on the grid once and then added,
+ * weighted by the appropriate density, to the table of each cell in which
+ * the density exceeds DENSITY_PHOT_MIN, exactly the x-sections radiation
+ * would include.
+ *
+ * ### Notes ###
+ * The table is only made if modes.kappa_table has been set, and is only
+ * used in the spectral cycles, where the plasma does not change.  The
+ * ionization cycles need the opacity of each ion separately to find the
+ * heating and photoionization rates and continue to use the x-sections
+ * directly.
+ *
+ * Electron scattering is not included since it does not reduce the weight
+ * of a photon in radiation.
+ *
+ **********************************************************/
+
+int
+kappa_cont_tab_make (fmin, fmax)
+     double fmin, fmax;
+{
+  TopPhotPtr x_top_ptr;
+  PlasmaPtr xplasma;
+  double *kap, *freq, *sigma;
+  double lfmax, density, fill, ftop;
+  int n, nn, i, imin, imax, nion;
+
+  nkappa_tab = 0;
+
+  if (!modes.kappa_table)
+    return (0);
+
+  if (kappa_tab == NULL)
+  {
+    if ((kappa_tab = calloc (sizeof (double), NPLASMA * NKAPPA_TAB)) == NULL)
+    {
+      Error ("kappa_cont_tab_make: Could not allocate memory for the continuum opacity table\n");
+      exit (0);
+    }
+    Log ("kappa_cont_tab_make: Allocated %10.1f Mb for the continuum opacity table\n", 1.e-6 * NPLASMA * NKAPPA_TAB * sizeof (double));
+  }
+
+  freq = calloc (sizeof (double), NKAPPA_TAB);
+  sigma = calloc (sizeof (double), NKAPPA_TAB);
+
+  if (freq == NULL || sigma == NULL)
+  {
+    Error ("kappa_cont_tab_make: Could not allocate memory for the frequency grid\n");
+    exit (0);
+  }
+
+  kappa_tab_lfmin = log (fmin / KAPPA_TAB_MARGIN);
+  lfmax = log (fmax * KAPPA_TAB_MARGIN);
+  kappa_tab_dlf = (lfmax - kappa_tab_lfmin) / (NKAPPA_TAB - 1);
+
+  for (i = 0; i < NKAPPA_TAB; i++)
+    freq[i] = exp (kappa_tab_lfmin + i * kappa_tab_dlf);
+
+  /* Start with the free-free and induced Compton opacity of each cell */
+
+  for (n = 0; n < NPLASMA; n++)
+  {
+    xplasma = &plasmamain[n];
+    kap = &kappa_tab[n * NKAPPA_TAB];
+    for (i = 0; i < NKAPPA_TAB; i++)
+      kap[i] = kappa_ff (xplasma, freq[i]) + kappa_ind_comp (xplasma, freq[i]);
+  }
+
+  /* Then add the photoionization x-sections, and the inner shell x-sections of the
+     VFKY ions, in the same way as radiation does */
+
+  if (DENSITY_PHOT_MIN > 0)
+  {
+    for (nn = 0; nn < nphot_total + n_inner_tot; nn++)
+    {
+      if (nn < nphot_total)
+        x_top_ptr = phot_top_ptr[nn];
+      else
+      {
+        x_top_ptr = inner_cross_ptr[nn - nphot_total];
+        if (ion[x_top_ptr->nion].phot_info == 1 || x_top_ptr->n_elec_yield == -1)
+          continue;
+      }
+
+      ftop = x_top_ptr->freq[x_top_ptr->np - 1];
+      if (ftop <= freq[0] || x_top_ptr->freq[0] >= freq[NKAPPA_TAB - 1])
+        continue;
+
+      for (imin = 0; freq[imin] < x_top_ptr->freq[0]; imin++);
+      for (imax = imin; imax < NKAPPA_TAB && freq[imax] < ftop; imax++);
+
+      for (i = imin; i < imax; i++)
+        sigma[i] = sigma_phot (NULL, x_top_ptr, freq[i]);
+
+      nion = x_top_ptr->nion;
+
+      for (n = 0; n < NPLASMA; n++)
+      {
+        xplasma = &plasmamain[n];
+
+        if (nn >= nphot_total)
+        {
+          if (ion[nion].phot_info == 0)
+            density = xplasma->density[nion];
+          else
+            density = den_config (xplasma, phot_top[ion[nion].ntop_ground].nlev);
+        }
+        else if (ion[nion].phot_info > 0)
+          density = den_config (xplasma, x_top_ptr->nlev);
+        else
+          density = xplasma->density[nion];
+
+        if (density > DENSITY_PHOT_MIN)
+        {
+          fill = density * zdom[wmain[xplasma->nwind].ndom].fill;
+          kap = &kappa_tab[n * NKAPPA_TAB];
+          for (i = imin; i < imax; i++)
+            kap[i] += sigma[i] * fill;
+        }
+      }
+    }
+  }
+
+  free (freq);
+  free (sigma);
+
+  nkappa_tab = NKAPPA_TAB;
+
+  Log ("kappa_cont_tab_make: Tabulated the continuum opacity of %d cells at %d frequencies from %.3e to %.3e Hz\n",
+       NPLASMA, nkappa_tab, exp (kappa_tab_lfmin), exp (lfmax));
+
+  return (nkappa_tab);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Interpolate the absorptive continuum opacity of a cell
+ * along a path from the table made by kappa_cont_tab_make
+ *
+ * @param [in] PlasmaPtr  xplasma   The plasma cell
+ * @param [in] double  fmin   The lowest co-moving frequency along the path
+ * @param [in] double  freq   The average co-moving frequency along the path
+ * @param [in] double  fmax   The highest co-moving frequency along the path
+ * @return     The opacity averaged over the path, or -1 if there is no
+ * table or the path lies partly outside it
+ *
+ * @details
+ * The table is interpolated linearly in log frequency at the three
+ * frequencies, and these are combined with Simpson's rule.  This
+ * replaces the treatment of edges crossed along the path in radiation.
+ *
+ * ### Notes ###
+ * A negative value tells the calling routine to calculate the opacity
+ * from the x-sections instead.
+ *
+ **********************************************************/
+
+double
+kappa_cont_tab (xplasma, fmin, freq, fmax)
+     PlasmaPtr xplasma;
+     double fmin, freq, fmax;
+{
+  double *kap;
+  double f[3], k[3], x;
+  int i, n;
+
+  if (nkappa_tab == 0)
+    return (-1.0);
+
+  kap = &kappa_tab[xplasma->nplasma * nkappa_tab];
+
+  f[0] = fmin;
+  f[1] = freq;
+  f[2] = fmax;
+
+  for (n = 0; n < 3; n++)
+  {
+    x = (log (f[n]) - kappa_tab_lfmin) / kappa_tab_dlf;
+    if (x < 0.0 || x >= nkappa_tab - 1)
+      return (-1.0);
+    i = (int) x;
+    x -= i;
+    k[n] = (1. - x) * kap[i] + x * kap[i + 1];
+  }
+
+  return ((k[0] + 4. * k[1] + k[2]) / 6.);
+}
@@ -30,6 +30,10 @@
 
 
 gsl_rng *rng;                   // pointer to a global random number generator
+#ifdef _OPENMP
+#pragma omp threadprivate(rng)
+#endif
+int rng_seed;                   // the seed given to init_rand, from which the generators of transport contexts are seeded
 
 /**********************************************************/
 /** @name      randvec
@@ -144,6 +148,10 @@ randvcos (lmn, north)
    * necessary as PDFSTEPS has been increased to 10000 in cdf.c  180715 ksl.
    */
 
+  /* The cdf is shared by all threads, so only one of them may create it */
+#ifdef _OPENMP
+#pragma omp critical (randvcos_init)
+#endif
   if (init_vcos == 0)
   {
     jumps[0] = 0.01745;
@@ -254,6 +262,11 @@ vcos (x)
  *
  * ###Notes###
  * 2/18	-	Written by NSH
+ *
+ * When the code is compiled with OpenMP, rng is private to each thread
+ * and this sets up the generator of the calling (master) thread.  The
+ * other threads use the generators of their transport contexts, see 
+ * use_rand_stream.
 ***********************************************************/
 
 
@@ -263,6 +276,53 @@ init_rand (seed)
 {
   rng = gsl_rng_alloc (gsl_rng_mt19937);        //Set the random number generator to the GSL Meursenne twirster
   gsl_rng_set (rng, seed);
+  rng_seed = seed;
+  return (0);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief	Makes the stream of a transport context the generator of the calling thread
+ *
+ * @param [in, out] ctx		The transport context of the calling thread
+ * @return 					0
+ *
+ * The first time a context is passed to this routine it is given 
+ * its own generator, seeded from the seed passed to init_rand and the
+ * number of the thread that owns the context, so that each 
+ * worker draws an independent sequence of random numbers.  The 
+ * generator of the context is then used by random_number and the 
+ * other routines in this file for the calling thread.
+ *
+ * ###Notes###
+ * The context of thread 0, the master thread, continues to use the
+ * generator set up by init_rand, so that a run on a single thread
+ * draws the same random numbers as one without contexts.
+***********************************************************/
+
+int
+use_rand_stream (ctx)
+     CtxPtr ctx;
+{
+  if (ctx->rng == NULL)
+  {
+    if (ctx->nthread == 0)
+    {
+      ctx->rng = rng;
+      ctx->own_rng = FALSE;
+    }
+    else
+    {
+      ctx->rng = gsl_rng_alloc (gsl_rng_mt19937);
+      gsl_rng_set (ctx->rng, rng_seed + ctx->nthread);
+      ctx->own_rng = TRUE;
+    }
+  }
+
+  rng = (gsl_rng *) ctx->rng;
+
   return (0);
 }
 
@@ -289,3 +349,174 @@ random_number (double min, double max)
   double x = min + ((max - min) * num);
   return (x);
 }
+
+
+
+/**********************************************************/
+/** 
+ * @brief	Set up a Walker alias table for sampling from a discrete distribution
+ *
+ * @param [in] int  n   The number of possible outcomes
+ * @param [in] double  weight[]   The (unnormalised) probabilities of the outcomes
+ * @param [out] double  prob[]   The probability of keeping each outcome in the table
+ * @param [out] int  alias[]   The outcome which replaces each one if it is not kept
+ * @return     0 on success, -1 if there are no outcomes or the total weight is not positive
+ *
+ * Once the table is set up, alias_sample chooses an outcome with a single random
+ * number and one comparison, however many outcomes there are.
+ *
+ * ###Notes###
+ * This is Vose's version of the method.  Instead of keeping lists of the
+ * outcomes whose scaled weight is smaller and larger than one, a pair of
+ * cursors is stepped through the arrays, so no extra memory is needed.
+ * Outcomes with zero weight are never chosen.
+***********************************************************/
+
+int
+alias_setup (int n, double weight[], double prob[], int alias[])
+{
+  double total;
+  int i, small, large, next;
+
+  total = 0.0;
+  for (i = 0; i < n; i++)
+  {
+    total += weight[i];
+  }
+
+  if (n <= 0 || total <= 0.0)
+  {
+    return (-1);
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    prob[i] = weight[i] * n / total;
+    alias[i] = i;
+  }
+
+  /* next is the place to look for the next outcome whose scaled weight is below one, and large
+     is the outcome whose excess weight is currently being used to fill the others */
+
+  for (large = 0; large < n && prob[large] < 1.0; large++);
+  for (next = 0; next < n && prob[next] >= 1.0; next++);
+  small = next++;
+
+  while (small < n && large < n)
+  {
+    alias[small] = large;
+    prob[large] -= 1.0 - prob[small];
+
+    if (prob[large] < 1.0)
+    {
+      /* large has become small.  If it is behind next it would otherwise be missed, so deal with it now */
+      if (large < next)
+      {
+        small = large;
+      }
+      else
+      {
+        for (; next < n && prob[next] >= 1.0; next++);
+        small = next++;
+      }
+      for (large++; large < n && prob[large] < 1.0; large++);
+    }
+    else
+    {
+      for (; next < n && prob[next] >= 1.0; next++);
+      small = next++;
+    }
+  }
+
+  /* Anything left over should have a scaled weight of one, apart from rounding errors */
+
+  for (i = 0; i < n; i++)
+  {
+    if (alias[i] == i)
+    {
+      prob[i] = 1.0;
+    }
+  }
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief	Choose an outcome from a Walker alias table
+ *
+ * @param [in] int  n   The number of possible outcomes
+ * @param [in] double  prob[]   The probabilities of keeping each outcome, from alias_setup
+ * @param [in] int  alias[]   The aliases of each outcome, from alias_setup
+ * @return     The outcome chosen, between 0 and n-1
+ *
+ * ###Notes###
+ * A single random number is used both to choose an entry in the table and
+ * to decide whether to keep it or to take its alias.
+***********************************************************/
+
+int
+alias_sample (int n, double prob[], int alias[])
+{
+  double u;
+  int i;
+
+  u = random_number (0.0, 1.0) * n;
+  i = (int) u;
+  if (i >= n)
+  {
+    i = n - 1;
+  }
+
+  if (u - i < prob[i])
+  {
+    return (i);
+  }
+
+  return (alias[i]);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief	Divide a number of events among a set of outcomes at random
+ *
+ * @param [in] int  k   The number of possible outcomes
+ * @param [in] int  ntot   The number of events
+ * @param [in] double  weight[]   The (unnormalised) probabilities of the outcomes
+ * @param [out] unsigned int  counts[]   The number of events which had each outcome
+ * @return     0 on success, -1 if the total weight is not positive
+ *
+ * The counts are a single draw from the multinomial distribution, and so
+ * are distributed in exactly the same way as if each event had been
+ * assigned an outcome separately, but the cost depends on k and not on ntot.
+ *
+ * ###Notes###
+ * This uses the random number generator set up in init_rand
+***********************************************************/
+
+int
+random_multinomial (int k, int ntot, double weight[], unsigned int counts[])
+{
+  double total;
+  int i;
+
+  total = 0.0;
+  for (i = 0; i < k; i++)
+  {
+    counts[i] = 0;
+    total += weight[i];
+  }
+
+  if (total <= 0.0)
+  {
+    return (-1);
+  }
+
+  gsl_ran_multinomial (rng, k, ntot, weight, counts);
+
+  return (0);
+}
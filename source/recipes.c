@@ -117,6 +117,9 @@ trapzd (func, a, b, n)
   double x, tnm, sum, del;
   static double s;
   static int it;
+#ifdef _OPENMP
+#pragma omp threadprivate(s, it)
+#endif
   double ssss;
   int j;
 
@@ -62,6 +62,9 @@ double fbt;
 
 /// fb_choice (see above)
 int fbfr;
+#ifdef _OPENMP
+#pragma omp threadprivate(fb_xtop, fbt, fbfr)
+#endif
 
 
 
@@ -127,7 +130,7 @@ fb_topbase_partial (freq)
   }
 
   gion = ion[nion + 1].g;       // Want the g factor of the next ion up
-  x = sigma_phot (fb_xtop, freq);
+  x = sigma_phot (NULL, fb_xtop, freq);
   // Now calculate emission using Ferland's expression
 
   partial = FBEMISS * gn / (2. * gion) * pow (freq * freq / fbt, 1.5) * exp (H_OVER_K * (fthresh - freq) / fbt) * x;
@@ -486,14 +489,18 @@ total_fb (one, t, f1, f2, fb_choice, mode)
 
 
 double fb_x[NCDF], fb_y[NCDF];
-/// There is at most one jump per level
-double fb_jumps[NLEVELS];
+/// There is at most one jump per x-section
+double *fb_jumps = NULL;
 /// This is just a dummy array that parallels fb_jumpts
-double xfb_jumps[NLEVELS];
+double *xfb_jumps = NULL;
 int fb_njumps = (-1);
+int fb_jumps_size = 0;          /* The number of jumps for which there is space */
 
 WindPtr ww_fb;
 double one_fb_f1, one_fb_f2, one_fb_te; /* Old values */
+#ifdef _OPENMP
+#pragma omp threadprivate(fb_x, fb_y, fb_jumps, xfb_jumps, fb_njumps, fb_jumps_size, ww_fb, one_fb_f1, one_fb_f2, one_fb_te)
+#endif
 
 
 /**********************************************************/
@@ -573,6 +580,17 @@ use that instead if possible --  57h */
 
     if (f1 != one_fb_f1 || f2 != one_fb_f2)
     {                           // Regenerate the jumps
+      if (fb_jumps_size < nphot_total)
+      {
+        fb_jumps = (double *) realloc (fb_jumps, sizeof (double) * nphot_total);
+        xfb_jumps = (double *) realloc (xfb_jumps, sizeof (double) * nphot_total);
+        if (fb_jumps == NULL || xfb_jumps == NULL)
+        {
+          Error ("one_fb: Could not allocate memory for %d jumps\n", nphot_total);
+          exit (0);
+        }
+        fb_jumps_size = nphot_total;
+      }
       fb_njumps = 0;
       for (n = 0; n < nphot_total; n++)
       {
@@ -1858,3 +1876,66 @@ matom_select_bf_freq (WindPtr one, int nconf)
 
 
 }
+
+
+
+/**********************************************************/
+/** 
+ * @brief finds the fraction of the bf macro atom emission of a continuum in a frequency range
+ * 
+ * @param [in]     PlasmaPtr xplasma   the plasma cell in which the emission takes place
+ * @param [in]     int nconf   the index into phot_top that identifies the continuum 
+ * @param [in]     double fmin   the minimum frequency of the range
+ * @param [in]     double fmax   the maximum frequency of the range
+ * @return frac    the fraction of the photons generated by matom_select_bf_freq which lie between fmin and fmax
+ *
+ * This is used when the macro atom emissivities are calculated directly rather than by
+ * following packets (see get_matom_f).  It uses the same spectrum, and the same frequency
+ * limits, as matom_select_bf_freq.
+ *
+ * ###Notes###
+***********************************************************/
+
+double
+matom_bf_freq_fraction (PlasmaPtr xplasma, int nconf, double fmin, double fmax)
+{
+  double f1, f2;
+  double total, part;
+
+  fbfr = FB_FULL;
+  fb_xtop = &phot_top[nconf];
+  fbt = xplasma->t_e;
+
+  f1 = phot_top[nconf].freq[0];
+
+  //If hydrogenic ion the emission falls off exponentially above the edge
+  if (ion[phot_top[nconf].nion].istate == ion[phot_top[nconf].nion].z)
+  {
+    if (fmin < f1)
+      fmin = f1;
+    if (fmax <= fmin)
+      return (0.0);
+    return (exp (H_OVER_K * (f1 - fmin) / fbt) - exp (H_OVER_K * (f1 - fmax) / fbt));
+  }
+
+  f2 = phot_top[nconf].freq[phot_top[nconf].np - 1];
+
+  if ((H_OVER_K * (f2 - f1) / fbt) > ALPHA_MATOM_NUMAX_LIMIT)
+  {
+    f2 = f1 + fbt * ALPHA_MATOM_NUMAX_LIMIT / H_OVER_K;
+  }
+
+  if (fmin < f1)
+    fmin = f1;
+  if (fmax > f2)
+    fmax = f2;
+  if (fmax <= fmin)
+    return (0.0);
+
+  if ((total = qromb (fb_topbase_partial, f1, f2, 1.e-4)) <= 0.0)
+    return (0.0);
+
+  part = qromb (fb_topbase_partial, fmin, fmax, 1.e-4);
+
+  return (part / total);
+}
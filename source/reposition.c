@@ -27,6 +27,7 @@
  * @brief      p) attempts to assure that a photon is not scattered
  * 	a second time inappropriately by the same transition
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in,out] PhotPtr  p   A photons
  * @return    Normally returns 0, but returns a negative number
  * if p is not in the wind in the domain it is supposed to be in
@@ -41,7 +42,8 @@
  **********************************************************/
 
 int
-reposition (p)
+reposition (ctx, p)
+     CtxPtr ctx;
      PhotPtr p;
 {
   int n;
@@ -49,7 +51,7 @@ reposition (p)
   if (p->nres < 0)
     return (0);                 /* Do nothing for non-resonant scatters */
 
-  if ((p->grid = n = where_in_grid (wmain[p->grid].ndom, p->x)) < 0)
+  if ((p->grid = n = where_in_grid (ctx, wmain[p->grid].ndom, p->x)) < 0)
   {
     Error ("reposition: Photon not in grid when routine entered %d \n", n);
     return (n);                 /* Photon was not in wind */
@@ -27,14 +27,12 @@
 
 
 
-struct photon cds_phot_old;
-double cds_v2_old, cds_dvds2_old;
-
 /**********************************************************/
 /**
  * @brief     calculate the distance a photon can travel
  * within a single shell without scattering
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] WindPtr  w   the entire wind structure
  * @param [in] PhotPtr  p   A photon (bundle)
  * @param [in] double  tau_scat   the optical depth at which the photon
@@ -62,6 +60,9 @@ double cds_v2_old, cds_dvds2_old;
  *
  * @details
  *
+ * The lines whose ions are flagged as not populated near the cell in 
+ * ion_populated are skipped without interpolating the ion density.
+ *
  * ### Notes ###
  * Calculate_ds does not modify the p in any way!!
  *
@@ -73,7 +74,8 @@ double cds_v2_old, cds_dvds2_old;
  *
  **********************************************************/
 double
-calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
+calculate_ds (ctx, w, p, tau_scat, tau, nres, smax, istat)
+     CtxPtr ctx;
      WindPtr w;
      PhotPtr p;
      double tau_scat, *tau;
@@ -101,6 +103,7 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
   PlasmaPtr xplasma, xplasma2;
   int ndom;
   double normal[3];
+  char *ion_use;
 
   one = &w[p->grid];            //pointer to the cell where the photon bundle is located.
 
@@ -125,14 +128,16 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
  * direction of two photons.  If they are the same, then
  * it just takes v1 from the old value.  */
 
-  if (comp_phot (&cds_phot_old, p))
+  ctx->cds_calls++;
+  if (comp_phot (&ctx->cds_phot_old, p))
   {
     vwind_xyz (ndom, p, v_inner);
     v1 = dot (p->lmn, v_inner);
   }
   else
   {
-    v1 = cds_v2_old;
+    v1 = ctx->cds_v2_old;
+    ctx->cds_hits++;
   }
 
   /* Initialize two photon structures phot and p_now for internal work
@@ -192,7 +197,7 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
 
   /*Compute the angle averaged cross section */
 
-  kap_es = klein_nishina (mean_freq) * xplasma->ne * zdom[ndom].fill;
+  kap_es = klein_nishina (mean_freq) * plasmahot[nplasma].ne * zdom[ndom].fill;
 
 
 /* The next section checks to see if the frequency difference on
@@ -209,19 +214,19 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
   }
   else if (dfreq > 0)
   {
-    limit_lines (freq_inner, freq_outer);
-    nstart = nline_min;
+    ctx->nline_delt = line_range (freq_inner, freq_outer, &ctx->nline_min, &ctx->nline_max);
+    nstart = ctx->nline_min;
     ndelt = 1;
   }
   else
   {
-    limit_lines (freq_outer, freq_inner);
-    nstart = nline_max;
+    ctx->nline_delt = line_range (freq_outer, freq_inner, &ctx->nline_min, &ctx->nline_max);
+    nstart = ctx->nline_max;
     ndelt = (-1);
   }
 
-/*nline_min, nline_max, and nline_delt are found in atomic.h and
- * are set by limit_lines()
+/* The range of lines, nline_min, nline_max, and nline_delt, is kept in the
+ * transport context of the photon
  */
 
 
@@ -246,7 +251,7 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
     freq_av = freq_inner;       //(freq_inner + freq_outer) * 0.5;  //need to do better than this perhaps but okay for star - comoving frequency (SS)
 
 
-    kap_bf_tot = kappa_bf (xplasma, freq_av, 0);
+    kap_bf_tot = kappa_bf (ctx, xplasma, freq_av, 0);
     kap_ff = kappa_ff (xplasma, freq_av);
 
     /* Okay the bound free contribution to the opacity is now sorted out (SS) */
@@ -261,17 +266,28 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
 
   kap_cont = kap_es + kap_bf_tot + kap_ff;      //total continuum opacity
 
+/* Lines of ions which are not populated anywhere near the cell (see ion_populated_make)
+ * cannot scatter the photon, and skipping them does not change the continuum optical depth,
+ * which is accumulated in the same way between the remaining resonances
+ */
+
+  ion_use = (ion_populated != NULL) ? &ion_populated[nplasma * nions] : NULL;
 
 
 /* Finally begin the loop over the resonances that can interact
  * with the photon in the cell
  */
 
-  for (n = 0; n < nline_delt; n++)
+  for (n = 0; n < ctx->nline_delt; n++)
   {
     nn = nstart + n * ndelt;    /* So if the frequency of resonance increases as we travel through
                                    the grid cell, we go up in the array, otherwise down */
-    x = (lin_ptr[nn]->freq - freq_inner) / dfreq;
+    if (ion_use != NULL && !ion_use[lin_nion[nn]])
+    {
+      continue;
+    }
+
+    x = (lin_freq[nn] - freq_inner) / dfreq;
 
     if (0. < x && x < 1.)
     {                           /* this particular line is in resonance */
@@ -303,7 +319,7 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
 
 
         ds_current = ds;        /* At this point ds_current is exactly the position of the resonance */
-        kkk = lin_ptr[nn]->nion;
+        kkk = lin_nion[nn];
 
 
 /* The density is calculated in the wind array at the center of a cell.
@@ -353,7 +369,7 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
             if (check_in_grid != P_HIT_STAR && check_in_grid != P_HIT_DISK && check_in_grid != P_ESCAPE)
             {
               /* The next line may be redundant.  */
-              two = &w[where_in_grid (wmain[p_now.grid].ndom, p_now.x)];
+              two = &w[where_in_grid (ctx, wmain[p_now.grid].ndom, p_now.x)];
 
               if (lin_ptr[nn]->macro_info == 1 && geo.macro_simple == 0)
               {
@@ -458,8 +474,8 @@ calculate_ds (w, p, tau_scat, tau, nres, smax, istat)
 
   *tau = ttau;
 
-  stuff_phot (&phot, &cds_phot_old);    // Store the final photon position
-  cds_v2_old = v2;              // and the velocity along the line of sight
+  stuff_phot (&phot, &ctx->cds_phot_old);       // Store the final photon position
+  ctx->cds_v2_old = v2;         // and the velocity along the line of sight
 
   return (ds_current);
 
@@ -554,6 +570,7 @@ Just do a check that all is well - this can be removed eventually (SS)
  * @brief      calculates the bf opacity in a specific
  * 	cell.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon being transported
  * @param [in] PlasmaPtr  xplasma   The plasma cell of interest
  * @param [in] double  freq   The frequency at which the opacity is calculated
  * @param [in] int  macro_all   1--> macro_atoms only, 0 all topbase ions
@@ -565,10 +582,14 @@ Just do a check that all is well - this can be removed eventually (SS)
  * The routine allows for clumping, reducing kappa_bf by the filling
  * factor.
  *
+ * kap_bf is (re)allocated here the first time it is needed by each
+ * thread, since its size depends on the atomic data.
+ *
  **********************************************************/
 
 double
-kappa_bf (xplasma, freq, macro_all)
+kappa_bf (ctx, xplasma, freq, macro_all)
+     CtxPtr ctx;
      PlasmaPtr xplasma;
      double freq;
      int macro_all;
@@ -587,6 +608,16 @@ kappa_bf (xplasma, freq, macro_all)
 
   kap_bf_tot = 0;
 
+  if (kap_bf_size < nphot_total)
+  {
+    if ((kap_bf = (double *) realloc (kap_bf, sizeof (double) * nphot_total)) == NULL)
+    {
+      Error ("kappa_bf: Could not allocate memory for %d x-sections\n", nphot_total);
+      exit (0);
+    }
+    kap_bf_size = nphot_total;
+  }
+
   macro_all--;                  // Subtract one from macro_all to avoid >= in for loop below.
 
 
@@ -612,7 +643,7 @@ kappa_bf (xplasma, freq, macro_all)
       {
 
         /* JM1411 -- added filling factor - density enhancement cancels with zdom[ndom].fill */
-        kap_bf[nn] = x = sigma_phot (&phot_top[n], freq) * density * zdom[ndom].fill;   //stimulated recombination? (SS)
+        kap_bf[nn] = x = sigma_phot (ctx, &phot_top[n], freq) * density * zdom[ndom].fill;   //stimulated recombination? (SS)
         kap_bf_tot += x;
       }
     }
@@ -764,9 +795,8 @@ sobolev (one, x, den_ion, lptr, dvds)
      double dvds;
 {
   double tau, xden_ion, tau_x_dvds;
-  double two_level_atom (), d1, d2;
+  double d1, d2;
   int nion;
-  double d_hold;
   int nplasma;
   int ndom;
   PlasmaPtr xplasma;
@@ -794,21 +824,15 @@ sobolev (one, x, den_ion, lptr, dvds)
     nion = lptr->nion;
 
 /* Next few steps to allow used of better calculation of density of this particular
-ion which was done above in calculate ds.  It was made necessary by a change in the
-calls to two_level atom
+ion which was done above in calculate ds.  The density is passed to two_level_atom_den
+directly, so that the plasma structure itself is not modified.
 */
-    d_hold = xplasma->density[nion];    // Store the density of this ion in the cell
 
     if (den_ion < 0)
     {
-      xplasma->density[nion] = get_ion_density (ndom, x, lptr->nion);   // Forced calculation of density
-    }
-    else
-    {
-      xplasma->density[nion] = den_ion; // Put den_ion into the density array
+      den_ion = get_ion_density (ndom, x, nion);        // Forced calculation of density
     }
-    two_level_atom (lptr, xplasma, &d1, &d2);   // Calculate d1 & d2
-    xplasma->density[nion] = d_hold;    // Restore w
+    two_level_atom_den (lptr, xplasma, den_ion, &d1, &d2);      // Calculate d1 & d2
   }
 
 
@@ -933,6 +957,7 @@ doppler (pin, pout, v, nres)
  * @brief      determine a new direction and frequency for a photon
  * that is in the wind
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in,out] PhotPtr  p   the  photon of interest
  * @param [in] int *  nres   either the number of the scatter
  * or a nonresonant scatter if nres < 0
@@ -960,7 +985,8 @@ doppler (pin, pout, v, nres)
  **********************************************************/
 
 int
-scatter (p, nres, nnscat)
+scatter (ctx, p, nres, nnscat)
+     CtxPtr ctx;
      PhotPtr p;
      int *nres;
      int *nnscat;
@@ -988,7 +1014,7 @@ scatter (p, nres, nnscat)
 
 
   stuff_phot (p, &pold);
-  n = where_in_grid (ndom, pold.x);     // Find out where we are
+  n = where_in_grid (ctx, ndom, pold.x);        // Find out where we are
 
   vwind_xyz (ndom, p, v);       //get the local velocity at the location of the photon
   v_dop = dot (p->lmn, v);      //get the dot product of the photon direction with the wind, to get the doppler velocity
@@ -8,6 +8,7 @@
  ***********************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 #include <errno.h>
@@ -18,6 +19,9 @@ char delay_dump_file[LINELENGTH];
 int delay_dump_bank_size = 65535, delay_dump_bank_curr = 0;
 int *delay_dump_spec;
 PhotPtr delay_dump_bank;
+delay_dump_record_dummy *delay_dump_records;   //The records of a batch of photons, before they are written
+FILE *delay_dump_fptr = NULL;
+long delay_dump_nrecords = 0;   //The number of photons in this process's file
 
 /**********************************************************/
 /** 
@@ -50,24 +54,28 @@ delay_to_observer (PhotPtr pp)
 /** 
  * @brief	Prepares delay dump output file
  *
- * @param [in] filename		File root for run
  * @param [in] restart_stat If this is a restart run
- * @param [in] i_rank		Parallel rank
  * @return 					0
  *
  * Sets up filenames, allocates bank for temporary storage
- * of photons that are to be dumped, and if it's not a resume
- * run prints out a header for the file. Filename is set per
- * thread. The file is then built up in batches using
- * delay_dump() in increments of #delay_dump_bank_size.
+ * of photons that are to be dumped, and opens the file, which
+ * is kept open for the rest of the run.  The file is built up
+ * in batches using delay_dump() in increments of 
+ * #delay_dump_bank_size.
  *
  * ###Notes###
  * 9/14	-	Written by SWM
+ *
+ * The file is binary (see delay_dump_header in python.h).  The
+ * master process writes the header, and other processes write
+ * only records, which delay_dump_combine adds to the master's
+ * file at the end of the run.  In a resume run the master adds
+ * to the records already in its file.
 ***********************************************************/
 int
 delay_dump_prep (int restart_stat)
 {
-  FILE *fptr;
+  delay_dump_header_dummy header;
   char s_time[LINELENGTH];
   int i;
 
@@ -84,30 +92,48 @@ delay_dump_prep (int restart_stat)
   //Allocate and zero dump files and set extract status
   delay_dump_bank = (PhotPtr) calloc (sizeof (p_dummy), delay_dump_bank_size);
   delay_dump_spec = (int *) calloc (sizeof (int), delay_dump_bank_size);
+  delay_dump_records = (delay_dump_record_dummy *) calloc (sizeof (delay_dump_record_dummy), delay_dump_bank_size);
   for (i = 0; i < delay_dump_bank_size; i++)
     delay_dump_spec[i] = 0;
 
-  if (restart_stat == 1)
+  delay_dump_nrecords = 0;
+  delay_dump_fptr = NULL;
+
+  if (restart_stat == 1 && rank_global == 0)
   {                             //Check whether the output file already has a header
-    Log ("delay_dump_prep: Resume run, skipping writeout\n");
-    return (0);
+    if ((delay_dump_fptr = fopen (delay_dump_file, "r+")) != NULL)
+    {
+      setvbuf (delay_dump_fptr, NULL, _IOFBF, DELAY_DUMP_BUFFER);
+      if (fread (&header, sizeof (header), 1, delay_dump_fptr) == 1 && strncmp (header.magic, DELAY_DUMP_MAGIC, 8) == 0
+          && header.record_size == sizeof (delay_dump_record_dummy))
+      {
+        delay_dump_nrecords = header.nrecords;
+        fseek (delay_dump_fptr, sizeof (header) + delay_dump_nrecords * sizeof (delay_dump_record_dummy), SEEK_SET);
+        Log ("delay_dump_prep: Resume run, adding to the %ld photons in '%s'\n", delay_dump_nrecords, delay_dump_file);
+        return (0);
+      }
+      Error ("delay_dump_prep: '%s' is not a delay dump file, so starting it again\n", delay_dump_file);
+      fclose (delay_dump_fptr);
+      delay_dump_fptr = NULL;
+    }
   }
 
 
-  if ((fptr = fopen (delay_dump_file, "w")) != NULL)
+  if ((delay_dump_fptr = fopen (delay_dump_file, "w")) != NULL)
   {                             //If this isn't a continue run, prep the output file
-    if (rank_global > 0)
-    {
-      fprintf (fptr, "# Delay dump file for slave process %d\n", rank_global);
-    }
-    else
-    {                           // Construct and write a header string for the output file
-      fprintf (fptr, "# Python Version %s\n", VERSION);
+    setvbuf (delay_dump_fptr, NULL, _IOFBF, DELAY_DUMP_BUFFER);
+    if (rank_global == 0)
+    {                           // Construct and write a header for the output file
+      memset (&header, 0, sizeof (header));
+      strncpy (header.magic, DELAY_DUMP_MAGIC, 8);
+      header.format = DELAY_DUMP_FORMAT;
+      header.record_size = sizeof (delay_dump_record_dummy);
+      header.nrecords = 0;
+      snprintf (header.version, sizeof (header.version), "%s", VERSION);
       get_time (s_time);
-      fprintf (fptr, "# Date	%s\n#  \n", s_time);
-      fprintf (fptr, "# \n#    Freq.     Lambda     Weight      Last X      Last Y      Last Z Scat. RScat      Delay Spec. Orig.  Res.\n");
+      strcpy (header.date, s_time);
+      fwrite (&header, sizeof (header), 1, delay_dump_fptr);
     }
-    fclose (fptr);
     Log ("delay_dump_prep: Thread %d successfully prepared file '%s' for writing\n", rank_global, delay_dump_file);
   }
   else
@@ -124,7 +150,8 @@ delay_dump_prep (int restart_stat)
  *
  * @return 					0
  *
- * Dumps the remaining tracked photons to file, frees memory.
+ * Dumps the remaining tracked photons to file, records the number
+ * of photons in the header, closes the file and frees memory.
  *
  * ###Notes###
  * 6/15	-	Written by SWM
@@ -132,25 +159,40 @@ delay_dump_prep (int restart_stat)
 int
 delay_dump_finish (void)
 {
-  Log ("delay_dump_finish: Dumping %d photons to file\n", delay_dump_bank_curr - 1);
+  Log ("delay_dump_finish: Dumping %d photons to file\n", delay_dump_bank_curr);
   if (delay_dump_bank_curr > 0)
   {
-    delay_dump (delay_dump_bank, delay_dump_bank_curr - 1);
+    delay_dump (delay_dump_bank, delay_dump_bank_curr);
+    delay_dump_bank_curr = 0;
+  }
+  if (delay_dump_fptr != NULL)
+  {
+    if (rank_global == 0)
+    {
+      fseek (delay_dump_fptr, offsetof (delay_dump_header_dummy, nrecords), SEEK_SET);
+      fwrite (&delay_dump_nrecords, sizeof (delay_dump_nrecords), 1, delay_dump_fptr);
+    }
+    fclose (delay_dump_fptr);
+    delay_dump_fptr = NULL;
   }
   free (delay_dump_bank);
   free (delay_dump_spec);
+  free (delay_dump_records);
   return (0);
 }
 
 /**********************************************************/
 /** 
- * @brief	Prepares delay dump output file
+ * @brief	Combines the delay dump files of all the processes
  *
  * @param [in] i_ranks		Number of parallel processes
  * @return 					0
  *
  * Collects all the delay dump files together at the end. 
- * Called by the master thread. Uses 'cat' for simplicity.
+ * Called by every process, after delay_dump_finish.  The
+ * records of each process are written to their place in 
+ * the master's file with collective MPI-IO writes, and 
+ * the files of the other processes are then removed.
  *
  * ###Notes###
  * 6/15	-	Written by SWM
@@ -158,36 +200,70 @@ delay_dump_finish (void)
 int
 delay_dump_combine (int i_ranks)
 {
-  FILE *fopen ();               //, *f_base, *f_cat;
-  char c_call[LINELENGTH];      //, c_cat[LINELENGTH], c_char;
-  //int i;
-/*
-	f_base = fopen(delay_dump_file, 'a');
-	for(i=1;i<iRanks;i++)
-	{
-		sprintf(c_cat, "%s%d", c_cat, i);
-		if((f_cat = fopen(c_cat, 'r')) == NULL)
-			Error("delay_dump_combine: Missing file %s%d", c_cat,i);
-		else
-			while((c_char = fgetc(f_cat)) != EOF) fputc(c_char, f_base);
-		fclose(f_cat);
-	}
-	fclose(f_base);
-*/
-  //Yes this is done as a system call and won 't work on Windows machines. Lazy solution!
-  sprintf (c_call, "cat %s[0-9]* >> %s", delay_dump_file, delay_dump_file);
-  if (system (c_call) < 0)
+#ifdef MPI_ON
+  FILE *fptr;
+  MPI_File fh;
+  MPI_Offset offset;
+  char combined_file[LINELENGTH + 16];
+  delay_dump_record_dummy *records;
+  long nlocal, nbefore, nfile, ntotal, nchunks, nmax_chunks, nchunk, n;
+
+  sprintf (combined_file, "%s.delay_dump", files.root);
+
+  /* The records of the master are already in place in the combined file */
+  nlocal = (rank_global == 0) ? 0 : delay_dump_nrecords;
+  nfile = delay_dump_nrecords;
+  nbefore = 0;
+  MPI_Bcast (&nfile, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+  MPI_Exscan (&nlocal, &nbefore, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  if (rank_global == 0)
+    nbefore = 0;
+  MPI_Allreduce (&nlocal, &ntotal, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  ntotal += nfile;
+
+  nchunks = (nlocal + delay_dump_bank_size - 1) / delay_dump_bank_size;
+  MPI_Allreduce (&nchunks, &nmax_chunks, 1, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+
+  records = (delay_dump_record_dummy *) calloc (sizeof (delay_dump_record_dummy), delay_dump_bank_size);
+  fptr = NULL;
+  if (nlocal > 0 && (fptr = fopen (delay_dump_file, "r")) == NULL)
   {
-    Error ("delay_dump_combine: Error calling system command '%s'", c_call);
+    Error ("delay_dump_combine: Thread %d could not reopen '%s'\n", rank_global, delay_dump_file);
+    nlocal = 0;
   }
-  else
+
+  MPI_File_open (MPI_COMM_WORLD, combined_file, MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+
+  /* Every process must take part in every write, even when it has nothing left to write */
+  for (nchunk = 0; nchunk < nmax_chunks; nchunk++)
   {
-    sprintf (c_call, "rm %s[0-9]*", delay_dump_file);
-    if (system (c_call) < 0)
+    n = nlocal - nchunk * delay_dump_bank_size;
+    if (n > delay_dump_bank_size)
+      n = delay_dump_bank_size;
+    if (n < 0)
+      n = 0;
+    if (n > 0 && fread (records, sizeof (delay_dump_record_dummy), n, fptr) != (size_t) n)
     {
-      Error ("delay_dump_combine: Error calling system command '%s'", c_call);
+      Error ("delay_dump_combine: Thread %d could not read all the photons in '%s'\n", rank_global, delay_dump_file);
     }
+    offset = sizeof (delay_dump_header_dummy) + (nfile + nbefore + nchunk * delay_dump_bank_size) * sizeof (delay_dump_record_dummy);
+    MPI_File_write_at_all (fh, offset, records, n * sizeof (delay_dump_record_dummy), MPI_BYTE, MPI_STATUS_IGNORE);
+  }
+
+  if (rank_global == 0)
+  {
+    MPI_File_write_at (fh, offsetof (delay_dump_header_dummy, nrecords), &ntotal, sizeof (ntotal), MPI_BYTE, MPI_STATUS_IGNORE);
+    Log ("delay_dump_combine: Combined %ld photons from %d processes in '%s'\n", ntotal, i_ranks, combined_file);
   }
+  MPI_File_close (&fh);
+
+  free (records);
+  if (fptr != NULL)
+    fclose (fptr);
+  if (rank_global > 0)
+    remove (delay_dump_file);
+#endif
+
   return (0);
 }
 
@@ -207,22 +283,23 @@ delay_dump_combine (int i_ranks)
  *
  * ###Notes###
  * 6/15	-	Written by SWM
+ *
+ * The photons which pass are converted to binary records
+ * and written with a single fwrite.
 ***********************************************************/
 int
 delay_dump (PhotPtr p, int np)
 {
-  FILE *fopen (), *fptr;
-  int nphot, mscat, mtopbot, i, subzero;
+  int nphot, mscat, mtopbot, i, subzero, nrec;
   double delay;
+  delay_dump_record_dummy *rec;
   subzero = 0;
+  nrec = 0;
 
   Log ("delay_dump: Dumping %d photons\n", np);
-  /*
-   * Open a file for writing the spectrum
-   */
-  if ((fptr = fopen (delay_dump_file, "a")) == NULL)
+  if (delay_dump_fptr == NULL)
   {
-    Error ("delay_dump: Unable to reopen %s for writing\n", delay_dump_file);
+    Error ("delay_dump: Unable to write to %s\n", delay_dump_file);
     exit (0);
   }
   for (nphot = 0; nphot < np; nphot++)
@@ -246,11 +323,19 @@ delay_dump (PhotPtr p, int np)
       if (delay < 0)
         subzero++;
 
-      fprintf (fptr,
-               "%10.5g %12.7g %10.5g %+10.5g %+10.5g %+10.5g %3d     %3d     %10.5g %5d %5d %5d\n",
-               p[nphot].freq, C * 1e8 / p[nphot].freq, p[nphot].w,
-               p[nphot].x[0], p[nphot].x[1], p[nphot].x[2],
-               p[nphot].nscat, p[nphot].nrscat, delay, i - MSPEC, p[nphot].origin, p[nphot].nres);
+      rec = &delay_dump_records[nrec++];
+      rec->freq = p[nphot].freq;
+      rec->w = p[nphot].w;
+      rec->x[0] = p[nphot].x[0];
+      rec->x[1] = p[nphot].x[1];
+      rec->x[2] = p[nphot].x[2];
+      rec->delay = delay;
+      rec->nscat = p[nphot].nscat;
+      rec->nrscat = p[nphot].nrscat;
+      rec->spec = i - MSPEC;
+      rec->origin = p[nphot].origin;
+      rec->nres = p[nphot].nres;
+      rec->pad = 0;
     }
   }
 
@@ -258,7 +343,11 @@ delay_dump (PhotPtr p, int np)
   {
     Error ("delay_dump: %d photons with <0 delay found! Increase path bin resolution to minimise this error.", subzero);
   }
-  fclose (fptr);
+  if (nrec > 0 && fwrite (delay_dump_records, sizeof (delay_dump_record_dummy), nrec, delay_dump_fptr) != (size_t) nrec)
+  {
+    Error ("delay_dump: Could not write %d photons to %s\n", nrec, delay_dump_file);
+  }
+  delay_dump_nrecords += nrec;
   return (0);
 }
 
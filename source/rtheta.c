@@ -25,6 +25,7 @@
  * @brief      calculates the distance to the far
  *         boundary of the cell in which the photon bundle resides.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] int  ndom   The domain in which the photon bundle is though to exist
  * @param [in, out] PhotPtr  p   Photon pointer
  * @return     Distance to the far boundary of the cell in which the photon
@@ -40,7 +41,8 @@
  **********************************************************/
 
 double
-rtheta_ds_in_cell (ndom, p)
+rtheta_ds_in_cell (ctx, ndom, p)
+     CtxPtr ctx;
      int ndom;
      PhotPtr p;
 
@@ -55,7 +57,7 @@ rtheta_ds_in_cell (ndom, p)
   /* Check that that the photon is in the domain it is supposed to be
    * in.  */
 
-  if ((p->grid = n = where_in_grid (ndom, p->x)) < 0)
+  if ((p->grid = n = where_in_grid (ctx, ndom, p->x)) < 0)
   {
     Error ("rtheta_ds_in_cell: Photon not in grid when routine entered\n");
     return (n);                 /* Photon was not in wind */
@@ -53,10 +53,12 @@ int
 calculate_ionization (restart_stat)
      int restart_stat;
 {
-  int n, nn;
+  int n, nn, nchunk;
   double zz, zzz, zze, ztot, zz_adiab;
   double zz_abs, zz_scat, zz_star, zz_disk;
   double zz_err, zz_else;
+  double lum_star_prev, lum_disk_prev, lum_star_now, lum_disk_now;
+  double heat_prev[NRINGS], heat_now[NRINGS];
   int nn_adiab;
   WindPtr w;
   PhotPtr p;
@@ -138,45 +140,6 @@ calculate_ionization (restart_stat)
       iwind = 1;                /* Create wind photons and force a reinitialization of wind parms */
 
 
-    /* Create the photons that need to be transported through the wind
-     *
-     * NPHOT is the number of photon bundles which will equal the luminosity; 
-     * 0 => for ionization calculation 
-     */
-
-
-    nphot_to_define = (long) NPHOT;
-
-    define_phot (p, freqmin, freqmax, nphot_to_define, 0, iwind, 1);
-
-    /* Zero the arrays, and other variables that need to be zeroed after the photons are generated. */
-
-
-    geo.lum_star_back = 0;
-    geo.lum_disk_back = 0;
-
-
-    for (n = 0; n < NRINGS; n++)
-    {
-      qdisk.heat[n] = qdisk.nphot[n] = qdisk.w[n] = qdisk.ave_freq[n] = 0;
-    }
-
-
-
-    photon_checks (p, freqmin, freqmax, "Check before transport");
-
-
-
-    zz = 0.0;
-    for (nn = 0; nn < NPHOT; nn++)
-    {
-      zz += p[nn].w;
-    }
-
-    Log ("!!python: Total photon luminosity before transphot %18.12e\n", zz);
-    Log_flush ();
-    ztot += zz;                 /* Total luminosity in all cycles, used for calculating disk heating */
-
     /* kbf_need determines how many & which bf processes one needs to considere.  It was introduced
      * as a way to speed up the program.  It has to be recalculated evey time one changes
      * freqmin and freqmax
@@ -189,48 +152,124 @@ calculate_ionization (restart_stat)
     if (gaunt_n_gsqrd > 0)
       pop_kappa_ff_array ();
 
-    /* Transport the photons through the wind */
-    trans_phot (w, p, 0);
+    /* Create the photons that need to be transported through the wind, and transport them,
+     * one chunk of NPHOT photons at a time.  The estimators and the spectra simply
+     * accumulate from one chunk to the next.
+     *
+     * NPHOT*NPHOT_CHUNKS is the number of photon bundles which will equal the luminosity; 
+     * 0 => for ionization calculation 
+     */
+
+    nphot_to_define = (long) NPHOT *(long) NPHOT_CHUNKS;
 
-    /*Determine how much energy was absorbed in the wind */
-    zze = zzz = zz_adiab = zz_abs = zz_scat = zz_star = zz_disk = zz_err = zz_else = 0.0;
+    /* The band limited luminosities are calculated for the first chunk, and used for the others */
+    xband.flux_known = FALSE;
+
+    zz = zze = zzz = zz_adiab = zz_abs = zz_scat = zz_star = zz_disk = zz_err = zz_else = 0.0;
     nn_adiab = 0;
-    for (nn = 0; nn < NPHOT; nn++)
+
+    for (nchunk = 0; nchunk < NPHOT_CHUNKS; nchunk++)
     {
-      zzz += p[nn].w;
-      if (p[nn].istat == P_ESCAPE)
-        zze += p[nn].w;
-      else if (p[nn].istat == P_ADIABATIC)
-      {
-        zz_adiab += p[nn].w;
-        nn_adiab++;
-      }
-      else if (p[nn].istat == P_ABSORB)
-      {
-        zz_abs += p[nn].w;
-      }
-      else if (p[nn].istat == P_TOO_MANY_SCATTERS)
+      if (NPHOT_CHUNKS > 1)
+        Log ("!!python: Chunk %d of %d of the photons for this cycle\n", nchunk, NPHOT_CHUNKS);
+
+      /* The photons of every chunk are generated with the heating of the star and disk from the last
+         cycle, not with the heating by the chunks of this cycle which have already been transported */
+      if (nchunk > 0)
       {
-        zz_scat += p[nn].w;
+        lum_star_now = geo.lum_star_back;
+        lum_disk_now = geo.lum_disk_back;
+        geo.lum_star_back = lum_star_prev;
+        geo.lum_disk_back = lum_disk_prev;
+        for (n = 0; n < NRINGS; n++)
+        {
+          heat_now[n] = qdisk.heat[n];
+          qdisk.heat[n] = heat_prev[n];
+        }
       }
-      else if (p[nn].istat == P_HIT_STAR)
+
+      define_phot (p, freqmin, freqmax, nphot_to_define, 0, iwind, 1);
+
+      if (nchunk == 0)
       {
-        zz_star += p[nn].w;
+        /* Zero the arrays, and other variables that need to be zeroed after the photons are generated. */
+
+        lum_star_prev = geo.lum_star_back;
+        lum_disk_prev = geo.lum_disk_back;
+        geo.lum_star_back = 0;
+        geo.lum_disk_back = 0;
+
+        for (n = 0; n < NRINGS; n++)
+        {
+          heat_prev[n] = qdisk.heat[n];
+          qdisk.heat[n] = qdisk.nphot[n] = qdisk.w[n] = qdisk.ave_freq[n] = 0;
+        }
       }
-      else if (p[nn].istat == P_HIT_DISK)
+      else
       {
-        zz_disk += p[nn].w;
+        geo.lum_star_back = lum_star_now;
+        geo.lum_disk_back = lum_disk_now;
+        for (n = 0; n < NRINGS; n++)
+        {
+          qdisk.heat[n] = heat_now[n];
+        }
       }
-      else if (p[nn].istat == P_ERROR)
+
+      photon_checks (p, freqmin, freqmax, "Check before transport");
+
+      for (nn = 0; nn < NPHOT; nn++)
       {
-        zz_err += p[nn].w;
+        zz += p[nn].w;
       }
-      else
+
+      /* Transport the photons through the wind */
+      trans_phot (w, p, 0);
+
+      /*Determine how much energy was absorbed in the wind */
+      for (nn = 0; nn < NPHOT; nn++)
       {
-        zz_else += p[nn].w;
+        zzz += p[nn].w;
+        if (p[nn].istat == P_ESCAPE)
+          zze += p[nn].w;
+        else if (p[nn].istat == P_ADIABATIC)
+        {
+          zz_adiab += p[nn].w;
+          nn_adiab++;
+        }
+        else if (p[nn].istat == P_ABSORB)
+        {
+          zz_abs += p[nn].w;
+        }
+        else if (p[nn].istat == P_TOO_MANY_SCATTERS)
+        {
+          zz_scat += p[nn].w;
+        }
+        else if (p[nn].istat == P_HIT_STAR)
+        {
+          zz_star += p[nn].w;
+        }
+        else if (p[nn].istat == P_HIT_DISK)
+        {
+          zz_disk += p[nn].w;
+        }
+        else if (p[nn].istat == P_ERROR)
+        {
+          zz_err += p[nn].w;
+        }
+        else
+        {
+          zz_else += p[nn].w;
+        }
       }
+
+      photon_checks (p, freqmin, freqmax, "Check after transport");
+
+      spectrum_create (p, freqmin, freqmax, geo.nangles, geo.select_extract);
     }
 
+    Log ("!!python: Total photon luminosity before transphot %18.12e\n", zz);
+    ztot += zz;                 /* Total luminosity in all cycles, used for calculating disk heating */
+
     Log
       ("!!python: Total photon luminosity after transphot  %18.12e (absorbed/lost  %18.12e). Radiated luminosity %18.12e\n",
        zzz, zzz - zz, zze);
@@ -242,11 +281,7 @@ calculate_ionization (restart_stat)
     Log ("!!python: luminosity lost by hitting the disk           %18.12e \n", zz_disk);
     Log ("!!python: luminosity lost by errors                     %18.12e \n", zz_err);
     Log ("!!python: luminosity lost by the unknown                %18.12e \n", zz_else);
-
-
-    photon_checks (p, freqmin, freqmax, "Check after transport");
-
-    spectrum_create (p, freqmin, freqmax, geo.nangles, geo.select_extract);
+    Log_flush ();
 
 
 
@@ -406,7 +441,7 @@ make_spectra (restart_stat)
   double renorm;
   long nphot_to_define;
   int iwind;
-  int n;
+  int n, nchunk;
 
 #ifdef MPI_ON
   char dummy[LINELENGTH];
@@ -456,6 +491,10 @@ make_spectra (restart_stat)
 
   kbf_need (freqmin, freqmax);
 
+  /* Tabulate the continuum opacity of each cell if this has been asked for */
+
+  kappa_cont_tab_make (freqmin, freqmax);
+
   /* BEGIN CYCLES TO CREATE THE DETAILED SPECTRUM */
 
   /* the next section initializes the spectrum array in two cases, for the
@@ -513,41 +552,51 @@ make_spectra (restart_stat)
     else
       iwind = 0;                /* Create wind photons but do not force reinitialization */
 
-    /* Create the initial photon bundles which need to be trannsported through the wind 
+    /* Create the initial photon bundles which need to be trannsported through the wind, and
+       transport them, one chunk of NPHOT photons at a time.
 
-       For the detailed spectra, NPHOT*pcycles is the number of photon bundles which will equal the luminosity, 
+       For the detailed spectra, NPHOT*NPHOT_CHUNKS*pcycles is the number of photon bundles which will equal the luminosity, 
        1 implies that detailed spectra, as opposed to the ionization of the wind is being calculated
 
        JM 130306 must convert NPHOT and pcycles to double precision variable nphot_to_define
 
      */
 
-    nphot_to_define = (long) NPHOT *(long) geo.pcycles;
-    define_phot (p, freqmin, freqmax, nphot_to_define, 1, iwind, 0);
+    nphot_to_define = (long) NPHOT *(long) NPHOT_CHUNKS *(long) geo.pcycles;
 
-    /* TODAY */
-    if (modes.save_photons)
+    for (nchunk = 0; nchunk < NPHOT_CHUNKS; nchunk++)
     {
-      for (n = 0; n < NPHOT; n++)
+      if (NPHOT_CHUNKS > 1)
+        Log ("!!python: Chunk %d of %d of the photons for this cycle\n", nchunk, NPHOT_CHUNKS);
+
+      /* define_phot only reinitializes the sources if the frequency limits or iwind change, so the
+         later chunks reuse what was calculated for the first */
+      define_phot (p, freqmin, freqmax, nphot_to_define, 1, iwind, 0);
+
+      /* TODAY */
+      if (modes.save_photons)
       {
-        save_photons (&p[n], "CREATE");
+        for (n = 0; n < NPHOT; n++)
+        {
+          save_photons (&p[n], "CREATE");
+        }
       }
-    }
 
-    for (icheck = 0; icheck < NPHOT; icheck++)
-    {
-      if (sane_check (p[icheck].freq))
+      for (icheck = 0; icheck < NPHOT; icheck++)
       {
-        Error ("python after define phot:sane_check unnatural frequency for photon %d\n", icheck);
+        if (sane_check (p[icheck].freq))
+        {
+          Error ("python after define phot:sane_check unnatural frequency for photon %d\n", icheck);
+        }
       }
-    }
 
 
-    /* Tranport photons through the wind */
+      /* Tranport photons through the wind */
 
-    trans_phot (w, p, geo.select_extract);
+      trans_phot (w, p, geo.select_extract);
 
-    spectrum_create (p, freqmin, freqmax, geo.nangles, geo.select_extract);
+      spectrum_create (p, freqmin, freqmax, geo.nangles, geo.select_extract);
+    }
 
 /* Write out the detailed spectrum each cycle so that one can see the statistics build up! */
     renorm = ((double) (geo.pcycles)) / (geo.pcycle + 1.0);
@@ -610,8 +659,8 @@ make_spectra (restart_stat)
     delay_dump_finish ();       // Each thread dumps to file
 #ifdef MPI_ON
   MPI_Barrier (MPI_COMM_WORLD); // Once all done
-  if (rank_global == 0 && geo.reverb != REV_NONE)
-    delay_dump_combine (np_mpi_global); // Combine results if necessary
+  if (geo.reverb != REV_NONE)
+    delay_dump_combine (np_mpi_global); // Combine results if necessary; all threads write to the combined file
 #endif
 
 
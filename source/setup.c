@@ -89,6 +89,7 @@ init_geo ()
 
   geo.disk_z0 = geo.disk_z1 = 0.0;
   geo.adiabatic = 1;            // Default is now set so that adiabatic cooling is included in the wind
+  geo.matom_emiss_method = MATOM_EMISS_MONTE_CARLO;
   geo.auger_ionization = 1;     //Default is on.
 
 
@@ -301,6 +302,8 @@ init_advanced_modes ()
 
 
   modes.keep_photoabs = 1;      // keep photoabsorption in final spectrum
+  modes.kappa_table = 0;        // calculate the continuum opacity from the x-sections in final spectrum
+  modes.dynamic_photons = 0;    // each MPI task transports only the photons it generated
 
   return (0);
 }
@@ -497,6 +500,10 @@ init_observers ()
  * ??? DESCRIPTION ???
  *
  * ### Notes ###
+ * In advanced mode the photons of a cycle can be split into chunks,
+ * in which case NPHOT is the number of photons in a chunk and
+ * NPHOT_CHUNKS the number of chunks in a cycle.
+ *
  * The routine also allocates memory for the photon structure.
  * If the routine is unable to allocate this membory, the routine
  * will exit.
@@ -507,7 +514,7 @@ PhotPtr
 init_photons ()
 {
   PhotPtr p;
-  double x;
+  double x, xchunk;
 
   /* Although Photons_per_cycle is really an integer,
      read in as a double so it is easier for input */
@@ -516,12 +523,33 @@ init_photons ()
   rddoub ("Photons_per_cycle", &x);
   NPHOT = x;                    // NPHOT is photons/cycle
 
+  /* In advanced mode, the photons of a cycle can be generated and transported in
+     chunks, so that only one chunk of photons has to be held in memory at a time */
+
+  xchunk = x;
+  if (modes.iadvanced)
+  {
+    rddoub ("@Diag.photons_per_chunk", &xchunk);
+  }
+
 #ifdef MPI_ON
   Log ("Photons per cycle per MPI task will be %d\n", NPHOT / np_mpi_global);
 
   NPHOT /= np_mpi_global;
+  xchunk /= np_mpi_global;
 #endif
 
+  /* Divide the photons of a cycle as evenly as possible into chunks no larger than
+     requested.  The number of photons per cycle is rounded up to fill the last chunk */
+
+  NPHOT_CHUNKS = 1;
+  if (xchunk >= 1 && xchunk < NPHOT)
+  {
+    NPHOT_CHUNKS = ceil (NPHOT / xchunk);
+    NPHOT = (NPHOT + NPHOT_CHUNKS - 1) / NPHOT_CHUNKS;
+    Log ("Photons will be generated and transported in %d chunks of %d photons per cycle\n", NPHOT_CHUNKS, NPHOT);
+  }
+
   rdint ("Ionization_cycles", &geo.wcycles);
 
   rdint ("Spectrum_cycles", &geo.pcycles);
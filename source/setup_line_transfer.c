@@ -146,6 +146,14 @@ get_line_transfer_mode ()
   {
     Log ("python: Using Macro Atom method so switching off wind radiation.\n");
     geo.wind_radiation = 0;
+
+    /* The emissivities for the detailed spectra can be found without following
+       packets through the macro atoms, which is faster and free of noise */
+    if (modes.iadvanced)
+    {
+      strcpy (answer, "monte_carlo");
+      geo.matom_emiss_method = rdchoice ("@Matom.emissivity_method(monte_carlo,deterministic)", "0,1", answer);
+    }
   }
 
 
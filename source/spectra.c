@@ -88,7 +88,7 @@ spectrum_init (f1, f2, nangle, angle, phase, scat_select, top_bot_select, select
      int select_extract;
      double rho_select[], z_select[], az_select[], r_select[];
 {
-  int i, n;
+  int i, n, m;
   int nspec;
   double freqmin, freqmax, dfreq;
   double lfreqmin, lfreqmax, ldfreq;    /* NSH 1302 Min, max and delta for the log spectrum */
@@ -181,6 +181,16 @@ disk. The minus sign in the terms associated with phase are to make this happen.
     xxspec[n].lmn[2] = cos (angle[n - MSPEC] / RADIAN);
     Log_silent ("Angle %e Angle cosines:%e %e %e\n", angle[n - MSPEC], xxspec[n].lmn[0], xxspec[n].lmn[1], xxspec[n].lmn[2]);
 
+    /* Find the first spectrum which is extracted in the same direction, which may be this one */
+    for (m = MSPEC; m <= n; m++)
+    {
+      if (xxspec[m].lmn[0] == xxspec[n].lmn[0] && xxspec[m].lmn[1] == xxspec[n].lmn[1] && xxspec[m].lmn[2] == xxspec[n].lmn[2])
+      {
+        xxspec[n].ndirection = m;
+        break;
+      }
+    }
+
     /* Initialize variables needed for live or die option */
     x1 = angle[n - MSPEC] - DANG_LIVE_OR_DIE;
     x2 = angle[n - MSPEC] + DANG_LIVE_OR_DIE;
@@ -63,6 +63,7 @@
  * @brief      calculates the distance to the far
  *         boundary of the cell in which the photon bundle resides.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the photon
  * @param [in] int  ndom   The domain in which the photon resides
  * @param [in, out] PhotPtr  p   Photon pointer
  * @return     Distance to the far boundary of the cell in which the photon
@@ -81,7 +82,8 @@
  **********************************************************/
 
 double
-spherical_ds_in_cell (ndom, p)
+spherical_ds_in_cell (ctx, ndom, p)
+     CtxPtr ctx;
      int ndom;
      PhotPtr p;
 
@@ -91,7 +93,7 @@ spherical_ds_in_cell (ndom, p)
   double s, smax;
 
 
-  if ((p->grid = n = where_in_grid (ndom, p->x)) < 0)
+  if ((p->grid = n = where_in_grid (ctx, ndom, p->x)) < 0)
   {
     Error ("spherical_ds_in_cell: Photon not in grid when routine entered\n");
     return (n);                 /* Photon was not in wind */
@@ -15,15 +15,24 @@ int index_inner_cross (void);
 int index_collisions (void);
 void indexx (int n, float arrin[], int indx[]);
 int limit_lines (double freqmin, double freqmax);
+int line_range (double freqmin, double freqmax, int *line_min, int *line_max);
 int check_xsections (void);
+int init_atomic_data (void);
+int count_atomic_data (char masterfile[]);
+void *atomic_arena_alloc (long nbytes);
+int alloc_xsection (struct topbase_phot *x_ptr, int np);
+/* atomic_image.c */
+int atomic_image_write (char *masterfile, char *imagefile);
+long atomic_image_start_section (FILE *fptr, char *name, long size, long nentries);
+int atomic_image_read (char *masterfile);
 /* python.c */
 int main (int argc, char *argv[]);
 /* photon2d.c */
-int translate (WindPtr w, PhotPtr pp, double tau_scat, double *tau, int *nres);
-int translate_in_space (PhotPtr pp);
+int translate (CtxPtr ctx, WindPtr w, PhotPtr pp, double tau_scat, double *tau, int *nres);
+int translate_in_space (CtxPtr ctx, PhotPtr pp);
 double ds_to_wind (PhotPtr pp, int *ndom_current);
-int translate_in_wind (WindPtr w, PhotPtr p, double tau_scat, double *tau, int *nres);
-double ds_in_cell (int ndom, PhotPtr p);
+int translate_in_wind (CtxPtr ctx, WindPtr w, PhotPtr p, double tau_scat, double *tau, int *nres);
+double ds_in_cell (CtxPtr ctx, int ndom, PhotPtr p);
 int walls (PhotPtr p, PhotPtr pold, double *normal);
 /* photon_gen.c */
 int define_phot (PhotPtr p, double f1, double f2, long nphot_tot, int ioniz_or_final, int iwind, int freq_sampling);
@@ -56,7 +65,9 @@ int spectrum_summary (char filename[], int nspecmin, int nspecmax, int select_sp
 int spectrum_restart_renormalise (int nangle);
 /* wind2d.c */
 int define_wind (void);
-int where_in_grid (int ndom, double x[]);
+int nearby_interval (double value, double array[], int npts, int i);
+int where_in_grid_nearby (int ndom, double x[], int n_last);
+int where_in_grid (CtxPtr ctx, int ndom, double x[]);
 int vwind_xyz (int ndom, PhotPtr p, double v[]);
 int wind_div_v (void);
 double rho (WindPtr w, double x[]);
@@ -98,7 +109,12 @@ double rtsafe (void (*funcd) (double, double *, double *), double x1, double x2,
 double golden (double ax, double bx, double cx, double (*f) (double), double tol, double *xmin);
 /* trans_phot.c */
 int trans_phot (WindPtr w, PhotPtr p, int iextract);
-int trans_phot_single (WindPtr w, PhotPtr p, int iextract);
+int extract_original (CtxPtr ctx, WindPtr w, PhotPtr p);
+int trans_phot_single (CtxPtr ctx, WindPtr w, PhotPtr p, int iextract);
+/* transport_context.c */
+CtxPtr init_transport_context (int nthread);
+int reset_transport_context (CtxPtr ctx);
+int transport_context_summary (CtxPtr ctx);
 /* phot_util.c */
 int stuff_phot (PhotPtr pin, PhotPtr pout);
 int move_phot (PhotPtr pp, double ds);
@@ -113,22 +129,24 @@ double ds_to_plane (struct plane *pl, struct photon *p);
 double ds_to_closest_approach (double x[], struct photon *p, double *impact_parameter);
 double ds_to_cylinder (double rho, struct photon *p);
 /* resonate.c */
-double calculate_ds (WindPtr w, PhotPtr p, double tau_scat, double *tau, int *nres, double smax, int *istat);
+double calculate_ds (CtxPtr ctx, WindPtr w, PhotPtr p, double tau_scat, double *tau, int *nres, double smax, int *istat);
 int select_continuum_scattering_process (double kap_cont, double kap_es, double kap_ff, PlasmaPtr xplasma);
-double kappa_bf (PlasmaPtr xplasma, double freq, int macro_all);
+double kappa_bf (CtxPtr ctx, PlasmaPtr xplasma, double freq, int macro_all);
 int kbf_need (double fmin, double fmax);
 double sobolev (WindPtr one, double x[], double den_ion, struct lines *lptr, double dvds);
 int doppler (PhotPtr pin, PhotPtr pout, double v[], int nres);
-int scatter (PhotPtr p, int *nres, int *nnscat);
+int scatter (CtxPtr ctx, PhotPtr p, int *nres, int *nnscat);
 /* radiation.c */
-int radiation (PhotPtr p, double ds);
+int radiation (CtxPtr ctx, PhotPtr p, double ds);
 double kappa_ff (PlasmaPtr xplasma, double freq);
-double sigma_phot (struct topbase_phot *x_ptr, double freq);
+double sigma_phot (CtxPtr ctx, struct topbase_phot *x_ptr, double freq);
 double sigma_phot_verner (struct innershell *x_ptr, double freq);
 double den_config (PlasmaPtr xplasma, int nconf);
 double pop_kappa_ff_array (void);
 int update_banded_estimators (PlasmaPtr xplasma, PhotPtr p, double ds, double w_ave);
 double mean_intensity (PlasmaPtr xplasma, double freq, int mode);
+int kappa_cont_tab_make (double fmin, double fmax);
+double kappa_cont_tab (PlasmaPtr xplasma, double fmin, double freq, double fmax);
 /* setup_files.c */
 int init_log_and_windsave (int restart_stat);
 int setup_created_files (void);
@@ -138,13 +156,19 @@ int wind_rad_init (void);
 int report_bf_simple_ionpool (void);
 /* windsave.c */
 int wind_save (char filename[]);
+long windsave_start_section (FILE * fptr, char *name, long size, long nvalues, long ncells);
+int windsave_write_fields (FILE * fptr, windsave_field_dummy * fields, int nfields, char *cells, size_t stride, int ncells);
+int windsave_read_fields (char *base, windsave_field_dummy * fields, int nfields, char *cells, size_t stride, int ncells);
+windsave_section_dummy *windsave_lookup_section (char *base, char *name);
+char *windsave_find_section (char *base, char *name, long size, long nvalues, long ncells);
 int wind_read (char filename[]);
+int wind_read_version1 (char filename[]);
 int wind_complete (WindPtr w);
 int spec_save (char filename[]);
 int spec_read (char filename[]);
 /* extract.c */
-int extract (WindPtr w, PhotPtr p, int itype);
-int extract_one (WindPtr w, PhotPtr pp, int itype, int nspec);
+int extract (CtxPtr ctx, WindPtr w, PhotPtr p, int itype);
+int extract_one (CtxPtr ctx, WindPtr w, PhotPtr pp, int itype, int nspec, int accept[]);
 /* cdf.c */
 int cdf_gen_from_func (CdfPtr cdf, double (*func) (double), double xmin, double xmax, int njumps, double jump[]);
 double gen_array_from_func (double (*func) (double), double xmin, double xmax, int pdfsteps);
@@ -173,7 +197,11 @@ int randvec (double a[], double r);
 int randvcos (double lmn[], double north[]);
 double vcos (double x);
 int init_rand (int seed);
+int use_rand_stream (CtxPtr ctx);
 double random_number (double min, double max);
+int alias_setup (int n, double weight[], double prob[], int alias[]);
+int alias_sample (int n, double prob[], int alias[]);
+int random_multinomial (int k, int ntot, double weight[], unsigned int counts[]);
 /* stellar_wind.c */
 int get_stellar_wind_params (int ndom);
 double stellar_velocity (int ndom, double x[], double v[]);
@@ -223,6 +251,7 @@ double q21 (struct lines *line_ptr, double t);
 double q12 (struct lines *line_ptr, double t);
 double a21 (struct lines *line_ptr);
 double two_level_atom (struct lines *line_ptr, PlasmaPtr xplasma, double *d1, double *d2);
+double two_level_atom_den (struct lines *line_ptr, PlasmaPtr xplasma, double den_ion, double *d1, double *d2);
 double line_nsigma (struct lines *line_ptr, PlasmaPtr xplasma);
 double scattering_fraction (struct lines *line_ptr, PlasmaPtr xplasma);
 double p_escape (struct lines *line_ptr, PlasmaPtr xplasma);
@@ -263,6 +292,7 @@ double gs_rrate (int nion, double T);
 int sort_and_compress (double *array_in, double *array_out, int npts);
 int compare_doubles (const void *a, const void *b);
 double matom_select_bf_freq (WindPtr one, int nconf);
+double matom_bf_freq_fraction (PlasmaPtr xplasma, int nconf, double fmin, double fmax);
 /* diag.c */
 int get_standard_care_factors (void);
 int get_extra_diagnostics (void);
@@ -287,13 +317,14 @@ int check_convergence (void);
 int one_shot (PlasmaPtr xplasma, int mode);
 double calc_te (PlasmaPtr xplasma, double tmin, double tmax);
 double zero_emit (double t);
+double te_stencil_root (double (*func) (double), double tmin, double tmax, double z1, double z2, double tol);
 /* levels.c */
 int levels (PlasmaPtr xplasma, int mode);
 /* gradv.c */
 double dvwind_ds (PhotPtr p);
 int dvds_ave (void);
 /* reposition.c */
-int reposition (PhotPtr p);
+int reposition (CtxPtr ctx, PhotPtr p);
 /* anisowind.c */
 int randwind_thermal_trapping (PhotPtr p, int *nnscat);
 /* util.c */
@@ -306,6 +337,7 @@ int wind_ij_to_n (int ndom, int i, int j, int *n);
 int wind_x_to_n (double x[], int *n);
 /* density.c */
 double get_ion_density (int ndom, double x[], int nion);
+int ion_populated_make (void);
 /* bands.c */
 int bands_init (int imode, struct xbands *band);
 int freqs_init (double freqmin, double freqmax);
@@ -314,16 +346,19 @@ double timer (void);
 int get_time (char curtime[]);
 /* matom.c */
 int matom (PhotPtr p, int *nres, int *escape);
+int matom_prbs (PlasmaPtr xplasma, int uplvl, double jprbs[], double eprbs[], double *pjnorm, double *penorm);
+int fill_matom_prbs (PlasmaPtr xplasma, int uplvl);
 double b12 (struct lines *line_ptr);
 double alpha_sp (struct topbase_phot *cont_ptr, PlasmaPtr xplasma, int ichoice);
 double alpha_sp_integrand (double freq);
+int fill_kpkt_rates (PlasmaPtr xplasma);
 int kpkt (PhotPtr p, int *nres, int *escape);
 int fake_matom_bb (PhotPtr p, int *nres, int *escape);
 int fake_matom_bf (PhotPtr p, int *nres, int *escape);
 int emit_matom (WindPtr w, PhotPtr p, int *nres, int upper);
 double matom_emit_in_line_prob (WindPtr one, struct lines *line_ptr_emit);
 /* estimators.c */
-int bf_estimators_increment (WindPtr one, PhotPtr p, double ds);
+int bf_estimators_increment (CtxPtr ctx, WindPtr one, PhotPtr p, double ds);
 int bb_estimators_increment (WindPtr one, PhotPtr p, double tau_sobolev, double dvds, int nn);
 int mc_estimator_normalise (int n);
 double total_fb_matoms (PlasmaPtr xplasma, double t_e, double f1, double f2);
@@ -341,6 +376,11 @@ double get_alpha_st (struct topbase_phot *cont_ptr, PlasmaPtr xplasma);
 double alpha_st_integrand (double freq);
 double get_alpha_st_e (struct topbase_phot *cont_ptr, PlasmaPtr xplasma);
 double alpha_st_e_integrand (double freq);
+double *matom_rate_table (struct topbase_phot *cont_ptr);
+double matom_rate_integrand (double freq);
+double matom_rate_e_integrand (double freq);
+double matom_rate_interp (double *tab, double t);
+double matom_rate_sum (struct topbase_phot *cont_ptr, int energy_weighted, double t_e, double t_r);
 /* wind_sum.c */
 int xtemp_rad (WindPtr w);
 /* yso.c */
@@ -348,7 +388,7 @@ int get_yso_wind_params (int ndom);
 double yso_velocity (int ndom, double x[], double v[]);
 double yso_rho (int ndom, double x[]);
 /* cylindrical.c */
-double cylind_ds_in_cell (int ndom, PhotPtr p);
+double cylind_ds_in_cell (CtxPtr ctx, int ndom, PhotPtr p);
 int cylind_make_grid (int ndom, WindPtr w);
 int cylind_wind_complete (int ndom, WindPtr w);
 int cylind_volumes (int ndom, WindPtr w);
@@ -357,7 +397,7 @@ int cylind_get_random_location (int n, double x[]);
 int cylind_extend_density (int ndom, WindPtr w);
 int cylind_is_cell_in_wind (int n);
 /* rtheta.c */
-double rtheta_ds_in_cell (int ndom, PhotPtr p);
+double rtheta_ds_in_cell (CtxPtr ctx, int ndom, PhotPtr p);
 int rtheta_make_grid (WindPtr w, int ndom);
 int rtheta_make_cones (int ndom, WindPtr w);
 int rtheta_wind_complete (int ndom, WindPtr w);
@@ -367,7 +407,7 @@ int rtheta_get_random_location (int n, double x[]);
 int rtheta_extend_density (int ndom, WindPtr w);
 int rtheta_is_cell_in_wind (int n);
 /* spherical.c */
-double spherical_ds_in_cell (int ndom, PhotPtr p);
+double spherical_ds_in_cell (CtxPtr ctx, int ndom, PhotPtr p);
 int spherical_make_grid (WindPtr w, int ndom);
 int spherical_wind_complete (int ndom, WindPtr w);
 int spherical_volumes (int ndom, WindPtr w);
@@ -375,7 +415,7 @@ int spherical_where_in_grid (int ndom, double x[]);
 int spherical_get_random_location (int n, double x[]);
 int spherical_extend_density (int ndom, WindPtr w);
 /* cylind_var.c */
-double cylvar_ds_in_cell (int ndom, PhotPtr p);
+double cylvar_ds_in_cell (CtxPtr ctx, int ndom, PhotPtr p);
 int cylvar_make_grid (WindPtr w, int ndom);
 int cylvar_wind_complete (int ndom, WindPtr w);
 int cylvar_volumes (int ndom, WindPtr w);
@@ -388,12 +428,15 @@ int bilin (double x[], double x00[], double x01[], double x10[], double x11[], d
 int xquadratic (double a, double b, double c, double r[]);
 /* gridwind.c */
 int create_maps (void);
+int wind_hot_make (void);
+int plasma_hot_make (void);
 int calloc_wind (int nelem);
 int calloc_plasma (int nelem);
 int check_plasma (PlasmaPtr xplasma, char message[]);
 int calloc_macro (int nelem);
 int calloc_estimators (int nelem);
 int calloc_dyn_plasma (int nelem);
+void *calloc_plasma_block (size_t size, int nelem, int nvalues, char *name);
 /* partition.c */
 int partition_functions (PlasmaPtr xplasma, int mode);
 int partition_functions_2 (PlasmaPtr xplasma, int xnion, double temp, double weight);
@@ -449,17 +492,28 @@ double q_recomb (struct topbase_phot *cont_ptr, double electron_temperature);
 /* pi_rates.c */
 double calc_pi_rate (int nion, PlasmaPtr xplasma, int mode, int type);
 double tb_planck1 (double freq);
-double tb_logpow1 (double freq);
-double tb_exp1 (double freq);
+PiKernelPtr pi_rate_kernel (struct topbase_phot *x_ptr);
+double pi_kernel_pl (PiKernelPtr kernel, double f1, double f2, double logw, double alpha);
+double pi_kernel_exp (PiKernelPtr kernel, double f1, double f2, double w, double temp);
 /* matrix_ion.c */
 int matrix_ion_populations (PlasmaPtr xplasma, int mode);
-int populate_ion_rate_matrix (double rate_matrix[nions][nions], double pi_rates[nions], double inner_rates[n_inner_tot],
-                              double rr_rates[nions], double b_temp[nions], double xne);
+int ion_matrix_structure (void);
+int ion_rate_add (double a[], int k, int j, int t, double rate, int lose);
+int populate_ion_rate_matrix (double rate_blocks[], double pi_rates[nions], double inner_rates[n_inner_tot], double rr_rates[nions],
+                              double xne);
+int solve_ion_block (int nelem, double a[], double guess[], double x[]);
 int solve_matrix (double *a_data, double *b_data, int nrows, double *x, int nplasma);
 /* para_update.c */
 int communicate_estimators_para (void);
+int communicate_plasma_cells (int my_nmin, int my_nmax);
 int gather_spectra_para (int nspec_helper, int nspecs);
 int communicate_matom_estimators_para (void);
+int copy_estimators_thread (PlasmaPtr master_plasma, MacroPtr master_macro, PhotStorePtr master_photstore, MatomPhotStorePtr master_matomphotstore);
+int reduce_estimators_thread (PlasmaPtr master_plasma, MacroPtr master_macro, PhotStorePtr master_photstore, MatomPhotStorePtr master_matomphotstore);
+int phot_batch_init (PhotPtr p);
+int phot_batch_next (PhotPtr * pbatch, int *nfirst, int *nbatch);
+int phot_batch_done (void);
+int phot_batch_finish (void);
 /* setup_star_bh.c */
 double get_stellar_params (void);
 int get_bl_and_agn_params (double lstar);
@@ -472,11 +526,13 @@ double get_disk_params (void);
 /* photo_gen_matom.c */
 double get_kpkt_f (void);
 double get_matom_f (int mode);
+int matom_emiss_direct (PlasmaPtr xplasma);
 int photo_gen_kpkt (PhotPtr p, double weight, int photstart, int nphot);
 int photo_gen_matom (PhotPtr p, double weight, int photstart, int nphot);
 /* macro_gov.c */
 int macro_gov (PhotPtr p, int *nres, int matom_or_kpkt, int *which_out);
 int macro_pops (PlasmaPtr xplasma, double xne);
+int macro_pops_solve (double q[], int nlev, double x[]);
 /* windsave2table_sub.c */
 int do_windsave2table (char *root);
 int create_master_table (int ndom, char rootname[]);
@@ -514,6 +570,8 @@ int delay_dump (PhotPtr p, int np);
 int delay_dump_single (PhotPtr pp, int i_spec);
 /* paths.c */
 Wind_Paths_Ptr wind_paths_constructor (WindPtr wind);
+int wind_paths_find_bin (double r_path);
+int wind_paths_bin (Wind_Paths_Ptr paths, int i_bin, int i_add);
 int reverb_init (WindPtr wind);
 int wind_paths_init (WindPtr wind);
 int line_paths_add_phot (WindPtr wind, PhotPtr pp, int *nres);
@@ -523,6 +581,8 @@ double r_draw_from_path_histogram (Wind_Paths_Ptr PathPtr);
 int wind_paths_gen_phot (WindPtr wind, PhotPtr pp);
 int line_paths_gen_phot (WindPtr wind, PhotPtr pp, int nres);
 int wind_paths_evaluate_single (Wind_Paths_Ptr paths);
+int wind_paths_reduce (WindPtr wind);
+int wind_paths_reduce_block (Wind_Paths_Ptr * a_paths, int n_paths);
 int wind_paths_evaluate (WindPtr wind, int i_rank);
 int wind_paths_dump (WindPtr wind, int rank_global);
 int wind_paths_output_dump (WindPtr wind, int i_rank);
@@ -632,3 +692,7 @@ int create_heat_table (int ndom, char rootname[]);
 int create_ion_table (int ndom, char rootname[], int iz);
 double *get_ion (int ndom, int element, int istate, int iswitch);
 double *get_one (int ndom, char variable_name[]);
+/* py_atomic_image.c */
+int main (int argc, char *argv[]);
+/* delay_dump2text.c */
+int main (int argc, char *argv[]);
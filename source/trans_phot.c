@@ -46,10 +46,16 @@
 
 #include "atomic.h"
 #include "python.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 long n_lost_to_dfudge = 0;
 
+CtxPtr *transport_ctx = NULL;   /* The transport contexts, one for each thread */
+int ntransport_ctx = 0;         /* The number of transport contexts */
+
 
 
 /**********************************************************/
@@ -71,22 +77,54 @@ long n_lost_to_dfudge = 0;
  *
  * The real physics is done elsewhere, in lower level routines.
  *
+ * If Python has been compiled with OpenMP (make OPENMP=1), the photons are
+ * divided among OMP_NUM_THREADS threads, which share the wind and the atomic
+ * data.  Each thread other than the master accumulates the MC estimators
+ * in its own copy of plasmamain and macromain (see copy_estimators_thread),
+ * and these are added into the master structures when all of the photons
+ * have been transported.  
+ *
+ * Each thread, or the single thread without OpenMP, has a transport context 
+ * which holds the values remembered by the transport routines and the 
+ * random number stream of the thread.  The contexts are created on the first 
+ * call and reset at the start of each flight.
+ *
+ * The photons are transported in batches obtained from phot_batch_next.
+ * Normally there is a single batch, which is all of the photons generated by
+ * this task, but if Python was started with --dynamic, an MPI task which has
+ * transported all of its own photons takes batches from tasks which
+ * have not, and returns them when they have been transported.
+ *
  * ### Notes ###
  *
  * At the end of the routine the position for each of the photons in p is the
  * last point where the photon was in the wind, * not the outer boundary of
  * the radiative transfer
  *
+ * The order in which the photons are transported by different threads
+ * is not fixed, and so a run with more than one thread cannot be 
+ * repeated exactly.  Caches which are private to each thread, such as 
+ * the cdfs for ff and fb emission, use static thread-local storage, so a large
+ * OMP_STACKSIZE (e.g. 64M) may be needed.
+ *
  **********************************************************/
 
 int
 trans_phot (WindPtr w, PhotPtr p, int iextract)
 {
   int nphot;
-  struct photon pp, pextract;
-  int absorb_reflect;           /* this is a variable used to store geo.absorb_reflect during exxtract */
-  double p_norm, tau_norm;
   int nreport;
+  int n;
+  CtxPtr ctx;
+  PhotPtr pbatch;
+  int nfirst, nbatch, batch_more;
+#ifdef _OPENMP
+  int nlev;
+  PlasmaPtr master_plasma;
+  MacroPtr master_macro;
+  PhotStorePtr master_photstore;
+  MatomPhotStorePtr master_matomphotstore;
+#endif
 
   nreport = 100000;
   if (nreport < NPHOT / 100)
@@ -96,108 +134,183 @@ trans_phot (WindPtr w, PhotPtr p, int iextract)
 
   Log ("\n");
 
-  /* Beginning of loop over photons */
+  if (transport_ctx == NULL)
+  {
+    ntransport_ctx = 1;
+#ifdef _OPENMP
+    ntransport_ctx = omp_get_max_threads ();
+#endif
+    transport_ctx = (CtxPtr *) calloc (sizeof (CtxPtr), ntransport_ctx);
+    for (n = 0; n < ntransport_ctx; n++)
+    {
+      transport_ctx[n] = init_transport_context (n);
+    }
+  }
 
-  for (nphot = 0; nphot < NPHOT; nphot++)
+  for (n = 0; n < ntransport_ctx; n++)
   {
-    CURRENT_PHOT = nphot;       /* A diagnostic to make it easier to determine what photon is causing a problem */
+    reset_transport_context (transport_ctx[n]);
+  }
 
-    /* This is just a watchdog method to tell the user the program is still running */
+  /* Photons may be added to the path histograms, which will then need to be combined again.
+     Every process calls trans_phot, so all of them agree on this */
 
-//OLD      if (nphot % 100000 == 0)
-    if (nphot % nreport == 0)
-    {
-      Log ("Cycle %d/%d: Photon %10d of %10d or %6.1f per cent \n", geo.wcycle, geo.pcycle, nphot, NPHOT, nphot * 100. / NPHOT);
-    }
+  wind_paths_reduced = FALSE;
 
-    Log_flush ();
+  /* Find which ions have lines which need to be considered in each cell, since the densities
+     may have changed since the last flight */
 
-    /* Verify that the weights are real, a check that is proably unnecessary */
+  ion_populated_make ();
 
-    if (sane_check (p[nphot].w))
-    {
-      Error ("trans_phot:sane_check photon %d has weight %e\n", nphot, p[nphot].w);
-    }
+  /* Copy the electron densities, which may also have changed, into plasmahot */
 
-    stuff_phot (&p[nphot], &pp);
-    absorb_reflect = geo.absorb_reflect;
+  plasma_hot_make ();
 
-    /* The next if statement is executed if we are calculating the detailed spectrum and makes sure we always run extract on
-       the original photon no matter where it was generated */
+  phot_batch_init (p);
+  pbatch = p;
+  nfirst = nbatch = 0;
+  batch_more = TRUE;
 
-    if (iextract)
-    {
-      // SS - for reflecting disk have to make sure disk photons are only extracted once.  Note we restore the
-      // correct geo.absorb_reflect value as soon as the photons are extracted!
+#ifndef _OPENMP
+  ctx = transport_ctx[0];
+  use_rand_stream (ctx);
+#else
+
+  /* The rates at which k-packets are destroyed, and the jumping probabilities of the macro atom
+     levels, are normally calculated when they are first needed in a cell.  They are stored in
+     macromain, which is shared by the threads, so calculate them for all cells before the threads
+     are started.  plasmamain and macromain are threadprivate, and until copy_estimators_thread
+     has been called they are only set on the master thread, so they are copied in to the other threads */
 
-      if (absorb_reflect == BACK_RAD_SCATTER && p[nphot].origin == PTYPE_DISK)
+  if (geo.rt_mode == RT_MODE_MACRO && geo.nmacro > 0)
+  {
+#pragma omp parallel for schedule(dynamic) private(nlev) copyin(plasmamain, macromain)
+    for (n = 0; n < NPLASMA; n++)
+    {
+      if (macromain[n].kpkt_rates_known != 1)
+      {
+        fill_kpkt_rates (&plasmamain[n]);
+      }
+      if (macromain[n].matom_prbs_t_e != plasmamain[n].t_e)
       {
-        geo.absorb_reflect = BACK_RAD_ABSORB_AND_DESTROY;
+        for (nlev = 0; nlev < nlevels_macro; nlev++)
+        {
+          fill_matom_prbs (&plasmamain[n], nlev);
+        }
+        macromain[n].matom_prbs_t_e = plasmamain[n].t_e;
       }
+    }
+  }
 
+  Log ("trans_phot: Transporting photons on %d threads\n", omp_get_max_threads ());
 
-      stuff_phot (&p[nphot], &pextract);
+  master_plasma = plasmamain;
+  master_macro = macromain;
+  master_photstore = photstoremain;
+  master_matomphotstore = matomphotstoremain;
 
+#pragma omp parallel private(ctx, n, nphot)
+  {
+    ctx = transport_ctx[omp_get_thread_num ()];
+    use_rand_stream (ctx);
+    if (omp_get_thread_num () > 0)
+    {
+      copy_estimators_thread (master_plasma, master_macro, master_photstore, master_matomphotstore);
+    }
+#endif
 
-      /* We increase weight to account for number of scatters. This is done because in extract we multiply by the escape
-         probability along a given direction, but we also need to divide the weight by the mean escape probability, which is
-         equal to 1/nnscat */
-      if (geo.scatter_mode == SCATTER_MODE_THERMAL && pextract.nres <= NLINES && pextract.nres > -1)
-      {
-        /* we normalised our rejection method by the escape probability along the vector of maximum velocity gradient.
-           First find the sobolev optical depth along that vector. The -1 enforces calculation of the ion density */
+    /* Beginning of the loop over the batches of photons.  Unless the photons are shared
+       dynamically between MPI tasks, there is a single batch containing all of the photons
+       in p.  A batch is claimed by the master thread, since it is the only one which makes MPI
+       calls, and then the photons in it are divided among all of the threads */
 
-        tau_norm = sobolev (&wmain[pextract.grid], pextract.x, -1.0, lin_ptr[pextract.nres], wmain[pextract.grid].dvds_max);
+    while (TRUE)
+    {
+#ifdef _OPENMP
+#pragma omp master
+#endif
+      batch_more = phot_batch_next (&pbatch, &nfirst, &nbatch);
+#ifdef _OPENMP
+#pragma omp barrier
+#endif
+
+      if (!batch_more)
+      {
+        break;
+      }
 
-        /* then turn into a probability */
-        p_norm = p_escape_from_tau (tau_norm);
+      /* Beginning of loop over the photons in the batch */
 
-      }
-      else
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+      for (n = 0; n < nbatch; n++)
       {
-        p_norm = 1.0;
+        nphot = nfirst + n;
+        CURRENT_PHOT = nphot;   /* A diagnostic to make it easier to determine what photon is causing a problem */
 
-        /* throw an error if nnscat does not equal 1 */
-        if (pextract.nnscat != 1)
-          Error
-            ("trans_phot: nnscat is %i for photon %i in scatter mode %i! nres %i NLINES %i\n",
-             pextract.nnscat, nphot, geo.scatter_mode, pextract.nres, NLINES);
-      }
+        /* This is just a watchdog method to tell the user the program is still running */
 
+        if (nphot % nreport == 0)
+        {
+          Log ("Cycle %d/%d: Photon %10d of %10d or %6.1f per cent \n", geo.wcycle, geo.pcycle, nphot, NPHOT, nphot * 100. / NPHOT);
+        }
 
+        Log_flush ();
 
-      /* We then increase weight to account for number of scatters. This is done because in extract we multiply by the escape
-         probability along a given direction, but we also need to divide the weight by the mean escape probability, which is
-         equal to 1/nnscat */
+        /* Verify that the weights are real, a check that is proably unnecessary */
 
-      pextract.w *= p[nphot].nnscat / p_norm;
+        if (sane_check (pbatch[n].w))
+        {
+          Error ("trans_phot:sane_check photon %d has weight %e\n", nphot, pbatch[n].w);
+        }
 
-      if (sane_check (pextract.w))
-      {
-        Error ("trans_phot: sane_check photon %d has weight %e before extract\n", nphot, pextract.w);
-      }
-      extract (w, &pextract, pextract.origin);
+        /* The next if statement is executed if we are calculating the detailed spectrum and makes sure we always run extract on
+           the original photon no matter where it was generated */
 
+        if (iextract)
+        {
+          extract_original (ctx, w, &pbatch[n]);
+        }
+
+        pbatch[n].np = nphot;
+
+        /* Transport a single photon */
+        trans_phot_single (ctx, w, &pbatch[n], iextract);
 
-      /* Restore the correct disk illumination */
-      if (absorb_reflect == BACK_RAD_SCATTER && p[nphot].origin == PTYPE_DISK)
-      {
-        geo.absorb_reflect = BACK_RAD_SCATTER;
       }
-    }                           /* End of extract loop */
 
-    p[nphot].np = nphot;
+      /* Return the photons to the task that generated them if they were taken from another task */
 
-    /* Transport a single photon */
-    trans_phot_single (w, &p[nphot], iextract);
+#ifdef _OPENMP
+#pragma omp master
+#endif
+      phot_batch_done ();
+#ifdef _OPENMP
+#pragma omp barrier
+#endif
+    }
 
+#ifdef _OPENMP
+    if (omp_get_thread_num () > 0)
+    {
+      reduce_estimators_thread (master_plasma, master_macro, master_photstore, master_matomphotstore);
+    }
   }
+#endif
+
+  phot_batch_finish ();
 
   /* This is the end of the loop over all of the photons; after this the routine returns */
 
   /* Line to complete watchdog timer */
   Log ("\n\n");
 
+  for (n = 0; n < ntransport_ctx; n++)
+  {
+    transport_context_summary (transport_ctx[n]);
+  }
+
   /* sometimes photons scatter near the edge of the wind and get pushed out by DFUDGE. We record these */
   if (n_lost_to_dfudge > 0)
     Error
@@ -211,6 +324,81 @@ trans_phot (WindPtr w, PhotPtr p, int iextract)
 
 
 
+/**********************************************************/
+/**
+ * @brief      Extract a photon in the directions of the observers before it is transported
+ *
+ * @param [in, out] CtxPtr  ctx   The transport context of the thread doing the extraction
+ * @param [in] WindPtr  w   The entire wind
+ * @param [in] PhotPtr  p   A single photon, as it was generated
+ *
+ * @return     Always returns 0
+ *
+ * @details
+ * When the detailed spectrum is being calculated, every photon is extracted 
+ * where it was generated, whatever its origin, before it is transported.
+ * The photon itself is not modified.
+ *
+ * ### Notes ###
+ *
+ * This is called by trans_phot.  Disk photons are extracted only once 
+ * even if the disk reflects, since extract does not consider reflection from
+ * the disk.
+ *
+ **********************************************************/
+
+int
+extract_original (CtxPtr ctx, WindPtr w, PhotPtr p)
+{
+  struct photon pextract;
+  double p_norm, tau_norm;
+
+  stuff_phot (p, &pextract);
+
+  /* We increase weight to account for number of scatters. This is done because in extract we multiply by the escape
+     probability along a given direction, but we also need to divide the weight by the mean escape probability, which is
+     equal to 1/nnscat */
+  if (geo.scatter_mode == SCATTER_MODE_THERMAL && pextract.nres <= NLINES && pextract.nres > -1)
+  {
+    /* we normalised our rejection method by the escape probability along the vector of maximum velocity gradient.
+       First find the sobolev optical depth along that vector. The -1 enforces calculation of the ion density */
+
+    tau_norm = sobolev (&wmain[pextract.grid], pextract.x, -1.0, lin_ptr[pextract.nres], wmain[pextract.grid].dvds_max);
+
+    /* then turn into a probability */
+    p_norm = p_escape_from_tau (tau_norm);
+
+  }
+  else
+  {
+    p_norm = 1.0;
+
+    /* throw an error if nnscat does not equal 1 */
+    if (pextract.nnscat != 1)
+      Error
+        ("trans_phot: nnscat is %i for photon %i in scatter mode %i! nres %i NLINES %i\n",
+         pextract.nnscat, CURRENT_PHOT, geo.scatter_mode, pextract.nres, NLINES);
+  }
+
+
+
+  /* We then increase weight to account for number of scatters. This is done because in extract we multiply by the escape
+     probability along a given direction, but we also need to divide the weight by the mean escape probability, which is
+     equal to 1/nnscat */
+
+  pextract.w *= p->nnscat / p_norm;
+
+  if (sane_check (pextract.w))
+  {
+    Error ("trans_phot: sane_check photon %d has weight %e before extract\n", CURRENT_PHOT, pextract.w);
+  }
+  extract (ctx, w, &pextract, pextract.origin);
+
+  return (0);
+}
+
+
+
 
 
 
@@ -218,6 +406,7 @@ trans_phot (WindPtr w, PhotPtr p, int iextract)
 /**
  * @brief      Transport a single photon photon through the wind.
  *
+ * @param [in, out] CtxPtr  ctx   The transport context of the thread transporting the photon
  * @param [in] WindPtr  w   The entire wind
  * @param [in, out] PhotPtr  p   A single photon
  * @param [in] int  iextract   If 0, then process this photon in the live or die option, without
@@ -253,7 +442,7 @@ trans_phot (WindPtr w, PhotPtr p, int iextract)
  **********************************************************/
 
 int
-trans_phot_single (WindPtr w, PhotPtr p, int iextract)
+trans_phot_single (CtxPtr ctx, WindPtr w, PhotPtr p, int iextract)
 {
   double tau_scat, tau;
   int istat;
@@ -296,7 +485,7 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
        of it's last scatter.  In most other cases though we store the final position of the photon. */
 
 
-    istat = translate (w, &pp, tau_scat, &tau, &nres);
+    istat = translate (ctx, w, &pp, tau_scat, &tau, &nres);
     /* nres is the resonance at which the photon was stopped.  At present the same value is also stored in pp->nres, but I have
        not yet eliminated it from translate. ?? 02jan ksl */
 
@@ -321,6 +510,9 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
 
     if (istat == P_HIT_STAR)
     {                           /* It hit the star */
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
       geo.lum_star_back += pp.w;
       if (geo.absorb_reflect == BACK_RAD_SCATTER)
       {
@@ -337,7 +529,7 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
         if (iextract)
         {
           stuff_phot (&pp, &pextract);
-          extract (w, &pextract, PTYPE_STAR);   // Treat as stellar photon for purpose of extraction
+          extract (ctx, w, &pextract, PTYPE_STAR);      // Treat as stellar photon for purpose of extraction
         }
       }
       else
@@ -360,9 +552,14 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
       while (rrr > qdisk.r[kkk] && kkk < NRINGS - 1)
         kkk++;
       kkk--;                    /* So that the heating refers to the heating between kkk and kkk+1 */
-      qdisk.nhit[kkk]++;
-      geo.lum_disk_back = qdisk.heat[kkk] += pp.w;
-      qdisk.ave_freq[kkk] += pp.w * pp.freq;
+#ifdef _OPENMP
+#pragma omp critical (qdisk)
+#endif
+      {
+        qdisk.nhit[kkk]++;
+        geo.lum_disk_back = qdisk.heat[kkk] += pp.w;
+        qdisk.ave_freq[kkk] += pp.w * pp.freq;
+      }
 
       if (geo.absorb_reflect == BACK_RAD_SCATTER)
       {
@@ -378,7 +575,7 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
         if (iextract)
         {
           stuff_phot (&pp, &pextract);
-          extract (w, &pextract, PTYPE_DISK);
+          extract (ctx, w, &pextract, PTYPE_DISK);
         }
       }
       else
@@ -392,7 +589,7 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
     {                           /* Cause the photon to scatter and reinitilize */
 
 
-      pp.grid = n = where_in_grid (wmain[pp.grid].ndom, pp.x);
+      pp.grid = n = where_in_grid (ctx, wmain[pp.grid].ndom, pp.x);
 
       if (n < 0)
       {
@@ -432,6 +629,9 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
       /* Add path lengths for reverberation mapping */
       if ((geo.reverb == REV_WIND || geo.reverb == REV_MATOM) && geo.ioniz_or_extract && geo.wcycle == geo.wcycles - 1)
       {
+#ifdef _OPENMP
+#pragma omp critical (reverb)
+#endif
         wind_paths_add_phot (&wmain[n], &pp);
       }
 
@@ -450,7 +650,7 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
       {
         Error ("trans_phot:sane_check photon %d has weight %e before scatter\n", p->np, pp.w);
       }
-      if ((nerr = scatter (&pp, ptr_nres, &nnscat)) != 0)
+      if ((nerr = scatter (ctx, &pp, ptr_nres, &nnscat)) != 0)
       {
         Error ("trans_phot: Bad return from scatter %d at point 2", nerr);
       }
@@ -557,7 +757,7 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
         {
           Error ("trans_phot: sane_check photon %d has weight %e before extract\n", p->np, pextract.w);
         }
-        extract (w, &pextract, PTYPE_WIND);     // Treat as wind photon for purpose of extraction
+        extract (ctx, w, &pextract, PTYPE_WIND);        // Treat as wind photon for purpose of extraction
       }
 
 
@@ -570,7 +770,7 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
       tau = 0;
 
       stuff_v (pp.x, x_dfudge_check);   // this is a vector we use to see if dfudge moved the photon outside the wind cone
-      reposition (&pp);
+      reposition (ctx, &pp);
 
       /* JM 1506 -- call walls again to account for instance where DFUDGE
          can take photon outside of the wind and into the disk or star
@@ -590,6 +790,9 @@ trans_phot_single (WindPtr w, PhotPtr p, int iextract)
 
       if (where_in_wind (pp.x, &ndom) != W_ALL_INWIND && where_in_wind (x_dfudge_check, &ndom) == W_ALL_INWIND)
       {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
         n_lost_to_dfudge++;     // increment the counter (checked at end of trans_phot)
       }
 
@@ -0,0 +1,160 @@
+
+/***********************************************************/
+/** @file  transport_context.c
+ * @date   October, 2026
+ *
+ * @brief  Routines to create and maintain the transport contexts
+ * which carry the remembered state of the photon transport routines
+ *
+ * ### Notes ###
+ *
+ * A transport context (see python.h) holds the values that routines such
+ * as where_in_grid, calculate_ds and sigma_phot keep from one call to the
+ * next to avoid repeating work, together with the random number stream of
+ * the worker that owns it.  trans_phot creates one context for each thread
+ * the first time it is called, and the contexts are then reused for
+ * every flight of photons.
+ *
+ ***********************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "atomic.h"
+#include "python.h"
+
+
+
+/**********************************************************/
+/**
+ * @brief      Allocate and initialise a transport context
+ *
+ * @param [in] int  nthread   The number of the worker (thread) which will use the context
+ * @return     A pointer to the new context
+ *
+ * @details
+ * The arrays used to remember the last photoionization x-section
+ * are sized for all of the phot_top and inner_cross x-sections, and
+ * so the atomic data must have been read before this is called.
+ *
+ * ### Notes ###
+ * The random number stream is not set up here, but the first time
+ * the context is passed to use_rand_stream.
+ *
+ **********************************************************/
+
+CtxPtr
+init_transport_context (nthread)
+     int nthread;
+{
+  CtxPtr ctx;
+
+  if ((ctx = (CtxPtr) calloc (sizeof (transport_dummy), 1)) == NULL)
+  {
+    Error ("init_transport_context: Could not allocate a context for thread %d\n", nthread);
+    exit (0);
+  }
+
+  ctx->nthread = nthread;
+  ctx->rng = NULL;
+  ctx->own_rng = FALSE;
+
+  ctx->nsigma = nphot_max + n_inner_max;
+  ctx->sigma_f = calloc (sizeof (double), ctx->nsigma);
+  ctx->sigma_x = calloc (sizeof (double), ctx->nsigma);
+  ctx->sigma_nlast = calloc (sizeof (int), ctx->nsigma);
+
+  if (ctx->sigma_f == NULL || ctx->sigma_x == NULL || ctx->sigma_nlast == NULL)
+  {
+    Error ("init_transport_context: Could not allocate the x-section memory for thread %d\n", nthread);
+    exit (0);
+  }
+
+  reset_transport_context (ctx);
+
+  return (ctx);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Forget all of the values remembered in a transport context
+ *
+ * @param [in, out] CtxPtr  ctx   The context
+ * @return     Always returns 0
+ *
+ * @details
+ * The remembered values and the counters of how often they were
+ * used are cleared.  The random number stream is unaffected.
+ *
+ * ### Notes ###
+ * trans_phot calls this at the start of each flight of photons,
+ * since the wind may have changed since the last one.
+ *
+ **********************************************************/
+
+int
+reset_transport_context (ctx)
+     CtxPtr ctx;
+{
+  int n;
+
+  ctx->wig_ndom = ctx->wig_n = -1;
+  ctx->wig_x = ctx->wig_y = ctx->wig_z = 0.0;
+
+  ctx->nline_min = ctx->nline_max = ctx->nline_delt = 0;
+
+  /* A null direction vector guarantees that comp_phot will not match this to a real photon */
+  for (n = 0; n < 3; n++)
+  {
+    ctx->cds_phot_old.x[n] = 0.0;
+    ctx->cds_phot_old.lmn[n] = 0.0;
+  }
+  ctx->cds_v2_old = 0.0;
+
+  for (n = 0; n < ctx->nsigma; n++)
+  {
+    ctx->sigma_f[n] = -1.0;
+    ctx->sigma_x[n] = 0.0;
+    ctx->sigma_nlast[n] = -1;
+  }
+
+  ctx->wig_calls = ctx->wig_hits = ctx->wig_nearby = 0;
+  ctx->cds_calls = ctx->cds_hits = 0;
+  ctx->sigma_calls = ctx->sigma_hits = 0;
+
+  return (0);
+}
+
+
+
+/**********************************************************/
+/**
+ * @brief      Write how often the values remembered in a transport context were used
+ *
+ * @param [in] CtxPtr  ctx   The context
+ * @return     Always returns 0
+ *
+ * @details
+ * The number of calls and the number of times the remembered
+ * values could be used instead of a fresh calculation are written
+ * to the diagnostic file for where_in_grid, calculate_ds and sigma_phot,
+ * together with how often where_in_grid found a new position next to the last one.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+int
+transport_context_summary (ctx)
+     CtxPtr ctx;
+{
+  Log_silent ("transport_context: thread %d where_in_grid %ld of %ld calculate_ds %ld of %ld sigma_phot %ld of %ld remembered\n",
+              ctx->nthread, ctx->wig_hits, ctx->wig_calls, ctx->cds_hits, ctx->cds_calls, ctx->sigma_hits, ctx->sigma_calls);
+  Log_silent ("transport_context: thread %d where_in_grid %ld of %ld found next to the last cell\n", ctx->nthread, ctx->wig_nearby,
+              ctx->wig_calls - ctx->wig_hits);
+
+  return (0);
+}
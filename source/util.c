@@ -221,6 +221,9 @@ linterp (x, xarray, yarray, xdim, y, mode)
 
 
 int ierr_coord_fraction = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(ierr_coord_fraction)
+#endif
 
 /**********************************************************/
 /**
@@ -399,6 +402,9 @@ coord_fraction (ndom, ichoice, x, ii, frac, nelem)
 
 
 int ierr_where_in_2dcell = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(ierr_where_in_2dcell)
+#endif
 
 /**********************************************************/
 /**
@@ -164,7 +164,7 @@ where_in_wind (x, ndomain)
     {
       one_dom = &zdom[ndom];
 
-      n = where_in_grid (ndom, x);
+      n = where_in_grid (NULL, ndom, x);
       if (n >= 0)
       {
         *ndomain = ndom;
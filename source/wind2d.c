@@ -269,6 +269,7 @@ define_wind ()
   calloc_plasma (NPLASMA);
   calloc_dyn_plasma (NPLASMA);
   create_maps ();               /* Populate the maps between plasmamain & wmain */
+  wind_hot_make ();             /* Copy the properties used most in transport into windhot */
 
   /* JM 1502 -- we want the macro structure to be allocated in geo.rt_mode = RT_MODE_MACRO. see #138  */
 
@@ -523,13 +524,128 @@ be optional which variables beyond here are moved to structures othere than Wind
 //OLD
 //OLD **************************************************************/
 
-int wig_n;
-double wig_x, wig_y, wig_z;
+/**********************************************************/
+/**
+ * @brief      finds which of three neighbouring intervals of a grid array contains a value
+ *
+ * @param [in] double  value   The value to be located
+ * @param [in] double  array[]   The boundaries of the grid, in increasing order
+ * @param [in] int  npts   The number of boundaries in the array
+ * @param [in] int  i   The interval which is expected to contain the value
+ * @return     The interval i, i+1 or i-1 which contains the value, or -1 if none does
+ *
+ * @details
+ * Interval k runs from array[k] to array[k+1], and the value is assigned in the
+ * same way as by fraction, that is array[k] < value <= array[k+1], except that
+ * a value equal to array[0] is in interval 0.  The interval is therefore the
+ * one fraction would have found, but is found without a binary search.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+int
+nearby_interval (value, array, npts, i)
+     double value;
+     double array[];
+     int npts, i;
+{
+  int k, kk;
+
+  for (kk = 0; kk < 3; kk++)
+  {
+    k = (kk == 0) ? i : ((kk == 1) ? i + 1 : i - 1);    /* The photon is most often still in the same interval */
+    if (k < 0 || k > npts - 2)
+      continue;
+    if ((array[k] < value || (k == 0 && array[0] == value)) && value <= array[k + 1])
+      return (k);
+  }
+  return (-1);
+}
+
+
+
+
+/**********************************************************/
+/**
+ * @brief      locates the element in wmain associated with a position which is
+ * known to be close to a given element
+ *
+ * @param [in] int  ndom   The domain number for the search
+ * @param [in] double  x[]   The position
+ * @param [in] int  n_last   An element of wmain in the domain which is in or next to the element containing x
+ * @return     The element in wmain associated with the position, or -1 if it is not
+ * n_last or one of its neighbours
+ *
+ * @details
+ * As a photon is transported it moves from one cell to a neighbouring cell, so
+ * rather than searching the whole grid, the cell and its neighbours are checked 
+ * in turn.  The coordinates of the position are calculated, and the cell assigned, in the
+ * same way as by cylind_where_in_grid, rtheta_where_in_grid and spherical_where_in_grid,
+ * so the element found is the one they would have returned.
+ *
+ * ### Notes ###
+ * If the position is not in the cell or its neighbours, including if it is
+ * outside the grid, the caller has to search the grid in the usual way.  cylvar
+ * coordinates, in which the boundaries in z differ from one column of cells 
+ * to the next, are not handled, and -1 is always returned for them.
+ *
+ **********************************************************/
+
+int
+where_in_grid_nearby (ndom, x, n_last)
+     int ndom;
+     double x[];
+     int n_last;
+{
+  int i, j, n;
+  double r, z;
+  DomainPtr one_dom;
+
+  one_dom = &zdom[ndom];
+  n = n_last - one_dom->nstart;
+
+  if (one_dom->coord_type == CYLIND)
+  {
+    z = fabs (x[2]);
+    if (z == 0)
+      z = 1.e4;                 // As in cylind_where_in_grid
+    r = sqrt (x[0] * x[0] + x[1] * x[1]);
+    if ((i = nearby_interval (r, one_dom->wind_x, one_dom->ndim, n / one_dom->mdim)) < 0)
+      return (-1);
+    if ((j = nearby_interval (z, one_dom->wind_z, one_dom->mdim, n % one_dom->mdim)) < 0)
+      return (-1);
+    return (one_dom->nstart + i * one_dom->mdim + j);
+  }
+  else if (one_dom->coord_type == RTHETA)
+  {
+    r = length (x);
+    z = acos ((fabs (x[2] / r))) * RADIAN;
+    if ((i = nearby_interval (r, one_dom->wind_x, one_dom->ndim, n / one_dom->mdim)) < 0)
+      return (-1);
+    if ((j = nearby_interval (z, one_dom->wind_z, one_dom->mdim, n % one_dom->mdim)) < 0)
+      return (-1);
+    return (one_dom->nstart + i * one_dom->mdim + j);
+  }
+  else if (one_dom->coord_type == SPHERICAL)
+  {
+    r = length (x);
+    if ((i = nearby_interval (r, one_dom->wind_x, one_dom->ndim, n)) < 0)
+      return (-1);
+    return (one_dom->nstart + i);
+  }
+
+  return (-1);
+}
+
+
 
 /**********************************************************/
 /**
  * @brief      locates the element in wmain associated with a postion
  *
+ * @param [in, out] CtxPtr  ctx   The transport context, or NULL if the
+ * position need not be remembered
  * @param [in] int  ndom   The domain number for the search
  * @param [in] double  x[]   The position
  * @return     where_in_grid normally  returns the element in wmain associated
@@ -555,20 +671,43 @@ double wig_x, wig_y, wig_z;
  * returns the position in wmain, rather than the position in one of
  * the plasma domains.  It would make sense to revise this.
  *
+ * The photon transport often asks for the same position more than
+ * once, so the last position and element are remembered in the
+ * transport context, if one is given.  A new position is then looked
+ * for first in the last element and its neighbours, see where_in_grid_nearby,
+ * and the grid is only searched if it is not there.
+ *
  **********************************************************/
 
 int
-where_in_grid (ndom, x)
+where_in_grid (ctx, ndom, x)
+     CtxPtr ctx;
      int ndom;
      double x[];
 {
   int n;
   double fx, fz;
 
-
-  if (wig_x != x[0] || wig_y != x[1] || wig_z != x[2])  // Calculate if new position
+  n = -1;
+  if (ctx != NULL)
   {
+    ctx->wig_calls++;
+    if (ctx->wig_ndom == ndom && ctx->wig_x == x[0] && ctx->wig_y == x[1] && ctx->wig_z == x[2])
+    {
+      ctx->wig_hits++;
+      return (ctx->wig_n);
+    }
+
+    /* Photons mostly move into a neighbouring cell, so check the last cell and its neighbours first */
+    if (ctx->wig_ndom == ndom && ctx->wig_n >= 0 && (n = where_in_grid_nearby (ndom, x, ctx->wig_n)) >= 0)
+    {
+      ctx->wig_nearby++;
+    }
+  }
 
+  /* Search the grid if the position was not found next to the last one */
+  if (n < 0)
+  {
     if (zdom[ndom].coord_type == CYLIND)
     {
       n = cylind_where_in_grid (ndom, x);
@@ -590,17 +729,20 @@ where_in_grid (ndom, x)
       Error ("where_in_grid: Unknown coord_type %d for domain %d\n", zdom[ndom].coord_type, ndom);
       exit (0);
     }
+  }
 
-
-    /* Store old positions to short-circuit calculation if asked for same position more
-       than once */
-    wig_x = x[0];
-    wig_y = x[1];
-    wig_z = x[2];
-    wig_n = n;
+  /* Store the position to short-circuit the calculation if asked for the same position more
+     than once */
+  if (ctx != NULL)
+  {
+    ctx->wig_ndom = ndom;
+    ctx->wig_x = x[0];
+    ctx->wig_y = x[1];
+    ctx->wig_z = x[2];
+    ctx->wig_n = n;
   }
 
-  return (wig_n);
+  return (n);
 }
 
 //OLD /***********************************************************
@@ -664,6 +806,9 @@ where_in_grid (ndom, x)
 //OLD
 //OLD **************************************************************/
 int ierr_vwind = 0;
+#ifdef _OPENMP
+#pragma omp threadprivate(ierr_vwind)
+#endif
 
 
 /**********************************************************/
@@ -727,12 +872,22 @@ vwind_xyz (ndom, p, v)
 
   coord_fraction (ndom, 0, p->x, nnn, frac, &nelem);
 
+  /* Read the velocities from the compact copy in windhot once it has been made */
+
   for (i = 0; i < 3; i++)
   {
 
     x = 0;
-    for (nn = 0; nn < nelem; nn++)
-      x += wmain[nnn[nn]].v[i] * frac[nn];
+    if (windhot != NULL)
+    {
+      for (nn = 0; nn < nelem; nn++)
+        x += windhot[nnn[nn]].v[i] * frac[nn];
+    }
+    else
+    {
+      for (nn = 0; nn < nelem; nn++)
+        x += wmain[nnn[nn]].v[i] * frac[nn];
+    }
 
     vv[i] = x;
   }
@@ -804,6 +959,9 @@ vwind_xyz (ndom, p, v)
  *
  **********************************************************/
 int wind_div_err = (-3);
+#ifdef _OPENMP
+#pragma omp threadprivate(wind_div_err)
+#endif
 
 int
 wind_div_v ()
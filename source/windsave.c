@@ -17,6 +17,23 @@
  * used for restars, and also by routines like py_wind and windsave2talbe
  * which inspect what is happening in the wind.
  *
+ * The windsave file begins with a header, and a table which gives the
+ * name, position and size of each section of the file.  The wind, plasma
+ * and macro structures are written by field: each section contains one
+ * member of the structure, or one of its variable length arrays, for all
+ * of the cells, and is named after it, e.g. plasma.t_e.  A file can therefore
+ * be read by a program in which members have been added to, removed from
+ * or moved within these structures; a member which is not in the file is
+ * simply not read.  wind_read maps the file into memory and copies each
+ * section to where it belongs.  Windsave files written before the table
+ * was introduced can still be read with wind_read_version1.
+ *
+ * geo, the domains, disk and qdisk are still written as single
+ * sections containing the structures as they are in memory, so a file
+ * can only be read by a program in which these have the same layout.
+ * They are small, but contain very many members, and are not
+ * written by field for this reason.
+ *
  * There are separate ascii_writing 
  * routines for writing the spectra out for plotting.)
  * 
@@ -24,12 +41,145 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "atomic.h"
 #include "python.h"
 
 
+#define WINDSAVE_MAGIC      "python_windsave"
+#define WINDSAVE_FORMAT     3
+#define NWINDSAVE_SECTIONS  256
+#define WINDSAVE_ALIGN      8   /* Each section begins at a multiple of this number of bytes */
+
+/* The header at the beginning of a windsave file.  The dimensions of the variable length arrays
+   are recorded so that a file can be checked against the atomic data with which it is read */
+
+typedef struct windsave_header
+{
+  char magic[16];
+  int format;                   /* WINDSAVE_FORMAT when the file was written */
+  int nsections;                /* The number of sections in the table which follows the header */
+  char version[LINELENGTH];     /* The version of python which wrote the file */
+  char atomic_filename[LINELENGTH];
+  int nions, nlte_levels, nphot_total, nlevels_macro;
+  int size_Jbar_est, size_gamma_est, size_alpha_est;
+  int ndim2, nplasma;
+} windsave_header_dummy;
+
+windsave_header_dummy windsave_header;
+windsave_section_dummy windsave_table[NWINDSAVE_SECTIONS];
+
+/* The members of the wind, plasma and macro structures which are saved, other than the
+   variable length arrays (see windsave_field in python.h) */
+
+#define WINDSAVE_FIELD(s, p, m, t) {p "." #m, offsetof (s, m), sizeof (t), sizeof (((s *) 0)->m) / sizeof (t)}
+#define WIND_FIELD(m, t)   WINDSAVE_FIELD (wind_dummy, "wind", m, t)
+#define PLASMA_FIELD(m, t) WINDSAVE_FIELD (plasma_dummy, "plasma", m, t)
+#define MACRO_FIELD(m, t)  WINDSAVE_FIELD (macro_dummy, "macro", m, t)
+
+windsave_field_dummy wind_fields[] = {
+  WIND_FIELD (ndom, int), WIND_FIELD (nwind, int), WIND_FIELD (nplasma, int),
+  WIND_FIELD (x, double), WIND_FIELD (xcen, double), WIND_FIELD (r, double), WIND_FIELD (rcen, double),
+  WIND_FIELD (theta, double), WIND_FIELD (thetacen, double), WIND_FIELD (dtheta, double), WIND_FIELD (dr, double),
+  WIND_FIELD (wcone.z, double), WIND_FIELD (wcone.dzdr, double),
+  WIND_FIELD (v, double), WIND_FIELD (v_grad, double), WIND_FIELD (div_v, double), WIND_FIELD (dvds_ave, double),
+  WIND_FIELD (dvds_max, double), WIND_FIELD (lmn, double), WIND_FIELD (vol, double), WIND_FIELD (dfudge, double),
+  WIND_FIELD (inwind, enum inwind_enum)
+};
+
+windsave_field_dummy plasma_fields[] = {
+  PLASMA_FIELD (nwind, int), PLASMA_FIELD (nplasma, int), PLASMA_FIELD (ne, double), PLASMA_FIELD (rho, double),
+  PLASMA_FIELD (vol, double), PLASMA_FIELD (kappa_ff_factor, double), PLASMA_FIELD (kpkt_emiss, double),
+  PLASMA_FIELD (kpkt_abs, double), PLASMA_FIELD (kbf_nuse, int),
+  PLASMA_FIELD (t_r, double), PLASMA_FIELD (t_r_old, double), PLASMA_FIELD (t_e, double), PLASMA_FIELD (t_e_old, double),
+  PLASMA_FIELD (dt_e, double), PLASMA_FIELD (dt_e_old, double), PLASMA_FIELD (heat_tot, double),
+  PLASMA_FIELD (heat_tot_old, double), PLASMA_FIELD (abs_tot, double), PLASMA_FIELD (heat_lines, double),
+  PLASMA_FIELD (heat_ff, double), PLASMA_FIELD (heat_comp, double), PLASMA_FIELD (heat_ind_comp, double),
+  PLASMA_FIELD (heat_lines_macro, double), PLASMA_FIELD (heat_photo_macro, double), PLASMA_FIELD (heat_photo, double),
+  PLASMA_FIELD (heat_z, double), PLASMA_FIELD (heat_auger, double), PLASMA_FIELD (abs_photo, double),
+  PLASMA_FIELD (abs_auger, double), PLASMA_FIELD (w, double),
+  PLASMA_FIELD (ntot, int), PLASMA_FIELD (ntot_star, int), PLASMA_FIELD (ntot_bl, int), PLASMA_FIELD (ntot_disk, int),
+  PLASMA_FIELD (ntot_wind, int), PLASMA_FIELD (ntot_agn, int), PLASMA_FIELD (nscat_es, int), PLASMA_FIELD (nscat_res, int),
+  PLASMA_FIELD (mean_ds, double), PLASMA_FIELD (n_ds, int), PLASMA_FIELD (nrad, int), PLASMA_FIELD (nioniz, int),
+  PLASMA_FIELD (j, double), PLASMA_FIELD (ave_freq, double), PLASMA_FIELD (xj, double), PLASMA_FIELD (xave_freq, double),
+  PLASMA_FIELD (fmin, double), PLASMA_FIELD (fmax, double), PLASMA_FIELD (fmin_mod, double), PLASMA_FIELD (fmax_mod, double),
+  PLASMA_FIELD (j_direct, double), PLASMA_FIELD (j_scatt, double), PLASMA_FIELD (ip_direct, double),
+  PLASMA_FIELD (ip_scatt, double), PLASMA_FIELD (xsd_freq, double), PLASMA_FIELD (nxtot, int), PLASMA_FIELD (max_freq, double),
+  PLASMA_FIELD (cool_tot, double), PLASMA_FIELD (lum_lines, double), PLASMA_FIELD (lum_ff, double),
+  PLASMA_FIELD (cool_adiabatic, double), PLASMA_FIELD (lum_rr, double), PLASMA_FIELD (lum_rr_metals, double),
+  PLASMA_FIELD (cool_comp, double), PLASMA_FIELD (cool_di, double), PLASMA_FIELD (cool_dr, double),
+  PLASMA_FIELD (cool_rr, double), PLASMA_FIELD (cool_rr_metals, double), PLASMA_FIELD (lum_tot, double),
+  PLASMA_FIELD (lum_tot_old, double), PLASMA_FIELD (cool_tot_ioniz, double), PLASMA_FIELD (lum_lines_ioniz, double),
+  PLASMA_FIELD (lum_ff_ioniz, double), PLASMA_FIELD (cool_adiabatic_ioniz, double), PLASMA_FIELD (lum_rr_ioniz, double),
+  PLASMA_FIELD (cool_comp_ioniz, double), PLASMA_FIELD (cool_di_ioniz, double), PLASMA_FIELD (cool_dr_ioniz, double),
+  PLASMA_FIELD (cool_rr_ioniz, double), PLASMA_FIELD (cool_rr_metals_ioniz, double), PLASMA_FIELD (lum_tot_ioniz, double),
+  PLASMA_FIELD (bf_simple_ionpool_in, double), PLASMA_FIELD (bf_simple_ionpool_out, double),
+  PLASMA_FIELD (comp_nujnu, double), PLASMA_FIELD (dmo_dt, double), PLASMA_FIELD (gain, double),
+  PLASMA_FIELD (converge_t_r, double), PLASMA_FIELD (converge_t_e, double), PLASMA_FIELD (converge_hc, double),
+  PLASMA_FIELD (trcheck, int), PLASMA_FIELD (techeck, int), PLASMA_FIELD (hccheck, int),
+  PLASMA_FIELD (converge_whole, int), PLASMA_FIELD (converging, int),
+  PLASMA_FIELD (spec_mod_type, enum spec_mod_type_enum), PLASMA_FIELD (pl_alpha, double), PLASMA_FIELD (pl_log_w, double),
+  PLASMA_FIELD (exp_temp, double), PLASMA_FIELD (exp_w, double), PLASMA_FIELD (ip, double), PLASMA_FIELD (xi, double)
+};
+
+windsave_field_dummy macro_fields[] = {
+  MACRO_FIELD (cooling_normalisation, double), MACRO_FIELD (cooling_bbtot, double), MACRO_FIELD (cooling_bftot, double),
+  MACRO_FIELD (cooling_bf_coltot, double), MACRO_FIELD (cooling_ff, double), MACRO_FIELD (cooling_adiabatic, double)
+};
+
+#define NWIND_FIELDS   (sizeof (wind_fields) / sizeof (windsave_field_dummy))
+#define NPLASMA_FIELDS (sizeof (plasma_fields) / sizeof (windsave_field_dummy))
+#define NMACRO_FIELDS  (sizeof (macro_fields) / sizeof (windsave_field_dummy))
+
+/* The variable length arrays of the plasma and macro structures which are saved.  offset
+   is the position of the pointer to the array in the structure, and nvalues points to the
+   variable which contains the number of values for each cell */
+
+typedef struct windsave_array
+{
+  char *name;
+  int macro;                    /* TRUE if the array belongs to the macro structure */
+  size_t offset;
+  size_t size;
+  int *nvalues;
+} windsave_array_dummy;
+
+#define PLASMA_ARRAY(m, s, n) {"plasma." #m, FALSE, offsetof (plasma_dummy, m), s, &n}
+#define MACRO_ARRAY(m, n)     {"macro." #m, TRUE, offsetof (macro_dummy, m), sizeof (double), &n}
+
+windsave_array_dummy windsave_arrays[] = {
+  PLASMA_ARRAY (density, sizeof (double), nions), PLASMA_ARRAY (partition, sizeof (double), nions),
+  PLASMA_ARRAY (ioniz, sizeof (double), nions), PLASMA_ARRAY (recomb, sizeof (double), nions),
+  PLASMA_ARRAY (inner_recomb, sizeof (double), nions),
+  PLASMA_ARRAY (scatters, sizeof (int), nions), PLASMA_ARRAY (xscatters, sizeof (double), nions),
+  PLASMA_ARRAY (heat_ion, sizeof (double), nions), PLASMA_ARRAY (cool_rr_ion, sizeof (double), nions),
+  PLASMA_ARRAY (cool_dr_ion, sizeof (double), nions), PLASMA_ARRAY (lum_rr_ion, sizeof (double), nions),
+  PLASMA_ARRAY (levden, sizeof (double), nlte_levels),
+  PLASMA_ARRAY (recomb_simple, sizeof (double), nphot_total),
+  PLASMA_ARRAY (recomb_simple_upweight, sizeof (double), nphot_total),
+  PLASMA_ARRAY (kbf_use, sizeof (int), nphot_total),
+  MACRO_ARRAY (jbar, size_Jbar_est), MACRO_ARRAY (jbar_old, size_Jbar_est),
+  MACRO_ARRAY (gamma, size_gamma_est), MACRO_ARRAY (gamma_old, size_gamma_est),
+  MACRO_ARRAY (gamma_e, size_gamma_est), MACRO_ARRAY (gamma_e_old, size_gamma_est),
+  MACRO_ARRAY (alpha_st, size_gamma_est), MACRO_ARRAY (alpha_st_old, size_gamma_est),
+  MACRO_ARRAY (alpha_st_e, size_gamma_est), MACRO_ARRAY (alpha_st_e_old, size_gamma_est),
+  MACRO_ARRAY (recomb_sp, size_alpha_est), MACRO_ARRAY (recomb_sp_e, size_alpha_est),
+  MACRO_ARRAY (matom_emiss, nlevels_macro), MACRO_ARRAY (matom_abs, nlevels_macro)
+};
+
+#define NWINDSAVE_ARRAYS (sizeof (windsave_arrays) / sizeof (windsave_array_dummy))
+
+/* The address of the array described by a, for cell n */
+#define WINDSAVE_ARRAY_PTR(a, n) \
+  (*(char **) ((a)->macro ? (char *) &macromain[n] + (a)->offset : (char *) &plasmamain[n] + (a)->offset))
+
+
 
 /**********************************************************/
 /** 
@@ -40,12 +190,18 @@
  * @return     The number of successful writes
  *
  * @details
+ * The file begins with a header and a table of the sections which follow.
+ * geo, the domains, disk and qdisk are each written as a section, and then
+ * each member of the wind, plasma (and macro) structures is written as
+ * a single section, with the values for all of the cells one after another.
  *
  * ### Notes ###
  *
- * For the most part, adding a variable to the structures geo,
- * or plasma, does not require changes to this routine, unless
- * new variable length arrays are involved.
+ * Adding a variable to geo or the domain structure does not require
+ * changes to this routine.  A new member of the wind, plasma or
+ * macro structures is only saved if it is added to wind_fields,
+ * plasma_fields or macro_fields, or for a variable length array
+ * to windsave_arrays.
  *
  **********************************************************/
 
@@ -54,8 +210,8 @@ wind_save (filename)
      char filename[];
 {
   FILE *fptr, *fopen ();
-  char line[LINELENGTH];
   int n, m;
+  windsave_array_dummy *a;
 
   if ((fptr = fopen (filename, "w")) == NULL)
   {
@@ -63,91 +219,344 @@ wind_save (filename)
     exit (0);
   }
 
-  sprintf (line, "Version %s\n", VERSION);
-  n = fwrite (line, sizeof (line), 1, fptr);
+  memset (&windsave_header, 0, sizeof (windsave_header));
+  memset (windsave_table, 0, sizeof (windsave_table));
+
+  strcpy (windsave_header.magic, WINDSAVE_MAGIC);
+  windsave_header.format = WINDSAVE_FORMAT;
+  strcpy (windsave_header.version, VERSION);
+  strcpy (windsave_header.atomic_filename, geo.atomic_filename);
+  windsave_header.nions = nions;
+  windsave_header.nlte_levels = nlte_levels;
+  windsave_header.nphot_total = nphot_total;
+  windsave_header.nlevels_macro = nlevels_macro;
+  windsave_header.size_Jbar_est = size_Jbar_est;
+  windsave_header.size_gamma_est = size_gamma_est;
+  windsave_header.size_alpha_est = size_alpha_est;
+  windsave_header.ndim2 = NDIM2;
+  windsave_header.nplasma = NPLASMA;
+
+  /* Leave space for the header and the table, which are written when the positions of
+     all of the sections are known */
+
+  n = fwrite (&windsave_header, sizeof (windsave_header), 1, fptr);
+  n += fwrite (windsave_table, sizeof (windsave_table), 1, fptr);
+
+  windsave_start_section (fptr, "geo", sizeof (geo), 1, 1);
   n += fwrite (&geo, sizeof (geo), 1, fptr);
+  windsave_start_section (fptr, "domain", sizeof (domain_dummy), 1, geo.ndomain);
   n += fwrite (zdom, sizeof (domain_dummy), geo.ndomain, fptr);
-  n += fwrite (wmain, sizeof (wind_dummy), NDIM2, fptr);
+  n += windsave_write_fields (fptr, wind_fields, NWIND_FIELDS, (char *) wmain, sizeof (wind_dummy), NDIM2);
+  windsave_start_section (fptr, "disk", sizeof (disk), 1, 1);
   n += fwrite (&disk, sizeof (disk), 1, fptr);
+  windsave_start_section (fptr, "qdisk", sizeof (disk), 1, 1);
   n += fwrite (&qdisk, sizeof (disk), 1, fptr);
-  n += fwrite (plasmamain, sizeof (plasma_dummy), NPLASMA, fptr);
+  n += windsave_write_fields (fptr, plasma_fields, NPLASMA_FIELDS, (char *) plasmamain, sizeof (plasma_dummy), NPLASMA);
 
-/* Write out the variable length arrays
-in the plasma structure */
+  if (geo.nmacro)
+  {
+    n += windsave_write_fields (fptr, macro_fields, NMACRO_FIELDS, (char *) macromain, sizeof (macro_dummy), NPLASMA);
+  }
 
-  for (m = 0; m < NPLASMA; m++)
+/* Write out the variable length arrays in the plasma and macro structures */
+
+  for (a = windsave_arrays; a < windsave_arrays + NWINDSAVE_ARRAYS; a++)
   {
-    n += fwrite (plasmamain[m].density, sizeof (double), nions, fptr);
-    n += fwrite (plasmamain[m].partition, sizeof (double), nions, fptr);
+    if (a->macro && geo.nmacro == 0)
+    {
+      continue;
+    }
 
-    n += fwrite (plasmamain[m].ioniz, sizeof (double), nions, fptr);
-    n += fwrite (plasmamain[m].recomb, sizeof (double), nions, fptr);
-    n += fwrite (plasmamain[m].inner_recomb, sizeof (double), nions, fptr);
+    windsave_start_section (fptr, a->name, a->size, *a->nvalues, NPLASMA);
+    for (m = 0; m < NPLASMA; m++)
+    {
+      n += fwrite (WINDSAVE_ARRAY_PTR (a, m), a->size, *a->nvalues, fptr);
+    }
+  }
 
+  /* Now that the table is complete, go back and write it */
 
-    n += fwrite (plasmamain[m].scatters, sizeof (int), nions, fptr);
-    n += fwrite (plasmamain[m].xscatters, sizeof (double), nions, fptr);
+  fseek (fptr, 0, SEEK_SET);
+  fwrite (&windsave_header, sizeof (windsave_header), 1, fptr);
+  fwrite (windsave_table, sizeof (windsave_table), 1, fptr);
 
-    n += fwrite (plasmamain[m].heat_ion, sizeof (double), nions, fptr);
-    n += fwrite (plasmamain[m].cool_rr_ion, sizeof (double), nions, fptr);
-    n += fwrite (plasmamain[m].cool_dr_ion, sizeof (double), nions, fptr);
-    n += fwrite (plasmamain[m].lum_rr_ion, sizeof (double), nions, fptr);
+  fclose (fptr);
 
+  Log_silent
+    ("wind_write sizes: NPLASMA %d size_Jbar_est %d size_gamma_est %d size_alpha_est %d nlevels_macro %d\n",
+     NPLASMA, size_Jbar_est, size_gamma_est, size_alpha_est, nlevels_macro);
+
+  return (n);
 
-    n += fwrite (plasmamain[m].levden, sizeof (double), nlte_levels, fptr);
-    n += fwrite (plasmamain[m].recomb_simple, sizeof (double), nphot_total, fptr);
-    n += fwrite (plasmamain[m].recomb_simple_upweight, sizeof (double), nphot_total, fptr);
-    n += fwrite (plasmamain[m].kbf_use, sizeof (double), nphot_total, fptr);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief      Add a section to the table of a windsave file which is being written
+ *
+ * @param [in] FILE *  fptr   The windsave file
+ * @param [in] char *  name   The name of the section
+ * @param [in] long  size   The size of one value
+ * @param [in] long  nvalues   The number of values for each cell
+ * @param [in] long  ncells   The number of cells, or structures
+ * @return     The position in the file at which the section begins
+ *
+ * @details
+ * The file is padded so that the section begins at a multiple of
+ * WINDSAVE_ALIGN bytes, and the section is added to windsave_table.
+ * The caller then writes the section itself.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+long
+windsave_start_section (fptr, name, size, nvalues, ncells)
+     FILE *fptr;
+     char *name;
+     long size, nvalues, ncells;
+{
+  long offset;
+  windsave_section_dummy *sec;
+
+  if (windsave_header.nsections == NWINDSAVE_SECTIONS)
+  {
+    Error ("windsave_start_section: Too many sections (%d) in the windsave file\n", NWINDSAVE_SECTIONS);
+    exit (0);
   }
 
-/* Now write out the macro atom info */
+  offset = ftell (fptr);
+  while (offset % WINDSAVE_ALIGN)
+  {
+    fputc (0, fptr);
+    offset++;
+  }
 
-  if (geo.nmacro)
+  sec = &windsave_table[windsave_header.nsections++];
+  strncpy (sec->name, name, sizeof (sec->name) - 1);
+  sec->offset = offset;
+  sec->size = size;
+  sec->nvalues = nvalues;
+  sec->ncells = ncells;
+
+  return (offset);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief      Write members of the structures of all of the cells to a windsave file
+ *
+ * @param [in] FILE *  fptr   The windsave file
+ * @param [in] windsave_field_dummy *  fields   The members to be written
+ * @param [in] int  nfields   The number of members
+ * @param [in] char *  cells   The first of the structures, e.g. wmain
+ * @param [in] size_t  stride   The size of one structure
+ * @param [in] int  ncells   The number of structures
+ * @return     The number of successful writes
+ *
+ * @details
+ * Each member is written as a section containing its values for
+ * all of the cells, one after another.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+int
+windsave_write_fields (fptr, fields, nfields, cells, stride, ncells)
+     FILE *fptr;
+     windsave_field_dummy *fields;
+     int nfields;
+     char *cells;
+     size_t stride;
+     int ncells;
+{
+  int n, m;
+  windsave_field_dummy *f;
+
+  n = 0;
+  for (f = fields; f < fields + nfields; f++)
   {
-    n += fwrite (macromain, sizeof (macro_dummy), NPLASMA, fptr);
-    for (m = 0; m < NPLASMA; m++)
+    windsave_start_section (fptr, f->name, f->size, f->nvalues, ncells);
+    for (m = 0; m < ncells; m++)
     {
-      n += fwrite (macromain[m].jbar, sizeof (double), size_Jbar_est, fptr);
-      n += fwrite (macromain[m].jbar_old, sizeof (double), size_Jbar_est, fptr);
-      n += fwrite (macromain[m].gamma, sizeof (double), size_gamma_est, fptr);
-      n += fwrite (macromain[m].gamma_old, sizeof (double), size_gamma_est, fptr);
-      n += fwrite (macromain[m].gamma_e, sizeof (double), size_gamma_est, fptr);
-      n += fwrite (macromain[m].gamma_e_old, sizeof (double), size_gamma_est, fptr);
-      n += fwrite (macromain[m].alpha_st, sizeof (double), size_gamma_est, fptr);
-      n += fwrite (macromain[m].alpha_st_old, sizeof (double), size_gamma_est, fptr);
-      n += fwrite (macromain[m].alpha_st_e, sizeof (double), size_gamma_est, fptr);
-      n += fwrite (macromain[m].alpha_st_e_old, sizeof (double), size_gamma_est, fptr);
-      n += fwrite (macromain[m].recomb_sp, sizeof (double), size_alpha_est, fptr);
-      n += fwrite (macromain[m].recomb_sp_e, sizeof (double), size_alpha_est, fptr);
-      n += fwrite (macromain[m].matom_emiss, sizeof (double), nlevels_macro, fptr);
-      n += fwrite (macromain[m].matom_abs, sizeof (double), nlevels_macro, fptr);
+      n += fwrite (cells + m * stride + f->offset, f->size, f->nvalues, fptr);
+    }
+  }
+
+  return (n);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief      Read members of the structures of all of the cells from a windsave file
+ *
+ * @param [in] char *  base   The beginning of the file in memory
+ * @param [in] windsave_field_dummy *  fields   The members to be read
+ * @param [in] int  nfields   The number of members
+ * @param [in, out] char *  cells   The first of the structures, e.g. wmain
+ * @param [in] size_t  stride   The size of one structure
+ * @param [in] int  ncells   The number of structures
+ * @return     The number of members which were read
+ *
+ * @details
+ * A member which is not in the file is left as it was allocated.  If a
+ * member which is an array has a different number of values in the file,
+ * for example because NXBANDS has changed, the values they have in
+ * common are read.
+ *
+ * ### Notes ###
+ * The program exits if the size of a value, or the number of cells,
+ * is different, since the values could not then be interpreted.
+ *
+ **********************************************************/
 
+int
+windsave_read_fields (base, fields, nfields, cells, stride, ncells)
+     char *base;
+     windsave_field_dummy *fields;
+     int nfields;
+     char *cells;
+     size_t stride;
+     int ncells;
+{
+  int n, m;
+  long nvalues;
+  windsave_field_dummy *f;
+  windsave_section_dummy *sec;
+  char *section;
+
+  n = 0;
+  for (f = fields; f < fields + nfields; f++)
+  {
+    if ((sec = windsave_lookup_section (base, f->name)) == NULL)
+    {
+      Log_silent ("windsave_read_fields: %s is not in the windsave file\n", f->name);
+      continue;
     }
 
-  }
+    if (sec->size != (long) f->size || sec->ncells != ncells)
+    {
+      Error ("windsave_read_fields: %s has values of %ld bytes for %ld cells, not %ld bytes for %d cells\n",
+             f->name, sec->size, sec->ncells, (long) f->size, ncells);
+      exit (0);
+    }
 
-  fclose (fptr);
+    nvalues = f->nvalues;
+    if (sec->nvalues != f->nvalues)
+    {
+      Error ("windsave_read_fields: %s has %ld values in the windsave file, not %ld\n", f->name, sec->nvalues, f->nvalues);
+      if (sec->nvalues < nvalues)
+      {
+        nvalues = sec->nvalues;
+      }
+    }
 
-  Log_silent
-    ("wind_write sizes: NPLASMA %d size_Jbar_est %d size_gamma_est %d size_alpha_est %d nlevels_macro %d\n",
-     NPLASMA, size_Jbar_est, size_gamma_est, size_alpha_est, nlevels_macro);
+    section = base + sec->offset;
+    for (m = 0; m < ncells; m++)
+    {
+      memcpy (cells + m * stride + f->offset, section + m * sec->nvalues * sec->size, nvalues * f->size);
+    }
+    n++;
+  }
 
   return (n);
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief      Look up a section in the table of a windsave file which has been mapped into memory
+ *
+ * @param [in] char *  base   The beginning of the file in memory
+ * @param [in] char *  name   The name of the section
+ * @return     The entry for the section in the table, or NULL if
+ * the section is not in the file
+ *
+ * @details
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+windsave_section_dummy *
+windsave_lookup_section (base, name)
+     char *base;
+     char *name;
+{
+  int n;
+  windsave_header_dummy *header;
+  windsave_section_dummy *table;
 
+  header = (windsave_header_dummy *) base;
+  table = (windsave_section_dummy *) (base + sizeof (windsave_header_dummy));
+
+  for (n = 0; n < header->nsections; n++)
+  {
+    if (strcmp (table[n].name, name) == 0)
+    {
+      return (&table[n]);
+    }
+  }
+
+  return (NULL);
 }
 
-/*
 
-   wind_read (filename)
 
-   History
-	11dec	ksl	Updated so returns -1 if it cannot open the windsave file.  This
-			was done to enable one to handle missing files differently in
-			different cases
-	14jul	nsh	Code added to read in variable length arrays in plasma structure
-	15aug	ksl	Updated to read domain structure
-	15oct	ksl	Updated to read disk and qdisk stuctures
-*/
+/**********************************************************/
+/** 
+ * @brief      Find a section of a windsave file which has been mapped into memory
+ *
+ * @param [in] char *  base   The beginning of the file in memory
+ * @param [in] char *  name   The name of the section
+ * @param [in] long  size   The size expected for one value
+ * @param [in] long  nvalues   The number of values expected for each cell
+ * @param [in] long  ncells   The number of cells, or structures, expected
+ * @return     A pointer to the beginning of the section, or NULL if the
+ * section is not in the file
+ *
+ * @details
+ * The program exits if the size of the section is not what is expected,
+ * since either the structures have a different layout from those of
+ * the program which wrote the file, or the atomic data are different.
+ *
+ * ### Notes ###
+ *
+ **********************************************************/
+
+char *
+windsave_find_section (base, name, size, nvalues, ncells)
+     char *base;
+     char *name;
+     long size, nvalues, ncells;
+{
+  windsave_section_dummy *sec;
+
+  if ((sec = windsave_lookup_section (base, name)) == NULL)
+  {
+    return (NULL);
+  }
+
+  if (sec->size != size || sec->nvalues != nvalues || sec->ncells != ncells)
+  {
+    Error ("windsave_find_section: %s has %ld values of %ld bytes for %ld cells, not %ld values of %ld bytes for %ld cells\n",
+           name, sec->nvalues, sec->size, sec->ncells, nvalues, size, ncells);
+    Error ("windsave_find_section: The windsave file was written by a program with a different %s\n",
+           sec->size != size ? "layout of the structures" : "set of atomic data");
+    exit (0);
+  }
+
+  return (base + sec->offset);
+}
+
 
 
 /**********************************************************/
@@ -155,7 +564,7 @@ in the plasma structure */
  * @brief      Read back the windsavefile 
  *
  * @param [in] char  filename[]   The full name of the windsave file
- * @return     The number of successful reads, or -1 if the file cannot 
+ * @return     The number of sections which were read, or -1 if the file cannot 
  * be opened
  *
  * @details
@@ -164,9 +573,17 @@ in the plasma structure */
  * associated atomic data files for a model. It also reads the
  * disk and qdisk structures.
  *
+ * The file is mapped into memory, and each section is copied to the
+ * structures and arrays allocated for it.  The variable length arrays of
+ * the plasma structure are allocated as one block for all of the cells
+ * (see calloc_dyn_plasma).  A variable length array which is not in
+ * the file is left as zero.
  *
  * ### Notes ###
  *
+ * The atomic data are only read if they are not already in memory,
+ * see get_atomic_data.
+ *
  * ### Programming Comment ### 
  * This routine calls wind_complete. This looks superfluous, since 
  * wind_complete and its subsidiary routines but it
@@ -177,11 +594,196 @@ in the plasma structure */
 int
 wind_read (filename)
      char filename[];
+{
+  int fd;
+  struct stat st;
+  char *base, *section;
+  windsave_header_dummy *header;
+  windsave_array_dummy *a;
+  int n, m;
+  size_t nbytes;
+
+  if ((fd = open (filename, O_RDONLY)) < 0)
+  {
+    return (-1);
+  }
+
+  if (fstat (fd, &st) != 0 || st.st_size < (off_t) (sizeof (windsave_header_dummy) + sizeof (windsave_table)))
+  {
+    close (fd);
+    return (wind_read_version1 (filename));
+  }
+
+  base = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+
+  if (base == MAP_FAILED)
+  {
+    Error ("wind_read: Could not map %s into memory\n", filename);
+    return (-1);
+  }
+
+  header = (windsave_header_dummy *) base;
+
+  if (strncmp (header->magic, WINDSAVE_MAGIC, sizeof (header->magic)) != 0)
+  {
+    munmap (base, st.st_size);
+    return (wind_read_version1 (filename));
+  }
+
+  if (header->format != WINDSAVE_FORMAT)
+  {
+    Error ("wind_read: %s has format %d, but this version of python reads format %d\n", filename, header->format, WINDSAVE_FORMAT);
+    exit (0);
+  }
+
+  Log ("Reading Windfile %s created with python version %s with python version %s\n", filename, header->version, VERSION);
+
+  /* Now read in the geo structure */
+
+  n = 0;
+  if ((section = windsave_find_section (base, "geo", sizeof (geo), 1, 1)) == NULL)
+  {
+    Error ("wind_read: %s does not contain the geo structure\n", filename);
+    exit (0);
+  }
+  memcpy (&geo, section, sizeof (geo));
+  n++;
+
+  /* Read the atomic data file.  This is necessary to do here in order to establish the 
+   * values for the dimensionality of some of the variable length structures, associated 
+   * with macro atoms, especially but likely to be a good idea ovrall
+   */
+
+  get_atomic_data (geo.atomic_filename);
+
+  if (header->nions != nions || header->nlte_levels != nlte_levels || header->nphot_total != nphot_total
+      || header->nlevels_macro != nlevels_macro)
+  {
+    Error ("wind_read: The atomic data in %s do not match those used to write %s\n", geo.atomic_filename, filename);
+    exit (0);
+  }
+
+/* Now allocate space for the wind array */
+
+  NDIM2 = geo.ndim2;
+  NPLASMA = geo.nplasma;
+
+  zdom = (DomainPtr) calloc (sizeof (domain_dummy), MaxDom);
+  if ((section = windsave_find_section (base, "domain", sizeof (domain_dummy), 1, geo.ndomain)) != NULL)
+  {
+    memcpy (zdom, section, sizeof (domain_dummy) * geo.ndomain);
+    n++;
+  }
+
+  calloc_wind (NDIM2);
+  n += windsave_read_fields (base, wind_fields, NWIND_FIELDS, (char *) wmain, sizeof (wind_dummy), NDIM2);
+
+  /* Read the disk and qdisk structures */
+
+  if ((section = windsave_find_section (base, "disk", sizeof (disk), 1, 1)) != NULL)
+  {
+    memcpy (&disk, section, sizeof (disk));
+    n++;
+  }
+  if ((section = windsave_find_section (base, "qdisk", sizeof (disk), 1, 1)) != NULL)
+  {
+    memcpy (&qdisk, section, sizeof (disk));
+    n++;
+  }
+
+  calloc_plasma (NPLASMA);
+  n += windsave_read_fields (base, plasma_fields, NPLASMA_FIELDS, (char *) plasmamain, sizeof (plasma_dummy), NPLASMA);
+
+  /*Allocate space for the dynamically allocated plasma arrays, and for the macro-atoms */
+
+  calloc_dyn_plasma (NPLASMA);
+
+  if (geo.nmacro > 0)
+  {
+    calloc_macro (NPLASMA);
+    n += windsave_read_fields (base, macro_fields, NMACRO_FIELDS, (char *) macromain, sizeof (macro_dummy), NPLASMA);
+    calloc_estimators (NPLASMA);
+  }
+
+  /* Read in the variable length arrays */
+
+  for (a = windsave_arrays; a < windsave_arrays + NWINDSAVE_ARRAYS; a++)
+  {
+    if (a->macro && geo.nmacro == 0)
+    {
+      continue;
+    }
+
+    if ((section = windsave_find_section (base, a->name, a->size, *a->nvalues, NPLASMA)) == NULL)
+    {
+      Error ("wind_read: %s does not contain %s, which is set to zero\n", filename, a->name);
+      continue;
+    }
+
+    nbytes = a->size * *a->nvalues;
+    for (m = 0; m < NPLASMA; m++)
+    {
+      memcpy (WINDSAVE_ARRAY_PTR (a, m), section + m * nbytes, nbytes);
+    }
+    n++;
+  }
+
+  /* Force recalculation of kpkt_rates and the macro atom jumping probabilities */
+
+  if (geo.nmacro > 0)
+  {
+    for (m = 0; m < NPLASMA; m++)
+    {
+      macromain[m].kpkt_rates_known = 0;
+      macromain[m].matom_prbs_t_e = -1;
+    }
+  }
+
+  munmap (base, st.st_size);
+
+  wind_complete (wmain);
+  wind_hot_make ();
+
+  Log ("Read geometry and wind structures from windsavefile %s\n", filename);
+
+  return (n);
+
+}
+
+
+
+/**********************************************************/
+/** 
+ * @brief      Read a windsavefile written before the file contained a table of its sections
+ *
+ * @param [in] char  filename[]   The full name of the windsave file
+ * @return     The number of successful reads, or -1 if the file cannot 
+ * be opened
+ *
+ * @details
+ * 
+ * In these files, which begin with a line containing the version of python,
+ * the structures are followed by the variable length arrays of each cell
+ * in turn.  The structures must have the same layout as those of the program
+ * which wrote the file.
+ *
+ * ### Notes ###
+ *
+ * kbf_use was written as though it contained doubles; it is 
+ * recalculated before it is used, so it is not read.
+ *
+ **********************************************************/
+
+int
+wind_read_version1 (filename)
+     char filename[];
 {
   FILE *fptr, *fopen ();
   int n, m;
   char line[LINELENGTH];
   char version[LINELENGTH];
+  double *kbf_use;
 
   if ((fptr = fopen (filename, "r")) == NULL)
   {
@@ -196,12 +798,6 @@ wind_read (filename)
 
   n += fread (&geo, sizeof (geo), 1, fptr);
 
-
-  /* Read the atomic data file.  This is necessary to do here in order to establish the 
-   * values for the dimensionality of some of the variable length structures, associated 
-   * with macro atoms, especially but likely to be a good idea ovrall
-   */
-
   get_atomic_data (geo.atomic_filename);
 
 
@@ -229,6 +825,7 @@ wind_read (filename)
 
   calloc_dyn_plasma (NPLASMA);
 
+  kbf_use = calloc (sizeof (double), nphot_total + 1);
 
   /* Read in the dynamically allocated plasma arrays */
 
@@ -253,9 +850,10 @@ wind_read (filename)
     n += fread (plasmamain[m].levden, sizeof (double), nlte_levels, fptr);
     n += fread (plasmamain[m].recomb_simple, sizeof (double), nphot_total, fptr);
     n += fread (plasmamain[m].recomb_simple_upweight, sizeof (double), nphot_total, fptr);
-    n += fread (plasmamain[m].kbf_use, sizeof (double), nphot_total, fptr);
+    n += fread (kbf_use, sizeof (double), nphot_total, fptr);
   }
 
+  free (kbf_use);
 
   /*Allocate space for macro-atoms and read in the data */
 
@@ -282,9 +880,10 @@ wind_read (filename)
       n += fread (macromain[m].matom_emiss, sizeof (double), nlevels_macro, fptr);
       n += fread (macromain[m].matom_abs, sizeof (double), nlevels_macro, fptr);
 
-      /* Force recalculation of kpkt_rates */
+      /* Force recalculation of kpkt_rates and the macro atom jumping probabilities */
 
       macromain[m].kpkt_rates_known = 0;
+      macromain[m].matom_prbs_t_e = -1;
     }
 
   }
@@ -292,6 +891,7 @@ wind_read (filename)
   fclose (fptr);
 
   wind_complete (wmain);
+  wind_hot_make ();
 
   Log ("Read geometry and wind structures from windsavefile %s\n", filename);
 
@@ -567,41 +567,54 @@ sane_check (x)
 int
 error_count (char *format)
 {
-  int n;
-  n = 0;
-  while (n < nerrors)
-  {
-    if (strcmp (errorlog[n].description, (format)) == 0)
-      break;
-    n++;
-  }
+  int n, nold;
 
-  if (n == nerrors)
+  /* The error log is shared by all threads, so only one thread at a time may update it.  The
+     message that an error will no longer be logged is written outside the critical section,
+     since Error calls this routine again */
+
+  nold = -1;
+#ifdef _OPENMP
+#pragma omp critical (error_count)
+#endif
   {
-    strcpy (errorlog[nerrors].description, format);
-    errorlog[n].n = 1;
-    if (nerrors < NERROR_MAX)
+    n = 0;
+    while (n < nerrors)
     {
-      nerrors++;
+      if (strcmp (errorlog[n].description, (format)) == 0)
+        break;
+      n++;
     }
-    else
+
+    if (n == nerrors)
     {
-      printf ("Exceeded number of different errors that can be stored\n");
-      error_summary ("Quitting because there are too many differnt types of errors\n");
-      exit (0);
+      strcpy (errorlog[nerrors].description, format);
+      errorlog[n].n = 1;
+      if (nerrors < NERROR_MAX)
+      {
+        nerrors++;
+      }
+      else
+      {
+        printf ("Exceeded number of different errors that can be stored\n");
+        error_summary ("Quitting because there are too many differnt types of errors\n");
+        exit (0);
+      }
     }
-  }
-  else
-  {
-    n = errorlog[n].n++;
-    if (n == log_print_max)
-      Error ("error_count: This error will no longer be logged: %s\n", format);
-    if (n == max_errors)
+    else
     {
-      error_summary ("Something is drastically wrong for any error to occur so much!\n");
-      exit (0);
+      n = nold = errorlog[n].n++;
+      if (n == max_errors)
+      {
+        error_summary ("Something is drastically wrong for any error to occur so much!\n");
+        exit (0);
+      }
     }
   }
+
+  if (nold == log_print_max)
+    Error ("error_count: This error will no longer be logged: %s\n", format);
+
   return (n + 1);
 }
 